@@ -0,0 +1,23 @@
+#ifndef _SYS_UIO_H_
+#define _SYS_UIO_H_
+
+#include <sys/types.h>
+#include <kern/limits.h>
+
+/*
+ * Scatter/gather I/O: readv and writev move data to or from several
+ * buffers in one system call, filling or draining each in turn. At
+ * most IOV_MAX buffers may be given at once.
+ *
+ * The layout of struct iovec must match what the kernel expects.
+ */
+
+struct iovec {
+	void *iov_base;		/* Start of buffer */
+	size_t iov_len;		/* Length of buffer */
+};
+
+int readv(int filehandle, const struct iovec *iov, int iovcnt);
+int writev(int filehandle, const struct iovec *iov, int iovcnt);
+
+#endif /* _SYS_UIO_H_ */
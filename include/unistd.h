@@ -11,6 +11,8 @@
 #include <kern/unistd.h>
 #include <kern/ioctl.h>
 
+struct kstats;
+
 
 /*
  * Prototypes for OS/161 system calls.
@@ -22,6 +24,8 @@
  *     fstat:    sys/stat.h
  *     lstat:    sys/stat.h
  *     mkdir:    sys/stat.h
+ *     readv:    sys/uio.h
+ *     writev:   sys/uio.h
  *
  * If this were standard Unix, more prototypes would go in other
  * header files as well, as follows:
@@ -120,8 +124,11 @@ int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 time_t __time(time_t *seconds, unsigned long *nanoseconds);
 int __getcwd(char *buf, size_t buflen);
+int __kstats(struct kstats *ks);	/* see <kern/kstats.h> */
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
+/* readv - see sys/uio.h */
+/* writev - see sys/uio.h */
 
 /*
  * These are not themselves system calls, but wrapper routines in libc.
@@ -34,6 +34,10 @@
  * context of execution is presently stopped in the middle of doing
  * something else, which makes all kinds of things unsafe to do.)
  *
+ * While in an interrupt handler, intr_pc holds the PC the interrupt
+ * was taken at and intr_user is 1 if that was in user mode. (For the
+ * profiler; see prof.h.)
+ *
  * cpu_idle() sits around until it thinks something interesting may
  * have happened, such as an interrupt. Then it returns. It may be
  * wrong (in fact, at present, it is almost always wrong), so it
@@ -49,6 +53,8 @@
 
 extern int curspl;
 extern int in_interrupt;
+extern vaddr_t intr_pc;
+extern int intr_user;
 
 int splhigh(void);
 int spl0(void);
@@ -7,6 +7,8 @@
 #include <vm.h>
 #include <machine/spl.h>
 #include <machine/tlb.h>
+#include <kstats.h>
+#include <trace.h>
 
 /*
  * Dumb MIPS-only "VM system" that is intended to only be just barely
@@ -18,27 +20,131 @@
 /* under dumbvm, always have 48k of user stack */
 #define DUMBVM_STACKPAGES    12
 
+/*
+ * Physical memory freed by as_destroy, as runs of contiguous pages,
+ * for getppages to hand out again. Without this, every process that
+ * ran would use up its memory for good. Kernel pages (free_kpages)
+ * still aren't given back, since we don't know how many there were.
+ * If the list fills up, further memory is lost as before.
+ */
+#define DUMBVM_NFREE         64
+
+struct freerun {
+	paddr_t fr_base;
+	unsigned long fr_npages;
+};
+
+static struct freerun dumbvm_free[DUMBVM_NFREE];
+static int dumbvm_nfree;
+
 void
 vm_bootstrap(void)
 {
 	/* Do nothing. */
 }
 
+/*
+ * Take NPAGES from the smallest freed run big enough, if there is
+ * one. Called at splhigh.
+ */
+static
+paddr_t
+getfreepages(unsigned long npages)
+{
+	struct freerun *fr, *best = NULL;
+	paddr_t addr;
+	int i;
+
+	for (i=0; i<dumbvm_nfree; i++) {
+		fr = &dumbvm_free[i];
+		if (fr->fr_npages >= npages &&
+		    (best == NULL || fr->fr_npages < best->fr_npages)) {
+			best = fr;
+		}
+	}
+	if (best == NULL) {
+		return 0;
+	}
+
+	addr = best->fr_base;
+	best->fr_base += npages * PAGE_SIZE;
+	best->fr_npages -= npages;
+	if (best->fr_npages == 0) {
+		*best = dumbvm_free[--dumbvm_nfree];
+	}
+	return addr;
+}
+
 static
 paddr_t
 getppages(unsigned long npages)
 {
 	int spl;
-	paddr_t addr;
+	paddr_t addr = 0;
 
 	spl = splhigh();
 
-	addr = ram_stealmem(npages);
+	if (npages > 0) {
+		addr = getfreepages(npages);
+	}
+	if (addr == 0) {
+		addr = ram_stealmem(npages);
+	}
 	
 	splx(spl);
 	return addr;
 }
 
+/*
+ * Give back NPAGES at ADDR, joining them to the freed runs just before
+ * and just after them, if any, so the list doesn't fill up with
+ * fragments of what was once one run.
+ */
+static
+void
+freeppages(paddr_t addr, unsigned long npages)
+{
+	struct freerun *fr, *prev = NULL, *next = NULL;
+	paddr_t end;
+	int i, spl;
+
+	if (addr == 0 || npages == 0) {
+		return;
+	}
+	end = addr + npages * PAGE_SIZE;
+
+	spl = splhigh();
+
+	for (i=0; i<dumbvm_nfree; i++) {
+		fr = &dumbvm_free[i];
+		if (fr->fr_base + fr->fr_npages * PAGE_SIZE == addr) {
+			prev = fr;
+		}
+		if (fr->fr_base == end) {
+			next = fr;
+		}
+	}
+
+	if (prev != NULL && next != NULL) {
+		prev->fr_npages += npages + next->fr_npages;
+		*next = dumbvm_free[--dumbvm_nfree];
+	}
+	else if (prev != NULL) {
+		prev->fr_npages += npages;
+	}
+	else if (next != NULL) {
+		next->fr_base = addr;
+		next->fr_npages += npages;
+	}
+	else if (dumbvm_nfree < DUMBVM_NFREE) {
+		dumbvm_free[dumbvm_nfree].fr_base = addr;
+		dumbvm_free[dumbvm_nfree].fr_npages = npages;
+		dumbvm_nfree++;
+	}
+
+	splx(spl);
+}
+
 /* Allocate/free some kernel-space virtual pages */
 vaddr_t 
 alloc_kpages(int npages)
@@ -69,7 +175,10 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	struct addrspace *as;
 	int spl;
 
+	TRACE(TR_VMFAULT, faultaddress, faulttype);
+
 	spl = splhigh();
+	kstats.ks_vmfaults++;
 
 	faultaddress &= PAGE_FRAME;
 
@@ -175,6 +284,9 @@ as_create(void)
 void
 as_destroy(struct addrspace *as)
 {
+	freeppages(as->as_pbase1, as->as_npages1);
+	freeppages(as->as_pbase2, as->as_npages2);
+	freeppages(as->as_stackpbase, DUMBVM_STACKPAGES);
 	kfree(as);
 }
 
@@ -233,8 +345,12 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 	return EUNIMP;
 }
 
+/*
+ * Get memory for the regions and the stack.
+ */
+static
 int
-as_prepare_load(struct addrspace *as)
+as_getpages(struct addrspace *as)
 {
 	assert(as->as_pbase1 == 0);
 	assert(as->as_pbase2 == 0);
@@ -258,6 +374,27 @@ as_prepare_load(struct addrspace *as)
 	return 0;
 }
 
+int
+as_prepare_load(struct addrspace *as)
+{
+	int result;
+
+	result = as_getpages(as);
+	if (result) {
+		return result;
+	}
+
+	/* Memory may have been used before, by another process */
+	bzero((void *)PADDR_TO_KVADDR(as->as_pbase1),
+	      as->as_npages1*PAGE_SIZE);
+	bzero((void *)PADDR_TO_KVADDR(as->as_pbase2),
+	      as->as_npages2*PAGE_SIZE);
+	bzero((void *)PADDR_TO_KVADDR(as->as_stackpbase),
+	      DUMBVM_STACKPAGES*PAGE_SIZE);
+
+	return 0;
+}
+
 int
 as_complete_load(struct addrspace *as)
 {
@@ -289,7 +426,8 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 	new->as_vbase2 = old->as_vbase2;
 	new->as_npages2 = old->as_npages2;
 
-	if (as_prepare_load(new)) {
+	/* All of it gets copied over, so no need to zero it */
+	if (as_getpages(new)) {
 		as_destroy(new);
 		return ENOMEM;
 	}
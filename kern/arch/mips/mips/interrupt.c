@@ -7,6 +7,10 @@
 /* Global that signals if we're presently in an interrupt handler. */
 int in_interrupt;
 
+/* Where the current interrupt came from; set by mips_trap. */
+vaddr_t intr_pc;
+int intr_user;
+
 /* 
  * General interrupt handler for mips.
  * "cause" is the contents of the c0_cause register.
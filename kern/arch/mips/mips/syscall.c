@@ -4,7 +4,6 @@
 #include <machine/pcb.h>
 #include <machine/spl.h>
 #include <machine/trapframe.h>
-#include <kern/callno.h>
 #include <syscall.h>
 
 
@@ -34,21 +33,46 @@
  * return code will restart the "syscall" instruction and the system
  * call will repeat forever.
  *
- * Since none of the OS/161 system calls have more than 4 arguments,
- * there should be no need to fetch additional arguments from the
- * user-level stack.
+ * The first four argument words come from a0-a3. Any beyond that
+ * are on the user stack, above the 16 bytes the caller reserves
+ * there for a0-a3; mips_syscall_args fetches them with copyin.
  *
  * Watch out: if you make system calls that have 64-bit quantities as
  * arguments, they will get passed in pairs of registers, and not
  * necessarily in the way you expect. We recommend you don't do it.
  * (In fact, we recommend you don't use 64-bit quantities at all. See
  * arch/mips/include/types.h.)
+ *
+ * Which call takes how many words, and what to do with them, is in
+ * the table in userprog/sysdispatch.c.
+ */
+
+/*
+ * Get the NARGS argument words of a system call into ARGS.
  */
+static
+int
+mips_syscall_args(struct trapframe *tf, int nargs, u_int32_t *args)
+{
+	assert(nargs <= SYSCALL_MAXARGS);
+
+	args[0] = tf->tf_a0;
+	args[1] = tf->tf_a1;
+	args[2] = tf->tf_a2;
+	args[3] = tf->tf_a3;
+
+	if (nargs <= 4) {
+		return 0;
+	}
+	return copyin((const_userptr_t)(tf->tf_sp + 16), &args[4],
+		      (nargs - 4) * sizeof(u_int32_t));
+}
 
 void
 mips_syscall(struct trapframe *tf)
 {
-	int callno;
+	u_int32_t args[SYSCALL_MAXARGS];
+	int callno, nargs;
 	int32_t retval;
 	int err;
 
@@ -67,17 +91,16 @@ mips_syscall(struct trapframe *tf)
 
 	retval = 0;
 
-	switch (callno) {
-	    case SYS_reboot:
-		err = sys_reboot(tf->tf_a0);
-		break;
-
-	    /* Add stuff here */
- 
-	    default:
+	nargs = syscall_nargs(callno);
+	if (nargs < 0) {
 		kprintf("Unknown syscall %d\n", callno);
 		err = ENOSYS;
-		break;
+	}
+	else {
+		err = mips_syscall_args(tf, nargs, args);
+		if (!err) {
+			err = syscall_dispatch(callno, tf, args, &retval);
+		}
 	}
 
 
@@ -111,11 +134,14 @@ void
 md_forkentry(struct trapframe *tf)
 {
 	/*
-	 * This function is provided as a reminder. You need to write
-	 * both it and the code that calls it.
-	 *
-	 * Thus, you can trash it and do things another way if you prefer.
+	 * Return to user mode in the child of a fork. TF is a copy of
+	 * the parent's trapframe, on the child's own kernel stack.
+	 * The child's fork returns 0.
 	 */
 
-	(void)tf;
+	tf->tf_v0 = 0;
+	tf->tf_a3 = 0;      /* signal no error */
+	tf->tf_epc += 4;
+
+	mips_usermode(tf);
 }
@@ -5,6 +5,7 @@
 #include <machine/pcb.h>
 #include <machine/spl.h>
 #include <vm.h>
+#include <kstats.h>
 #include <thread.h>
 #include <curthread.h>
 
@@ -85,10 +86,17 @@ mips_trap(struct trapframe *tf)
 
 	/* Interrupt? Call the interrupt handler and return. */
 	if (code == EX_IRQ) {
+		intr_pc = tf->tf_epc;
+		intr_user = !iskern;
 		mips_interrupt(tf->tf_cause);
 		goto done;
 	}
 
+	/* Count TLB misses while interrupts are still off */
+	if (code == EX_TLBL || code == EX_TLBS) {
+		kstats.ks_tlbmisses++;
+	}
+
 	/*
 	 * While we're in the kernel, and not actually handling an
 	 * interrupt, leave spl where it was in the previous context,
@@ -17,6 +17,15 @@
  * and (2) if the system crashes before we find a console, no output
  * at all may appear.
  *
+ * Output with interrupts on is buffered: characters are put in a ring
+ * buffer in the con_softc, and sent from it one at a time as each
+ * write-done interrupt comes in, so the writer only waits if the ring
+ * is full. Writes from user programs are moved into the ring a chunk
+ * at a time rather than by the character. Output by polling first
+ * sends whatever is still in the ring, so things come out in order,
+ * and a panic or a shutdown message gets everything before it out
+ * too.
+ *
  * Note that we have no input buffering; characters typed too rapidly
  * will be lost.
  */
@@ -26,6 +35,7 @@
 #include <lib.h>
 #include <machine/spl.h>
 #include <synch.h>
+#include <thread.h>
 #include <generic/console.h>
 #include <dev.h>
 #include <vfs.h>
@@ -37,6 +47,11 @@
  */
 static struct con_softc *the_console = NULL;
 
+/*
+ * User writes are moved from the uio this many bytes at a time.
+ */
+#define CON_WCHUNK  64
+
 /*
  * Lock so user I/Os are atomic.
  * We use two locks so readers waiting for input don't lock out writers.
@@ -72,38 +87,100 @@ static
 void
 flush_delay_buf(void)
 {
-	size_t i;
-	for (i=0; i<delayed_outbuf_pos; i++) {
-		putch(delayed_outbuf[i]);
-	}
+	putchars(delayed_outbuf, delayed_outbuf_pos);
 	delayed_outbuf_pos = 0;
 }
 
 //////////////////////////////////////////////////
 
 /*
- * Print a character, using polling instead of interrupts to wait for
- * I/O completion.
+ * Take the next character out of the output ring. Wakes up anyone
+ * waiting for space when the ring gets down to half full, so a writer
+ * that filled it isn't woken for every character. Must be called at
+ * splhigh.
+ */
+static
+int
+con_txget(struct con_softc *cs)
+{
+	int ch;
+
+	assert(cs->cs_txhead != cs->cs_txtail);
+	ch = cs->cs_txbuf[cs->cs_txhead++ % CON_TXBUFSIZE];
+
+	if (cs->cs_txtail - cs->cs_txhead == CON_TXBUFSIZE/2) {
+		thread_wakeup(&cs->cs_txhead);
+	}
+	return ch;
+}
+
+/*
+ * Start the device on the ring if it isn't already busy with it.
+ * Must be called at splhigh.
  */
 static
 void
-putch_polled(struct con_softc *cs, int ch)
+con_txkick(struct con_softc *cs)
 {
-	cs->cs_sendpolled(cs->cs_devdata, ch);
+	if (!cs->cs_txbusy && cs->cs_txhead != cs->cs_txtail) {
+		cs->cs_txbusy = 1;
+		cs->cs_send(cs->cs_devdata, con_txget(cs));
+	}
 }
 
 //////////////////////////////////////////////////
 
 /*
- * Print a character, using interrupts to wait for I/O completion.
+ * Print characters, using polling instead of interrupts to wait for
+ * I/O completion. Anything still in the ring goes first.
+ *
+ * If the device is busy with a character from the ring, the
+ * sendpolled function waits for it and leaves the interrupt pending,
+ * so con_start will still be called for it and cs_txbusy stays set
+ * until then.
+ */
+static
+void
+putch_polled(struct con_softc *cs, const char *buf, size_t len)
+{
+	int spl;
+	size_t i;
+
+	spl = splhigh();
+	while (cs->cs_txhead != cs->cs_txtail) {
+		cs->cs_sendpolled(cs->cs_devdata, con_txget(cs));
+	}
+	for (i=0; i<len; i++) {
+		cs->cs_sendpolled(cs->cs_devdata, buf[i]);
+	}
+	splx(spl);
+}
+
+//////////////////////////////////////////////////
+
+/*
+ * Print characters, using interrupts to wait for I/O completion: put
+ * them in the ring, waiting if it's full, and make sure the device is
+ * sending.
  */
 
 static
 void
-putch_intr(struct con_softc *cs, int ch)
+putch_intr(struct con_softc *cs, const char *buf, size_t len)
 {
-	P(cs->cs_wsem);
-	cs->cs_send(cs->cs_devdata, ch);
+	int spl;
+	size_t i;
+
+	spl = splhigh();
+	for (i=0; i<len; i++) {
+		while (cs->cs_txtail - cs->cs_txhead == CON_TXBUFSIZE) {
+			con_txkick(cs);
+			thread_sleep(&cs->cs_txhead);
+		}
+		cs->cs_txbuf[cs->cs_txtail++ % CON_TXBUFSIZE] = buf[i];
+	}
+	con_txkick(cs);
+	splx(spl);
 }
 
 /*
@@ -132,13 +209,17 @@ con_input(void *vcs, int ch)
 
 /*
  * Called from underlying device when a write-done interrupt occurs.
+ * Send the next character from the ring, if there is one.
  */
 void
 con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
 
-	V(cs->cs_wsem);
+	assert(curspl>0);
+
+	cs->cs_txbusy = 0;
+	con_txkick(cs);
 }
 
 //////////////////////////////////////////////////
@@ -146,27 +227,38 @@ con_start(void *vcs)
 /*
  * Exported interface.
  * 
- * Warning: putch must work even in an interrupt handler or with
- * interrupts disabled, and before the console is probed. getch need
- * not, and does not.
+ * Warning: putch and putchars must work even in an interrupt handler
+ * or with interrupts disabled, and before the console is probed.
+ * getch need not, and does not.
  */
 
 void
-putch(int ch)
+putchars(const char *buf, size_t len)
 {
 	struct con_softc *cs = the_console;
+	size_t i;
 
 	if (cs==NULL) {
-		putch_delayed(ch);
+		for (i=0; i<len; i++) {
+			putch_delayed(buf[i]);
+		}
 	}
 	else if (in_interrupt || curspl>0) {
-		putch_polled(cs, ch);
+		putch_polled(cs, buf, len);
 	}
 	else {
-		putch_intr(cs, ch);
+		putch_intr(cs, buf, len);
 	}
 }
 
+void
+putch(int ch)
+{
+	char c = ch;
+
+	putchars(&c, 1);
+}
+
 int
 getch(void)
 {
@@ -200,12 +292,18 @@ con_close(struct device *dev)
 	return 0;
 }
 
+/*
+ * Writes are moved in CON_WCHUNK bytes at a time and put in the ring
+ * with one putchars, adding a carriage return before each newline.
+ */
 static
 int
 con_io(struct device *dev, struct uio *uio)
 {
 	int result;
 	char ch;
+	char inbuf[CON_WCHUNK], outbuf[2*CON_WCHUNK];
+	size_t len, outlen, i;
 	struct lock *lk;
 
 	(void)dev;  // unused
@@ -236,15 +334,23 @@ con_io(struct device *dev, struct uio *uio)
 			}
 		}
 		else {
-			result = uiomove(&ch, 1, uio);
+			len = uio->uio_resid;
+			if (len > sizeof(inbuf)) {
+				len = sizeof(inbuf);
+			}
+			result = uiomove(inbuf, len, uio);
 			if (result) {
 				lock_release(lk);
 				return result;
 			}
-			if (ch=='\n') {
-				putch('\r');
+			outlen = 0;
+			for (i=0; i<len; i++) {
+				if (inbuf[i]=='\n') {
+					outbuf[outlen++] = '\r';
+				}
+				outbuf[outlen++] = inbuf[i];
 			}
-			putch(ch);
+			putchars(outbuf, outlen);
 		}
 	}
 	lock_release(lk);
@@ -278,6 +384,7 @@ attach_console_to_vfs(struct con_softc *cs)
 	dev->d_close = con_close;
 	dev->d_io = con_io;
 	dev->d_ioctl = con_ioctl;
+	dev->d_submit = NULL;
 	dev->d_blocks = 0;
 	dev->d_blocksize = 1;
 	dev->d_data = cs;
@@ -300,7 +407,7 @@ attach_console_to_vfs(struct con_softc *cs)
 int
 config_con(struct con_softc *cs, int unit)
 {
-	struct semaphore *rsem, *wsem;
+	struct semaphore *rsem;
 	struct lock *rlk, *wlk;
 
 	/*
@@ -320,28 +427,23 @@ config_con(struct con_softc *cs, int unit)
 	if (rsem == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
-	if (wsem == NULL) {
-		sem_destroy(rsem);
-		return ENOMEM;
-	}
 	rlk = lock_create("console-lock-read");
 	if (rlk == NULL) {
 		sem_destroy(rsem);
-		sem_destroy(wsem);
 		return ENOMEM;
 	}
 	wlk = lock_create("console-lock-write");
 	if (wlk == NULL) {
 		lock_destroy(rlk);
 		sem_destroy(rsem);
-		sem_destroy(wsem);
 		return ENOMEM;
 	}
 
 	cs->cs_rsem = rsem; 
-	cs->cs_wsem = wsem; 
 	cs->cs_gotchar = 0;
+	cs->cs_txhead = 0;
+	cs->cs_txtail = 0;
+	cs->cs_txbusy = 0;
 
 	the_console = cs;
 	con_userlock_read = rlk;
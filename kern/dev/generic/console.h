@@ -6,8 +6,15 @@
  *
  * devdata, send, and sendpolled are provided by the underlying
  * device, and are to be initialized by the attach routine.
+ *
+ * Output goes through a ring buffer of CON_TXBUFSIZE characters: it's
+ * added at cs_txtail and sent from cs_txhead, one character each time
+ * the device says it's ready for another. The indexes run freely and
+ * are taken modulo the size, which must be a power of 2.
  */
 
+#define CON_TXBUFSIZE  1024
+
 struct con_softc {
 	/* initialized by attach routine */
 	void *cs_devdata;
@@ -16,8 +23,11 @@ struct con_softc {
 
 	/* initialized by config routine */
 	struct semaphore *cs_rsem;
-	struct semaphore *cs_wsem;
 	int cs_gotchar;
+	char cs_txbuf[CON_TXBUFSIZE];
+	unsigned cs_txhead;	/* next character to send */
+	unsigned cs_txtail;	/* where the next character goes */
+	int cs_txbusy;		/* device is sending a character for us */
 };
 
 /*
@@ -0,0 +1,342 @@
+/*
+ * I/O scheduler: request queues for disk drivers, and the policies
+ * that pick which queued request goes to the disk next. See
+ * iosched.h.
+ *
+ * Queues are short (a few requests per thread doing I/O), so a queue
+ * is just a list, and each policy looks through all of it to choose.
+ * That way the policy can be changed with requests already queued.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <machine/spl.h>
+#include <dev.h>
+#include <iosched.h>
+#include <trace.h>
+
+/* How long a request may wait under the deadline policy, in msec */
+#define IOQ_READDEADLINE   100
+#define IOQ_WRITEDEADLINE  500
+
+/*
+ * A policy. IS_PICK returns a pointer to the link in the queue that
+ * points to the request to start next. The queue is not empty.
+ */
+struct iosched {
+	const char *is_name;
+	struct devreq **(*is_pick)(struct ioqueue *);
+};
+
+static struct devreq **iosched_noop(struct ioqueue *iq);
+static struct devreq **iosched_cscan(struct ioqueue *iq);
+static struct devreq **iosched_deadline(struct ioqueue *iq);
+
+static const struct iosched iosched_policies[] = {
+	{ "noop",	iosched_noop },
+	{ "cscan",	iosched_cscan },
+	{ "deadline",	iosched_deadline },
+	{ NULL, NULL },
+};
+
+/* The policy in use: cscan, unless changed */
+static const struct iosched *iosched_cur = &iosched_policies[1];
+
+/* All the queues, for stats */
+static struct ioqueue *ioq_all;
+
+////////////////////////////////////////////////////////////
+//
+// Policies
+
+/*
+ * First come, first served.
+ */
+static
+struct devreq **
+iosched_noop(struct ioqueue *iq)
+{
+	return &iq->iq_head;
+}
+
+/*
+ * Circular scan: the lowest request at or above the head, or if there
+ * isn't one, the lowest request of all.
+ */
+static
+struct devreq **
+iosched_cscan(struct ioqueue *iq)
+{
+	struct devreq **rp, **above = NULL, **lowest = NULL;
+
+	for (rp = &iq->iq_head; *rp != NULL; rp = &(*rp)->dr_next) {
+		if ((*rp)->dr_block >= iq->iq_headpos &&
+		    (above == NULL || (*rp)->dr_block < (*above)->dr_block)) {
+			above = rp;
+		}
+		if (lowest == NULL || (*rp)->dr_block < (*lowest)->dr_block) {
+			lowest = rp;
+		}
+	}
+	return above != NULL ? above : lowest;
+}
+
+/*
+ * How long a request has been waiting, in msec.
+ */
+static
+u_int32_t
+ioq_age(struct devreq *req, time_t nowsecs, u_int32_t nownsecs)
+{
+	time_t secs;
+	u_int32_t nsecs;
+
+	getinterval(req->dr_qsecs, req->dr_qnsecs, nowsecs, nownsecs,
+		    &secs, &nsecs);
+	return secs*1000 + nsecs/1000000;
+}
+
+/*
+ * Circular scan, unless the oldest request is past its deadline.
+ */
+static
+struct devreq **
+iosched_deadline(struct ioqueue *iq)
+{
+	struct devreq **rp, **oldest = NULL;
+	u_int32_t age, oldestage = 0, deadline;
+	time_t secs;
+	u_int32_t nsecs;
+
+	gettime(&secs, &nsecs);
+
+	for (rp = &iq->iq_head; *rp != NULL; rp = &(*rp)->dr_next) {
+		deadline = (*rp)->dr_write ?
+			IOQ_WRITEDEADLINE : IOQ_READDEADLINE;
+		age = ioq_age(*rp, secs, nsecs);
+		if (age > deadline && (oldest == NULL || age > oldestage)) {
+			oldest = rp;
+			oldestage = age;
+		}
+	}
+	return oldest != NULL ? oldest : iosched_cscan(iq);
+}
+
+/*
+ * Change the policy.
+ */
+int
+iosched_select(const char *name)
+{
+	int i;
+
+	for (i=0; iosched_policies[i].is_name != NULL; i++) {
+		if (!strcmp(iosched_policies[i].is_name, name)) {
+			iosched_cur = &iosched_policies[i];
+			return 0;
+		}
+	}
+	return EINVAL;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Queues
+
+void
+ioq_init(struct ioqueue *iq, const char *name)
+{
+	int spl;
+
+	bzero(iq, sizeof(*iq));
+	iq->iq_name = name;
+
+	spl = splhigh();
+	iq->iq_next = ioq_all;
+	ioq_all = iq;
+	splx(spl);
+}
+
+/*
+ * Queue a request. If it picks up where a queued request in the same
+ * direction leaves off, or ends where one begins, put it next to that
+ * one; otherwise put it on the end.
+ */
+void
+ioq_add(struct ioqueue *iq, struct devreq *req)
+{
+	struct devreq **rp, **where = NULL;
+
+	assert(curspl > 0);
+
+	TRACE(TR_DISKQ, req->dr_block,
+	      req->dr_nblocks | (req->dr_write ? TR_DISKWRITE : 0));
+
+	req->dr_merged = 0;
+	gettime(&req->dr_qsecs, &req->dr_qnsecs);
+
+	for (rp = &iq->iq_head; *rp != NULL; rp = &(*rp)->dr_next) {
+		if (where != NULL || (*rp)->dr_write != req->dr_write) {
+			continue;
+		}
+		if ((*rp)->dr_block + (*rp)->dr_nblocks == req->dr_block) {
+			/* Goes right after this one */
+			where = &(*rp)->dr_next;
+			(*rp)->dr_merged = req->dr_merged = 1;
+		}
+		else if (req->dr_block + req->dr_nblocks == (*rp)->dr_block) {
+			/* Goes right before this one */
+			where = rp;
+			(*rp)->dr_merged = req->dr_merged = 1;
+		}
+	}
+	if (where == NULL) {
+		where = rp;
+	}
+
+	req->dr_next = *where;
+	*where = req;
+
+	iq->iq_len++;
+	if (iq->iq_len > iq->iq_maxlen) {
+		iq->iq_maxlen = iq->iq_len;
+	}
+}
+
+/*
+ * Take the next request to start off the queue.
+ */
+struct devreq *
+ioq_next(struct ioqueue *iq)
+{
+	struct devreq **rp, *req;
+
+	assert(curspl > 0);
+
+	if (iq->iq_head == NULL) {
+		return NULL;
+	}
+
+	rp = iosched_cur->is_pick(iq);
+	req = *rp;
+	*rp = req->dr_next;
+	req->dr_next = NULL;
+	iq->iq_len--;
+
+	if (req->dr_block != iq->iq_headpos) {
+		iq->iq_seeks++;
+		if (req->dr_block > iq->iq_headpos) {
+			iq->iq_seekdist += req->dr_block - iq->iq_headpos;
+		}
+		else {
+			iq->iq_seekdist += iq->iq_headpos - req->dr_block;
+		}
+	}
+	iq->iq_headpos = req->dr_block + req->dr_nblocks;
+
+	TRACE(TR_DISKSTART, req->dr_block,
+	      req->dr_nblocks | (req->dr_write ? TR_DISKWRITE : 0));
+	return req;
+}
+
+/*
+ * Record a finished request's latency.
+ */
+void
+ioq_done(struct ioqueue *iq, struct devreq *req)
+{
+	time_t secs;
+	u_int32_t nsecs, usecs;
+	int bucket;
+
+	assert(curspl > 0);
+
+	gettime(&secs, &nsecs);
+	getinterval(req->dr_qsecs, req->dr_qnsecs, secs, nsecs,
+		    &secs, &nsecs);
+	usecs = secs*1000000 + nsecs/1000;
+	TRACE(TR_DISKDONE, req->dr_block, usecs);
+
+	for (bucket = 0; bucket < IOQ_NLATBUCKETS-1 && (usecs >> (bucket+1));
+	     bucket++) {
+		/* nothing */
+	}
+	iq->iq_lathist[bucket]++;
+	if (usecs > iq->iq_maxlat) {
+		iq->iq_maxlat = usecs;
+	}
+
+	iq->iq_nreqs++;
+	if (req->dr_merged) {
+		iq->iq_nmerged++;
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Stats
+
+/*
+ * Upper bound, in usec, of the latency PCT percent of requests were
+ * under.
+ */
+static
+u_int32_t
+ioq_percentile(struct ioqueue *iq, u_int32_t pct)
+{
+	u_int32_t want, seen = 0;
+	int i;
+
+	want = (iq->iq_nreqs * pct + 99) / 100;
+	for (i=0; i<IOQ_NLATBUCKETS-1; i++) {
+		seen += iq->iq_lathist[i];
+		if (seen >= want) {
+			break;
+		}
+	}
+	return (i < IOQ_NLATBUCKETS-1) ? (2U << i) : iq->iq_maxlat;
+}
+
+void
+iosched_printstats(void)
+{
+	struct ioqueue *iq;
+
+	kprintf("iosched: policy %s\n", iosched_cur->is_name);
+	for (iq = ioq_all; iq != NULL; iq = iq->iq_next) {
+		if (iq->iq_nreqs == 0) {
+			continue;
+		}
+		kprintf("%s: %u requests, %u merged, queue length up to %u\n",
+			iq->iq_name, iq->iq_nreqs, iq->iq_nmerged,
+			iq->iq_maxlen);
+		kprintf("%s: %u seeks, %u blocks in all, %u blocks/request\n",
+			iq->iq_name, iq->iq_seeks, iq->iq_seekdist,
+			iq->iq_seekdist / iq->iq_nreqs);
+		kprintf("%s: latency usec: 50%% < %u, 90%% < %u, "
+			"99%% < %u, max %u\n", iq->iq_name,
+			ioq_percentile(iq, 50), ioq_percentile(iq, 90),
+			ioq_percentile(iq, 99), iq->iq_maxlat);
+	}
+}
+
+void
+iosched_resetstats(void)
+{
+	struct ioqueue *iq;
+	int spl;
+
+	spl = splhigh();
+	for (iq = ioq_all; iq != NULL; iq = iq->iq_next) {
+		iq->iq_nreqs = 0;
+		iq->iq_nmerged = 0;
+		iq->iq_maxlen = iq->iq_len;
+		iq->iq_seeks = 0;
+		iq->iq_seekdist = 0;
+		iq->iq_maxlat = 0;
+		bzero(iq->iq_lathist, sizeof(iq->iq_lathist));
+	}
+	splx(spl);
+}
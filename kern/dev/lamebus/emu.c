@@ -20,6 +20,8 @@
 #include <array.h>
 #include <uio.h>
 #include <vfs.h>
+#include <dev.h>
+#include <vm.h>
 #include <emufs.h>
 #include <lamebus/emu.h>
 #include <machine/bus.h>
@@ -61,6 +63,10 @@
 #define EMU_RES_UNKNOWN      12
 #define EMU_RES_UNSUPP       13
 
+/* Statistics */
+static u_int32_t emu_nops;              /* round trips to the hardware */
+static u_int32_t emu_nsizehits;         /* file sizes we already knew */
+
 ////////////////////////////////////////////////////////////
 //
 // Hardware ops
@@ -138,6 +144,7 @@ int
 emu_waitdone(struct emu_softc *sc)
 {
 	P(sc->e_sem);
+	emu_nops++;
 	return translate_err(sc, sc->e_result);
 }
 
@@ -227,46 +234,29 @@ emu_close(struct emu_softc *sc, u_int32_t handle)
 }
 
 /*
- * Common code for read and readdir.
+ * Read up to LEN bytes at OFFSET into the I/O buffer, and hand back
+ * how many there were. The caller must hold e_lock.
  */
 static
 int
-emu_doread(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
-	   u_int32_t op, struct uio *uio)
+emu_rawread(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
+	    u_int32_t op, off_t offset, u_int32_t *got)
 {
 	int result;
 
-	assert(uio->uio_rw == UIO_READ);
-
-	lock_acquire(sc->e_lock);
+	assert(lock_do_i_hold(sc->e_lock));
 
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_IOLEN, len);
-	emu_wreg(sc, REG_OFFSET, uio->uio_offset);
+	emu_wreg(sc, REG_OFFSET, offset);
 	emu_wreg(sc, REG_OPER, op);
 	result = emu_waitdone(sc);
 	if (result) {
-		goto out;
+		return result;
 	}
-	
-	result = uiomove(sc->e_iobuf, emu_rreg(sc, REG_IOLEN), uio);
-
-	uio->uio_offset = emu_rreg(sc, REG_OFFSET);
 
- out:
-	lock_release(sc->e_lock);
-	return result;
-}
-
-/*
- * Read from a hardware-level file handle.
- */
-static
-int
-emu_read(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
-	 struct uio *uio)
-{
-	return emu_doread(sc, handle, len, EMU_OP_READ, uio);
+	*got = emu_rreg(sc, REG_IOLEN);
+	return 0;
 }
 
 /*
@@ -277,7 +267,27 @@ int
 emu_readdir(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
 	    struct uio *uio)
 {
-	return emu_doread(sc, handle, len, EMU_OP_READDIR, uio);
+	u_int32_t got;
+	int result;
+
+	assert(uio->uio_rw == UIO_READ);
+
+	lock_acquire(sc->e_lock);
+
+	result = emu_rawread(sc, handle, len, EMU_OP_READDIR, uio->uio_offset,
+			     &got);
+	if (result) {
+		goto out;
+	}
+	
+	result = uiomove(sc->e_iobuf, got, uio);
+
+	/* The offset is a cookie from the hardware */
+	uio->uio_offset = emu_rreg(sc, REG_OFFSET);
+
+ out:
+	lock_release(sc->e_lock);
+	return result;
 }
 
 /*
@@ -313,6 +323,7 @@ emu_write(struct emu_softc *sc, u_int32_t handle, u_int32_t len,
 
 /*
  * Get the file size associated with a hardware-level file handle.
+ * The caller must hold e_lock.
  */
 static
 int
@@ -320,7 +331,7 @@ emu_getsize(struct emu_softc *sc, u_int32_t handle, off_t *retval)
 {
 	int result;
 
-	lock_acquire(sc->e_lock);
+	assert(lock_do_i_hold(sc->e_lock));
 
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_OPER, EMU_OP_GETSIZE);
@@ -329,7 +340,6 @@ emu_getsize(struct emu_softc *sc, u_int32_t handle, off_t *retval)
 		*retval = emu_rreg(sc, REG_IOLEN);
 	}
 
-	lock_release(sc->e_lock);
 	return result;
 }
 
@@ -366,6 +376,26 @@ emu_trunc(struct emu_softc *sc, u_int32_t handle, off_t len)
 static int emufs_loadvnode(struct emufs_fs *ef, u_int32_t handle, int isdir,
 			   struct emufs_vnode **ret);
 
+/*
+ * Forget the cached pages and size of a file, after a write or
+ * truncate.
+ *
+ * The caches assume nobody changes the files underneath us: not
+ * someone on the host, and not another handle the hardware gave out
+ * for the same host file, which gets a vnode of its own. Either one
+ * can leave stale pages here until they're evicted.
+ */
+static
+void
+emufs_invalidate(struct emufs_vnode *ev)
+{
+	vfs_pcache_invalidate(&ev->ev_v);
+
+	lock_acquire(ev->ev_emu->e_lock);
+	ev->ev_sizevalid = 0;
+	lock_release(ev->ev_emu->e_lock);
+}
+
 /*
  * VOP_OPEN on files
  */
@@ -476,6 +506,7 @@ emufs_reclaim(struct vnode *v)
 
 	lock_release(ef->ef_emu->e_lock);
 
+	vfs_pcache_invalidate(&ev->ev_v);
 	VOP_KILL(&ev->ev_v);
 
 	kfree(ev);
@@ -483,39 +514,64 @@ emufs_reclaim(struct vnode *v)
 }
 
 /*
- * VOP_READ
+ * Read one page of a file for the page cache. The trip to the
+ * hardware costs about the same however much it moves, so read
+ * EMU_MAXIO bytes and offer the pages after the one asked for to the
+ * cache too; reading a file straight through then takes as few trips
+ * as it would without the cache.
  */
 static
 int
-emufs_read(struct vnode *v, struct uio *uio)
+emufs_fillpage(struct vnode *v, void *page, off_t offset, u_int32_t *len)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	u_int32_t amt;
-	size_t oldresid;
+	struct emu_softc *sc = ev->ev_emu;
+	u_int32_t got, pos, more;
 	int result;
 
-	assert(uio->uio_rw==UIO_READ);
-
-	while (uio->uio_resid > 0) {
-		amt = uio->uio_resid;
-		if (amt > EMU_MAXIO) {
-			amt = EMU_MAXIO;
-		}
+	lock_acquire(sc->e_lock);
+	result = emu_rawread(sc, ev->ev_handle, EMU_MAXIO, EMU_OP_READ,
+			     offset, &got);
+	if (result) {
+		lock_release(sc->e_lock);
+		return result;
+	}
 
-		oldresid = uio->uio_resid;
+	*len = got < PAGE_SIZE ? got : PAGE_SIZE;
+	memcpy(page, sc->e_iobuf, *len);
+	dev_countcopy(*len);
 
-		result = emu_read(ev->ev_emu, ev->ev_handle, amt, uio);
-		if (result) {
-			return result;
-		}
-		
-		if (uio->uio_resid == oldresid) {
-			/* nothing read - EOF */
-			break;
-		}
+	/* A short read means EOF, so the page where it ended goes in too */
+	for (pos = PAGE_SIZE; pos < EMU_MAXIO && pos <= got; pos += PAGE_SIZE) {
+		more = got - pos < PAGE_SIZE ? got - pos : PAGE_SIZE;
+		vfs_pcache_insert(v, (offset + pos) / PAGE_SIZE,
+				  (char *)sc->e_iobuf + pos, more);
 	}
+	lock_release(sc->e_lock);
 
-	return 0;
+	return result;
+}
+
+/*
+ * VOP_READ
+ *
+ * Every trip to the hardware is expensive, so reads go through the
+ * page cache: each page of a file is fetched once, EMU_MAXIO bytes a
+ * trip, and then served from memory to everyone who reads it (like
+ * every process that runs the same program).
+ */
+static
+int
+emufs_read(struct vnode *v, struct uio *uio)
+{
+	size_t oldresid = uio->uio_resid;
+	int result;
+
+	assert(uio->uio_rw==UIO_READ);
+
+	result = vfs_pcache_read(v, uio, emufs_fillpage);
+	dev_countdelivered(oldresid - uio->uio_resid);
+	return result;
 }
 
 /*
@@ -562,6 +618,7 @@ emufs_write(struct vnode *v, struct uio *uio)
 
 		result = emu_write(ev->ev_emu, ev->ev_handle, amt, uio);
 		if (result) {
+			emufs_invalidate(ev);
 			return result;
 		}
 
@@ -571,6 +628,7 @@ emufs_write(struct vnode *v, struct uio *uio)
 		}
 	}
 
+	emufs_invalidate(ev);
 	return 0;
 }
 
@@ -611,10 +669,21 @@ emufs_stat(struct vnode *v, struct stat *statbuf)
 
 	statbuf->st_nlink = 1;  /* might be a lie, but doesn't matter much */
 
-	result = emu_getsize(ev->ev_emu, ev->ev_handle, &statbuf->st_size);
-	if (result) {
-		return result;
+	/* Ask the hardware for the size only if we don't already know */
+	lock_acquire(ev->ev_emu->e_lock);
+	if (ev->ev_sizevalid) {
+		emu_nsizehits++;
+	}
+	else {
+		result = emu_getsize(ev->ev_emu, ev->ev_handle, &ev->ev_size);
+		if (result) {
+			lock_release(ev->ev_emu->e_lock);
+			return result;
+		}
+		ev->ev_sizevalid = 1;
 	}
+	statbuf->st_size = ev->ev_size;
+	lock_release(ev->ev_emu->e_lock);
 
 	statbuf->st_blocks = 0;  /* almost certainly a lie */
 
@@ -681,7 +750,11 @@ int
 emufs_truncate(struct vnode *v, off_t len)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	return emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	int result;
+
+	result = emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	emufs_invalidate(ev);
+	return result;
 }
 
 /*
@@ -941,6 +1014,8 @@ emufs_loadvnode(struct emufs_fs *ef, u_int32_t handle, int isdir,
 
 	ev->ev_emu = ef->ef_emu;
 	ev->ev_handle = handle;
+	ev->ev_size = 0;
+	ev->ev_sizevalid = 0;
 
 	result = VOP_INIT(&ev->ev_v, isdir ? &emufs_dirops : &emufs_fileops,
 			   &ef->ef_fs, ev);
@@ -1077,6 +1152,16 @@ emufs_addtovfs(struct emu_softc *sc, const char *devname)
 	return result;
 }
 
+/*
+ * Print statistics for all emu devices.
+ */
+void
+emufs_printstats(void)
+{
+	kprintf("emufs: %u hardware operations, %u file sizes already "
+		"known\n", emu_nops, emu_nsizehits);
+}
+
 //
 ////////////////////////////////////////////////////////////
 
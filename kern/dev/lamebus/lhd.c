@@ -4,9 +4,10 @@
 
 #include <types.h>
 #include <lib.h>
-#include <synch.h>
 #include <kern/errno.h>
 #include <machine/bus.h>
+#include <machine/spl.h>
+#include <thread.h>
 #include <uio.h>
 #include <vfs.h>
 #include <lamebus/lhd.h>
@@ -66,15 +67,110 @@ int lhd_code_to_errno(struct lhd_softc *lh, int code)
 }
 
 /*
- * Record that an I/O has completed: save the result and poke the
- * completion semaphore.
+ * Requests with no buffer (dr_buf NULL) are lhd_io moving data
+ * between the on-card buffer and a user buffer itself. The driver
+ * doesn't copy anything for them, and instead of running them from
+ * start to finish it calls dr_done when the request gets the disk and
+ * again after each sector; lhd_io starts each sector and gives the
+ * disk back when it's finished.
+ */
+
+/*
+ * Start the sector transfer that comes next in the active request.
+ * Called at splhigh.
+ */
+static
+void
+lhd_startsector(struct lhd_softc *lh)
+{
+	struct devreq *req = lh->lh_active;
+	u_int32_t statval = LHD_WORKING;
+
+	if (req->dr_write) {
+		if (req->dr_buf != NULL) {
+			memcpy(lh->lh_buf,
+			       (char *)req->dr_buf + req->dr_xfer*LHD_SECTSIZE,
+			       LHD_SECTSIZE);
+			dev_countcopy(LHD_SECTSIZE);
+		}
+		statval |= LHD_ISWRITE;
+	}
+
+	/* Tell it what sector we want and start the operation. */
+	lhd_wreg(lh, LHD_REG_SECT, req->dr_block + req->dr_xfer);
+	lhd_wreg(lh, LHD_REG_STAT, statval);
+}
+
+/*
+ * If the disk is idle, have the I/O scheduler pick the next request
+ * and start it. Called at splhigh.
+ */
+static
+void
+lhd_start(struct lhd_softc *lh)
+{
+	if (lh->lh_active != NULL) {
+		return;
+	}
+
+	lh->lh_active = ioq_next(&lh->lh_ioq);
+	if (lh->lh_active == NULL) {
+		return;
+	}
+	if (lh->lh_active->dr_buf == NULL) {
+		/* The disk is lhd_io's now */
+		lh->lh_active->dr_done(lh->lh_active);
+		return;
+	}
+	lhd_startsector(lh);
+}
+
+/*
+ * Record that a sector transfer has completed. Copy the data out if
+ * it was a read; then either go on to the next sector of the request,
+ * or finish the request, call its completion function, and start the
+ * next one. Called from the interrupt handler.
  */
 static
 void
 lhd_iodone(struct lhd_softc *lh, int err)
 {
-	lh->lh_result = err;
-	V(lh->lh_done);
+	struct devreq *req = lh->lh_active;
+
+	if (req == NULL) {
+		kprintf("lhd%d: Spurious completion\n", lh->lh_unit);
+		return;
+	}
+
+	if (req->dr_buf == NULL) {
+		/* lhd_io is doing this one; just tell it */
+		req->dr_result = err;
+		if (err == 0) {
+			req->dr_xfer++;
+		}
+		req->dr_done(req);
+		return;
+	}
+
+	if (err == 0) {
+		if (!req->dr_write) {
+			memcpy((char *)req->dr_buf + req->dr_xfer*LHD_SECTSIZE,
+			       lh->lh_buf, LHD_SECTSIZE);
+			dev_countcopy(LHD_SECTSIZE);
+		}
+		req->dr_xfer++;
+		if (req->dr_xfer < req->dr_nblocks) {
+			lhd_startsector(lh);
+			return;
+		}
+	}
+
+	lh->lh_active = NULL;
+	req->dr_result = err;
+	ioq_done(&lh->lh_ioq, req);
+	req->dr_done(req);
+
+	lhd_start(lh);
 }
 
 /*
@@ -87,7 +183,7 @@ lhd_irq(void *vlh)
 {
 	struct lhd_softc *lh = vlh;
 	u_int32_t val;
-	
+
 	val = lhd_rdreg(lh, LHD_REG_STAT);
 
 	switch (val & LHD_STATEMASK) {
@@ -164,8 +260,133 @@ lhd_reset(struct lhd_softc *lh)
 }
 #endif
 
+/*
+ * Queue an asynchronous request (see dev.h). The I/O scheduler
+ * decides when it goes to the disk.
+ */
+static
+int
+lhd_submit(struct device *d, struct devreq *req)
+{
+	struct lhd_softc *lh = d->d_data;
+	int spl;
+
+	/* Don't allow I/O past the end of the disk. */
+	if (req->dr_buf == NULL || req->dr_nblocks == 0 ||
+	    req->dr_block + req->dr_nblocks > lh->lh_dev.d_blocks ||
+	    req->dr_block + req->dr_nblocks < req->dr_block) {
+		return EINVAL;
+	}
+
+	req->dr_xfer = 0;
+	req->dr_result = 0;
+
+	spl = splhigh();
+	ioq_add(&lh->lh_ioq, req);
+	lhd_start(lh);
+	splx(spl);
+
+	return 0;
+}
+
+/*
+ * Completion function for lhd_directio's request: count the event
+ * and wake up lhd_directio.
+ */
+static
+void
+lhd_directdone(struct devreq *req)
+{
+	int *events = req->dr_data;
+
+	(*events)++;
+	thread_wakeup(req);
+}
+
+/*
+ * Transfer LEN sectors starting at SECTOR directly between the
+ * on-card buffer and the (user) buffer in UIO. This can't be left to
+ * the interrupt handler, as copying to or from user memory can
+ * fault, so we get the disk to ourselves through the I/O scheduler
+ * and then run the sectors from here, one by one.
+ */
+static
+int
+lhd_directio(struct lhd_softc *lh, struct uio *uio,
+	     u_int32_t sector, u_int32_t len)
+{
+	struct devreq req;
+	int events = 0, target;
+	int spl, result = 0;
+
+	req.dr_block = sector;
+	req.dr_nblocks = len;
+	req.dr_buf = NULL;
+	req.dr_write = (uio->uio_rw == UIO_WRITE);
+	req.dr_done = lhd_directdone;
+	req.dr_data = &events;
+	req.dr_xfer = 0;
+	req.dr_result = 0;
+
+	spl = splhigh();
+
+	/* Wait for our turn */
+	ioq_add(&lh->lh_ioq, &req);
+	lhd_start(lh);
+	while (events < 1) {
+		thread_sleep(&req);
+	}
+	assert(lh->lh_active == &req);
+
+	while (req.dr_xfer < len) {
+		if (req.dr_write) {
+			splx(spl);
+			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
+			spl = splhigh();
+			if (result) {
+				break;
+			}
+			dev_countcopy(LHD_SECTSIZE);
+		}
+
+		target = events + 1;
+		lhd_startsector(lh);
+		while (events < target) {
+			thread_sleep(&req);
+		}
+		result = req.dr_result;
+		if (result) {
+			break;
+		}
+
+		if (!req.dr_write) {
+			splx(spl);
+			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
+			spl = splhigh();
+			if (result) {
+				break;
+			}
+			dev_countcopy(LHD_SECTSIZE);
+		}
+	}
+
+	/* Give the disk back */
+	lh->lh_active = NULL;
+	req.dr_result = result;
+	ioq_done(&lh->lh_ioq, &req);
+	lhd_start(lh);
+
+	splx(spl);
+	return result;
+}
+
 /*
  * I/O function (for both reads and writes)
+ *
+ * The whole transfer goes to the disk as one request. Data moves
+ * straight between the on-card buffer and the caller's buffer: from
+ * the interrupt handler for kernel buffers (such as the buffer cache),
+ * or from lhd_directio for user buffers.
  */
 static
 int
@@ -177,8 +398,7 @@ lhd_io(struct device *d, struct uio *uio)
 	u_int32_t sectoff = uio->uio_offset % LHD_SECTSIZE;
 	u_int32_t len = uio->uio_resid / LHD_SECTSIZE;
 	u_int32_t lenoff = uio->uio_resid % LHD_SECTSIZE;
-	u_int32_t i;
-	u_int32_t statval = LHD_WORKING;
+	struct devreq req;
 	int result;
 
 	/* Don't allow I/O that isn't sector-aligned. */
@@ -191,58 +411,31 @@ lhd_io(struct device *d, struct uio *uio)
 		return EINVAL;
 	}
 
-	/* Set up the value to write into the status register. */
-	if (uio->uio_rw==UIO_WRITE) {
-		statval |= LHD_ISWRITE;
+	if (len == 0) {
+		return 0;
 	}
 
-	/* Loop over all the sectors we were asked to do. */
-	for (i=0; i<len; i++) {
-
-		/* Wait until nobody else is using the device. */
-		P(lh->lh_clear);
-
-		/*
-		 * Are we writing? If so, transfer the data to the
-		 * on-card buffer.
-		 */
-		if (uio->uio_rw == UIO_WRITE) {
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
-			if (result) {
-				V(lh->lh_clear);
-				return result;
-			}
-		}
-
-		/* Tell it what sector we want... */
-		lhd_wreg(lh, LHD_REG_SECT, sector+i);
-
-		/* and start the operation. */
-		lhd_wreg(lh, LHD_REG_STAT, statval);
-
-		/* Now wait until the interrupt handler tells us we're done. */
-		P(lh->lh_done);
-
-		/* Get the result value saved by the interrupt handler. */
-		result = lh->lh_result;
-
-		/*
-		 * Are we reading? If so, and if we succeeded,
-		 * transfer the data out of the on-card buffer.
-		 */
-		if (result==0 && uio->uio_rw==UIO_READ) {
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
-		}
-
-		/* Tell another thread it's cleared to go ahead. */
-		V(lh->lh_clear);
+	/* One request straight into the buffer, if it's all in one block */
+	if (uio->uio_segflg != UIO_SYSSPACE ||
+	    uio->uio_iovec.iov_len < len*LHD_SECTSIZE) {
+		return lhd_directio(lh, uio, sector, len);
+	}
 
-		/* If we failed, return the error. */
-		if (result) {
-			return result;
-		}
+	req.dr_block = sector;
+	req.dr_nblocks = len;
+	req.dr_buf = uio->uio_iovec.iov_kbase;
+	req.dr_write = (uio->uio_rw == UIO_WRITE);
+	result = dev_doio(d, &req);
+	if (result) {
+		return result;
 	}
 
+	/* Advance the uio, as uiomove would have */
+	uio->uio_iovec.iov_kbase =
+		(char *)uio->uio_iovec.iov_kbase + len*LHD_SECTSIZE;
+	uio->uio_iovec.iov_len -= len*LHD_SECTSIZE;
+	uio->uio_offset += len*LHD_SECTSIZE;
+	uio->uio_resid -= len*LHD_SECTSIZE;
 	return 0;
 }
 
@@ -260,23 +453,17 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 	/* Get a pointer to the on-chip buffer. */
 	lh->lh_buf = bus_map_area(lh->lh_busdata, lh->lh_buspos, LHD_BUFFER);
 
-	/* Create the semaphores. */
-	lh->lh_clear = sem_create("lhd-clear", 1);
-	if (lh->lh_clear == NULL) {
-		return ENOMEM;
-	}
-	lh->lh_done = sem_create("lhd-done", 0);
-	if (lh->lh_done == NULL) {
-		sem_destroy(lh->lh_clear);
-		lh->lh_clear = NULL;
-		return ENOMEM;
-	}
+	/* Nothing queued yet. */
+	snprintf(lh->lh_name, sizeof(lh->lh_name), "lhd%d", lhdno);
+	ioq_init(&lh->lh_ioq, lh->lh_name);
+	lh->lh_active = NULL;
 
 	/* Set up the VFS device structure. */
 	lh->lh_dev.d_open = lhd_open;
 	lh->lh_dev.d_close = lhd_close;
 	lh->lh_dev.d_io = lhd_io;
 	lh->lh_dev.d_ioctl = lhd_ioctl;
+	lh->lh_dev.d_submit = lhd_submit;
 	lh->lh_dev.d_blocks = bus_read_register(lh->lh_busdata, lh->lh_buspos,
 						LHD_REG_NSECT);
 	lh->lh_dev.d_blocksize = LHD_SECTSIZE;
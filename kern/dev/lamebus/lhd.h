@@ -2,6 +2,7 @@
 #define _LAMEBUS_LHD_H_
 
 #include <dev.h>
+#include <iosched.h>
 
 /*
  * Our sector size
@@ -22,9 +23,9 @@ struct lhd_softc {
 	 */
 
 	void *lh_buf;			/* Pointer to on-card I/O buffer */
-	int lh_result;			/* Result from I/O operation */
-	struct semaphore *lh_clear;	/* Synchronization */
-	struct semaphore *lh_done;
+	char lh_name[16];		/* "lhdN", for stats */
+	struct ioqueue lh_ioq;		/* Requests waiting to start */
+	struct devreq *lh_active;	/* Request the disk is working on */
 
 	struct device lh_dev;		/* VFS device structure */
 };
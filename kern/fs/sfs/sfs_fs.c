@@ -7,8 +7,10 @@
 #include <types.h>
 #include <lib.h>
 #include <kern/errno.h>
-#include <array.h>
 #include <bitmap.h>
+#include <synch.h>
+#include <thread.h>
+#include <clock.h>
 #include <uio.h>
 #include <dev.h>
 #include <sfs.h>
@@ -56,12 +58,16 @@ sfs_mapio(struct sfs_fs *sfs, enum uio_rw rw)
 		/* Get a pointer to its data */
 		void *ptr = bitdata + j*SFS_BLOCKSIZE;
 
-		/* and read or write it. The bitmap starts at sector 2. */ 
+		/*
+		 * and read or write it. The bitmap starts at sector 2.
+		 * Writes are metadata, and go through the journal if
+		 * there is one.
+		 */
 		if (rw == UIO_READ) {
 			result = sfs_rblock(sfs, ptr, SFS_MAP_LOCATION+j);
 		}
 		else {
-			result = sfs_wblock(sfs, ptr, SFS_MAP_LOCATION+j);
+			result = sfs_wmeta(sfs, ptr, SFS_MAP_LOCATION+j);
 		}
 
 		/* If we failed, stop. */
@@ -72,6 +78,120 @@ sfs_mapio(struct sfs_fs *sfs, enum uio_rw rw)
 	return 0;
 }
 
+/*
+ * Write back the free block map and superblock, if they're dirty.
+ * Clear the dirty flags first so allocations made during the write
+ * aren't forgotten.
+ */
+int
+sfs_syncmap(struct sfs_fs *sfs)
+{
+	int result;
+
+	if (sfs->sfs_freemapdirty) {
+		sfs->sfs_freemapdirty = 0;
+		result = sfs_mapio(sfs, UIO_WRITE);
+		if (result) {
+			sfs->sfs_freemapdirty = 1;
+			return result;
+		}
+	}
+
+	if (sfs->sfs_superdirty) {
+		sfs->sfs_superdirty = 0;
+		result = sfs_wmeta(sfs, &sfs->sfs_super, SFS_SB_LOCATION);
+		if (result) {
+			sfs->sfs_superdirty = 1;
+			return result;
+		}
+	}
+
+	sfs->sfs_freemapdirtysince = 0;
+	return 0;
+}
+
+/*
+ * Write back everything that has been dirty for at least MINAGE
+ * seconds: file and directory blocks, then inodes, then the free
+ * block map and superblock. With MINAGE 0, write back everything.
+ *
+ * Like inodes, the freemap and superblock are aged from when a
+ * writeback pass first noticed them dirty.
+ *
+ * With a journal, age doesn't matter: everything is committed every
+ * time, as one transaction.
+ */
+static
+int
+sfs_writeback(struct sfs_fs *sfs, int minage)
+{
+	time_t now;
+	u_int32_t nsecs;
+	int result, err = 0;
+
+	if (sfs->sfs_jblocks > 0) {
+		return sfs_jsync(sfs);
+	}
+
+	result = sfs_bflush(sfs, SFS_NOINO, minage);
+	if (result) {
+		err = result;
+	}
+
+	result = sfs_syncvnodes(sfs, minage);
+	if (result && err == 0) {
+		err = result;
+	}
+
+	if (!sfs->sfs_freemapdirty && !sfs->sfs_superdirty) {
+		return err;
+	}
+	if (minage > 0) {
+		gettime(&now, &nsecs);
+		if (sfs->sfs_freemapdirtysince == 0) {
+			sfs->sfs_freemapdirtysince = now;
+			return err;
+		}
+		if (now - sfs->sfs_freemapdirtysince < minage) {
+			return err;
+		}
+	}
+
+	result = sfs_syncmap(sfs);
+	return err ? err : result;
+}
+
+/*
+ * Syncer thread. One of these runs for each mounted sfs, waking up
+ * every SFS_SYNCPERIOD seconds to write back anything that has been
+ * dirty for SFS_SYNCAGE seconds. This bounds how much is lost in a
+ * crash without making every write synchronous. With a journal, each
+ * pass is a group commit of everything since the last one.
+ */
+static
+void
+sfs_syncer(void *data, unsigned long unused)
+{
+	struct sfs_fs *sfs = data;
+	int result;
+
+	(void)unused;
+
+	while (!sfs->sfs_syncerexit) {
+		clocksleep(SFS_SYNCPERIOD);
+		if (sfs->sfs_syncerexit) {
+			break;
+		}
+		result = sfs_writeback(sfs, SFS_SYNCAGE);
+		if (result) {
+			kprintf("sfs: %s: syncer: %s\n",
+				sfs->sfs_super.sp_volname, strerror(result));
+		}
+	}
+
+	V(sfs->sfs_syncerdone);
+}
+
 /*
  * Sync routine. This is what gets invoked if you do FS_SYNC on the
  * sfs filesystem structure.
@@ -82,7 +202,6 @@ int
 sfs_sync(struct fs *fs)
 {
 	struct sfs_fs *sfs; 
-	int i, num, result;
 
 	/*
 	 * Get the sfs_fs from the generic abstract fs.
@@ -116,32 +235,8 @@ sfs_sync(struct fs *fs)
 
 	sfs = fs->fs_data;
 
-	/* Go over the array of loaded vnodes, syncing as we go. */
-	num = array_getnum(sfs->sfs_vnodes);
-	for (i=0; i<num; i++) {
-		struct sfs_vnode *sv = array_getguy(sfs->sfs_vnodes, i);
-		VOP_FSYNC(&sv->sv_v);
-	}
-
-	/* If the free block map needs to be written, write it. */
-	if (sfs->sfs_freemapdirty) {
-		result = sfs_mapio(sfs, UIO_WRITE);
-		if (result) {
-			return result;
-		}
-		sfs->sfs_freemapdirty = 0;
-	}
-
-	/* If the superblock needs to be written, write it. */
-	if (sfs->sfs_superdirty) {
-		result = sfs_wblock(sfs, &sfs->sfs_super, SFS_SB_LOCATION);
-		if (result) {
-			return result;
-		}
-		sfs->sfs_superdirty = 0;
-	}
-
-	return 0;
+	/* Write back everything, regardless of age. */
+	return sfs_writeback(sfs, 0);
 }
 
 /*
@@ -169,17 +264,28 @@ sfs_unmount(struct fs *fs)
 	struct sfs_fs *sfs = fs->fs_data;
 	
 	/* Do we have any files open? If so, can't unmount. */
-	if (array_getnum(sfs->sfs_vnodes)>0) {
+	if (sfs->sfs_nvnodes > 0) {
 		return EBUSY;
 	}
 
+	/* Stop the syncer and wait for it to go away. */
+	sfs->sfs_syncerexit = 1;
+	P(sfs->sfs_syncerdone);
+
 	/* We should have just had sfs_sync called. */
 	assert(sfs->sfs_superdirty==0);
 	assert(sfs->sfs_freemapdirty==0);
 
 	/* Once we start nuking stuff we can't fail. */
-	array_destroy(sfs->sfs_vnodes);
+	sfs_bufcleanup(sfs);
+	sem_destroy(sfs->sfs_syncerdone);
+	lock_destroy(sfs->sfs_vnlock);
+	if (sfs->sfs_jbuf != NULL) {
+		kfree(sfs->sfs_jbuf);
+	}
+	kfree(sfs->sfs_vnhash);
 	bitmap_destroy(sfs->sfs_freemap);
+	kfree(sfs->sfs_groupfree);
 	
 	/* The vfs layer takes care of the device for us */
 	(void)sfs->sfs_device;
@@ -210,6 +316,7 @@ int
 sfs_domount(void *options, struct device *dev, struct fs **ret)
 {
 	int result;
+	u_int32_t i;
 	struct sfs_fs *sfs;
 
 	/* We don't pass any options through mount */
@@ -240,12 +347,14 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 		return ENOMEM;
 	}
 
-	/* Allocate array */
-	sfs->sfs_vnodes = array_create();
-	if (sfs->sfs_vnodes == NULL) {
+	/* Allocate vnode table */
+	sfs->sfs_vnhash = kmalloc(SFS_VNHASHSIZE * sizeof(struct sfs_vnode *));
+	if (sfs->sfs_vnhash == NULL) {
 		kfree(sfs);
 		return ENOMEM;
 	}
+	bzero(sfs->sfs_vnhash, SFS_VNHASHSIZE * sizeof(struct sfs_vnode *));
+	sfs->sfs_nvnodes = 0;
 
 	/* Set the device so we can use sfs_rblock() */
 	sfs->sfs_device = dev;
@@ -253,7 +362,7 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Load superblock */
 	result = sfs_rblock(sfs, &sfs->sfs_super, SFS_SB_LOCATION);
 	if (result) {
-		array_destroy(sfs->sfs_vnodes);
+		kfree(sfs->sfs_vnhash);
 		kfree(sfs);
 		return result;
 	}
@@ -265,7 +374,7 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 			"(0x%x, should be 0x%x)\n", 
 			sfs->sfs_super.sp_magic,
 			SFS_MAGIC);
-		array_destroy(sfs->sfs_vnodes);
+		kfree(sfs->sfs_vnhash);
 		kfree(sfs);
 		return EINVAL;
 	}
@@ -278,21 +387,101 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Ensure null termination of the volume name */
 	sfs->sfs_super.sp_volname[sizeof(sfs->sfs_super.sp_volname)-1] = 0;
 
+	/*
+	 * Set up the journal, if there is one, and replay anything
+	 * left in it. This has to come before reading the freemap,
+	 * since replay may change it.
+	 */
+	sfs->sfs_jstart = sfs->sfs_super.sp_jstart;
+	sfs->sfs_jblocks = sfs->sfs_super.sp_jblocks;
+	sfs->sfs_jseq = 0;
+	sfs->sfs_jactive = 0;
+	sfs->sfs_jcommitting = 0;
+	sfs->sfs_jbuf = NULL;
+	if (sfs->sfs_jblocks > 0) {
+		if (sfs->sfs_jblocks < 4 ||
+		    sfs->sfs_jstart <= SFS_MAP_LOCATION ||
+		    sfs->sfs_jstart + sfs->sfs_jblocks >
+		    sfs->sfs_super.sp_nblocks) {
+			kprintf("sfs: %s: Invalid journal location\n",
+				sfs->sfs_super.sp_volname);
+			kfree(sfs->sfs_vnhash);
+			kfree(sfs);
+			return EINVAL;
+		}
+		sfs->sfs_jbuf = kmalloc(SFS_BLOCKSIZE);
+		if (sfs->sfs_jbuf == NULL) {
+			kfree(sfs->sfs_vnhash);
+			kfree(sfs);
+			return ENOMEM;
+		}
+		result = sfs_jreplay(sfs);
+		if (result) {
+			kfree(sfs->sfs_jbuf);
+			kfree(sfs->sfs_vnhash);
+			kfree(sfs);
+			return result;
+		}
+
+		/*
+		 * Splitting a commit would give up atomicity, so if a
+		 * whole one won't fit, do without. (The journal blocks
+		 * stay allocated in the freemap, so nothing uses them.)
+		 */
+		if (sfs->sfs_jblocks < SFS_JMINBLOCKS) {
+			kprintf("sfs: %s: Journal has %u blocks; needs %u. "
+				"Mounting without journaling\n",
+				sfs->sfs_super.sp_volname, sfs->sfs_jblocks,
+				SFS_JMINBLOCKS);
+			kfree(sfs->sfs_jbuf);
+			sfs->sfs_jbuf = NULL;
+			sfs->sfs_jblocks = 0;
+		}
+	}
+
 	/* Load free space bitmap */
 	sfs->sfs_freemap = bitmap_create(SFS_FS_BITMAPSIZE(sfs));
 	if (sfs->sfs_freemap == NULL) {
-		array_destroy(sfs->sfs_vnodes);
-		kfree(sfs);
-		return ENOMEM;
+		result = ENOMEM;
+		goto fail_jbuf;
 	}
 	result = sfs_mapio(sfs, UIO_READ);
 	if (result) {
-		bitmap_destroy(sfs->sfs_freemap);
-		array_destroy(sfs->sfs_vnodes);
-		kfree(sfs);
-		return result;
+		goto fail_freemap;
 	}
 
+	/* Count the free space in each allocation group */
+	sfs->sfs_ngroups = DIVROUNDUP(sfs->sfs_super.sp_nblocks, SFS_GROUPSIZE);
+	sfs->sfs_groupfree = kmalloc(sfs->sfs_ngroups * sizeof(u_int32_t));
+	if (sfs->sfs_groupfree == NULL) {
+		result = ENOMEM;
+		goto fail_freemap;
+	}
+	bzero(sfs->sfs_groupfree, sfs->sfs_ngroups * sizeof(u_int32_t));
+	for (i=0; i<sfs->sfs_super.sp_nblocks; i++) {
+		if (!bitmap_isset(sfs->sfs_freemap, i)) {
+			sfs->sfs_groupfree[SFS_GROUP(i)]++;
+		}
+	}
+
+	/* Set up the vnode table lock, buffer cache, and syncer */
+	sfs->sfs_vnlock = lock_create("sfs vnodes");
+	if (sfs->sfs_vnlock == NULL) {
+		result = ENOMEM;
+		goto fail_groupfree;
+	}
+	result = sfs_bufinit(sfs);
+	if (result) {
+		goto fail_vnlock;
+	}
+	sfs->sfs_syncerdone = sem_create("sfs syncer", 0);
+	if (sfs->sfs_syncerdone == NULL) {
+		result = ENOMEM;
+		goto fail_bufs;
+	}
+	sfs->sfs_syncerexit = 0;
+	sfs->sfs_freemapdirtysince = 0;
+
 	/* Set up abstract fs calls */
 	sfs->sfs_absfs.fs_sync = sfs_sync;
 	sfs->sfs_absfs.fs_getvolname = sfs_getvolname;
@@ -304,10 +493,34 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	sfs->sfs_superdirty = 0;
 	sfs->sfs_freemapdirty = 0;
 
+	/* Start the syncer last; it may use anything set up above */
+	result = thread_fork("sfs syncer", sfs, 0, sfs_syncer, NULL);
+	if (result) {
+		goto fail_sem;
+	}
+
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
 	return 0;
+
+ fail_sem:
+	sem_destroy(sfs->sfs_syncerdone);
+ fail_bufs:
+	sfs_bufcleanup(sfs);
+ fail_vnlock:
+	lock_destroy(sfs->sfs_vnlock);
+ fail_groupfree:
+	kfree(sfs->sfs_groupfree);
+ fail_freemap:
+	bitmap_destroy(sfs->sfs_freemap);
+ fail_jbuf:
+	if (sfs->sfs_jbuf != NULL) {
+		kfree(sfs->sfs_jbuf);
+	}
+	kfree(sfs->sfs_vnhash);
+	kfree(sfs);
+	return result;
 }
 
 /*
@@ -4,6 +4,9 @@
 #include <uio.h>
 #include <sfs.h>
 #include <dev.h>
+#include <clock.h>
+#include <thread.h>
+#include <machine/spl.h>
 
 ////////////////////////////////////////////////////////////
 //
@@ -69,3 +72,536 @@ sfs_wblock(struct sfs_fs *sfs, void *data, u_int32_t block)
 	SFSUIO(&ku, data, block, UIO_WRITE);
 	return sfs_rwblock(sfs, &ku);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Buffer cache
+//
+// Directory blocks, indirect blocks, and file data that isn't
+// transferred a whole block at a time go through a small per-fs
+// cache of block buffers. Buffers are written back when they're
+// evicted, when the file they belong to is fsync'd, on sync, and by
+// the syncer thread once they've been dirty for a while.
+//
+// A buffer handed out by sfs_bread/sfs_bget is busy, that is, owned
+// exclusively by the caller until sfs_brelse. Other threads wanting
+// the same block sleep on the buffer. The cache structures themselves
+// are protected by splhigh, like the thread queues.
+//
+// Buffers dirtied as metadata (inodes, directories, indirect blocks,
+// the freemap and superblock) are counted. If the filesystem has a
+// journal they may only reach their home locations after they've been
+// committed to the journal, so they're left alone by eviction and by
+// sfs_bflush; sfs_jsync takes care of them.
+
+#define SFS_BUFHASH(block)  ((block) % SFS_BUFHASHSIZE)
+
+/* True if B may not be written back except through the journal */
+#define SFS_BPINNED(sfs, b) \
+    ((b)->b_dirty && (b)->b_meta && (sfs)->sfs_jblocks > 0)
+
+/* Statistics */
+static u_int32_t sfs_nbufhits;
+static u_int32_t sfs_nbufmisses;
+static u_int32_t sfs_nbufwrites;
+static u_int32_t sfs_maxdirtyage;
+
+static
+void
+sfs_buf_lruremove(struct sfs_fs *sfs, struct sfs_buf *b)
+{
+	if (b->b_lruprev != NULL) {
+		b->b_lruprev->b_lrunext = b->b_lrunext;
+	}
+	else {
+		sfs->sfs_bufmru = b->b_lrunext;
+	}
+	if (b->b_lrunext != NULL) {
+		b->b_lrunext->b_lruprev = b->b_lruprev;
+	}
+	else {
+		sfs->sfs_buflru = b->b_lruprev;
+	}
+}
+
+static
+void
+sfs_buf_lruaddhead(struct sfs_fs *sfs, struct sfs_buf *b)
+{
+	b->b_lruprev = NULL;
+	b->b_lrunext = sfs->sfs_bufmru;
+	if (sfs->sfs_bufmru != NULL) {
+		sfs->sfs_bufmru->b_lruprev = b;
+	}
+	else {
+		sfs->sfs_buflru = b;
+	}
+	sfs->sfs_bufmru = b;
+}
+
+static
+struct sfs_buf *
+sfs_buf_find(struct sfs_fs *sfs, u_int32_t block)
+{
+	struct sfs_buf *b;
+
+	for (b = sfs->sfs_bufhash[SFS_BUFHASH(block)]; b != NULL;
+	     b = b->b_hashnext) {
+		if (b->b_block == block) {
+			return b;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+sfs_buf_unhash(struct sfs_fs *sfs, struct sfs_buf *b)
+{
+	struct sfs_buf **bp;
+
+	assert(b->b_valid);
+	for (bp = &sfs->sfs_bufhash[SFS_BUFHASH(b->b_block)]; *bp != b;
+	     bp = &(*bp)->b_hashnext) {
+		assert(*bp != NULL);
+	}
+	*bp = b->b_hashnext;
+	b->b_valid = 0;
+}
+
+/*
+ * Mark a buffer clean, keeping the count of dirty metadata straight.
+ */
+static
+void
+sfs_buf_clean(struct sfs_fs *sfs, struct sfs_buf *b)
+{
+	int spl;
+
+	spl = splhigh();
+	if (b->b_dirty && b->b_meta) {
+		assert(sfs->sfs_nbufmeta > 0);
+		sfs->sfs_nbufmeta--;
+	}
+	b->b_dirty = 0;
+	b->b_meta = 0;
+	splx(spl);
+}
+
+/*
+ * Write out a busy buffer to its home location. Clear the dirty flag
+ * first, so that if it gets redirtied while we're writing it, that
+ * isn't lost.
+ */
+int
+sfs_bwrite(struct sfs_fs *sfs, struct sfs_buf *b)
+{
+	time_t secs;
+	u_int32_t nsecs;
+	int result, meta;
+
+	assert(b->b_busy);
+	assert(b->b_dirty);
+
+	gettime(&secs, &nsecs);
+	if ((u_int32_t)(secs - b->b_dirtytime) > sfs_maxdirtyage) {
+		sfs_maxdirtyage = secs - b->b_dirtytime;
+	}
+
+	meta = b->b_meta;
+	sfs_buf_clean(sfs, b);
+	result = sfs_wblock(sfs, b->b_data, b->b_block);
+	if (result) {
+		sfs_bdirty(sfs, b, b->b_owner, meta);
+		return result;
+	}
+	sfs_nbufwrites++;
+	return 0;
+}
+
+/*
+ * Allocate a buffer and put it on the LRU list.
+ */
+static
+struct sfs_buf *
+sfs_buf_create(struct sfs_fs *sfs)
+{
+	struct sfs_buf *b;
+	int spl;
+
+	b = kmalloc(sizeof(struct sfs_buf));
+	if (b == NULL) {
+		return NULL;
+	}
+	b->b_data = kmalloc(SFS_BLOCKSIZE);
+	if (b->b_data == NULL) {
+		kfree(b);
+		return NULL;
+	}
+	b->b_hashnext = NULL;
+	b->b_block = 0;
+	b->b_owner = SFS_NOINO;
+	b->b_valid = 0;
+	b->b_dirty = 0;
+	b->b_meta = 0;
+	b->b_busy = 0;
+	b->b_dirtytime = 0;
+
+	spl = splhigh();
+	if (sfs->sfs_nbufs >= SFS_MAXBUFS) {
+		/* Someone else grew the cache while we were allocating */
+		splx(spl);
+		kfree(b->b_data);
+		kfree(b);
+		return NULL;
+	}
+	sfs->sfs_bufs[sfs->sfs_nbufs++] = b;
+	sfs_buf_lruaddhead(sfs, b);
+	splx(spl);
+
+	return b;
+}
+
+/*
+ * Get a busy buffer for BLOCK, reading it from disk if DOREAD is set
+ * and it isn't already cached.
+ */
+static
+int
+sfs_buf_get(struct sfs_fs *sfs, u_int32_t block, int doread,
+	    struct sfs_buf **ret)
+{
+	struct sfs_buf *b;
+	int spl, result;
+
+	spl = splhigh();
+ again:
+	b = sfs_buf_find(sfs, block);
+	if (b != NULL) {
+		if (b->b_busy) {
+			thread_sleep(b);
+			goto again;
+		}
+		b->b_busy = 1;
+		sfs_buf_lruremove(sfs, b);
+		sfs_buf_lruaddhead(sfs, b);
+		sfs_nbufhits++;
+		splx(spl);
+		*ret = b;
+		return 0;
+	}
+
+	/* Not cached; recycle the least recently used idle buffer. */
+	for (b = sfs->sfs_buflru; b != NULL; b = b->b_lruprev) {
+		if (!b->b_busy && !SFS_BPINNED(sfs, b)) {
+			break;
+		}
+	}
+	if (b == NULL && sfs->sfs_nbufs < SFS_MAXBUFS &&
+	    sfs->sfs_jblocks > 0) {
+		/* Everything's waiting for the journal; grow the cache */
+		splx(spl);
+		b = sfs_buf_create(sfs);
+		spl = splhigh();
+		if (b != NULL || sfs->sfs_nbufs >= SFS_MAXBUFS) {
+			/* Ours, or someone else grew it; look again */
+			goto again;
+		}
+		/* Out of memory; wait for a buffer to come free */
+	}
+	if (b == NULL) {
+		/* Everything's in use; wait for something to be released */
+		thread_sleep(&sfs->sfs_buflru);
+		goto again;
+	}
+	b->b_busy = 1;
+
+	if (b->b_dirty) {
+		/* Write it back; it stays in the hash until it's clean */
+		splx(spl);
+		result = sfs_bwrite(sfs, b);
+		spl = splhigh();
+		if (result) {
+			b->b_busy = 0;
+			thread_wakeup(b);
+			thread_wakeup(&sfs->sfs_buflru);
+			splx(spl);
+			return result;
+		}
+	}
+	if (b->b_valid) {
+		sfs_buf_unhash(sfs, b);
+		thread_wakeup(b);
+	}
+
+	/* We may have slept; someone else may have loaded our block */
+	if (sfs_buf_find(sfs, block) != NULL) {
+		b->b_busy = 0;
+		thread_wakeup(&sfs->sfs_buflru);
+		goto again;
+	}
+
+	b->b_block = block;
+	b->b_valid = 1;
+	b->b_hashnext = sfs->sfs_bufhash[SFS_BUFHASH(block)];
+	sfs->sfs_bufhash[SFS_BUFHASH(block)] = b;
+	sfs_buf_lruremove(sfs, b);
+	sfs_buf_lruaddhead(sfs, b);
+	sfs_nbufmisses++;
+	splx(spl);
+
+	if (doread) {
+		result = sfs_rblock(sfs, b->b_data, block);
+		if (result) {
+			spl = splhigh();
+			sfs_buf_unhash(sfs, b);
+			b->b_busy = 0;
+			thread_wakeup(b);
+			thread_wakeup(&sfs->sfs_buflru);
+			splx(spl);
+			return result;
+		}
+	}
+
+	*ret = b;
+	return 0;
+}
+
+/*
+ * Get a buffer for BLOCK holding its contents.
+ */
+int
+sfs_bread(struct sfs_fs *sfs, u_int32_t block, struct sfs_buf **ret)
+{
+	return sfs_buf_get(sfs, block, 1, ret);
+}
+
+/*
+ * Get a buffer for BLOCK without reading it; the caller is going to
+ * overwrite all of it.
+ */
+int
+sfs_bget(struct sfs_fs *sfs, u_int32_t block, struct sfs_buf **ret)
+{
+	return sfs_buf_get(sfs, block, 0, ret);
+}
+
+/*
+ * Get the buffer for BLOCK only if it's already cached.
+ */
+struct sfs_buf *
+sfs_bpeek(struct sfs_fs *sfs, u_int32_t block)
+{
+	struct sfs_buf *b;
+	int spl;
+
+	spl = splhigh();
+	while ((b = sfs_buf_find(sfs, block)) != NULL && b->b_busy) {
+		thread_sleep(b);
+	}
+	if (b != NULL) {
+		b->b_busy = 1;
+		sfs_nbufhits++;
+	}
+	splx(spl);
+	return b;
+}
+
+/*
+ * Mark a busy buffer dirty, on behalf of inode OWNER. META says
+ * whether it holds metadata.
+ */
+void
+sfs_bdirty(struct sfs_fs *sfs, struct sfs_buf *b, u_int32_t owner, int meta)
+{
+	u_int32_t nsecs;
+	int spl;
+
+	assert(b->b_busy);
+
+	spl = splhigh();
+	if (!b->b_dirty) {
+		gettime(&b->b_dirtytime, &nsecs);
+		b->b_dirty = 1;
+	}
+	if (meta && !b->b_meta) {
+		b->b_meta = 1;
+		sfs->sfs_nbufmeta++;
+	}
+	b->b_owner = owner;
+	splx(spl);
+}
+
+/*
+ * Release a busy buffer.
+ */
+void
+sfs_brelse(struct sfs_fs *sfs, struct sfs_buf *b)
+{
+	int spl;
+
+	spl = splhigh();
+	assert(b->b_busy);
+	b->b_busy = 0;
+	thread_wakeup(b);
+	thread_wakeup(&sfs->sfs_buflru);
+	splx(spl);
+}
+
+/*
+ * Forget any cached copy of BLOCK, which is being freed. Don't write
+ * it back even if it's dirty.
+ */
+void
+sfs_binval(struct sfs_fs *sfs, u_int32_t block)
+{
+	struct sfs_buf *b;
+	int spl;
+
+	spl = splhigh();
+	while ((b = sfs_buf_find(sfs, block)) != NULL && b->b_busy) {
+		thread_sleep(b);
+	}
+	if (b != NULL) {
+		sfs_buf_clean(sfs, b);
+		sfs_buf_unhash(sfs, b);
+	}
+	splx(spl);
+}
+
+/*
+ * Write back dirty buffers belonging to inode OWNER (or to anyone, if
+ * OWNER is SFS_NOINO) that have been dirty for at least MINAGE
+ * seconds. Metadata waiting for the journal is skipped.
+ */
+int
+sfs_bflush(struct sfs_fs *sfs, u_int32_t owner, int minage)
+{
+	struct sfs_buf *b;
+	time_t now;
+	u_int32_t nsecs, i;
+	int spl, result, err = 0;
+
+	gettime(&now, &nsecs);
+
+	for (i=0; i<sfs->sfs_nbufs; i++) {
+		b = sfs->sfs_bufs[i];
+
+		spl = splhigh();
+		while (b->b_busy) {
+			thread_sleep(b);
+		}
+		if (!b->b_dirty || SFS_BPINNED(sfs, b) ||
+		    (owner != SFS_NOINO && b->b_owner != owner) ||
+		    now - b->b_dirtytime < minage) {
+			splx(spl);
+			continue;
+		}
+		b->b_busy = 1;
+		splx(spl);
+
+		result = sfs_bwrite(sfs, b);
+		if (result && err == 0) {
+			err = result;
+		}
+		sfs_brelse(sfs, b);
+	}
+	return err;
+}
+
+/*
+ * Collect up to MAX buffers holding dirty metadata, for the journal.
+ * They're handed back busy; the caller writes them out with sfs_bwrite
+ * and releases them.
+ */
+int
+sfs_bgetmeta(struct sfs_fs *sfs, struct sfs_buf **bufs, int max)
+{
+	struct sfs_buf *b;
+	u_int32_t i;
+	int n = 0, spl;
+
+	spl = splhigh();
+	for (i=0; i<sfs->sfs_nbufs && n < max; i++) {
+		b = sfs->sfs_bufs[i];
+		while (b->b_busy) {
+			thread_sleep(b);
+		}
+		if (b->b_dirty && b->b_meta) {
+			b->b_busy = 1;
+			bufs[n++] = b;
+		}
+	}
+	splx(spl);
+	return n;
+}
+
+/*
+ * Write a block of metadata. With a journal, it goes into the buffer
+ * cache to be committed; otherwise straight to disk.
+ */
+int
+sfs_wmeta(struct sfs_fs *sfs, const void *data, u_int32_t block)
+{
+	struct sfs_buf *buf;
+	int result;
+
+	if (sfs->sfs_jblocks == 0) {
+		return sfs_wblock(sfs, (void *)data, block);
+	}
+
+	result = sfs_bget(sfs, block, &buf);
+	if (result) {
+		return result;
+	}
+	memcpy(buf->b_data, data, SFS_BLOCKSIZE);
+	sfs_bdirty(sfs, buf, SFS_NOINO, 1);
+	sfs_brelse(sfs, buf);
+	return 0;
+}
+
+/*
+ * Set up and tear down the buffer cache for a filesystem.
+ */
+int
+sfs_bufinit(struct sfs_fs *sfs)
+{
+	int i;
+
+	bzero(sfs->sfs_bufhash, sizeof(sfs->sfs_bufhash));
+	sfs->sfs_bufmru = sfs->sfs_buflru = NULL;
+	sfs->sfs_nbufs = 0;
+	sfs->sfs_nbufmeta = 0;
+
+	for (i=0; i<SFS_NBUFS; i++) {
+		if (sfs_buf_create(sfs) == NULL) {
+			sfs_bufcleanup(sfs);
+			return ENOMEM;
+		}
+	}
+	return 0;
+}
+
+void
+sfs_bufcleanup(struct sfs_fs *sfs)
+{
+	u_int32_t i;
+
+	for (i=0; i<sfs->sfs_nbufs; i++) {
+		assert(!sfs->sfs_bufs[i]->b_busy);
+		assert(!sfs->sfs_bufs[i]->b_dirty);
+		kfree(sfs->sfs_bufs[i]->b_data);
+		kfree(sfs->sfs_bufs[i]);
+		sfs->sfs_bufs[i] = NULL;
+	}
+	sfs->sfs_nbufs = 0;
+}
+
+void
+sfs_printbufstats(void)
+{
+	kprintf("sfs: buffer cache: %u hits, %u misses, %u writebacks\n",
+		sfs_nbufhits, sfs_nbufmisses, sfs_nbufwrites);
+	kprintf("sfs: oldest dirty buffer written back was %u seconds old\n",
+		sfs_maxdirtyage);
+}
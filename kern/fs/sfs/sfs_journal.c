@@ -0,0 +1,410 @@
+/*
+ * SFS filesystem
+ *
+ * Metadata journal.
+ *
+ * Changes to metadata (inodes, directories, indirect blocks, the
+ * freemap and superblock) collect as dirty buffers in the buffer
+ * cache. Every so often they are committed together as one
+ * transaction: a descriptor block, the block images, and a commit
+ * block, written one after another to the journal region that mksfs
+ * set aside. (A transaction with more blocks than one descriptor
+ * lists has several descriptors, one after another, before the
+ * images.) Only after the commit block is on disk are the blocks
+ * written to their home locations; then the journal header is
+ * updated so the transaction is never replayed.
+ *
+ * If we crash, sfs_jreplay finds the transaction (if its commit
+ * block made it to disk) when the filesystem is next mounted and
+ * writes it home again. Either all of a transaction happens or none
+ * of it does, so the filesystem is consistent without a full scan.
+ *
+ * A transaction must not catch an operation halfway done, so
+ * operations that change metadata are bracketed with sfs_jbegin and
+ * sfs_jend, and a commit waits until none are in progress. That also
+ * means an operation must not start another one (for instance by
+ * dropping the last reference to a vnode, which reclaims it) until
+ * it has called sfs_jend.
+ *
+ * File data is not journaled, but all dirty file data is written
+ * back just before each commit, so committed metadata never points at
+ * blocks whose contents haven't reached the disk.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <thread.h>
+#include <machine/spl.h>
+#include <sfs.h>
+
+/* Statistics */
+static u_int32_t sfs_njcommits;         /* transactions committed */
+static u_int32_t sfs_njblocks;          /* block images journaled */
+static u_int32_t sfs_njops;             /* operations journaled */
+static u_int32_t sfs_njreplays;         /* transactions replayed */
+
+/*
+ * Fold a block into a transaction checksum.
+ */
+static
+u_int32_t
+sfs_jchecksum(u_int32_t sum, const void *data)
+{
+	const u_int32_t *words = data;
+	unsigned i;
+
+	for (i=0; i<SFS_BLOCKSIZE/sizeof(u_int32_t); i++) {
+		sum = ((sum << 1) | (sum >> 31)) ^ words[i];
+	}
+	return sum;
+}
+
+/*
+ * Write the journal header, retiring every transaction before SEQ.
+ */
+static
+int
+sfs_jwriteheader(struct sfs_fs *sfs, u_int32_t seq)
+{
+	struct sfs_jheader *jh = sfs->sfs_jbuf;
+
+	bzero(jh, SFS_BLOCKSIZE);
+	jh->jh_magic = SFS_JMAGIC;
+	jh->jh_seq = seq;
+	return sfs_wblock(sfs, jh, sfs->sfs_jstart);
+}
+
+/*
+ * Replay the journal, if it holds a committed transaction. Called at
+ * mount time, before anything else reads the freemap or inodes.
+ */
+int
+sfs_jreplay(struct sfs_fs *sfs)
+{
+	struct sfs_jheader *jh;
+	struct sfs_jdesc *jd;
+	struct sfs_jcommit *jc;
+	u_int32_t *homes;
+	u_int32_t seq, n, nd, d, i, images, checksum, sum;
+	int result;
+
+	jh = sfs->sfs_jbuf;
+	result = sfs_rblock(sfs, jh, sfs->sfs_jstart);
+	if (result) {
+		return result;
+	}
+	if (jh->jh_magic != SFS_JMAGIC) {
+		kprintf("sfs: %s: Bad journal header\n",
+			sfs->sfs_super.sp_volname);
+		return EINVAL;
+	}
+	seq = jh->jh_seq;
+	sfs->sfs_jseq = seq;
+
+	/* Is there a transaction we haven't retired? */
+	jd = sfs->sfs_jbuf;
+	result = sfs_rblock(sfs, jd, sfs->sfs_jstart+1);
+	if (result) {
+		return result;
+	}
+	n = jd->jd_nblocks;
+	nd = SFS_JNDESC(n);
+	if (jd->jd_magic != SFS_JDESCMAGIC || jd->jd_seq != seq ||
+	    n == 0 || n > SFS_MAXBUFS || 2 + nd + n > sfs->sfs_jblocks) {
+		return 0;
+	}
+	images = sfs->sfs_jstart + 1 + nd;
+
+	/* Gather where everything goes from all the descriptors */
+	homes = kmalloc(n * sizeof(u_int32_t));
+	if (homes == NULL) {
+		return ENOMEM;
+	}
+	for (d=0; d<nd; d++) {
+		result = sfs_rblock(sfs, jd, sfs->sfs_jstart+1+d);
+		if (result) {
+			kfree(homes);
+			return result;
+		}
+		if (jd->jd_magic != SFS_JDESCMAGIC || jd->jd_seq != seq ||
+		    jd->jd_nblocks != n) {
+			/* A descriptor didn't make it; nor did the commit */
+			kfree(homes);
+			return 0;
+		}
+		for (i=0; i<SFS_JDESCMAX && d*SFS_JDESCMAX+i < n; i++) {
+			homes[d*SFS_JDESCMAX+i] = jd->jd_blocks[i];
+		}
+	}
+
+	/* Did it commit? */
+	jc = sfs->sfs_jbuf;
+	result = sfs_rblock(sfs, jc, images + n);
+	if (result) {
+		kfree(homes);
+		return result;
+	}
+	if (jc->jc_magic != SFS_JCOMMITMAGIC || jc->jc_seq != seq ||
+	    jc->jc_nblocks != n) {
+		/* No; the crash came first. Forget it. */
+		kfree(homes);
+		return 0;
+	}
+	checksum = jc->jc_checksum;
+
+	/* Make sure all the images made it before trusting any of them */
+	sum = seq;
+	for (i=0; i<n; i++) {
+		result = sfs_rblock(sfs, sfs->sfs_jbuf, images+i);
+		if (result) {
+			kfree(homes);
+			return result;
+		}
+		sum = sfs_jchecksum(sum, sfs->sfs_jbuf);
+	}
+	if (sum != checksum) {
+		kprintf("sfs: %s: Journal transaction %u has bad checksum; "
+			"not replaying it\n", sfs->sfs_super.sp_volname, seq);
+		kfree(homes);
+		return 0;
+	}
+
+	/* Write each block home */
+	for (i=0; i<n; i++) {
+		if (homes[i] >= sfs->sfs_super.sp_nblocks ||
+		    (homes[i] >= sfs->sfs_jstart &&
+		     homes[i] < sfs->sfs_jstart + sfs->sfs_jblocks)) {
+			panic("sfs: %s: Journal transaction %u has "
+			      "invalid block %u\n", sfs->sfs_super.sp_volname,
+			      seq, homes[i]);
+		}
+		result = sfs_rblock(sfs, sfs->sfs_jbuf, images+i);
+		if (result) {
+			kfree(homes);
+			return result;
+		}
+		result = sfs_wblock(sfs, sfs->sfs_jbuf, homes[i]);
+		if (result) {
+			kfree(homes);
+			return result;
+		}
+	}
+	kfree(homes);
+
+	/* Retire it */
+	result = sfs_jwriteheader(sfs, seq+1);
+	if (result) {
+		return result;
+	}
+	sfs->sfs_jseq = seq+1;
+	sfs_njreplays++;
+
+	kprintf("sfs: %s: Replayed journal transaction %u (%u blocks)\n",
+		sfs->sfs_super.sp_volname, seq, n);
+	return 0;
+}
+
+/*
+ * Commit all dirty metadata in the buffer cache. The caller has made
+ * sure no operations are in progress.
+ *
+ * Dirty metadata can't be evicted, so there is never more of it than
+ * the buffer cache holds, SFS_MAXBUFS blocks, and the mount code
+ * makes sure the journal has room for that much. So everything always
+ * goes in one transaction, and all of it happens or none of it does.
+ */
+static
+int
+sfs_jcommit(struct sfs_fs *sfs)
+{
+	struct sfs_buf **bufs = sfs->sfs_jbufs;
+	struct sfs_jdesc *jd;
+	struct sfs_jcommit *jc;
+	u_int32_t seq, block, checksum;
+	int i, d, n, nd, result, err = 0;
+
+	n = sfs_bgetmeta(sfs, bufs, SFS_MAXBUFS);
+	if (n == 0) {
+		return 0;
+	}
+	nd = SFS_JNDESC(n);
+	assert((u_int32_t)(2 + nd + n) <= sfs->sfs_jblocks);
+
+	seq = sfs->sfs_jseq;
+	block = sfs->sfs_jstart+1;
+
+	/* The descriptors, each listing the homes of its share */
+	jd = sfs->sfs_jbuf;
+	for (d=0; d<nd; d++) {
+		bzero(jd, SFS_BLOCKSIZE);
+		jd->jd_magic = SFS_JDESCMAGIC;
+		jd->jd_seq = seq;
+		jd->jd_nblocks = n;
+		for (i=0; i<SFS_JDESCMAX && d*SFS_JDESCMAX+i < n; i++) {
+			jd->jd_blocks[i] = bufs[d*SFS_JDESCMAX+i]->b_block;
+		}
+		result = sfs_wblock(sfs, jd, block++);
+		if (result) {
+			goto fail;
+		}
+	}
+
+	/* The block images, right behind them */
+	checksum = seq;
+	for (i=0; i<n; i++) {
+		result = sfs_wblock(sfs, bufs[i]->b_data, block++);
+		if (result) {
+			goto fail;
+		}
+		checksum = sfs_jchecksum(checksum, bufs[i]->b_data);
+	}
+
+	/* The commit block. Once it's on disk, we're committed. */
+	jc = sfs->sfs_jbuf;
+	bzero(jc, SFS_BLOCKSIZE);
+	jc->jc_magic = SFS_JCOMMITMAGIC;
+	jc->jc_seq = seq;
+	jc->jc_nblocks = n;
+	jc->jc_checksum = checksum;
+	result = sfs_wblock(sfs, jc, block);
+	if (result) {
+		goto fail;
+	}
+
+	/*
+	 * Write the blocks home. If that fails, the buffer stays dirty
+	 * and goes in the next transaction; meanwhile the journal
+	 * still has this one for replay, so don't retire it.
+	 */
+	for (i=0; i<n; i++) {
+		result = sfs_bwrite(sfs, bufs[i]);
+		if (result && err == 0) {
+			err = result;
+		}
+		sfs_brelse(sfs, bufs[i]);
+	}
+	if (err) {
+		return err;
+	}
+
+	result = sfs_jwriteheader(sfs, seq+1);
+	if (result) {
+		return result;
+	}
+	sfs->sfs_jseq = seq+1;
+
+	sfs_njcommits++;
+	sfs_njblocks += n;
+	return 0;
+
+ fail:
+	/* Nothing was committed; the buffers are still dirty */
+	for (i=0; i<n; i++) {
+		sfs_brelse(sfs, bufs[i]);
+	}
+	return result;
+}
+
+/*
+ * Commit everything: write back file data, gather up dirty inodes,
+ * the freemap and the superblock into the buffer cache, then commit
+ * all the metadata as one transaction. This is the group commit;
+ * every operation since the last one rides along.
+ */
+int
+sfs_jsync(struct sfs_fs *sfs)
+{
+	int spl, result;
+
+	/* Wait for any other commit, then keep new operations out */
+	spl = splhigh();
+	while (sfs->sfs_jcommitting) {
+		thread_sleep(&sfs->sfs_jactive);
+	}
+	sfs->sfs_jcommitting = 1;
+	while (sfs->sfs_jactive > 0) {
+		thread_sleep(&sfs->sfs_jactive);
+	}
+	splx(spl);
+
+	result = sfs_bflush(sfs, SFS_NOINO, 0);
+	if (result == 0) {
+		result = sfs_syncvnodes(sfs, 0);
+	}
+	if (result == 0) {
+		result = sfs_syncmap(sfs);
+	}
+	if (result == 0) {
+		result = sfs_jcommit(sfs);
+	}
+
+	spl = splhigh();
+	sfs->sfs_jcommitting = 0;
+	thread_wakeup(&sfs->sfs_jactive);
+	splx(spl);
+
+	return result;
+}
+
+/*
+ * Start an operation that changes metadata. If a lot of dirty
+ * metadata has piled up, commit it first, so the buffer cache doesn't
+ * fill up with blocks that can't be evicted.
+ */
+void
+sfs_jbegin(struct sfs_fs *sfs)
+{
+	int spl;
+
+	if (sfs->sfs_jblocks == 0) {
+		return;
+	}
+
+	if (sfs->sfs_nbufmeta >= SFS_JTHRESHOLD) {
+		/* If this fails, the syncer will complain and retry */
+		sfs_jsync(sfs);
+	}
+
+	spl = splhigh();
+	while (sfs->sfs_jcommitting) {
+		thread_sleep(&sfs->sfs_jactive);
+	}
+	sfs->sfs_jactive++;
+	sfs_njops++;
+	splx(spl);
+}
+
+/*
+ * Finish an operation started with sfs_jbegin.
+ */
+void
+sfs_jend(struct sfs_fs *sfs)
+{
+	int spl;
+
+	if (sfs->sfs_jblocks == 0) {
+		return;
+	}
+
+	spl = splhigh();
+	assert(sfs->sfs_jactive > 0);
+	sfs->sfs_jactive--;
+	if (sfs->sfs_jactive == 0) {
+		thread_wakeup(&sfs->sfs_jactive);
+	}
+	splx(spl);
+}
+
+void
+sfs_printjournalstats(void)
+{
+	kprintf("sfs: journal: %u transactions, %u blocks, %u operations",
+		sfs_njcommits, sfs_njblocks, sfs_njops);
+	if (sfs_njcommits > 0) {
+		kprintf(" (%u operations/transaction)",
+			sfs_njops / sfs_njcommits);
+	}
+	kprintf("\n");
+	kprintf("sfs: journal: %u transactions replayed at mount\n",
+		sfs_njreplays);
+}
@@ -6,13 +6,15 @@
 #include <types.h>
 #include <lib.h>
 #include <synch.h>
-#include <array.h>
 #include <bitmap.h>
 #include <kern/stat.h>
 #include <kern/errno.h>
 #include <kern/unistd.h>
 #include <uio.h>
+#include <vfs.h>
+#include <vm.h>
 #include <dev.h>
+#include <clock.h>
 #include <sfs.h>
 
 /* At bottom of file */
@@ -20,50 +22,155 @@ static int
 sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int type,
 		 struct sfs_vnode **ret);
 
+/* Below, with the vnode ops */
+static int sfs_dotruncate(struct vnode *v, off_t len);
+
 ////////////////////////////////////////////////////////////
 //
 // Simple stuff
 
-/* Zero out a disk block. */
+/*
+ * True if the contents of SV count as metadata for the journal. For
+ * directories that's everything; for files, just the indirect block.
+ */
+#define SFS_ISMETA(sv)  ((sv)->sv_i.sfi_type == SFS_TYPE_DIR)
+
+/*
+ * Zero out a disk block, on behalf of inode OWNER. This only zeroes
+ * it in the buffer cache; it reaches the disk when the buffer is
+ * written back.
+ */
 static
 int
-sfs_clearblock(struct sfs_fs *sfs, u_int32_t block)
+sfs_clearblock(struct sfs_fs *sfs, u_int32_t block, u_int32_t owner,
+	       int meta)
 {
-	/* static -> automatically initialized to zero */
-	static char zeros[SFS_BLOCKSIZE];
-	return sfs_wblock(sfs, zeros, block);
+	struct sfs_buf *buf;
+	int result;
+
+	result = sfs_bget(sfs, block, &buf);
+	if (result) {
+		return result;
+	}
+	bzero(buf->b_data, SFS_BLOCKSIZE);
+	sfs_bdirty(sfs, buf, owner, meta);
+	sfs_brelse(sfs, buf);
+	return 0;
 }
 
-/* Write an on-disk inode structure back out to disk. */
+/*
+ * Write an on-disk inode structure back out to disk (or, with a
+ * journal, into the buffer cache to be committed). Clear the dirty
+ * flag first so changes made while the write is in progress aren't
+ * lost.
+ */
 static
 int
 sfs_sync_inode(struct sfs_vnode *sv)
 {
 	if (sv->sv_dirty) {
 		struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
-		int result = sfs_wblock(sfs, &sv->sv_i, sv->sv_ino);
+		int result;
+
+		sv->sv_dirty = 0;
+		result = sfs_wmeta(sfs, &sv->sv_i, sv->sv_ino);
 		if (result) {
+			sv->sv_dirty = 1;
 			return result;
 		}
-		sv->sv_dirty = 0;
+		sv->sv_dirtysince = 0;
 	}
 	return 0;
 }
 
+////////////////////////////////////////////////////////////
+//
+// Vnode table
+//
+// Loaded vnodes are kept in a hash table keyed by inode number, with
+// doubly linked chains so a vnode can be removed without searching.
+// The table is protected by sfs_vnlock, which also keeps loadvnode
+// and reclaim from racing, and the syncer from walking the table
+// while it changes.
+
+#define SFS_VNHASH(ino)  ((ino) % SFS_VNHASHSIZE)
+
+/* Statistics: lookups in the table, and chain entries examined */
+static u_int32_t sfs_nvnlookups;
+static u_int32_t sfs_nvnprobes;
+
+static
+struct sfs_vnode *
+sfs_vnhash_find(struct sfs_fs *sfs, u_int32_t ino)
+{
+	struct sfs_vnode *sv;
+
+	sfs_nvnlookups++;
+	for (sv = sfs->sfs_vnhash[SFS_VNHASH(ino)]; sv != NULL;
+	     sv = sv->sv_hashnext) {
+		sfs_nvnprobes++;
+		if (sv->sv_ino == ino) {
+			return sv;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+sfs_vnhash_add(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	struct sfs_vnode **head = &sfs->sfs_vnhash[SFS_VNHASH(sv->sv_ino)];
+
+	sv->sv_hashnext = *head;
+	if (*head != NULL) {
+		(*head)->sv_hashprev = &sv->sv_hashnext;
+	}
+	sv->sv_hashprev = head;
+	*head = sv;
+	sfs->sfs_nvnodes++;
+}
+
+static
+void
+sfs_vnhash_remove(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	assert(*sv->sv_hashprev == sv);
+
+	*sv->sv_hashprev = sv->sv_hashnext;
+	if (sv->sv_hashnext != NULL) {
+		sv->sv_hashnext->sv_hashprev = sv->sv_hashprev;
+	}
+	sv->sv_hashnext = NULL;
+	sv->sv_hashprev = NULL;
+
+	assert(sfs->sfs_nvnodes > 0);
+	sfs->sfs_nvnodes--;
+}
+
 ////////////////////////////////////////////////////////////
 //
 // Space allocation
 
 /*
- * Allocate a block.
+ * Allocation statistics. A block that lands exactly on its goal is
+ * contiguous with whatever it was supposed to follow, so the fraction
+ * of on-goal allocations is a reasonable measure of fragmentation.
+ */
+static u_int32_t sfs_nballoc;
+static u_int32_t sfs_nballoc_ongoal;
+static u_int32_t sfs_nbfree;
+
+/*
+ * Allocate a block, as close after GOAL as possible.
  */
 static
 int
-sfs_balloc(struct sfs_fs *sfs, u_int32_t *diskblock)
+sfs_balloc(struct sfs_fs *sfs, u_int32_t goal, u_int32_t *diskblock)
 {
 	int result;
 
-	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
+	result = bitmap_alloc_near(sfs->sfs_freemap, goal, diskblock);
 	if (result) {
 		return result;
 	}
@@ -73,8 +180,19 @@ sfs_balloc(struct sfs_fs *sfs, u_int32_t *diskblock)
 		panic("sfs: balloc: invalid block %u\n", *diskblock);
 	}
 
-	/* Clear block before returning it */
-	return sfs_clearblock(sfs, *diskblock);
+	assert(sfs->sfs_groupfree[SFS_GROUP(*diskblock)] > 0);
+	sfs->sfs_groupfree[SFS_GROUP(*diskblock)]--;
+
+	sfs_nballoc++;
+	if (*diskblock == goal) {
+		sfs_nballoc_ongoal++;
+	}
+
+	/*
+	 * The block is not cleared; callers that need it zeroed use
+	 * sfs_clearblock, which does it in the buffer cache.
+	 */
+	return 0;
 }
 
 /*
@@ -84,8 +202,13 @@ static
 void
 sfs_bfree(struct sfs_fs *sfs, u_int32_t diskblock)
 {
+	/* Any cached contents are garbage now; don't write them back */
+	sfs_binval(sfs, diskblock);
+
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
 	sfs->sfs_freemapdirty = 1;
+	sfs->sfs_groupfree[SFS_GROUP(diskblock)]++;
+	sfs_nbfree++;
 }
 
 /*
@@ -102,6 +225,32 @@ sfs_bused(struct sfs_fs *sfs, u_int32_t diskblock)
 	return bitmap_isset(sfs->sfs_freemap, diskblock);
 }
 
+/*
+ * Choose where a new inode in directory DIR should go: in the
+ * directory's own group, unless that group is getting full, in which
+ * case use the group with the most free space so the new file has
+ * room to grow contiguously.
+ */
+static
+u_int32_t
+sfs_inodegoal(struct sfs_fs *sfs, struct sfs_vnode *dir)
+{
+	u_int32_t group, best;
+
+	group = SFS_GROUP(dir->sv_ino);
+	if (sfs->sfs_groupfree[group] >= SFS_GROUPSIZE/8) {
+		return dir->sv_ino;
+	}
+
+	best = group;
+	for (group=0; group<sfs->sfs_ngroups; group++) {
+		if (sfs->sfs_groupfree[group] > sfs->sfs_groupfree[best]) {
+			best = group;
+		}
+	}
+	return best * SFS_GROUPSIZE;
+}
+
 ////////////////////////////////////////////////////////////
 //
 // Block mapping/inode maintenance
@@ -117,23 +266,15 @@ int
 sfs_bmap(struct sfs_vnode *sv, u_int32_t fileblock, int doalloc,
 	    u_int32_t *diskblock)
 {
-	/*
-	 * I/O buffer for handling indirect blocks.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static u_int32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_buf *idbuf;
+	u_int32_t *ids;
 	u_int32_t block;
 	u_int32_t idblock;
 	u_int32_t idnum, idoff;
+	u_int32_t goal;
 	int result;
 
-	assert(sizeof(idbuf)==SFS_BLOCKSIZE);
-
 	/*
 	 * If the block we want is one of the direct blocks...
 	 */
@@ -147,10 +288,24 @@ sfs_bmap(struct sfs_vnode *sv, u_int32_t fileblock, int doalloc,
 		 * Do we need to allocate?
 		 */
 		if (block==0 && doalloc) {
-			result = sfs_balloc(sfs, &block);
+			/* Try to put it right after the previous block */
+			if (fileblock > 0 && sv->sv_i.sfi_direct[fileblock-1]) {
+				goal = sv->sv_i.sfi_direct[fileblock-1] + 1;
+			}
+			else {
+				goal = sv->sv_ino + 1;
+			}
+
+			result = sfs_balloc(sfs, goal, &block);
 			if (result) {
 				return result;
 			}
+			result = sfs_clearblock(sfs, block, sv->sv_ino,
+						SFS_ISMETA(sv));
+			if (result) {
+				sfs_bfree(sfs, block);
+				return result;
+			}
 
 			/* Remember what we allocated; mark inode dirty */
 			sv->sv_i.sfi_direct[fileblock] = block;
@@ -205,51 +360,68 @@ sfs_bmap(struct sfs_vnode *sv, u_int32_t fileblock, int doalloc,
 		 * There's no indirect block allocated, but we need to
 		 * allocate a block whose number needs to be stored in
 		 * the indirect block. Thus, we need to allocate an
-		 * indirect block.
+		 * indirect block. Put it after the last direct block.
 		 */
-		result = sfs_balloc(sfs, &idblock);
+		goal = sv->sv_i.sfi_direct[SFS_NDIRECT-1];
+		goal = (goal != 0) ? goal + 1 : sv->sv_ino + 1;
+		result = sfs_balloc(sfs, goal, &idblock);
 		if (result) {
 			return result;
 		}
 
+		/* Start it out empty */
+		result = sfs_clearblock(sfs, idblock, sv->sv_ino, 1);
+		if (result) {
+			sfs_bfree(sfs, idblock);
+			return result;
+		}
+
 		/* Remember the block we just allocated */
 		sv->sv_i.sfi_indirect = idblock;
 
 		/* Mark the inode dirty */
 		sv->sv_dirty = 1;
-
-		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
 	}
-	else {
-		/*
-		 * We already have an indirect block allocated; load it.
-		 */
-		result = sfs_rblock(sfs, idbuf, idblock);
-		if (result) {
-			return result;
-		}
+
+	/* Get the indirect block from the buffer cache */
+	result = sfs_bread(sfs, idblock, &idbuf);
+	if (result) {
+		return result;
 	}
+	ids = idbuf->b_data;
 
 	/* Get the block out of the indirect block buffer */
-	block = idbuf[idoff];
+	block = ids[idoff];
 
 	/* If there's no block there, allocate one */
 	if (block==0 && doalloc) {
-		result = sfs_balloc(sfs, &block);
+		if (idoff > 0 && ids[idoff-1] != 0) {
+			goal = ids[idoff-1] + 1;
+		}
+		else {
+			goal = idblock + 1;
+		}
+		result = sfs_balloc(sfs, goal, &block);
 		if (result) {
+			sfs_brelse(sfs, idbuf);
 			return result;
 		}
-
-		/* Remember the block we allocated */
-		idbuf[idoff] = block;
-
-		/* The indirect block is now dirty; write it back */
-		result = sfs_wblock(sfs, idbuf, idblock);
+		result = sfs_clearblock(sfs, block, sv->sv_ino,
+					SFS_ISMETA(sv));
 		if (result) {
+			sfs_bfree(sfs, block);
+			sfs_brelse(sfs, idbuf);
 			return result;
 		}
+
+		/*
+		 * Remember the block we allocated. The indirect block
+		 * is now dirty; it gets written back with the rest.
+		 */
+		ids[idoff] = block;
+		sfs_bdirty(sfs, idbuf, sv->sv_ino, 1);
 	}
+	sfs_brelse(sfs, idbuf);
 
 	/* Hand back the result and return. */
 	if (block != 0 && !sfs_bused(sfs, block)) {
@@ -268,7 +440,8 @@ sfs_bmap(struct sfs_vnode *sv, u_int32_t fileblock, int doalloc,
  * Do I/O to a block of a file that doesn't cover the whole block.  We
  * need to read in the original block first, even if we're writing, so
  * we don't clobber the portion of the block we're not intending to
- * write over.
+ * write over. This goes through the buffer cache; a write just
+ * dirties the buffer.
  *
  * skipstart is the number of bytes to skip past at the beginning of
  * the sector; len is the number of bytes to actually read or write.
@@ -279,16 +452,8 @@ int
 sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      u_int32_t skipstart, u_int32_t len)
 {
-	/*
-	 * I/O buffer for handling partial sectors.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static char iobuf[SFS_BLOCKSIZE];
-
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_buf *buf;
 	u_int32_t diskblock;
 	u_int32_t fileblock;
 	int result;
@@ -310,40 +475,33 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * Hand back zeros.
 		 */
 		assert(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
-	}
-	else {
-		/*
-		 * Read the block.
-		 */
-		result = sfs_rblock(sfs, iobuf, diskblock);
-		if (result) {
-			return result;
-		}
+		return uiomovezeros(len, uio);
 	}
 
 	/*
-	 * Now perform the requested operation into/out of the buffer.
+	 * Get the block.
 	 */
-	result = uiomove(iobuf+skipstart, len, uio);
+	result = sfs_bread(sfs, diskblock, &buf);
 	if (result) {
 		return result;
 	}
 
 	/*
-	 * If it was a write, write back the modified block.
+	 * Now perform the requested operation into/out of the buffer.
+	 * If it was a write, the buffer is dirty even if uiomove
+	 * failed partway.
 	 */
+	result = uiomove((char *)buf->b_data + skipstart, len, uio);
+	dev_countcopy(len);
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_wblock(sfs, iobuf, diskblock);
-		if (result) {
-			return result;
-		}
+		sfs_bdirty(sfs, buf, sv->sv_ino, SFS_ISMETA(sv));
 	}
+	sfs_brelse(sfs, buf);
 
-	return 0;
+	return result;
 }
 
 /*
@@ -354,6 +512,7 @@ int
 sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 {
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_buf *buf;
 	u_int32_t diskblock;
 	u_int32_t fileblock;
 	int result;
@@ -384,8 +543,25 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	}
 
 	/*
-	 * Do the I/O directly to the uio region. Save the uio_offset,
-	 * and substitute one that makes sense to the device.
+	 * If the block is in the buffer cache, the copy there is the
+	 * current one; use it.
+	 */
+	buf = sfs_bpeek(sfs, diskblock);
+	if (buf != NULL) {
+		result = uiomove(buf->b_data, SFS_BLOCKSIZE, uio);
+		dev_countcopy(SFS_BLOCKSIZE);
+		if (uio->uio_rw == UIO_WRITE) {
+			sfs_bdirty(sfs, buf, sv->sv_ino, SFS_ISMETA(sv));
+		}
+		sfs_brelse(sfs, buf);
+		return result;
+	}
+
+	/*
+	 * Otherwise do the I/O directly to the uio region; the device
+	 * moves the data straight between its buffer and the caller's.
+	 * Save the uio_offset, and substitute one that makes sense to the
+	 * device.
 	 */
 	saveoff = uio->uio_offset;
 	diskoff = diskblock * SFS_BLOCKSIZE;
@@ -606,14 +782,13 @@ sfs_dir_nentries(struct sfs_vnode *sv)
 }
 
 /*
- * Search a directory for a particular filename in a directory, and
- * return its inode number, its slot, and/or the slot number of an
- * empty directory slot if one is found.
+ * Search a directory for a particular filename by reading every slot.
+ * This is the fallback for when we can't build a name index.
  */
 
 static
 int
-sfs_dir_findname(struct sfs_vnode *sv, const char *name,
+sfs_dir_scanname(struct sfs_vnode *sv, const char *name,
 		    u_int32_t *ino, int *slot, int *emptyslot)
 {
 	struct sfs_dir tsd;
@@ -657,6 +832,303 @@ sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 	return found ? 0 : ENOENT;
 }
 
+////////////////////////////////////////////////////////////
+//
+// Directory name index
+//
+// Searching a directory on disk costs a VOP_READ per 64-byte entry,
+// so for each directory we keep an in-memory hash of the names in it,
+// plus a stack of the empty slots. The index is built the first time
+// the directory is searched, kept current by sfs_dir_link and
+// sfs_dir_unlink, and thrown away when the vnode is reclaimed. If we
+// run out of memory keeping it current we throw it away early; it
+// gets rebuilt on the next search.
+
+#define SFS_DIRHASHSIZE  64
+
+struct sfs_dirname {
+	struct sfs_dirname *dn_next;    /* next in hash chain */
+	char *dn_name;                  /* the name */
+	u_int32_t dn_ino;               /* inode number */
+	int dn_slot;                    /* slot in the directory */
+};
+
+struct sfs_dirindex {
+	struct sfs_dirname *di_hash[SFS_DIRHASHSIZE];
+	int *di_freeslots;              /* stack of empty slots */
+	int di_nfree;                   /* number of empty slots */
+	int di_maxfree;                 /* allocated size of di_freeslots */
+};
+
+/* Statistics: index builds, and lookups served from an index */
+static u_int32_t sfs_ndirbuilds;
+static u_int32_t sfs_ndirlookups;
+
+static
+u_int32_t
+sfs_dirhash(const char *name)
+{
+	u_int32_t hash = 5381;
+
+	while (*name) {
+		hash = hash*33 + (unsigned char)*name++;
+	}
+	return hash % SFS_DIRHASHSIZE;
+}
+
+static
+struct sfs_dirname *
+sfs_dirindex_find(struct sfs_dirindex *di, const char *name)
+{
+	struct sfs_dirname *dn;
+
+	for (dn = di->di_hash[sfs_dirhash(name)]; dn != NULL; dn = dn->dn_next) {
+		if (!strcmp(dn->dn_name, name)) {
+			return dn;
+		}
+	}
+	return NULL;
+}
+
+static
+int
+sfs_dirindex_addname(struct sfs_dirindex *di, const char *name,
+		     u_int32_t ino, int slot)
+{
+	struct sfs_dirname *dn;
+	u_int32_t hash;
+
+	dn = kmalloc(sizeof(struct sfs_dirname));
+	if (dn == NULL) {
+		return ENOMEM;
+	}
+	dn->dn_name = kstrdup(name);
+	if (dn->dn_name == NULL) {
+		kfree(dn);
+		return ENOMEM;
+	}
+	dn->dn_ino = ino;
+	dn->dn_slot = slot;
+
+	hash = sfs_dirhash(name);
+	dn->dn_next = di->di_hash[hash];
+	di->di_hash[hash] = dn;
+	return 0;
+}
+
+static
+void
+sfs_dirindex_removename(struct sfs_dirindex *di, const char *name, int slot)
+{
+	struct sfs_dirname **dnp, *dn;
+
+	for (dnp = &di->di_hash[sfs_dirhash(name)]; *dnp != NULL;
+	     dnp = &(*dnp)->dn_next) {
+		dn = *dnp;
+		if (!strcmp(dn->dn_name, name)) {
+			assert(dn->dn_slot == slot);
+			*dnp = dn->dn_next;
+			kfree(dn->dn_name);
+			kfree(dn);
+			return;
+		}
+	}
+	panic("sfs: dirindex: %s not found\n", name);
+}
+
+static
+int
+sfs_dirindex_pushfree(struct sfs_dirindex *di, int slot)
+{
+	int *newslots;
+	int newmax;
+
+	if (di->di_nfree == di->di_maxfree) {
+		newmax = di->di_maxfree ? di->di_maxfree*2 : 8;
+		newslots = kmalloc(newmax * sizeof(int));
+		if (newslots == NULL) {
+			return ENOMEM;
+		}
+		if (di->di_freeslots != NULL) {
+			memcpy(newslots, di->di_freeslots, 
+			       di->di_nfree * sizeof(int));
+			kfree(di->di_freeslots);
+		}
+		di->di_freeslots = newslots;
+		di->di_maxfree = newmax;
+	}
+	di->di_freeslots[di->di_nfree++] = slot;
+	return 0;
+}
+
+/*
+ * Take SLOT off the free stack. Since sfs_dir_findname hands out the
+ * top of the stack, this is normally the top entry.
+ */
+static
+void
+sfs_dirindex_removefree(struct sfs_dirindex *di, int slot)
+{
+	int i;
+
+	for (i=di->di_nfree-1; i>=0; i--) {
+		if (di->di_freeslots[i] == slot) {
+			di->di_freeslots[i] = di->di_freeslots[--di->di_nfree];
+			return;
+		}
+	}
+	panic("sfs: dirindex: free slot %d not found\n", slot);
+}
+
+static
+void
+sfs_dirindex_destroy(struct sfs_vnode *sv)
+{
+	struct sfs_dirindex *di = sv->sv_dirindex;
+	struct sfs_dirname *dn;
+	int i;
+
+	if (di == NULL) {
+		return;
+	}
+
+	for (i=0; i<SFS_DIRHASHSIZE; i++) {
+		while ((dn = di->di_hash[i]) != NULL) {
+			di->di_hash[i] = dn->dn_next;
+			kfree(dn->dn_name);
+			kfree(dn);
+		}
+	}
+	if (di->di_freeslots != NULL) {
+		kfree(di->di_freeslots);
+	}
+	kfree(di);
+	sv->sv_dirindex = NULL;
+}
+
+/*
+ * Build the name index for a directory. Read it a whole block of
+ * entries at a time rather than an entry at a time.
+ */
+static
+int
+sfs_dirindex_build(struct sfs_vnode *sv)
+{
+	const int perblock = SFS_BLOCKSIZE / sizeof(struct sfs_dir);
+	struct sfs_dirindex *di;
+	struct sfs_dir *sds;
+	struct uio ku;
+	int nentries = sfs_dir_nentries(sv);
+	int i, j, n, result;
+
+	assert(sv->sv_dirindex == NULL);
+
+	sds = kmalloc(SFS_BLOCKSIZE);
+	if (sds == NULL) {
+		return ENOMEM;
+	}
+
+	di = kmalloc(sizeof(struct sfs_dirindex));
+	if (di == NULL) {
+		kfree(sds);
+		return ENOMEM;
+	}
+	bzero(di, sizeof(struct sfs_dirindex));
+	sv->sv_dirindex = di;
+
+	for (i=0; i<nentries; i += n) {
+		n = nentries - i;
+		if (n > perblock) {
+			n = perblock;
+		}
+
+		mk_kuio(&ku, sds, n*sizeof(struct sfs_dir), 
+			i*sizeof(struct sfs_dir), UIO_READ);
+		result = sfs_io(sv, &ku);
+		if (result) {
+			goto fail;
+		}
+		if (ku.uio_resid > 0) {
+			panic("sfs: dirindex: Short read (inode %u)\n",
+			      sv->sv_ino);
+		}
+
+		for (j=0; j<n; j++) {
+			if (sds[j].sfd_ino == SFS_NOINO) {
+				result = sfs_dirindex_pushfree(di, i+j);
+			}
+			else {
+				/* Ensure null termination, just in case */
+				sds[j].sfd_name[sizeof(sds[j].sfd_name)-1] = 0;
+
+				/* Each name may legally appear only once... */
+				assert(sfs_dirindex_find(di, 
+						 sds[j].sfd_name) == NULL);
+
+				result = sfs_dirindex_addname(di, 
+					      sds[j].sfd_name, 
+					      sds[j].sfd_ino, i+j);
+			}
+			if (result) {
+				goto fail;
+			}
+		}
+	}
+
+	sfs_ndirbuilds++;
+	kfree(sds);
+	return 0;
+
+ fail:
+	sfs_dirindex_destroy(sv);
+	kfree(sds);
+	return result;
+}
+
+/*
+ * Search a directory for a particular filename in a directory, and
+ * return its inode number, its slot, and/or the slot number of an
+ * empty directory slot if one is found.
+ */
+static
+int
+sfs_dir_findname(struct sfs_vnode *sv, const char *name,
+		 u_int32_t *ino, int *slot, int *emptyslot)
+{
+	struct sfs_dirindex *di;
+	struct sfs_dirname *dn;
+	int result;
+
+	if (sv->sv_dirindex == NULL) {
+		result = sfs_dirindex_build(sv);
+		if (result == ENOMEM) {
+			/* Do it the slow way */
+			return sfs_dir_scanname(sv, name, ino, slot, emptyslot);
+		}
+		if (result) {
+			return result;
+		}
+	}
+	di = sv->sv_dirindex;
+	sfs_ndirlookups++;
+
+	if (emptyslot != NULL && di->di_nfree > 0) {
+		*emptyslot = di->di_freeslots[di->di_nfree-1];
+	}
+
+	dn = sfs_dirindex_find(di, name);
+	if (dn == NULL) {
+		return ENOENT;
+	}
+	if (slot != NULL) {
+		*slot = dn->dn_slot;
+	}
+	if (ino != NULL) {
+		*ino = dn->dn_ino;
+	}
+	return 0;
+}
+
 /*
  * Create a link in a directory to the specified inode by number, with
  * the specified name, and optionally hand back the slot.
@@ -666,6 +1138,7 @@ int
 sfs_dir_link(struct sfs_vnode *sv, const char *name, u_int32_t ino, int *slot)
 {
 	int emptyslot = -1;
+	int reused;
 	int result;
 	struct sfs_dir sd;
 
@@ -683,7 +1156,8 @@ sfs_dir_link(struct sfs_vnode *sv, const char *name, u_int32_t ino, int *slot)
 	}
 
 	/* If we didn't get an empty slot, add the entry at the end. */
-	if (emptyslot < 0) {
+	reused = (emptyslot >= 0);
+	if (!reused) {
 		emptyslot = sfs_dir_nentries(sv);
 	}
 
@@ -698,25 +1172,55 @@ sfs_dir_link(struct sfs_vnode *sv, const char *name, u_int32_t ino, int *slot)
 	}
 
 	/* Write the entry. */
-	return sfs_writedir(sv, &sd, emptyslot);
-	
+	result = sfs_writedir(sv, &sd, emptyslot);
+	if (result) {
+		return result;
+	}
+
+	/* Update the name index, if there is one. */
+	if (sv->sv_dirindex != NULL) {
+		if (reused) {
+			sfs_dirindex_removefree(sv->sv_dirindex, emptyslot);
+		}
+		if (sfs_dirindex_addname(sv->sv_dirindex, name, ino, 
+					 emptyslot)) {
+			sfs_dirindex_destroy(sv);
+		}
+	}
+
+	return 0;
 }
 
 /*
- * Unlink a name in a directory, by slot number.
+ * Unlink a name in a directory, by slot number. The name is needed
+ * to keep the name index up to date.
  */
 static
 int
-sfs_dir_unlink(struct sfs_vnode *sv, int slot)
+sfs_dir_unlink(struct sfs_vnode *sv, const char *name, int slot)
 {
 	struct sfs_dir sd;
+	int result;
 
 	/* Initialize a suitable directory entry... */ 
 	bzero(&sd, sizeof(sd));
 	sd.sfd_ino = SFS_NOINO;
 
 	/* ... and write it */
-	return sfs_writedir(sv, &sd, slot);
+	result = sfs_writedir(sv, &sd, slot);
+	if (result) {
+		return result;
+	}
+
+	/* Update the name index, if there is one. */
+	if (sv->sv_dirindex != NULL) {
+		sfs_dirindex_removename(sv->sv_dirindex, name, slot);
+		if (sfs_dirindex_pushfree(sv->sv_dirindex, slot)) {
+			sfs_dirindex_destroy(sv);
+		}
+	}
+
+	return 0;
 }
 
 /*
@@ -756,11 +1260,13 @@ sfs_lookonce(struct sfs_vnode *sv, const char *name,
 // Object creation
 
 /*
- * Create a new filesystem object and hand back its vnode.
+ * Create a new filesystem object in directory DIR and hand back its
+ * vnode.
  */
 static
 int
-sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
+sfs_makeobj(struct sfs_fs *sfs, struct sfs_vnode *dir, int type,
+	    struct sfs_vnode **ret)
 {
 	u_int32_t ino;
 	int result;
@@ -770,7 +1276,7 @@ sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
 	 * number is the block number, so just get a block.)
 	 */
 
-	result = sfs_balloc(sfs, &ino);
+	result = sfs_balloc(sfs, sfs_inodegoal(sfs, dir), &ino);
 	if (result) {
 		return result;
 	}
@@ -844,8 +1350,12 @@ static
 int
 sfs_close(struct vnode *v)
 {
-	/* Sync it. */
-	return VOP_FSYNC(v);
+	/*
+	 * Don't sync it; the syncer thread will write back whatever
+	 * changed soon enough, and callers that care use fsync.
+	 */
+	(void)v;
+	return 0;
 }
 
 /*
@@ -859,13 +1369,15 @@ sfs_reclaim(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = v->vn_fs->fs_data;
-	int ix, i, num, result;
+	int result;
 
 	/*
 	 * Make sure someone else hasn't picked up the vnode since the
 	 * decision was made to reclaim it. (You must also synchronize
-	 * this with sfs_loadvnode.)
+	 * this with sfs_loadvnode, which is what sfs_vnlock is for.)
 	 */
+	sfs_jbegin(sfs);
+	lock_acquire(sfs->sfs_vnlock);
 	lock_acquire(v->vn_countlock);
 	if (v->vn_refcount != 1) {
 
@@ -874,6 +1386,8 @@ sfs_reclaim(struct vnode *v)
 		v->vn_refcount--;
 
 		lock_release(v->vn_countlock);
+		lock_release(sfs->sfs_vnlock);
+		sfs_jend(sfs);
 		return EBUSY;
 	}
 	lock_release(v->vn_countlock);
@@ -881,8 +1395,10 @@ sfs_reclaim(struct vnode *v)
 
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount==0) {
-		result = VOP_TRUNCATE(&sv->sv_v, 0);
+		result = sfs_dotruncate(&sv->sv_v, 0);
 		if (result) {
+			lock_release(sfs->sfs_vnlock);
+			sfs_jend(sfs);
 			return result;
 		}
 	}
@@ -890,6 +1406,8 @@ sfs_reclaim(struct vnode *v)
 	/* Sync the inode to disk */
 	result = sfs_sync_inode(sv);
 	if (result) {
+		lock_release(sfs->sfs_vnlock);
+		sfs_jend(sfs);
 		return result;
 	}
 
@@ -898,21 +1416,20 @@ sfs_reclaim(struct vnode *v)
 		sfs_bfree(sfs, sv->sv_ino);
 	}
 
+	/* Drop the name index, if it's a directory that has one */
+	sfs_dirindex_destroy(sv);
+
 	/* Remove the vnode structure from the table in the struct sfs_fs. */
-	ix = -1;
-	num = array_getnum(sfs->sfs_vnodes);
-	for (i=0; i<num; i++) {
-		struct sfs_vnode *sv2 = array_getguy(sfs->sfs_vnodes, i);
-		if (sv2==sv) {
-			ix = i;
-			break;
-		}
-	}
-	if (ix<0) {
+	if (sfs_vnhash_find(sfs, sv->sv_ino) != sv) {
 		panic("sfs: reclaim vnode %u not in vnode pool\n",
 		      sv->sv_ino);
 	}
-	array_remove(sfs->sfs_vnodes, ix);
+	sfs_vnhash_remove(sfs, sv);
+	lock_release(sfs->sfs_vnlock);
+	sfs_jend(sfs);
+
+	/* Drop its cached pages, before the memory is reused */
+	vfs_pcache_invalidate(&sv->sv_v);
 
 	VOP_KILL(&sv->sv_v);
 
@@ -924,15 +1441,49 @@ sfs_reclaim(struct vnode *v)
 }
 
 /*
- * Called for read(). sfs_io() does the work.
+ * Read one page of a file for the page cache. sfs_io() does the work.
+ */
+static
+int
+sfs_fillpage(struct vnode *v, void *page, off_t offset, u_int32_t *len)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	struct uio ku;
+	int result;
+
+	mk_kuio(&ku, page, PAGE_SIZE, offset, UIO_READ);
+	result = sfs_io(sv, &ku);
+	*len = PAGE_SIZE - ku.uio_resid;
+	return result;
+}
+
+/*
+ * Called for read(). Small or unaligned reads go through the page
+ * cache, which calls sfs_fillpage for the pages it doesn't have.
+ * Block-aligned reads of a block or more go straight to sfs_io,
+ * which moves whole blocks directly between the disk and the
+ * caller's buffer; through the cache they'd be copied once more.
+ * (The cache is write-through, so either way sees the same data.)
  */
 static
 int
 sfs_read(struct vnode *v, struct uio *uio)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	size_t oldresid = uio->uio_resid;
+	int result;
+
 	assert(uio->uio_rw==UIO_READ);
-	return sfs_io(sv, uio);
+
+	if (uio->uio_offset % SFS_BLOCKSIZE == 0 &&
+	    uio->uio_resid >= SFS_BLOCKSIZE) {
+		result = sfs_io(sv, uio);
+	}
+	else {
+		result = vfs_pcache_read(v, uio, sfs_fillpage);
+	}
+	dev_countdelivered(oldresid - uio->uio_resid);
+	return result;
 }
 
 /*
@@ -943,8 +1494,21 @@ int
 sfs_write(struct vnode *v, struct uio *uio)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
+	size_t oldresid = uio->uio_resid;
+	int result;
+
 	assert(uio->uio_rw==UIO_WRITE);
-	return sfs_io(sv, uio);
+
+	sfs_jbegin(sfs);
+	result = sfs_io(sv, uio);
+	sfs_jend(sfs);
+
+	/* The page cache is write-through; drop what we changed */
+	vfs_pcache_invalidate(v);
+	dev_countdelivered(oldresid - uio->uio_resid);
+
+	return result;
 }
 
 /*
@@ -1043,6 +1607,18 @@ int
 sfs_fsync(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
+	int result;
+
+	/* Write back this file's blocks, then its inode */
+	result = sfs_bflush(sfs, sv->sv_ino, 0);
+	if (result) {
+		return result;
+	}
+	if (sfs->sfs_jblocks > 0) {
+		/* Metadata only gets to disk through the journal */
+		return sfs_jsync(sfs);
+	}
 	return sfs_sync_inode(sv);
 }
 
@@ -1058,23 +1634,17 @@ sfs_mmap(struct vnode *v   /* add stuff as needed */)
 }
 
 /*
- * Called for ftruncate() and from sfs_reclaim.
+ * Truncate a file; the work for sfs_truncate and sfs_reclaim. The
+ * caller brackets it with sfs_jbegin/sfs_jend.
  */
 static
 int
-sfs_truncate(struct vnode *v, off_t len)
+sfs_dotruncate(struct vnode *v, off_t len)
 {
-	/*
-	 * I/O buffer for handling the indirect block.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static u_int32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = sv->sv_v.vn_fs->fs_data;
+	struct sfs_buf *idbuf;
+	u_int32_t *ids;
 
 	/* Length in blocks (divide rounding up) */
 	u_int32_t blocklen = DIVROUNDUP(len, SFS_BLOCKSIZE);
@@ -1084,8 +1654,6 @@ sfs_truncate(struct vnode *v, off_t len)
 	int result;
 	int hasnonzero, iddirty;
 
-	assert(sizeof(idbuf)==SFS_BLOCKSIZE);
-
 	/*
 	 * Go through the direct blocks. Discard any that are
 	 * past the limit we're truncating to.
@@ -1112,39 +1680,38 @@ sfs_truncate(struct vnode *v, off_t len)
 		/* We're past the proposed EOF; may need to free stuff */
 
 		/* Read the indirect block */
-		result = sfs_rblock(sfs, idbuf, idblock);
+		result = sfs_bread(sfs, idblock, &idbuf);
 		if (result) {
 			return result;
 		}
+		ids = idbuf->b_data;
 		
 		hasnonzero = 0;
 		iddirty = 0;
 		for (j=0; j<SFS_DBPERIDB; j++) {
 			/* Discard any blocks that are past the new EOF */
-			if (blocklen < baseblock+j && idbuf[j] != 0) {
-				sfs_bfree(sfs, idbuf[j]);
-				idbuf[j] = 0;
+			if (blocklen < baseblock+j && ids[j] != 0) {
+				sfs_bfree(sfs, ids[j]);
+				ids[j] = 0;
 				iddirty = 1;
 			}
 			/* Remember if we see any nonzero blocks in here */
-			if (idbuf[j]!=0) {
+			if (ids[j]!=0) {
 				hasnonzero=1;
 			}
 		}
 
+		if (iddirty) {
+			sfs_bdirty(sfs, idbuf, sv->sv_ino, 1);
+		}
+		sfs_brelse(sfs, idbuf);
+
 		if (!hasnonzero) {
 			/* The whole indirect block is empty now; free it */
 			sfs_bfree(sfs, idblock);
 			sv->sv_i.sfi_indirect = 0;
 			sv->sv_dirty = 1;
 		}
-		else if (iddirty) {
-			/* The indirect block is dirty; write it back */
-			result = sfs_wblock(sfs, idbuf, idblock);
-			if (result) {
-				return result;
-			}
-		}
 	}
 
 	/* Set the file size */
@@ -1156,6 +1723,25 @@ sfs_truncate(struct vnode *v, off_t len)
 	return 0;
 }
 
+/*
+ * Called for ftruncate().
+ */
+static
+int
+sfs_truncate(struct vnode *v, off_t len)
+{
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
+	int result;
+
+	sfs_jbegin(sfs);
+	result = sfs_dotruncate(v, len);
+	sfs_jend(sfs);
+
+	vfs_pcache_invalidate(v);
+
+	return result;
+}
+
 /*
  * Get the full pathname for a file. This only needs to work on directories.
  * Since we don't support subdirectories, assume it's the root directory
@@ -1190,20 +1776,25 @@ sfs_creat(struct vnode *v, const char *name, int excl, struct vnode **ret)
 	u_int32_t ino;
 	int result;
 
+	sfs_jbegin(sfs);
+
 	/* Look up the name */
 	result = sfs_dir_findname(sv, name, &ino, NULL, NULL);
 	if (result!=0 && result!=ENOENT) {
+		sfs_jend(sfs);
 		return result;
 	}
 
 	/* If it exists and we didn't want it to, fail */
 	if (result==0 && excl) {
+		sfs_jend(sfs);
 		return EEXIST;
 	}
 
 	if (result==0) {
 		/* We got a file; load its vnode and return */
 		result = sfs_loadvnode(sfs, ino, SFS_TYPE_INVAL, &newguy);
+		sfs_jend(sfs);
 		if (result) {
 			return result;
 		}
@@ -1212,14 +1803,17 @@ sfs_creat(struct vnode *v, const char *name, int excl, struct vnode **ret)
 	}
 
 	/* Didn't exist - create it */
-	result = sfs_makeobj(sfs, SFS_TYPE_FILE, &newguy);
+	result = sfs_makeobj(sfs, sv, SFS_TYPE_FILE, &newguy);
 	if (result) {
+		sfs_jend(sfs);
 		return result;
 	}
 
 	/* Link it into the directory */
 	result = sfs_dir_link(sv, name, newguy->sv_ino, NULL);
 	if (result) {
+		/* End the operation first; reclaim starts its own */
+		sfs_jend(sfs);
 		VOP_DECREF(&newguy->sv_v);
 		return result;
 	}
@@ -1230,6 +1824,8 @@ sfs_creat(struct vnode *v, const char *name, int excl, struct vnode **ret)
 	/* and consequently mark it dirty. */
 	newguy->sv_dirty = 1;
 
+	sfs_jend(sfs);
+
 	*ret = &newguy->sv_v;
 	
 	return 0;
@@ -1244,15 +1840,19 @@ static
 int
 sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 {
+	struct sfs_fs *sfs = dir->vn_fs->fs_data;
 	struct sfs_vnode *sv = dir->vn_data;
 	struct sfs_vnode *f = file->vn_data;
 	int result;
 
 	assert(file->vn_fs == dir->vn_fs);
 
+	sfs_jbegin(sfs);
+
 	/* Just create a link */
 	result = sfs_dir_link(sv, name, f->sv_ino, NULL);
 	if (result) {
+		sfs_jend(sfs);
 		return result;
 	}
 
@@ -1260,6 +1860,7 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 	f->sv_i.sfi_linkcount++;
 	f->sv_dirty = 1;
 
+	sfs_jend(sfs);
 	return 0;
 }
 
@@ -1270,19 +1871,23 @@ static
 int
 sfs_remove(struct vnode *dir, const char *name)
 {
+	struct sfs_fs *sfs = dir->vn_fs->fs_data;
 	struct sfs_vnode *sv = dir->vn_data;
 	struct sfs_vnode *victim;
 	int slot;
 	int result;
 
+	sfs_jbegin(sfs);
+
 	/* Look for the file and fetch a vnode for it. */
 	result = sfs_lookonce(sv, name, &victim, &slot);
 	if (result) {
+		sfs_jend(sfs);
 		return result;
 	}
 
 	/* Erase its directory entry. */
-	result = sfs_dir_unlink(sv, slot);
+	result = sfs_dir_unlink(sv, name, slot);
 	if (result==0) {
 		/* If we succeeded, decrement the link count. */
 		assert(victim->sv_i.sfi_linkcount > 0);
@@ -1290,6 +1895,9 @@ sfs_remove(struct vnode *dir, const char *name)
 		victim->sv_dirty = 1;
 	}
 
+	/* End the operation first; reclaim, if it happens, starts its own */
+	sfs_jend(sfs);
+
 	/* Discard the reference that sfs_lookonce got us */
 	VOP_DECREF(&victim->sv_v);
 
@@ -1307,6 +1915,7 @@ int
 sfs_rename(struct vnode *d1, const char *n1, 
 	   struct vnode *d2, const char *n2)
 {
+	struct sfs_fs *sfs = d1->vn_fs->fs_data;
 	struct sfs_vnode *sv = d1->vn_data;
 	struct sfs_vnode *g1;
 	int slot1, slot2;
@@ -1315,9 +1924,12 @@ sfs_rename(struct vnode *d1, const char *n1,
 	assert(d1==d2);
 	assert(sv->sv_ino == SFS_ROOT_LOCATION);
 
+	sfs_jbegin(sfs);
+
 	/* Look up the old name of the file and get its inode and slot number*/
 	result = sfs_lookonce(sv, n1, &g1, &slot1);
 	if (result) {
+		sfs_jend(sfs);
 		return result;
 	}
 
@@ -1342,7 +1954,7 @@ sfs_rename(struct vnode *d1, const char *n1,
 	g1->sv_dirty = 1;
 
 	/* Unlink the old slot */
-	result = sfs_dir_unlink(sv, slot1);
+	result = sfs_dir_unlink(sv, n1, slot1);
 	if (result) {
 		goto puke_harder;
 	}
@@ -1355,6 +1967,8 @@ sfs_rename(struct vnode *d1, const char *n1,
 	g1->sv_i.sfi_linkcount--;
 	g1->sv_dirty = 1;
 
+	sfs_jend(sfs);
+
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_v);
 
@@ -1364,7 +1978,7 @@ sfs_rename(struct vnode *d1, const char *n1,
 	/*
 	 * Error recovery: try to undo what we already did
 	 */
-	result2 = sfs_dir_unlink(sv, slot2);
+	result2 = sfs_dir_unlink(sv, n2, slot2);
 	if (result2) {
 		kprintf("sfs: rename: %s\n", strerror(result));
 		kprintf("sfs: rename: while cleaning up: %s\n", 
@@ -1373,6 +1987,8 @@ sfs_rename(struct vnode *d1, const char *n1,
 	}
 	g1->sv_i.sfi_linkcount--;
  puke:
+	sfs_jend(sfs);
+
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_v);
 	return result;
@@ -1548,39 +2164,35 @@ sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int forcetype,
 		 struct sfs_vnode **ret)
 {
 	struct sfs_vnode *sv;
+	struct sfs_buf *buf;
 	const struct vnode_ops *ops = NULL;
-	int i, num;
 	int result;
 
-	/* Look in the vnodes table */
-	num = array_getnum(sfs->sfs_vnodes);
-
-	/* Linear search. Is this too slow? You decide. */
-	for (i=0; i<num; i++) {
-		sv = array_getguy(sfs->sfs_vnodes, i);
+	lock_acquire(sfs->sfs_vnlock);
 
+	/* Look in the vnodes table */
+	sv = sfs_vnhash_find(sfs, ino);
+	if (sv != NULL) {
 		/* Every inode in memory must be in an allocated block */
 		if (!sfs_bused(sfs, sv->sv_ino)) {
 			panic("sfs: Found inode %u in unallocated block\n",
 			      sv->sv_ino);
 		}
 
-		if (sv->sv_ino==ino) {
-			/* Found */
+		/* May only be set when creating new objects */
+		assert(forcetype==SFS_TYPE_INVAL);
 
-			/* May only be set when creating new objects */
-			assert(forcetype==SFS_TYPE_INVAL);
-
-			VOP_INCREF(&sv->sv_v);
-			*ret = sv;
-			return 0;
-		}
+		VOP_INCREF(&sv->sv_v);
+		lock_release(sfs->sfs_vnlock);
+		*ret = sv;
+		return 0;
 	}
 
 	/* Didn't have it loaded; load it */
 
 	sv = kmalloc(sizeof(struct sfs_vnode));
 	if (sv==NULL) {
+		lock_release(sfs->sfs_vnlock);
 		return ENOMEM;
 	}
 
@@ -1590,26 +2202,37 @@ sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int forcetype,
 		      ino);
 	}
 
-	/* Read the block the inode is in */
-	result = sfs_rblock(sfs, &sv->sv_i, ino);
-	if (result) {
-		kfree(sv);
-		return result;
-	}
-
 	/* Not dirty yet */
 	sv->sv_dirty = 0;
+	sv->sv_dirtysince = 0;
+
+	/* No name index until the first lookup */
+	sv->sv_dirindex = NULL;
 
 	/*
-	 * FORCETYPE is set if we're creating a new file, because the
-	 * block on disk will have been zeroed out and thus the type
-	 * recorded there will be SFS_TYPE_INVAL.
+	 * FORCETYPE is set if we're creating a new file. The block
+	 * was just allocated and nothing on disk is worth reading;
+	 * start from an empty inode of that type.
 	 */
 	if (forcetype != SFS_TYPE_INVAL) {
-		assert(sv->sv_i.sfi_type == SFS_TYPE_INVAL);
+		bzero(&sv->sv_i, sizeof(sv->sv_i));
 		sv->sv_i.sfi_type = forcetype;
 		sv->sv_dirty = 1;
 	}
+	else if ((buf = sfs_bpeek(sfs, ino)) != NULL) {
+		/* A newer copy is waiting in the buffer cache */
+		memcpy(&sv->sv_i, buf->b_data, sizeof(sv->sv_i));
+		sfs_brelse(sfs, buf);
+	}
+	else {
+		/* Read the block the inode is in */
+		result = sfs_rblock(sfs, &sv->sv_i, ino);
+		if (result) {
+			kfree(sv);
+			lock_release(sfs->sfs_vnlock);
+			return result;
+		}
+	}
 
 	/*
 	 * Choose the function table based on the object type.
@@ -1631,6 +2254,7 @@ sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int forcetype,
 	result = VOP_INIT(&sv->sv_v, ops, &sfs->sfs_absfs, sv);
 	if (result) {
 		kfree(sv);
+		lock_release(sfs->sfs_vnlock);
 		return result;
 	}
 
@@ -1638,12 +2262,8 @@ sfs_loadvnode(struct sfs_fs *sfs, u_int32_t ino, int forcetype,
 	sv->sv_ino = ino;
 
 	/* Add it to our table */
-	result = array_add(sfs->sfs_vnodes, sv);
-	if (result) {
-		VOP_KILL(&sv->sv_v);
-		kfree(sv);
-		return result;
-	}
+	sfs_vnhash_add(sfs, sv);
+	lock_release(sfs->sfs_vnlock);
 
 	/* Hand it back */
 	*ret = sv;
@@ -1668,3 +2288,68 @@ sfs_getroot(struct fs *fs)
 
 	return &sv->sv_v;
 }
+
+/*
+ * Write back the inodes of loaded vnodes. With MINAGE of 0, write
+ * back every dirty inode; otherwise only those the syncer has seen
+ * dirty for at least MINAGE seconds. (Inodes get marked dirty in too
+ * many places to timestamp each one, so the age is measured from the
+ * first pass of the syncer that noticed.)
+ */
+int
+sfs_syncvnodes(struct sfs_fs *sfs, int minage)
+{
+	struct sfs_vnode *sv;
+	time_t now;
+	u_int32_t nsecs, i;
+	int result, err = 0;
+
+	gettime(&now, &nsecs);
+
+	lock_acquire(sfs->sfs_vnlock);
+	for (i=0; i<SFS_VNHASHSIZE; i++) {
+		for (sv = sfs->sfs_vnhash[i]; sv != NULL; sv = sv->sv_hashnext) {
+			if (!sv->sv_dirty) {
+				continue;
+			}
+			if (minage > 0) {
+				if (sv->sv_dirtysince == 0) {
+					sv->sv_dirtysince = now;
+					continue;
+				}
+				if (now - sv->sv_dirtysince < minage) {
+					continue;
+				}
+			}
+			result = sfs_sync_inode(sv);
+			if (result && err == 0) {
+				err = result;
+			}
+		}
+	}
+	lock_release(sfs->sfs_vnlock);
+
+	return err;
+}
+
+/*
+ * Print allocation, vnode table, directory index, and buffer cache
+ * statistics.
+ */
+void
+sfs_printstats(void)
+{
+	kprintf("sfs: %u blocks allocated, %u freed\n",
+		sfs_nballoc, sfs_nbfree);
+	if (sfs_nballoc > 0) {
+		kprintf("sfs: %u allocations (%u%%) contiguous with goal\n",
+			sfs_nballoc_ongoal,
+			(sfs_nballoc_ongoal * 100) / sfs_nballoc);
+	}
+	kprintf("sfs: %u vnode table lookups, %u probes\n",
+		sfs_nvnlookups, sfs_nvnprobes);
+	kprintf("sfs: %u directory index builds, %u indexed lookups\n",
+		sfs_ndirbuilds, sfs_ndirlookups);
+	sfs_printbufstats();
+	sfs_printjournalstats();
+}
@@ -13,6 +13,8 @@
 #include <vnode.h>
 #include <uio.h>
 #include <dev.h>
+#include <thread.h>
+#include <machine/spl.h>
 
 /*
  * Called for each open().
@@ -413,3 +415,92 @@ dev_create_vnode(struct device *dev)
 
 	return v;
 }
+
+/*
+ * Completion callback for dev_doio: wake up the waiting thread.
+ */
+static
+void
+dev_iodone(struct devreq *req)
+{
+	int *done = req->dr_data;
+
+	*done = 1;
+	thread_wakeup(req);
+}
+
+/*
+ * Submit an asynchronous request and wait for it to finish.
+ */
+int
+dev_doio(struct device *d, struct devreq *req)
+{
+	int done = 0;
+	int spl, result;
+
+	assert(d->d_submit != NULL);
+
+	req->dr_done = dev_iodone;
+	req->dr_data = &done;
+
+	/* Stay at splhigh so the completion can't get in before we sleep */
+	spl = splhigh();
+	result = d->d_submit(d, req);
+	if (result == 0) {
+		while (!done) {
+			thread_sleep(req);
+		}
+		result = req->dr_result;
+	}
+	splx(spl);
+
+	return result;
+}
+
+/*
+ * Copy accounting.
+ */
+
+static u_int32_t dev_ncopied;
+static u_int32_t dev_ndelivered;
+
+void
+dev_countcopy(u_int32_t bytes)
+{
+	int spl;
+
+	spl = splhigh();
+	dev_ncopied += bytes;
+	splx(spl);
+}
+
+void
+dev_countdelivered(u_int32_t bytes)
+{
+	int spl;
+
+	spl = splhigh();
+	dev_ndelivered += bytes;
+	splx(spl);
+}
+
+void
+dev_printcopystats(void)
+{
+	u_int32_t hundredths;
+
+	kprintf("dev: %u bytes delivered, %u bytes copied", dev_ndelivered,
+		dev_ncopied);
+	if (dev_ndelivered > 0) {
+		/* Careful not to overflow */
+		if (dev_ncopied <= 0xffffffff/100) {
+			hundredths = (dev_ncopied*100) / dev_ndelivered;
+		}
+		else {
+			hundredths = dev_ncopied / (dev_ndelivered/100 + 1);
+		}
+		kprintf(" (%u.%02u copies/byte)", hundredths / 100,
+			hundredths % 100);
+	}
+	kprintf("\n");
+}
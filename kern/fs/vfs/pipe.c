@@ -0,0 +1,440 @@
+/*
+ * Pipes.
+ *
+ * A pipe is a buffer with a vnode for each end: what is written to
+ * the write end can be read from the read end. The ends have no
+ * names; they come only from pipe_create.
+ *
+ * When the last open of one end is closed the other end finds out: a
+ * reader gets EOF once the buffer is empty, and a writer gets EPIPE.
+ * The pipe itself is freed when both vnodes have been reclaimed.
+ */
+#include <types.h>
+#include <lib.h>
+#include <synch.h>
+#include <kern/errno.h>
+#include <kern/stat.h>
+#include <vnode.h>
+#include <uio.h>
+#include <vfs.h>
+
+#define PIPE_SIZE  1024     /* bytes a pipe can hold */
+
+struct pipe {
+	struct vnode p_rvn;             /* read end */
+	struct vnode p_wvn;             /* write end */
+	struct lock *p_lock;
+	struct cv *p_cv;                /* data, space, or a close */
+	char *p_buf;
+	u_int32_t p_start;              /* first byte in p_buf */
+	u_int32_t p_len;                /* bytes in p_buf */
+	int p_rclosed;                  /* read end closed */
+	int p_wclosed;                  /* write end closed */
+	int p_nvnodes;                  /* ends not yet reclaimed */
+};
+
+/*
+ * Called on the last close of an end.
+ */
+static
+int
+pipe_close(struct vnode *v)
+{
+	struct pipe *p = v->vn_data;
+
+	lock_acquire(p->p_lock);
+	if (v == &p->p_rvn) {
+		p->p_rclosed = 1;
+	}
+	else {
+		p->p_wclosed = 1;
+	}
+	cv_broadcast(p->p_cv, p->p_lock);
+	lock_release(p->p_lock);
+
+	return 0;
+}
+
+static
+void
+pipe_destroy(struct pipe *p)
+{
+	cv_destroy(p->p_cv);
+	lock_destroy(p->p_lock);
+	kfree(p->p_buf);
+	kfree(p);
+}
+
+/*
+ * Called when an end's refcount reaches zero. The second one to go
+ * frees the pipe.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *p = v->vn_data;
+	int last;
+
+	VOP_KILL(v);
+
+	lock_acquire(p->p_lock);
+	p->p_nvnodes--;
+	last = (p->p_nvnodes == 0);
+	lock_release(p->p_lock);
+
+	if (last) {
+		pipe_destroy(p);
+	}
+	return 0;
+}
+
+/*
+ * Read whatever is in the pipe, up to what was asked for, waiting
+ * if it's empty. Returns with nothing read at EOF.
+ */
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *p = v->vn_data;
+	u_int32_t amt;
+	int result = 0;
+
+	assert(uio->uio_rw == UIO_READ);
+
+	if (v != &p->p_rvn) {
+		return EINVAL;
+	}
+
+	lock_acquire(p->p_lock);
+	while (p->p_len == 0 && !p->p_wclosed) {
+		cv_wait(p->p_cv, p->p_lock);
+	}
+
+	/* The data may wrap around the end of the buffer */
+	while (p->p_len > 0 && uio->uio_resid > 0) {
+		amt = PIPE_SIZE - p->p_start;
+		if (amt > p->p_len) {
+			amt = p->p_len;
+		}
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
+		}
+		result = uiomove(p->p_buf + p->p_start, amt, uio);
+		if (result) {
+			break;
+		}
+		p->p_start = (p->p_start + amt) % PIPE_SIZE;
+		p->p_len -= amt;
+	}
+
+	cv_broadcast(p->p_cv, p->p_lock);
+	lock_release(p->p_lock);
+	return result;
+}
+
+/*
+ * Write everything, waiting for room as needed.
+ */
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *p = v->vn_data;
+	u_int32_t pos, amt;
+	int result = 0;
+
+	assert(uio->uio_rw == UIO_WRITE);
+
+	if (v != &p->p_wvn) {
+		return EINVAL;
+	}
+
+	lock_acquire(p->p_lock);
+	while (uio->uio_resid > 0) {
+		if (p->p_rclosed) {
+			result = EPIPE;
+			break;
+		}
+		if (p->p_len == PIPE_SIZE) {
+			cv_wait(p->p_cv, p->p_lock);
+			continue;
+		}
+
+		/* Fill the free space up to the end of the buffer */
+		pos = (p->p_start + p->p_len) % PIPE_SIZE;
+		amt = PIPE_SIZE - pos;
+		if (amt > PIPE_SIZE - p->p_len) {
+			amt = PIPE_SIZE - p->p_len;
+		}
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
+		}
+		result = uiomove(p->p_buf + pos, amt, uio);
+		if (result) {
+			break;
+		}
+		p->p_len += amt;
+		cv_broadcast(p->p_cv, p->p_lock);
+	}
+	lock_release(p->p_lock);
+
+	return result;
+}
+
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *p = v->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+	statbuf->st_mode = S_IFIFO;
+	statbuf->st_nlink = 1;
+
+	lock_acquire(p->p_lock);
+	statbuf->st_size = p->p_len;
+	lock_release(p->p_lock);
+
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *v, u_int32_t *ret)
+{
+	(void)v;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+int
+pipe_tryseek(struct vnode *v, off_t pos)
+{
+	(void)v;
+	(void)pos;
+	return ESPIPE;
+}
+
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return 0;
+}
+
+/*
+ * Operations that make no sense on a pipe.
+ */
+
+static
+int
+pipe_open(struct vnode *v, int flags)
+{
+	/* Pipes have no names, so this is never reached */
+	(void)v;
+	(void)flags;
+	return EINVAL;
+}
+
+static
+int
+pipe_badio(struct vnode *v, struct uio *uio)
+{
+	(void)v;
+	(void)uio;
+	return EINVAL;
+}
+
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+pipe_mmap(struct vnode *v)
+{
+	(void)v;
+	return EUNIMP;
+}
+
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+static
+int
+pipe_creat(struct vnode *v, const char *name, int excl,
+	   struct vnode **result)
+{
+	(void)v;
+	(void)name;
+	(void)excl;
+	(void)result;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_symlink(struct vnode *v, const char *contents, const char *name)
+{
+	(void)v;
+	(void)contents;
+	(void)name;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_nameop(struct vnode *v, const char *name)
+{
+	(void)v;
+	(void)name;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_link(struct vnode *v, const char *name, struct vnode *file)
+{
+	(void)v;
+	(void)name;
+	(void)file;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_rename(struct vnode *v, const char *n1, struct vnode *v2,
+	    const char *n2)
+{
+	(void)v;
+	(void)n1;
+	(void)v2;
+	(void)n2;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_lookup(struct vnode *v, char *pathname, struct vnode **result)
+{
+	(void)v;
+	(void)pathname;
+	(void)result;
+	return ENOTDIR;
+}
+
+static
+int
+pipe_lookparent(struct vnode *v, char *pathname, struct vnode **result,
+		char *namebuf, size_t buflen)
+{
+	(void)v;
+	(void)pathname;
+	(void)result;
+	(void)namebuf;
+	(void)buflen;
+	return ENOTDIR;
+}
+
+static const struct vnode_ops pipe_vnode_ops = {
+	VOP_MAGIC,
+
+	pipe_open,
+	pipe_close,
+	pipe_reclaim,
+	pipe_read,
+	pipe_badio,     /* readlink */
+	pipe_badio,     /* getdirentry */
+	pipe_write,
+	pipe_ioctl,
+	pipe_stat,
+	pipe_gettype,
+	pipe_tryseek,
+	pipe_fsync,
+	pipe_mmap,
+	pipe_truncate,
+	pipe_badio,     /* namefile */
+	pipe_creat,
+	pipe_symlink,
+	pipe_nameop,    /* mkdir */
+	pipe_link,
+	pipe_nameop,    /* remove */
+	pipe_nameop,    /* rmdir */
+	pipe_rename,
+	pipe_lookup,
+	pipe_lookparent,
+};
+
+/*
+ * Make a pipe. The two ends are handed back open, as if by vfs_open;
+ * close them with vfs_close.
+ */
+int
+pipe_create(struct vnode **readend, struct vnode **writeend)
+{
+	struct pipe *p;
+	int result;
+
+	p = kmalloc(sizeof(struct pipe));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	p->p_buf = kmalloc(PIPE_SIZE);
+	if (p->p_buf == NULL) {
+		kfree(p);
+		return ENOMEM;
+	}
+	p->p_lock = lock_create("pipe");
+	if (p->p_lock == NULL) {
+		kfree(p->p_buf);
+		kfree(p);
+		return ENOMEM;
+	}
+	p->p_cv = cv_create("pipe");
+	if (p->p_cv == NULL) {
+		lock_destroy(p->p_lock);
+		kfree(p->p_buf);
+		kfree(p);
+		return ENOMEM;
+	}
+	p->p_start = 0;
+	p->p_len = 0;
+	p->p_rclosed = 0;
+	p->p_wclosed = 0;
+
+	result = vnode_init(&p->p_rvn, &pipe_vnode_ops, NULL, p);
+	if (result) {
+		pipe_destroy(p);
+		return result;
+	}
+	result = vnode_init(&p->p_wvn, &pipe_vnode_ops, NULL, p);
+	if (result) {
+		VOP_KILL(&p->p_rvn);
+		pipe_destroy(p);
+		return result;
+	}
+	p->p_nvnodes = 2;
+
+	VOP_INCOPEN(&p->p_rvn);
+	VOP_INCOPEN(&p->p_wvn);
+
+	*readend = &p->p_rvn;
+	*writeend = &p->p_wvn;
+	return 0;
+}
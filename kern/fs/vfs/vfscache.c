@@ -0,0 +1,382 @@
+/*
+ * VFS name cache.
+ *
+ * Maps (starting directory vnode, path) to the vnode vfs_lookup
+ * found, or to "no such file" if it failed with ENOENT. Since not all
+ * filesystems resolve paths a component at a time (emufs hands the
+ * whole path to the host), the key is whatever subpath was passed to
+ * VOP_LOOKUP, not a single component.
+ *
+ * Entries hold a reference on both vnodes. There is a fixed pool of
+ * entries, reused in least-recently-used order. Anything that adds or
+ * removes a name in a directory purges the filesystem's entries whose
+ * path has that name as one of its components. Since keys are whole
+ * subpaths from wherever the lookup started, the entry for the
+ * directory and name that changed can't be picked out exactly, but
+ * any path that reached the name has to contain it.
+ *
+ * Each purge bumps a generation number. A lookup that misses hands
+ * back the current generation, and the result of the real lookup is
+ * only entered if no purge happened in between; otherwise a lookup
+ * racing with a remove could cache a name that no longer exists.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <fs.h>
+
+#define NC_SIZE      64         /* number of entries */
+#define NC_HASHSIZE  32         /* number of hash chains */
+#define NC_NAMELEN   VFS_NAMECACHE_NAMELEN
+
+struct nc_entry {
+	struct nc_entry *nc_hashnext;   /* next in hash chain */
+	struct nc_entry *nc_lruprev;    /* more recently used */
+	struct nc_entry *nc_lrunext;    /* less recently used */
+	struct vnode *nc_dir;           /* directory looked up in */
+	struct vnode *nc_vn;            /* result, or NULL if ENOENT */
+	u_int32_t nc_hash;              /* hash of (nc_dir, nc_name) */
+	char nc_name[NC_NAMELEN];       /* path looked up */
+};
+
+static struct nc_entry nc_pool[NC_SIZE];
+static struct nc_entry *nc_hash[NC_HASHSIZE];
+static struct nc_entry *nc_lruhead;     /* most recently used */
+static struct nc_entry *nc_lrutail;     /* least recently used */
+static struct nc_entry *nc_free;        /* unused entries */
+static struct lock *nc_lock;
+static u_int32_t nc_generation;
+
+/* Statistics */
+static u_int32_t nc_hits;
+static u_int32_t nc_neghits;
+static u_int32_t nc_misses;
+static u_int32_t nc_enters;
+static u_int32_t nc_purges;
+
+void
+vfs_namecache_bootstrap(void)
+{
+	int i;
+
+	nc_lock = lock_create("namecache");
+	if (nc_lock == NULL) {
+		panic("vfs: Could not create name cache lock\n");
+	}
+
+	for (i=0; i<NC_SIZE; i++) {
+		nc_pool[i].nc_hashnext = nc_free;
+		nc_free = &nc_pool[i];
+	}
+}
+
+static
+u_int32_t
+nc_hashname(struct vnode *dir, const char *name)
+{
+	u_int32_t hash = (u_int32_t)dir;
+
+	while (*name) {
+		hash = hash*33 + (unsigned char)*name++;
+	}
+	return hash;
+}
+
+static
+void
+nc_lru_remove(struct nc_entry *nc)
+{
+	if (nc->nc_lruprev != NULL) {
+		nc->nc_lruprev->nc_lrunext = nc->nc_lrunext;
+	}
+	else {
+		nc_lruhead = nc->nc_lrunext;
+	}
+	if (nc->nc_lrunext != NULL) {
+		nc->nc_lrunext->nc_lruprev = nc->nc_lruprev;
+	}
+	else {
+		nc_lrutail = nc->nc_lruprev;
+	}
+}
+
+static
+void
+nc_lru_addhead(struct nc_entry *nc)
+{
+	nc->nc_lruprev = NULL;
+	nc->nc_lrunext = nc_lruhead;
+	if (nc_lruhead != NULL) {
+		nc_lruhead->nc_lruprev = nc;
+	}
+	else {
+		nc_lrutail = nc;
+	}
+	nc_lruhead = nc;
+}
+
+/*
+ * Take an entry out of the hash and the LRU list. The caller must
+ * drop its vnode references, without holding nc_lock.
+ */
+static
+void
+nc_unhash(struct nc_entry *nc)
+{
+	struct nc_entry **ncp;
+
+	for (ncp = &nc_hash[nc->nc_hash % NC_HASHSIZE]; *ncp != nc;
+	     ncp = &(*ncp)->nc_hashnext) {
+		assert(*ncp != NULL);
+	}
+	*ncp = nc->nc_hashnext;
+	nc_lru_remove(nc);
+}
+
+static
+struct nc_entry *
+nc_find(struct vnode *dir, const char *name, u_int32_t hash)
+{
+	struct nc_entry *nc;
+
+	for (nc = nc_hash[hash % NC_HASHSIZE]; nc != NULL;
+	     nc = nc->nc_hashnext) {
+		if (nc->nc_hash == hash && nc->nc_dir == dir &&
+		    !strcmp(nc->nc_name, name)) {
+			return nc;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Drop the references held by an entry taken out of the cache, and
+ * put it on the free list.
+ */
+static
+void
+nc_release(struct nc_entry *nc)
+{
+	VOP_DECREF(nc->nc_dir);
+	if (nc->nc_vn != NULL) {
+		VOP_DECREF(nc->nc_vn);
+	}
+
+	lock_acquire(nc_lock);
+	nc->nc_hashnext = nc_free;
+	nc_free = nc;
+	lock_release(nc_lock);
+}
+
+/*
+ * Look up NAME relative to DIR. Returns nonzero if there was an
+ * entry; then *RET is the vnode (with a reference added for the
+ * caller) or NULL for a cached ENOENT. Otherwise *GEN is set for
+ * passing to vfs_namecache_enter.
+ */
+int
+vfs_namecache_lookup(struct vnode *dir, const char *name, struct vnode **ret,
+		     u_int32_t *gen)
+{
+	struct nc_entry *nc;
+	u_int32_t hash;
+
+	*gen = nc_generation;
+	if (strlen(name) >= NC_NAMELEN) {
+		return 0;
+	}
+	hash = nc_hashname(dir, name);
+
+	lock_acquire(nc_lock);
+	nc = nc_find(dir, name, hash);
+	if (nc == NULL) {
+		nc_misses++;
+		*gen = nc_generation;
+		lock_release(nc_lock);
+		return 0;
+	}
+
+	nc_lru_remove(nc);
+	nc_lru_addhead(nc);
+
+	*ret = nc->nc_vn;
+	if (nc->nc_vn != NULL) {
+		VOP_INCREF(nc->nc_vn);
+		nc_hits++;
+	}
+	else {
+		nc_neghits++;
+	}
+	lock_release(nc_lock);
+	return 1;
+}
+
+/*
+ * Record that looking up NAME relative to DIR yields VN (or ENOENT,
+ * if VN is NULL). The cache takes its own references. GEN is what
+ * vfs_namecache_lookup handed back before the lookup was done.
+ */
+void
+vfs_namecache_enter(struct vnode *dir, const char *name, struct vnode *vn,
+		    u_int32_t gen)
+{
+	struct nc_entry *nc;
+	struct vnode *olddir = NULL, *oldvn = NULL;
+	u_int32_t hash;
+
+	if (strlen(name) >= NC_NAMELEN || dir->vn_fs == NULL) {
+		return;
+	}
+	hash = nc_hashname(dir, name);
+
+	lock_acquire(nc_lock);
+
+	if (gen != nc_generation || nc_find(dir, name, hash) != NULL) {
+		/* Purged since the lookup, or someone else got there first */
+		lock_release(nc_lock);
+		return;
+	}
+
+	if (nc_free != NULL) {
+		nc = nc_free;
+		nc_free = nc->nc_hashnext;
+	}
+	else {
+		/* Recycle the least recently used entry */
+		nc = nc_lrutail;
+		assert(nc != NULL);
+		nc_unhash(nc);
+		olddir = nc->nc_dir;
+		oldvn = nc->nc_vn;
+	}
+
+	nc->nc_dir = dir;
+	nc->nc_vn = vn;
+	nc->nc_hash = hash;
+	strcpy(nc->nc_name, name);
+	VOP_INCREF(dir);
+	if (vn != NULL) {
+		VOP_INCREF(vn);
+	}
+
+	nc->nc_hashnext = nc_hash[hash % NC_HASHSIZE];
+	nc_hash[hash % NC_HASHSIZE] = nc;
+	nc_lru_addhead(nc);
+	nc_enters++;
+
+	lock_release(nc_lock);
+
+	/* Drop the recycled entry's references without holding the lock */
+	if (olddir != NULL) {
+		VOP_DECREF(olddir);
+	}
+	if (oldvn != NULL) {
+		VOP_DECREF(oldvn);
+	}
+}
+
+/*
+ * Throw away every entry for filesystem FS, or every entry at all if
+ * FS is NULL.
+ */
+void
+vfs_namecache_purge(struct fs *fs)
+{
+	struct nc_entry *nc, *next, *dead = NULL;
+
+	lock_acquire(nc_lock);
+	nc_generation++;
+	for (nc = nc_lruhead; nc != NULL; nc = next) {
+		next = nc->nc_lrunext;
+		if (fs == NULL || nc->nc_dir->vn_fs == fs) {
+			nc_unhash(nc);
+			nc->nc_hashnext = dead;
+			dead = nc;
+		}
+	}
+	if (dead != NULL) {
+		nc_purges++;
+	}
+	lock_release(nc_lock);
+
+	/* Release the references without holding the lock */
+	while (dead != NULL) {
+		nc = dead;
+		dead = nc->nc_hashnext;
+		nc_release(nc);
+	}
+}
+
+/*
+ * Nonzero if NAME is one of the slash-separated components of PATH.
+ */
+static
+int
+nc_hascomponent(const char *path, const char *name)
+{
+	const char *n;
+
+	for (;;) {
+		for (n = name; *n != 0 && *path == *n; n++, path++);
+		if (*n == 0 && (*path == '/' || *path == 0)) {
+			return 1;
+		}
+		path = strchr(path, '/');
+		if (path == NULL) {
+			return 0;
+		}
+		path++;
+	}
+}
+
+/*
+ * Throw away the entries for filesystem FS whose path goes through
+ * or ends at a directory entry called NAME, because that entry has
+ * been created, removed, or renamed.
+ */
+void
+vfs_namecache_purgename(struct fs *fs, const char *name)
+{
+	struct nc_entry *nc, *next, *dead = NULL;
+
+	lock_acquire(nc_lock);
+	nc_generation++;
+	for (nc = nc_lruhead; nc != NULL; nc = next) {
+		next = nc->nc_lrunext;
+		if (nc->nc_dir->vn_fs == fs &&
+		    nc_hascomponent(nc->nc_name, name)) {
+			nc_unhash(nc);
+			nc->nc_hashnext = dead;
+			dead = nc;
+		}
+	}
+	if (dead != NULL) {
+		nc_purges++;
+	}
+	lock_release(nc_lock);
+
+	while (dead != NULL) {
+		nc = dead;
+		dead = nc->nc_hashnext;
+		nc_release(nc);
+	}
+}
+
+void
+vfs_namecache_printstats(void)
+{
+	u_int32_t total = nc_hits + nc_neghits + nc_misses;
+
+	kprintf("namecache: %u lookups: %u hits, %u negative hits, "
+		"%u misses\n", total, nc_hits, nc_neghits, nc_misses);
+	if (total > 0) {
+		kprintf("namecache: hit rate %u%%\n",
+			((nc_hits + nc_neghits) * 100) / total);
+	}
+	kprintf("namecache: %u entries made, %u purges\n", 
+		nc_enters, nc_purges);
+}
@@ -70,6 +70,8 @@ vfs_bootstrap(void)
 	}
 
 	vfs_initbootfs();
+	vfs_namecache_bootstrap();
+	vfs_pcache_bootstrap();
 	devnull_create();
 }
 
@@ -429,6 +431,24 @@ findmount(const char *devname, struct knowndev **result)
 	return found ? 0 : ENODEV;
 }
 
+/*
+ * Hand back the device structure for the mountable device DEVNAME.
+ */
+int
+vfs_getdevice(const char *devname, struct device **result)
+{
+	struct knowndev *kd;
+	int err;
+
+	lock_acquire(knowndevs_lock);
+	err = findmount(devname, &kd);
+	if (err == 0) {
+		*result = kd->kd_device;
+	}
+	lock_release(knowndevs_lock);
+	return err;
+}
+
 /*
  * Mount a filesystem. Once we've found the device, call MOUNTFUNC to
  * set up the filesystem and hand back a struct fs. This is done with
@@ -505,6 +525,9 @@ vfs_unmount(const char *devname)
 	assert(kd->kd_rawname != NULL);
 	assert(kd->kd_device != NULL);
 
+	/* Cached names hold vnodes, which would keep the fs busy */
+	vfs_namecache_purge(kd->kd_fs);
+
 	result = FSOP_SYNC(kd->kd_fs);
 	if (result) {
 		goto puke;
@@ -552,6 +575,8 @@ vfs_unmountall(void)
 
 		kprintf("vfs: Unmounting %s:\n", dev->kd_name);
 
+		vfs_namecache_purge(dev->kd_fs);
+
 		result = FSOP_SYNC(dev->kd_fs);
 		if (result) {
 			kprintf("vfs: Warning: sync failed for %s: %s, trying "
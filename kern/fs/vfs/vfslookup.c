@@ -237,6 +237,8 @@ int
 vfs_lookup(char *path, struct vnode **retval)
 {
 	struct vnode *startvn;
+	char key[VFS_NAMECACHE_NAMELEN];
+	u_int32_t gen;
 	int result;
 
 	result = getdevice(path, &path, &startvn);
@@ -249,8 +251,25 @@ vfs_lookup(char *path, struct vnode **retval)
 		return 0;
 	}
 
+	/* Try the name cache first. */
+	if (vfs_namecache_lookup(startvn, path, retval, &gen)) {
+		VOP_DECREF(startvn);
+		return (*retval == NULL) ? ENOENT : 0;
+	}
+
+	/* VOP_LOOKUP may destroy the path, so save it for the cache. */
+	key[0] = 0;
+	if (strlen(path) < sizeof(key)) {
+		strcpy(key, path);
+	}
+
 	result = VOP_LOOKUP(startvn, path, retval);
 
+	if (key[0] != 0 && (result == 0 || result == ENOENT)) {
+		vfs_namecache_enter(startvn, key,
+				    result ? NULL : *retval, gen);
+	}
+
 	VOP_DECREF(startvn);
 	return result;
 }
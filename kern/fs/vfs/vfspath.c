@@ -46,6 +46,11 @@ vfs_open(char *path, int openflags, struct vnode **ret)
 
 		result = VOP_CREAT(dir, name, excl, &vn);
 
+		/* The name may not have existed before */
+		if (result == 0) {
+			vfs_namecache_purgename(dir->vn_fs, name);
+		}
+
 		VOP_DECREF(dir);
 	}
 	else {
@@ -121,6 +126,9 @@ vfs_remove(char *path)
 	}
 
 	result = VOP_REMOVE(dir, name);
+	if (result == 0) {
+		vfs_namecache_purgename(dir->vn_fs, name);
+	}
 	VOP_DECREF(dir);
 
 	return result;
@@ -155,6 +163,10 @@ vfs_rename(char *oldpath, char *newpath)
 
 	result = VOP_RENAME(olddir, oldname, newdir, newname);
 
+	/* Even a failed rename may have got partway */
+	vfs_namecache_purgename(olddir->vn_fs, oldname);
+	vfs_namecache_purgename(newdir->vn_fs, newname);
+
 	VOP_DECREF(newdir);
 	VOP_DECREF(olddir);
 
@@ -188,6 +200,9 @@ vfs_link(char *oldpath, char *newpath)
 	}
 
 	result = VOP_LINK(newdir, newname, oldfile);
+	if (result == 0) {
+		vfs_namecache_purgename(newdir->vn_fs, newname);
+	}
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(oldfile);
@@ -215,6 +230,9 @@ vfs_symlink(const char *contents, char *path)
 	}
 
 	result = VOP_SYMLINK(newdir, newname, contents);
+	if (result == 0) {
+		vfs_namecache_purgename(newdir->vn_fs, newname);
+	}
 	VOP_DECREF(newdir);
 
 	return result;
@@ -261,6 +279,9 @@ vfs_mkdir(char *path)
 	}
 
 	result = VOP_MKDIR(parent, name);
+	if (result == 0) {
+		vfs_namecache_purgename(parent->vn_fs, name);
+	}
 
 	VOP_DECREF(parent);
 
@@ -283,6 +304,9 @@ vfs_rmdir(char *path)
 	}
 
 	result = VOP_RMDIR(parent, name);
+	if (result == 0) {
+		vfs_namecache_purgename(parent->vn_fs, name);
+	}
 
 	VOP_DECREF(parent);
 
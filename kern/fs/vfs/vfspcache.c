@@ -0,0 +1,383 @@
+/*
+ * VFS page cache.
+ *
+ * Caches file data a page at a time, indexed by (vnode, page number
+ * within the file). Filesystems route VOP_READ on regular files
+ * through vfs_pcache_read, passing a function that reads one page of
+ * the file from wherever it really lives; the page is then kept for
+ * anyone who reads it later, such as the next process to load the
+ * same program.
+ *
+ * The cache is write-through: a filesystem writes as usual and then
+ * calls vfs_pcache_invalidate so the stale pages are dropped. It must
+ * also do so when truncating and when reclaiming a vnode, since the
+ * vnode's memory may then be reused for another file.
+ *
+ * The pages come from a fixed pool set aside at boot. Pages in use
+ * (being filled, or being copied out of) are marked busy; anyone else
+ * who wants one waits. As in the SFS buffer cache, the lists are
+ * protected by going to splhigh, so nothing here sleeps on a lock
+ * while a filesystem holds its own.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <thread.h>
+#include <machine/spl.h>
+#include <vm.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <dev.h>
+
+#define VPC_NPAGES    32        /* pages in the cache */
+#define VPC_HASHSIZE  16        /* number of hash chains */
+
+struct vpc_page {
+	struct vpc_page *pc_hashnext;   /* next in hash chain */
+	struct vpc_page *pc_lruprev;    /* more recently used */
+	struct vpc_page *pc_lrunext;    /* less recently used */
+	struct vnode *pc_vn;            /* file, or NULL if not in use */
+	u_int32_t pc_pageno;            /* page number within file */
+	u_int32_t pc_len;               /* bytes valid; short at EOF */
+	int pc_busy;                    /* being filled or read */
+	int pc_stale;                   /* invalidated while busy */
+	char *pc_data;
+};
+
+static struct vpc_page vpc_pages[VPC_NPAGES];
+static struct vpc_page *vpc_hash[VPC_HASHSIZE];
+static struct vpc_page *vpc_lruhead;    /* most recently used */
+static struct vpc_page *vpc_lrutail;    /* least recently used */
+
+/* Statistics */
+static u_int32_t vpc_hits;
+static u_int32_t vpc_misses;
+static u_int32_t vpc_invalidations;
+
+#define VPC_HASH(vn, pageno) \
+	((((u_int32_t)(vn) >> 4) + (pageno)) % VPC_HASHSIZE)
+
+static
+void
+vpc_lru_remove(struct vpc_page *pg)
+{
+	if (pg->pc_lruprev != NULL) {
+		pg->pc_lruprev->pc_lrunext = pg->pc_lrunext;
+	}
+	else {
+		vpc_lruhead = pg->pc_lrunext;
+	}
+	if (pg->pc_lrunext != NULL) {
+		pg->pc_lrunext->pc_lruprev = pg->pc_lruprev;
+	}
+	else {
+		vpc_lrutail = pg->pc_lruprev;
+	}
+}
+
+static
+void
+vpc_lru_addhead(struct vpc_page *pg)
+{
+	pg->pc_lruprev = NULL;
+	pg->pc_lrunext = vpc_lruhead;
+	if (vpc_lruhead != NULL) {
+		vpc_lruhead->pc_lruprev = pg;
+	}
+	else {
+		vpc_lrutail = pg;
+	}
+	vpc_lruhead = pg;
+}
+
+void
+vfs_pcache_bootstrap(void)
+{
+	vaddr_t base;
+	int i;
+
+	base = alloc_kpages(VPC_NPAGES);
+	if (base == 0) {
+		panic("vfs: Could not allocate page cache\n");
+	}
+
+	for (i=0; i<VPC_NPAGES; i++) {
+		vpc_pages[i].pc_vn = NULL;
+		vpc_pages[i].pc_busy = 0;
+		vpc_pages[i].pc_stale = 0;
+		vpc_pages[i].pc_data = (char *)(base + i*PAGE_SIZE);
+		vpc_lru_addhead(&vpc_pages[i]);
+	}
+}
+
+/*
+ * Take a page out of the hash. Called at splhigh.
+ */
+static
+void
+vpc_unhash(struct vpc_page *pg)
+{
+	struct vpc_page **pp;
+
+	for (pp = &vpc_hash[VPC_HASH(pg->pc_vn, pg->pc_pageno)]; *pp != pg;
+	     pp = &(*pp)->pc_hashnext) {
+		assert(*pp != NULL);
+	}
+	*pp = pg->pc_hashnext;
+	pg->pc_vn = NULL;
+	pg->pc_stale = 0;
+}
+
+/*
+ * Find a page. Called at splhigh.
+ */
+static
+struct vpc_page *
+vpc_find(struct vnode *vn, u_int32_t pageno)
+{
+	struct vpc_page *pg;
+
+	for (pg = vpc_hash[VPC_HASH(vn, pageno)]; pg != NULL;
+	     pg = pg->pc_hashnext) {
+		if (pg->pc_vn == vn && pg->pc_pageno == pageno &&
+		    !pg->pc_stale) {
+			return pg;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Done with a page gotten with vpc_get.
+ */
+static
+void
+vpc_put(struct vpc_page *pg)
+{
+	int spl;
+
+	spl = splhigh();
+	assert(pg->pc_busy);
+	pg->pc_busy = 0;
+	if (pg->pc_stale) {
+		vpc_unhash(pg);
+	}
+	thread_wakeup(pg);
+	thread_wakeup(&vpc_lrutail);
+	splx(spl);
+}
+
+/*
+ * Get page PAGENO of VN, marked busy, filling it with FILL if it
+ * isn't cached.
+ */
+static
+int
+vpc_get(struct vnode *vn, u_int32_t pageno, vfs_pcache_fill_t fill,
+	struct vpc_page **ret)
+{
+	struct vpc_page *pg;
+	int spl, result;
+
+	spl = splhigh();
+ again:
+	pg = vpc_find(vn, pageno);
+	if (pg != NULL) {
+		if (pg->pc_busy) {
+			thread_sleep(pg);
+			goto again;
+		}
+		pg->pc_busy = 1;
+		vpc_lru_remove(pg);
+		vpc_lru_addhead(pg);
+		vpc_hits++;
+		splx(spl);
+		*ret = pg;
+		return 0;
+	}
+
+	/* Not cached; recycle the least recently used idle page */
+	for (pg = vpc_lrutail; pg != NULL; pg = pg->pc_lruprev) {
+		if (!pg->pc_busy) {
+			break;
+		}
+	}
+	if (pg == NULL) {
+		thread_sleep(&vpc_lrutail);
+		goto again;
+	}
+
+	if (pg->pc_vn != NULL) {
+		vpc_unhash(pg);
+	}
+	pg->pc_vn = vn;
+	pg->pc_pageno = pageno;
+	pg->pc_busy = 1;
+	pg->pc_hashnext = vpc_hash[VPC_HASH(vn, pageno)];
+	vpc_hash[VPC_HASH(vn, pageno)] = pg;
+	vpc_lru_remove(pg);
+	vpc_lru_addhead(pg);
+	vpc_misses++;
+	splx(spl);
+
+	result = fill(vn, pg->pc_data, (off_t)pageno * PAGE_SIZE,
+		      &pg->pc_len);
+	if (result) {
+		spl = splhigh();
+		pg->pc_stale = 1;
+		splx(spl);
+		vpc_put(pg);
+		return result;
+	}
+	assert(pg->pc_len <= PAGE_SIZE);
+
+	*ret = pg;
+	return 0;
+}
+
+/*
+ * Read from VN into UIO through the cache.
+ */
+int
+vfs_pcache_read(struct vnode *vn, struct uio *uio, vfs_pcache_fill_t fill)
+{
+	struct vpc_page *pg;
+	u_int32_t pageno, skip, amt, len;
+	int result = 0;
+
+	assert(uio->uio_rw == UIO_READ);
+
+	while (uio->uio_resid > 0) {
+		pageno = uio->uio_offset / PAGE_SIZE;
+		skip = uio->uio_offset % PAGE_SIZE;
+
+		result = vpc_get(vn, pageno, fill, &pg);
+		if (result) {
+			break;
+		}
+
+		len = pg->pc_len;
+		if (skip >= len) {
+			/* Past EOF */
+			vpc_put(pg);
+			break;
+		}
+
+		amt = len - skip;
+		if (amt > uio->uio_resid) {
+			amt = uio->uio_resid;
+		}
+		result = uiomove(pg->pc_data + skip, amt, uio);
+		dev_countcopy(amt);
+		vpc_put(pg);
+
+		if (result || len < PAGE_SIZE) {
+			break;
+		}
+	}
+
+	return result;
+}
+
+void
+vfs_pcache_insert(struct vnode *vn, u_int32_t pageno, const void *data,
+		  u_int32_t len)
+{
+	struct vpc_page *pg;
+	int spl;
+
+	assert(len <= PAGE_SIZE);
+
+	spl = splhigh();
+	if (vpc_find(vn, pageno) != NULL) {
+		splx(spl);
+		return;
+	}
+
+	/* Take an idle page if there is one; this isn't worth waiting for */
+	for (pg = vpc_lrutail; pg != NULL; pg = pg->pc_lruprev) {
+		if (!pg->pc_busy) {
+			break;
+		}
+	}
+	if (pg == NULL) {
+		splx(spl);
+		return;
+	}
+
+	if (pg->pc_vn != NULL) {
+		vpc_unhash(pg);
+	}
+	pg->pc_vn = vn;
+	pg->pc_pageno = pageno;
+	pg->pc_len = len;
+	pg->pc_busy = 1;
+	pg->pc_hashnext = vpc_hash[VPC_HASH(vn, pageno)];
+	vpc_hash[VPC_HASH(vn, pageno)] = pg;
+	vpc_lru_remove(pg);
+	vpc_lru_addhead(pg);
+	splx(spl);
+
+	memcpy(pg->pc_data, data, len);
+	dev_countcopy(len);
+	vpc_put(pg);
+}
+
+/*
+ * Drop every cached page of VN, or of every file on filesystem FS.
+ */
+static
+void
+vpc_invalidate(struct vnode *vn, struct fs *fs)
+{
+	struct vpc_page *pg;
+	int i, spl;
+
+	spl = splhigh();
+	for (i=0; i<VPC_NPAGES; i++) {
+		pg = &vpc_pages[i];
+		if (pg->pc_vn == NULL || pg->pc_stale) {
+			continue;
+		}
+		if (pg->pc_vn != vn &&
+		    (fs == NULL || pg->pc_vn->vn_fs != fs)) {
+			continue;
+		}
+		if (pg->pc_busy) {
+			/* Let go of it when whoever has it is done */
+			pg->pc_stale = 1;
+		}
+		else {
+			vpc_unhash(pg);
+		}
+		vpc_invalidations++;
+	}
+	splx(spl);
+}
+
+void
+vfs_pcache_invalidate(struct vnode *vn)
+{
+	vpc_invalidate(vn, NULL);
+}
+
+void
+vfs_pcache_purge(struct fs *fs)
+{
+	vpc_invalidate(NULL, fs);
+}
+
+void
+vfs_pcache_printstats(void)
+{
+	u_int32_t total = vpc_hits + vpc_misses;
+
+	kprintf("pagecache: %u pages, %u lookups: %u hits, %u misses\n",
+		VPC_NPAGES, total, vpc_hits, vpc_misses);
+	if (total > 0) {
+		kprintf("pagecache: hit rate %u%%\n", (vpc_hits * 100) / total);
+	}
+	kprintf("pagecache: %u pages invalidated\n", vpc_invalidations);
+}
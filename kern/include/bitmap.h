@@ -9,6 +9,9 @@
  *                      Returns NULL on error.
  *     bitmap_getdata - return pointer to raw bit data (for I/O).
  *     bitmap_alloc   - locate a cleared bit, set it, and return its index.
+ *                      Always finds the lowest-numbered clear bit.
+ *     bitmap_alloc_near - like bitmap_alloc, but find the first cleared
+ *                      bit at or after GOAL, wrapping around if needed.
  *     bitmap_mark    - set a clear bit by its index.
  *     bitmap_unmark  - clear a set bit by its index.
  *     bitmap_isset   - return whether a particular bit is set or not.
@@ -20,6 +23,8 @@ struct bitmap;  /* Opaque. */
 struct bitmap *bitmap_create(u_int32_t nbits);
 void          *bitmap_getdata(struct bitmap *);
 int            bitmap_alloc(struct bitmap *, u_int32_t *index);
+int            bitmap_alloc_near(struct bitmap *, u_int32_t goal,
+				 u_int32_t *index);
 void           bitmap_mark(struct bitmap *, u_int32_t index);
 void           bitmap_unmark(struct bitmap *, u_int32_t index);
 int	       bitmap_isset(struct bitmap *, u_int32_t index);
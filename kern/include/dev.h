@@ -2,16 +2,20 @@
 #define _DEV_H_
 
 struct uio;  /* in <uio.h> */
+struct devreq;
 
 /*
  * Filesystem-namespace-accessible device.
  * d_io is for both reads and writes; the uio indicates which should be done.
+ * d_submit starts an asynchronous block request (see below) and returns
+ * without waiting for it; it is NULL for devices that can't do that.
  */
 struct device {
 	int (*d_open)(struct device *, int flags_from_open);
 	int (*d_close)(struct device *);
 	int (*d_io)(struct device *, struct uio *);
 	int (*d_ioctl)(struct device *, int op, userptr_t data);
+	int (*d_submit)(struct device *, struct devreq *);
 
 	u_int32_t d_blocks;
 	u_int32_t d_blocksize;
@@ -19,6 +23,54 @@ struct device {
 	void *d_data;   /* device-specific data */
 };
 
+/*
+ * Asynchronous block request.
+ *
+ * The caller fills in dr_block, dr_nblocks, dr_buf (a kernel buffer
+ * of dr_nblocks * d_blocksize bytes), dr_write, dr_done and dr_data,
+ * and passes the request to d_submit. Once submitted, the request
+ * belongs to the driver until it calls dr_done, which it does when
+ * the transfer finishes or fails, with dr_result set. dr_done is
+ * called from the interrupt handler, so it must not sleep; it may V a
+ * semaphore or call thread_wakeup. dr_merged is set if the driver
+ * found the request adjacent to another one and ran the two back to
+ * back.
+ *
+ * dev_doio submits a request and waits for it.
+ */
+struct devreq {
+	struct devreq *dr_next;         /* for the driver's queue */
+	u_int32_t dr_block;             /* first block */
+	u_int32_t dr_nblocks;           /* number of blocks */
+	void *dr_buf;                   /* data */
+	int dr_write;                   /* nonzero for writes */
+	void (*dr_done)(struct devreq *);
+	void *dr_data;                  /* for dr_done */
+
+	/* Set by the driver */
+	u_int32_t dr_xfer;              /* blocks transferred so far */
+	int dr_merged;                  /* ran back to back with another */
+	int dr_result;                  /* error code on completion */
+	time_t dr_qsecs;                /* when it was queued */
+	u_int32_t dr_qnsecs;
+};
+
+int dev_doio(struct device *dev, struct devreq *req);
+
+/*
+ * Accounting of how many times file data gets copied on its way
+ * between the disk and whoever asked for it.
+ *
+ *    dev_countcopy      - Drivers and filesystems call this for each
+ *                         copy of file or disk data they make.
+ *    dev_countdelivered - Filesystems call this for the data they hand
+ *                         to (or take from) their callers.
+ *    dev_printcopystats - Print bytes copied per byte delivered.
+ */
+void dev_countcopy(u_int32_t bytes);
+void dev_countdelivered(u_int32_t bytes);
+void dev_printcopystats(void);
+
 /* Create vnode for namespace-accessible device. */
 struct vnode *dev_create_vnode(struct device *dev);
 
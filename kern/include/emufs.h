@@ -15,6 +15,10 @@ struct emufs_vnode {
 	struct vnode ev_v;		/* abstract vnode structure */
 	struct emu_softc *ev_emu;	/* device */
 	u_int32_t ev_handle;		/* file handle */
+
+	/* Protected by the device's e_lock */
+	off_t ev_size;			/* file size, if ev_sizevalid */
+	int ev_sizevalid;
 };
 
 struct emufs_fs {
@@ -24,4 +28,7 @@ struct emufs_fs {
 	struct array *ef_vnodes;	/* table of loaded vnodes */
 };
 
+/* Print statistics (in emu.c) */
+void emufs_printstats(void);
+
 #endif /* _EMUFS_H_ */
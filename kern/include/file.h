@@ -0,0 +1,77 @@
+#ifndef _FILE_H_
+#define _FILE_H_
+
+#include <kern/limits.h>
+
+/*
+ * Open files and file descriptor tables.
+ *
+ * An open file is what open() makes: a vnode, the flags it was opened
+ * with, and a seek position. Descriptors made by dup2, and a forked
+ * child's copies of its parent's, share one open file, and so share
+ * its seek position. An open file is freed, and its vnode closed,
+ * when the last descriptor for it goes.
+ *
+ * The seek position is protected by of_lock, which is held across
+ * each read or write so that one read or write is atomic relative to
+ * others on the same open file. Nothing global is locked for I/O.
+ *
+ * A file table maps descriptors to open files for one process. The
+ * descriptors in use are kept in a bitmap, so the lowest free one
+ * (which open, pipe, etc. must return) is found without walking the
+ * table. A table is only used by the thread it belongs to, so it
+ * has no lock of its own.
+ *
+ *    openfile_open     - Open PATH with FLAGS (as for open()). May
+ *                        destroy PATH.
+ *    openfile_create   - Make an open file for VN, which has already
+ *                        been opened (e.g. by vfs_open).
+ *    openfile_incref   - Add a reference.
+ *    openfile_decref   - Drop a reference, closing the file if it's
+ *                        the last one.
+ *
+ *    filetable_create  - Make an empty table.
+ *    filetable_destroy - Close everything in a table and free it.
+ *    filetable_copy    - Make a new table with the same descriptors,
+ *                        sharing their open files (for fork).
+ *    filetable_place   - Give OF (and our reference to it) the lowest
+ *                        free descriptor.
+ *    filetable_get     - Look up a descriptor. No reference is added;
+ *                        the result is good until the descriptor is
+ *                        closed.
+ *    filetable_dup2    - Make NEWFD refer to what OLDFD does, closing
+ *                        whatever NEWFD referred to before.
+ *    filetable_close   - Close a descriptor.
+ */
+
+struct vnode;
+struct lock;
+struct bitmap;
+
+struct openfile {
+	struct vnode *of_vnode;
+	int of_flags;                   /* flags from open() */
+	struct lock *of_lock;           /* protects of_offset */
+	off_t of_offset;                /* seek position */
+	int of_refcount;                /* descriptors using this */
+};
+
+struct filetable {
+	struct openfile *ft_files[OPEN_MAX];
+	struct bitmap *ft_used;         /* descriptors in use */
+};
+
+int openfile_open(char *path, int flags, struct openfile **ret);
+int openfile_create(struct vnode *vn, int flags, struct openfile **ret);
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+struct filetable *filetable_create(void);
+void filetable_destroy(struct filetable *ft);
+int filetable_copy(struct filetable *ft, struct filetable **ret);
+int filetable_place(struct filetable *ft, struct openfile *of, int *fd);
+int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
+int filetable_dup2(struct filetable *ft, int oldfd, int newfd);
+int filetable_close(struct filetable *ft, int fd);
+
+#endif /* _FILE_H_ */
@@ -0,0 +1,79 @@
+#ifndef _IOSCHED_H_
+#define _IOSCHED_H_
+
+/*
+ * I/O scheduler.
+ *
+ * A disk driver keeps the requests it has been handed (see struct
+ * devreq in dev.h) in a struct ioqueue, and asks the queue which one
+ * to start each time the disk goes idle. Which one that is depends
+ * on the scheduling policy:
+ *
+ *    noop     - first come, first served.
+ *    cscan    - circular elevator: the lowest-numbered request at or
+ *               past the disk head, sweeping upward only, then
+ *               starting again from the bottom.
+ *    deadline - like cscan, unless some request has been waiting
+ *               longer than its deadline, in which case the oldest
+ *               request goes next.
+ *
+ * Whatever the policy, a request that is contiguous with one already
+ * queued (same direction) is placed next to it, and noop then sends
+ * both to the disk back to back.
+ *
+ * There is one policy for the whole system. It can be changed at any
+ * time, including from the kernel command line, with the "iosched"
+ * menu command.
+ *
+ * The queue also keeps statistics: how far the head moved between
+ * requests, and how long requests took from submission to
+ * completion.
+ *
+ * All the ioq_* functions must be called at splhigh, as drivers
+ * touch their queues from their interrupt handlers.
+ *
+ *    ioq_init    - Set up a queue. NAME is used for printing stats.
+ *    ioq_add     - Queue a request.
+ *    ioq_next    - Remove and return the request to start next, or
+ *                  NULL if the queue is empty.
+ *    ioq_done    - Record that a request returned by ioq_next has
+ *                  finished.
+ *
+ *    iosched_select     - Change the scheduling policy, by name.
+ *    iosched_printstats - Print seek and latency statistics for every
+ *                  queue.
+ *    iosched_resetstats - Clear the statistics.
+ */
+
+struct devreq;
+
+#define IOQ_NLATBUCKETS  24     /* buckets in the latency histogram */
+
+struct ioqueue {
+	const char *iq_name;
+	struct devreq *iq_head;         /* queued requests */
+	u_int32_t iq_len;               /* number of requests queued */
+	u_int32_t iq_headpos;           /* block after the last one done */
+
+	/* Statistics */
+	u_int32_t iq_nreqs;             /* requests completed */
+	u_int32_t iq_nmerged;           /* requests run back to back */
+	u_int32_t iq_maxlen;            /* longest the queue has been */
+	u_int32_t iq_seeks;             /* requests that moved the head */
+	u_int32_t iq_seekdist;          /* blocks the head moved in all */
+	u_int32_t iq_maxlat;            /* longest latency, in usec */
+	u_int32_t iq_lathist[IOQ_NLATBUCKETS]; /* latencies, by power of 2 */
+
+	struct ioqueue *iq_next;        /* list of all queues */
+};
+
+void ioq_init(struct ioqueue *iq, const char *name);
+void ioq_add(struct ioqueue *iq, struct devreq *req);
+struct devreq *ioq_next(struct ioqueue *iq);
+void ioq_done(struct ioqueue *iq, struct devreq *req);
+
+int iosched_select(const char *name);
+void iosched_printstats(void);
+void iosched_resetstats(void);
+
+#endif /* _IOSCHED_H_ */
@@ -40,6 +40,9 @@
 #define SYS___getcwd     29
 #define SYS_stat         30
 #define SYS_lstat        31
+#define SYS_readv        32
+#define SYS_writev       33
+#define SYS___kstats     34
 /*CALLEND*/
 
 
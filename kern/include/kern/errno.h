@@ -36,5 +36,8 @@
 #define ENOEXEC      24     /* File is not executable */
 #define E2BIG        25     /* Argument list too long */
 #define EBADF        26     /* Bad file number */
+#define EPIPE        27     /* Broken pipe */
+#define ESRCH        28     /* No such process */
+#define ECHILD       29     /* No child processes */
 
 #endif /* _KERN_ERRNO_H_ */
@@ -0,0 +1,26 @@
+#ifndef _KERN_KSTATS_H_
+#define _KERN_KSTATS_H_
+
+/*
+ * Kernel-wide event counters, as returned to user programs by the
+ * __kstats system call. They count up from boot and wrap; take the
+ * difference of two snapshots to measure something.
+ *
+ * ks_tlbmisses counts TLB miss exceptions; ks_vmfaults counts calls
+ * to vm_fault, which also get writes to read-only pages. (Under
+ * dumbvm every TLB miss goes to vm_fault, so the two are about the
+ * same; a VM that refilled the TLB without calling vm_fault would
+ * make them differ.) ks_readbytes and ks_writebytes are what read,
+ * write, readv, and writev moved, on any kind of file.
+ */
+
+struct kstats {
+	u_int32_t ks_syscalls;         /* system calls made */
+	u_int32_t ks_vmfaults;         /* calls to vm_fault */
+	u_int32_t ks_tlbmisses;        /* TLB miss exceptions */
+	u_int32_t ks_switches;         /* context switches */
+	u_int32_t ks_readbytes;        /* bytes read by user programs */
+	u_int32_t ks_writebytes;       /* bytes written by user programs */
+};
+
+#endif /* _KERN_KSTATS_H_ */
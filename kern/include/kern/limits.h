@@ -7,5 +7,14 @@
 /* Longest full path name */
 #define PATH_MAX   1024
 
+/* Most bytes of arguments to execv, counting argv[] itself */
+#define ARG_MAX    8192
+
+/* Most files one process may have open at once */
+#define OPEN_MAX   64
+
+/* Most blocks in one readv or writev */
+#define IOV_MAX    16
+
 
 #endif /* _KERN_LIMITS_H_ */
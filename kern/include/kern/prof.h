@@ -0,0 +1,47 @@
+#ifndef _KERN_PROF_H_
+#define _KERN_PROF_H_
+
+/*
+ * Kernel profile format, shared between the kernel (see prof.h) and
+ * profdump.
+ *
+ * A profile file, as written by the kernel menu's "prof dump file",
+ * is a struct prof_header, then ph_npcs struct prof_pcs, then
+ * ph_nthreads struct prof_threads. Everything is in the kernel's byte
+ * order, which for System/161 is big-endian.
+ */
+
+#define PROF_MAGIC  0x50524631         /* "PRF1" */
+
+struct prof_header {
+	u_int32_t ph_magic;
+	u_int32_t ph_hz;               /* samples per second */
+	u_int32_t ph_nsamples;         /* samples taken */
+	u_int32_t ph_dropped;          /* samples with no room in the table */
+	u_int32_t ph_npcs;             /* struct prof_pcs that follow */
+	u_int32_t ph_nthreads;         /* struct prof_threads after those */
+};
+
+/*
+ * Samples at one PC. Instructions are word-aligned, so the bottom bit
+ * of the PC is free; PROF_USER is set there for a PC in user mode.
+ */
+struct prof_pc {
+	u_int32_t pp_pc;
+	u_int32_t pp_count;
+};
+#define PROF_USER  1
+
+/*
+ * Samples in one thread. Threads past the kernel's table size are
+ * lumped together under pt_thread 0.
+ */
+#define PROF_NAMELEN  16
+struct prof_thread {
+	u_int32_t pt_thread;           /* address of the thread */
+	u_int32_t pt_kernel;           /* samples in kernel mode */
+	u_int32_t pt_user;             /* samples in user mode */
+	char pt_name[PROF_NAMELEN];    /* null-terminated */
+};
+
+#endif /* _KERN_PROF_H_ */
@@ -24,6 +24,21 @@
 /* Size of bitmap (in blocks) */
 #define SFS_BITBLOCKS(nblocks)  (SFS_BITMAPSIZE(nblocks)/SFS_BLOCKBITS)
 
+/*
+ * Metadata journal. mksfs reserves SFS_JNBLOCKS blocks right after
+ * the freemap (if the disk is big enough) and records where in the
+ * superblock. The first block of the journal is a header; a
+ * transaction is one or more descriptor blocks listing where its
+ * blocks go, the block images, and a commit block. The kernel
+ * needs room for a transaction as big as its buffer cache, so
+ * SFS_JNBLOCKS must be at least its SFS_JMINBLOCKS.
+ */
+#define SFS_JNBLOCKS      256           /* journal size made by mksfs */
+#define SFS_JMAGIC        0x4a524e4c    /* journal header magic */
+#define SFS_JDESCMAGIC    0x4a444553    /* descriptor block magic */
+#define SFS_JCOMMITMAGIC  0x4a434d54    /* commit block magic */
+#define SFS_JDESCMAX      125           /* block images per descriptor */
+
 /* File types for dfi_type */
 #define SFS_TYPE_INVAL    0       /* Should not appear on disk */
 #define SFS_TYPE_FILE     1
@@ -36,7 +51,9 @@ struct sfs_super {
 	u_int32_t sp_magic;       /* Magic number, should be SFS_MAGIC */
 	u_int32_t sp_nblocks;     /* Number of blocks in fs */
 	char sp_volname[SFS_VOLNAME_SIZE];  /* Name of this volume */
-	u_int32_t reserved[118];
+	u_int32_t sp_jstart;      /* First block of journal */
+	u_int32_t sp_jblocks;     /* Size of journal, 0 if none */
+	u_int32_t reserved[116];
 };
 
 /*
@@ -59,4 +76,36 @@ struct sfs_dir {
 	char sfd_name[SFS_NAMELEN];  /* Filename */
 };
 
+/*
+ * On-disk journal header. Only a transaction whose sequence number
+ * matches jh_seq is replayed; it's bumped after each transaction has
+ * been written to its home locations.
+ */
+struct sfs_jheader {
+	u_int32_t jh_magic;             /* SFS_JMAGIC */
+	u_int32_t jh_seq;               /* sequence number of next transaction */
+	u_int32_t reserved[126];
+};
+
+/*
+ * On-disk journal descriptor; the block images follow it.
+ */
+struct sfs_jdesc {
+	u_int32_t jd_magic;             /* SFS_JDESCMAGIC */
+	u_int32_t jd_seq;               /* transaction sequence number */
+	u_int32_t jd_nblocks;           /* number of block images */
+	u_int32_t jd_blocks[SFS_JDESCMAX];  /* home location of each */
+};
+
+/*
+ * On-disk journal commit block; follows the block images.
+ */
+struct sfs_jcommit {
+	u_int32_t jc_magic;             /* SFS_JCOMMITMAGIC */
+	u_int32_t jc_seq;               /* transaction sequence number */
+	u_int32_t jc_nblocks;           /* number of block images */
+	u_int32_t jc_checksum;          /* checksum of the block images */
+	u_int32_t reserved[124];
+};
+
 #endif /* _KERN_SFS_H_ */
@@ -0,0 +1,61 @@
+#ifndef _KERN_TRACE_H_
+#define _KERN_TRACE_H_
+
+/*
+ * Kernel event trace format, shared between the kernel (see trace.h)
+ * and tracedump.
+ *
+ * A trace file, as written by the kernel menu's "tr save", is a
+ * struct trace_header followed by th_nevents struct trace_events,
+ * oldest first. Everything is in the kernel's byte order, which for
+ * System/161 is big-endian.
+ */
+
+#define TRACE_MAGIC  0x54524331        /* "TRC1" */
+
+struct trace_header {
+	u_int32_t th_magic;
+	u_int32_t th_nevents;          /* events that follow */
+	u_int32_t th_lost;             /* earlier events overwritten */
+	u_int32_t th_mask;             /* classes enabled when saved */
+};
+
+struct trace_event {
+	u_int32_t te_usecs;            /* time of day in usec; wraps */
+	u_int32_t te_type;             /* TR_* */
+	u_int32_t te_thread;           /* address of current thread */
+	u_int32_t te_arg1;
+	u_int32_t te_arg2;
+};
+
+/*
+ * Event classes. Tracing is turned on and off by class: bit
+ * (1 << TRC_x) in the kernel's trace mask.
+ */
+#define TRC_SCHED    0                 /* context switch, sleep, wakeup */
+#define TRC_LOCK     1                 /* lock acquire and release */
+#define TRC_VM       2                 /* VM faults */
+#define TRC_SYSCALL  3                 /* system call entry and exit */
+#define TRC_DISK     4                 /* disk requests */
+#define TRC_NCLASSES 5
+
+/* Event types. The class is in the bits above the low 8. */
+#define TR_TYPE(cls, n)  (((cls) << 8) | (n))
+#define TR_CLASS(type)   ((type) >> 8)
+
+#define TR_SWITCH    TR_TYPE(TRC_SCHED, 0)   /* old thread, its new state */
+#define TR_SLEEP     TR_TYPE(TRC_SCHED, 1)   /* sleep address */
+#define TR_WAKEUP    TR_TYPE(TRC_SCHED, 2)   /* sleep address, thread */
+#define TR_LOCK      TR_TYPE(TRC_LOCK, 0)    /* lock, 1 if it had to wait */
+#define TR_UNLOCK    TR_TYPE(TRC_LOCK, 1)    /* lock */
+#define TR_VMFAULT   TR_TYPE(TRC_VM, 0)      /* address, fault type */
+#define TR_SYSCALL   TR_TYPE(TRC_SYSCALL, 0) /* call number, first arg */
+#define TR_SYSRET    TR_TYPE(TRC_SYSCALL, 1) /* call number, error */
+#define TR_DISKQ     TR_TYPE(TRC_DISK, 0)    /* block, count (see below) */
+#define TR_DISKSTART TR_TYPE(TRC_DISK, 1)    /* block, count (see below) */
+#define TR_DISKDONE  TR_TYPE(TRC_DISK, 2)    /* block, latency in usec */
+
+/* In the count for TR_DISKQ and TR_DISKSTART, set for a write */
+#define TR_DISKWRITE 0x80000000
+
+#endif /* _KERN_TRACE_H_ */
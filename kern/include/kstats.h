@@ -0,0 +1,16 @@
+#ifndef _KSTATS_H_
+#define _KSTATS_H_
+
+#include <kern/kstats.h>
+
+/*
+ * Kernel-wide event counters (see <kern/kstats.h>), bumped in place
+ * wherever the event happens. Do it at splhigh, or an interrupt
+ * handler that also counts can lose an update.
+ *
+ *    sys___kstats (userprog/kstats_syscalls.c) copies them out.
+ */
+
+extern struct kstats kstats;
+
+#endif /* _KSTATS_H_ */
@@ -126,6 +126,7 @@ void longjmp(jmp_buf jb, int retval);
  * Low-level console access.
  */
 void putch(int ch);
+void putchars(const char *buf, size_t len);
 int getch(void);
 void beep(void);
 
@@ -183,13 +184,31 @@ u_int64_t htonll(u_int64_t);
  * NOTE that the order of the arguments is the same as bcopy() or 
  * cp/mv, that is, source on the left, NOT the same as strcpy().
  *
+ * copyinv and copyoutv do a copyin or copyout of each block in an
+ * array of struct copyvec, and copyinstrv a copyinstr of each string
+ * in an array, packing them into DEST one after another and returning
+ * the total length in GOT. These check and set up fault handling once
+ * for the whole batch, so when several things are to be copied they
+ * are cheaper than calling copyin and friends for each. If one fails,
+ * some of the others may have been copied already.
+ *
  * These functions are machine-dependent.
  */
+
+struct copyvec {
+	void *cv_kaddr;		/* kernel address */
+	userptr_t cv_uaddr;	/* user address */
+	size_t cv_len;		/* length of block */
+};
  
 int copyin(const_userptr_t usersrc, void *dest, size_t len);
 int copyout(const void *src, userptr_t userdest, size_t len);
 int copyinstr(const_userptr_t usersrc, char *dest, size_t len, size_t *got);
 int copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *got);
+int copyinv(const struct copyvec *vec, unsigned nvec);
+int copyoutv(const struct copyvec *vec, unsigned nvec);
+int copyinstrv(const const_userptr_t *usrcs, unsigned nstrs, char *dest,
+	       size_t len, size_t *got);
 
 /*
  * Simple timing hooks.
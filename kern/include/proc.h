@@ -0,0 +1,72 @@
+#ifndef _PROC_H_
+#define _PROC_H_
+
+/*
+ * Processes.
+ *
+ * A process is, for now, one thread running a user program; its
+ * address space, open files and current directory are kept in the
+ * thread (t_vmspace, t_filetable, t_cwd). What struct proc adds is
+ * what outlives the thread: the pid, who the parent is, and the exit
+ * code, which stays around until the parent collects it with waitpid.
+ *
+ * Processes started from the kernel menu have no parent process; a
+ * kernel thread (whose t_proc is NULL) may wait for them. When a
+ * process exits, its children are orphaned: nobody can wait for them
+ * any more, so they are freed as soon as they exit.
+ *
+ * Pids are handed out from a fixed table of PROC_MAX slots. The free
+ * slots are kept on a list, oldest first, so getting and releasing a
+ * pid take constant time and a freed slot sits unused for as long as
+ * possible. Each slot also has a generation number that goes into the
+ * pid, so a pid is not reused until many processes later even when
+ * its slot is.
+ *
+ * All of this is protected by one lock; a parent waits for a child on
+ * the child's own CV.
+ *
+ *    proc_bootstrap  - Set up the pid table.
+ *    proc_create     - Make a process with a new pid. PARENT is NULL
+ *                      for a process started by the kernel.
+ *    proc_destroy    - Free a process that never ran.
+ *    proc_exit       - Exit the current thread's process with CODE
+ *                      and detach it from the thread. The thread
+ *                      should then call thread_exit.
+ *    proc_wait       - Wait for the child PID to exit, hand back its
+ *                      exit code, and free it.
+ *    proc_timefork   - Account for a fork that began at time S/NS.
+ *    proc_timeexec   - Likewise, for an exec.
+ *    proc_printstats - Print fork and exec counts and timings.
+ *
+ *    exec_bootstrap  - Set up for execv (in runprogram.c).
+ */
+
+struct cv;
+
+/* Most processes at once */
+#define PROC_MAX  128
+
+struct proc {
+	pid_t p_pid;
+	struct proc *p_parent;          /* NULL if none */
+	int p_orphan;                   /* nobody will wait for it */
+	int p_nchildren;                /* children not yet freed */
+	int p_exited;
+	int p_exitcode;
+	struct cv *p_cv;                /* signalled on exit */
+};
+
+void proc_bootstrap(void);
+int proc_create(struct proc *parent, struct proc **ret);
+void proc_destroy(struct proc *p);
+void proc_exit(int code);
+int proc_wait(pid_t pid, int *code);
+
+void proc_timefork(time_t s, u_int32_t ns);
+void proc_timeexec(time_t s, u_int32_t ns);
+void proc_printstats(void);
+void proc_resetstats(void);
+
+void exec_bootstrap(void);
+
+#endif /* _PROC_H_ */
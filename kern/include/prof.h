@@ -0,0 +1,40 @@
+#ifndef _PROF_H_
+#define _PROF_H_
+
+#include <kern/prof.h>
+
+/*
+ * Statistical kernel profiler.
+ *
+ * While it's on, each timer interrupt (HZ times a second) records
+ * the PC the interrupt came in at, whether that was in user mode,
+ * and the current thread. PCs are counted in a hash table of
+ * PROF_NPCS entries; a sample that finds no room within PROF_PROBE
+ * entries of its slot is counted as dropped. Threads are counted in
+ * a table of PROF_NTHREADS. Symbolize a saved profile against the
+ * kernel with profdump (or host-profdump) to get a flat profile.
+ *
+ *    prof_bootstrap  - Allocate the tables. The profiler starts off.
+ *    prof_sample     - Record a sample at PC. Called from hardclock.
+ *    prof_start      - Start sampling.
+ *    prof_stop       - Stop sampling.
+ *    prof_clear      - Throw away the samples taken.
+ *    prof_print      - Print the thread table and the N PCs with the
+ *                      most samples.
+ *    prof_save       - Write the samples to the file PATH, in the
+ *                      format profdump reads. May destroy PATH.
+ */
+
+#define PROF_NPCS      4096     /* must be a power of 2 */
+#define PROF_PROBE     16
+#define PROF_NTHREADS  32
+
+void prof_bootstrap(void);
+void prof_sample(vaddr_t pc, int user);
+void prof_start(void);
+void prof_stop(void);
+void prof_clear(void);
+void prof_print(unsigned n);
+int prof_save(char *path);
+
+#endif /* _PROF_H_ */
@@ -18,16 +18,91 @@ struct sfs_vnode {
 	struct sfs_inode sv_i;		/* on-disk inode */
 	u_int32_t sv_ino;               /* inode number */
 	int sv_dirty;                   /* true if sv_i modified */
+	time_t sv_dirtysince;           /* when syncer first saw it dirty */
+	struct sfs_vnode *sv_hashnext;  /* next in vnode hash chain */
+	struct sfs_vnode **sv_hashprev; /* pointer that points to us */
+	struct sfs_dirindex *sv_dirindex; /* name index (directories only) */
 };
 
+/* Number of chains in the vnode hash table */
+#define SFS_VNHASHSIZE  512
+
+/*
+ * In-memory copy of a disk block, managed by the buffer cache in
+ * sfs_io.c.
+ */
+struct sfs_buf {
+	struct sfs_buf *b_hashnext;     /* next in hash chain */
+	struct sfs_buf *b_lruprev;      /* more recently used */
+	struct sfs_buf *b_lrunext;      /* less recently used */
+	u_int32_t b_block;              /* disk block held */
+	u_int32_t b_owner;              /* inode that last dirtied it */
+	int b_valid;                    /* true if b_block is meaningful */
+	int b_dirty;                    /* true if modified */
+	int b_meta;                     /* true if dirty metadata */
+	int b_busy;                     /* true if handed out */
+	time_t b_dirtytime;             /* when it became dirty */
+	void *b_data;                   /* the block itself */
+};
+
+/*
+ * Size of the buffer cache, per filesystem, and its hash table. With
+ * a journal, dirty metadata can't be evicted until it's committed,
+ * so the cache may grow to SFS_MAXBUFS to make room.
+ */
+#define SFS_NBUFS        64
+#define SFS_MAXBUFS      (2*SFS_NBUFS)
+#define SFS_BUFHASHSIZE  32
+
+/* With a journal, commit before starting an operation past this */
+#define SFS_JTHRESHOLD   (SFS_NBUFS/4)
+
+/*
+ * Descriptor blocks for a transaction of N blocks, and the smallest
+ * journal that can hold the biggest transaction: the whole buffer
+ * cache, plus the header, descriptors, and commit block. A
+ * filesystem with a smaller journal is mounted without journaling.
+ */
+#define SFS_JNDESC(n)    (((n) + SFS_JDESCMAX - 1) / SFS_JDESCMAX)
+#define SFS_JMINBLOCKS   (SFS_MAXBUFS + SFS_JNDESC(SFS_MAXBUFS) + 2)
+
+/*
+ * Write-back parameters. The syncer thread wakes up every
+ * SFS_SYNCPERIOD seconds and writes back whatever has been dirty for
+ * SFS_SYNCAGE seconds or more, so after a crash at most about
+ * SFS_SYNCAGE+SFS_SYNCPERIOD seconds of changes are lost.
+ */
+#define SFS_SYNCPERIOD   1
+#define SFS_SYNCAGE      5
+
 struct sfs_fs {
 	struct fs sfs_absfs;            /* abstract filesystem structure */
 	struct sfs_super sfs_super;	/* on-disk superblock */
 	int sfs_superdirty;             /* true if superblock modified */
 	struct device *sfs_device;      /* device mounted on */
-	struct array *sfs_vnodes;       /* vnodes loaded into memory */
+	struct sfs_vnode **sfs_vnhash;  /* vnodes loaded, hashed by inode */
+	u_int32_t sfs_nvnodes;          /* number of vnodes loaded */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	int sfs_freemapdirty;           /* true if freemap modified */
+	u_int32_t sfs_ngroups;          /* number of allocation groups */
+	u_int32_t *sfs_groupfree;       /* free blocks in each group */
+	struct lock *sfs_vnlock;        /* protects sfs_vnhash */
+	struct sfs_buf *sfs_bufs[SFS_MAXBUFS]; /* buffer cache */
+	u_int32_t sfs_nbufs;            /* buffers allocated */
+	u_int32_t sfs_nbufmeta;         /* buffers holding dirty metadata */
+	struct sfs_buf *sfs_bufhash[SFS_BUFHASHSIZE]; /* buffers by block */
+	struct sfs_buf *sfs_bufmru;     /* most recently used buffer */
+	struct sfs_buf *sfs_buflru;     /* least recently used buffer */
+	time_t sfs_freemapdirtysince;   /* when freemap/super became dirty */
+	volatile int sfs_syncerexit;    /* tells syncer thread to quit */
+	struct semaphore *sfs_syncerdone; /* syncer signals when it quits */
+	u_int32_t sfs_jstart;           /* first block of journal */
+	u_int32_t sfs_jblocks;          /* journal size; 0 if none */
+	u_int32_t sfs_jseq;             /* next transaction number */
+	int sfs_jactive;                /* operations in progress */
+	int sfs_jcommitting;            /* true while committing */
+	void *sfs_jbuf;                 /* block for journal bookkeeping */
+	struct sfs_buf *sfs_jbufs[SFS_MAXBUFS]; /* transaction being built */
 };
 
 /*
@@ -35,11 +110,24 @@ struct sfs_fs {
  */
 int sfs_mount(const char *device);
 
+/*
+ * Print allocation statistics (for the kernel menu)
+ */
+void sfs_printstats(void);
+
 
 /*
  * Internal functions
  */
 
+/*
+ * Allocation groups. Like cylinder groups in FFS, these let us keep
+ * related blocks near each other; each group is the span of disk
+ * covered by one block of the freemap.
+ */
+#define SFS_GROUPSIZE       SFS_BLOCKBITS
+#define SFS_GROUP(block)    ((block) / SFS_GROUPSIZE)
+
 /* Initialize uio structure */
 #define SFSUIO(uio, ptr, block, rw) \
     mk_kuio(uio, ptr, SFS_BLOCKSIZE, ((off_t)(block))*SFS_BLOCKSIZE, rw)
@@ -49,6 +137,35 @@ int sfs_rwblock(struct sfs_fs *sfs, struct uio *uio);
 int sfs_rblock(struct sfs_fs *sfs, void *data, u_int32_t block);
 int sfs_wblock(struct sfs_fs *sfs, void *data, u_int32_t block);
 
+/* Buffer cache */
+int sfs_bufinit(struct sfs_fs *sfs);
+void sfs_bufcleanup(struct sfs_fs *sfs);
+int sfs_bread(struct sfs_fs *sfs, u_int32_t block, struct sfs_buf **ret);
+int sfs_bget(struct sfs_fs *sfs, u_int32_t block, struct sfs_buf **ret);
+struct sfs_buf *sfs_bpeek(struct sfs_fs *sfs, u_int32_t block);
+void sfs_bdirty(struct sfs_fs *sfs, struct sfs_buf *buf, u_int32_t owner,
+		int meta);
+void sfs_brelse(struct sfs_fs *sfs, struct sfs_buf *buf);
+void sfs_binval(struct sfs_fs *sfs, u_int32_t block);
+int sfs_bflush(struct sfs_fs *sfs, u_int32_t owner, int minage);
+int sfs_bgetmeta(struct sfs_fs *sfs, struct sfs_buf **bufs, int max);
+int sfs_bwrite(struct sfs_fs *sfs, struct sfs_buf *buf);
+int sfs_wmeta(struct sfs_fs *sfs, const void *data, u_int32_t block);
+void sfs_printbufstats(void);
+
+/* Metadata journal */
+int sfs_jreplay(struct sfs_fs *sfs);
+void sfs_jbegin(struct sfs_fs *sfs);
+void sfs_jend(struct sfs_fs *sfs);
+int sfs_jsync(struct sfs_fs *sfs);
+void sfs_printjournalstats(void);
+
+/* Write back the freemap and superblock, if dirty */
+int sfs_syncmap(struct sfs_fs *sfs);
+
+/* Write back inodes dirty for at least MINAGE seconds */
+int sfs_syncvnodes(struct sfs_fs *sfs, int minage);
+
 /* Get root vnode */
 struct vnode *sfs_getroot(struct fs *fs);
 
@@ -4,6 +4,9 @@
 
 #ifndef _SYNCH_H_
 #define _SYNCH_H_
+
+#include "opt-lockstat.h"
+#include "opt-lockorder.h"
 // #include <stdbool.h>
 
 /*
@@ -19,9 +22,14 @@
  * internally.
  */
 
+struct lockstat;
+
 struct semaphore {
 	char *name;
 	volatile int count;
+#if OPT_LOCKSTAT
+	struct lockstat *ls;                /* stats for its name */
+#endif
 };
 
 struct semaphore *sem_create(const char *name, int initial_count);
@@ -56,6 +64,13 @@ typedef struct lock { 					// this is a basic implementation
 	// volatile int available;
 	int *available;						// indicates if the lock is in use or not. TODO: should this be volatile
     struct thread *holder;
+#if OPT_LOCKSTAT
+	struct lockstat *ls;                /* stats for its name */
+	u_int32_t ls_stamp;                 /* when it was acquired */
+#endif
+#if OPT_LOCKORDER
+	int lo_class;                       /* order class, or -1 */
+#endif
 
 } lock_t;
 
@@ -106,4 +121,59 @@ void       cv_signal(struct cv *cv, struct lock *lock);
 void       cv_broadcast(struct cv *cv, struct lock *lock);
 void       cv_destroy(struct cv *);
 
+
+#if OPT_LOCKSTAT
+/*
+ * Lock contention statistics (options lockstat).
+ *
+ * Locks and semaphores are grouped by name, so all the vnode count
+ * locks, say, count together. For each name this keeps how often
+ * they were acquired (P for a semaphore) and how often that had to
+ * wait, the total time spent waiting, the total and longest time a
+ * lock was held, and the threads that waited longest for it.
+ *
+ *    lockstat_bootstrap - Start timing; call once there's a clock.
+ *    lockstat_print     - Print the names, most total wait first.
+ *    lockstat_reset     - Zero the statistics.
+ *
+ * Without the option none of this, nor anything in the lock and
+ * semaphore code to collect it, is compiled.
+ */
+void lockstat_bootstrap(void);
+void lockstat_print(void);
+void lockstat_reset(void);
+#endif
+
+#if OPT_LOCKORDER
+/*
+ * Lock order checking (options lockorder).
+ *
+ * Locks are grouped into classes by name, as for lockstat. Each time
+ * a thread acquires a lock while holding others, the order (held
+ * class before acquired class) is added to a graph. If a new order
+ * closes a cycle in the graph, some interleaving of the threads that
+ * took those orders can deadlock, whether or not it has yet; this is
+ * reported on the console the first time each such pair is seen,
+ * with the acquiring thread's held locks and, for each order along
+ * the other way round the cycle, the locks held when it was first
+ * taken. Locks are shown with the address each was acquired from.
+ *
+ * The check is made before lock_acquire waits, so a deadlock that
+ * is about to happen is reported before it hangs. Try-acquires
+ * can't deadlock, so they add no orders, but they count as held.
+ * Nesting two locks of the same class isn't checked, since
+ * hand-over-hand locking (as in the stoplight queues) does that
+ * legitimately and the classes can't tell the locks apart.
+ *
+ *    lockorder_print   - Print the orders seen and how many cycles
+ *                        have been reported.
+ *    lockorder_reports - Return how many cycles have been reported.
+ *
+ * Without the option none of this, nor anything in the lock or thread
+ * code to support it, is compiled.
+ */
+void lockorder_print(void);
+unsigned lockorder_reports(void);
+#endif
+
 #endif /* _SYNCH_H_ */
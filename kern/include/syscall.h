@@ -5,7 +5,48 @@
  * Prototypes for IN-KERNEL entry points for system call implementations.
  */
 
+/*
+ * Dispatch (userprog/sysdispatch.c). The machine-dependent trap code
+ * fetches syscall_nargs(callno) argument words, at most
+ * SYSCALL_MAXARGS, and passes them to syscall_dispatch.
+ */
+#define SYSCALL_MAXARGS  6
+
+struct trapframe;
+
+int syscall_nargs(int callno);
+int syscall_dispatch(int callno, struct trapframe *tf, const u_int32_t *args,
+		     int32_t *retval);
+void syscall_printstats(void);
+void syscall_resetstats(void);
+void syscall_shutdown(void);
+
 int sys_reboot(int code);
 
+/* Processes */
+int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_execv(userptr_t path, userptr_t argv);
+int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
+int sys_getpid(pid_t *retval);
+void sys__exit(int code);
+
+/* Files */
+int sys_open(userptr_t path, int flags, int *retval);
+int sys_read(int fd, userptr_t buf, size_t len, int *retval);
+int sys_write(int fd, userptr_t buf, size_t len, int *retval);
+int sys_readv(int fd, userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, userptr_t iov, int iovcnt, int *retval);
+int sys_close(int fd);
+int sys_lseek(int fd, off_t pos, int whence, off_t *retval);
+int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_pipe(userptr_t fds);
+int sys_remove(userptr_t path);
+
+/* Time */
+int sys___time(userptr_t secs, userptr_t nsecs, int *retval);
+
+/* Stats */
+int sys___kstats(userptr_t ks);
+
 
 #endif /* _SYSCALL_H_ */
@@ -19,6 +19,8 @@ int createvehicles(int, char **);
 int arraytest(int, char **);
 int bitmaptest(int, char **);
 int queuetest(int, char **);
+int memcpytest(int, char **);
+int memcpybench(int, char **);
 
 /* thread tests */
 int threadtest(int, char **);
@@ -27,6 +29,7 @@ int threadtest3(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
+int lockordertest(int, char **);	/* only if OPT_LOCKORDER is set */
 
 /* filesystem tests */
 int fstest(int, char **);
@@ -34,8 +37,25 @@ int readstress(int, char **);
 int writestress(int, char **);
 int writestress2(int, char **);
 int createstress(int, char **);
+int filltest(int, char **);
+int dirstress(int, char **);
+int gathertest(int, char **);
 int printfile(int, char **);
 
+/* benchmarks */
+int benchfork(int, char **);
+int benchyield(int, char **);
+int benchpv(int, char **);
+int benchlock(int, char **);
+int benchmalloc(int, char **);
+int benchuio(int, char **);
+int benchfs(int, char **);
+int benchlookup(int, char **);
+int benchall(int, char **);
+
+/* device tests */
+int iotest(int, char **);
+
 /* other tests */
 int malloctest(int, char **);
 int mallocstress(int, char **);
@@ -45,6 +65,6 @@ int nettest(int, char **);
 void menu(char *argstr);
 
 /* Routine for running userlevel test code. */
-int runprogram(char *progname);
+int runprogram(char *progname, char **args, int nargs);
 
 #endif /* _TEST_H_ */
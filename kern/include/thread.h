@@ -7,9 +7,16 @@
 
 /* Get machine-dependent stuff */
 #include <machine/pcb.h>
+#include "opt-lockorder.h"
 
 
 struct addrspace;
+struct filetable;
+struct proc;
+struct lock;
+
+/* Locks per thread the lock order checker keeps track of */
+#define THREAD_NHELD 8
 
 struct thread {
 	/**********************************************************/
@@ -20,6 +27,32 @@ struct thread {
 	char *t_name;
 	const void *t_sleepaddr;
 	char *t_stack;
+
+	/*
+	 * CPU accounting, for thread_printstats. Times are in
+	 * microseconds and wrap after about 71 minutes; t_stamp is
+	 * when the thread last started running, became runnable, or
+	 * went to sleep.
+	 */
+	u_int32_t t_stamp;
+	u_int32_t t_ticks;          /* timer ticks while running */
+	u_int32_t t_runtime;        /* time running */
+	u_int32_t t_readytime;      /* time runnable but not running */
+	u_int32_t t_sleeptime;      /* time asleep */
+	u_int32_t t_lastruntime;    /* t_runtime at the last printstats */
+	u_int32_t t_nvolswitch;     /* switches by sleeping or yielding */
+	u_int32_t t_ninvolswitch;   /* switches by being preempted */
+
+#if OPT_LOCKORDER
+	/*
+	 * Locks held, oldest first, and where each was acquired, for
+	 * the lock order checker (see synch.h). Past THREAD_NHELD
+	 * they aren't tracked.
+	 */
+	struct lock *t_held[THREAD_NHELD];
+	vaddr_t t_heldpc[THREAD_NHELD];
+	int t_nheld;
+#endif
 	
 	/**********************************************************/
 	/* Public thread members - can be used by other code      */
@@ -37,6 +70,18 @@ struct thread {
 	 * and is manipulated by the virtual filesystem (VFS) code.
 	 */
 	struct vnode *t_cwd;
+
+	/*
+	 * The file descriptor table, for threads running user
+	 * programs; NULL otherwise. See file.h.
+	 */
+	struct filetable *t_filetable;
+
+	/*
+	 * The process, for threads running user programs; NULL
+	 * otherwise. See proc.h.
+	 */
+	struct proc *t_proc;
 };
 
 /* Call once during startup to allocate data structures. */
@@ -69,6 +114,14 @@ int thread_fork(const char *name,
  */
 void thread_exit(void);
 
+/*
+ * Let go of the current thread's open files and address space, so
+ * that a process has released everything by the time its parent
+ * hears it has exited. thread_exit does this too, if it hasn't been
+ * done.
+ */
+void thread_release(void);
+
 /*
  * Cause the current thread to yield to the next runnable thread, but
  * itself stay runnable.
@@ -90,6 +143,13 @@ void thread_sleep(const void *addr);
  */
 void thread_wakeup(const void *addr);
 
+/*
+ * Like thread_wakeup, but wake only one thread (the one that has
+ * been asleep longest).
+ * Interrupts must be disabled.
+ */
+void thread_wakeone(const void *addr);
+
 /*
  * Return nonzero if there are any threads sleeping on the specified
  * address. Meant only for diagnostic purposes.
@@ -97,6 +157,20 @@ void thread_wakeup(const void *addr);
 int thread_hassleepers(const void *addr);
 
 
+/*
+ * CPU accounting.
+ *
+ * thread_stats_bootstrap starts it; call it once there's a clock.
+ * thread_tick is called from hardclock on every timer tick.
+ * thread_printstats prints a table of the threads with the time each
+ * has spent running, runnable, and asleep, and its context switches,
+ * and the system-wide switch rate and idle time since the last call.
+ */
+void thread_stats_bootstrap(void);
+void thread_tick(void);
+void thread_printstats(void);
+
+
 /*
  * Private thread functions.
  */
@@ -0,0 +1,55 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <kern/trace.h>
+
+/*
+ * In-memory event trace.
+ *
+ * TRACE(type, arg1, arg2) records an event (see <kern/trace.h> for
+ * the types and what their arguments are) with the time and the
+ * current thread, if the event's class is enabled in trace_mask.
+ * Events go in a ring of TRACE_NEVENTS, so once it's full each new
+ * one overwrites the oldest. When the class is off, a tracepoint
+ * costs a load, an and, and a branch, so they can be left in hot
+ * paths.
+ *
+ * This is a uniprocessor, so recording an event just goes to
+ * splhigh to claim a slot and fill it in; there is no lock. It may be
+ * done from anywhere, including interrupt handlers and the scheduler.
+ *
+ *    trace_bootstrap - Allocate the ring. Tracing starts off.
+ *    trace_record    - Record an event. Use TRACE instead.
+ *    trace_setmask   - Set which classes are traced; 0 turns tracing
+ *                      off.
+ *    trace_class     - Look up a class by name (see TRC_* in
+ *                      <kern/trace.h>; "sched" for TRC_SCHED, etc.)
+ *                      Returns -1 if there's no such class.
+ *    trace_clear     - Throw away everything recorded.
+ *    trace_printstats - Print the mask and how many events are held.
+ *    trace_print     - Decode the last N events to the console.
+ *    trace_save      - Write the ring to the file PATH, in the format
+ *                      tracedump reads. May destroy PATH.
+ *
+ * Tracing is turned off while printing or saving, so the trace isn't
+ * filled with the console and disk activity that causes.
+ */
+
+#define TRACE_NEVENTS  4096     /* must be a power of 2 */
+
+extern u_int32_t trace_mask;
+
+#define TRACE(type, a1, a2) \
+	((trace_mask & (1 << TR_CLASS(type))) ? \
+	 trace_record((type), (u_int32_t)(a1), (u_int32_t)(a2)) : (void)0)
+
+void trace_bootstrap(void);
+void trace_record(u_int32_t type, u_int32_t arg1, u_int32_t arg2);
+void trace_setmask(u_int32_t mask);
+int trace_class(const char *name);
+void trace_clear(void);
+void trace_printstats(void);
+void trace_print(unsigned n);
+int trace_save(char *path);
+
+#endif /* _TRACE_H_ */
@@ -2,8 +2,14 @@
 #define _UIO_H_
 
 /*
- * Like BSD uio, but simplified a bit. (In BSD, there can be more than one
- * iovec in a uio.)
+ * Like BSD uio, but simplified a bit.
+ *
+ * The data block being transferred is always in uio_iovec. A uio can
+ * also describe several blocks (for readv and writev): the rest are
+ * in the array uio_iov, and uiomove moves on to each one in turn when
+ * it finishes the one before. uio_iov is only read, never written, so
+ * it may point at the caller's array. For a single block, set uio_iov
+ * to NULL and uio_iovcnt to 0.
  */
 
 enum uio_rw {
@@ -29,6 +35,8 @@ struct iovec {
 
 struct uio {
 	struct iovec      uio_iovec;       /* Data block */
+	const struct iovec *uio_iov;       /* Further data blocks, or NULL */
+	int               uio_iovcnt;      /* Number of blocks in uio_iov */
 	off_t             uio_offset;      /* desired offset into object */
 	size_t            uio_resid;       /* Remaining amt of data to xfer */
 	enum uio_seg      uio_segflg;      /* what kind of pointer we have */
@@ -43,7 +51,8 @@ struct uio {
  * fields as well.
  *
  * Before calling this, you should
- *   (1) set up uio_iovec to point to the buffer you want to transfer to;
+ *   (1) set up uio_iovec to point to the buffer you want to transfer to,
+ *       and uio_iov and uio_iovcnt to any further buffers;
  *   (2) initialize uio_offset as desired;
  *   (3) initialize uio_resid to the total amount of data that can be 
  *       transferred through this uio;
@@ -53,8 +62,8 @@ struct uio {
  *       should be found.
  *
  * After calling, 
- *   (1) the contents of uio_iovec may be altered and should not be 
- *       interpreted;
+ *   (1) the contents of uio_iovec, uio_iov, and uio_iovcnt may be
+ *       altered and should not be interpreted;
  *   (2) uio_offset will have been incremented by the amount transferred;
  *   (3) uio_resid will have been decremented by the amount transferred;
  *   (4) uio_segflg, uio_rw, and uio_space will be unchanged.
@@ -83,4 +92,15 @@ int uiomovezeros(size_t len, struct uio *uio);
  */
 void mk_kuio(struct uio *, void *kbuf, size_t len, off_t pos, enum uio_rw rw);
 
+/*
+ * Initialize uio for I/O to or from user memory, given the address
+ * UIOV of an array of IOVCNT user iovecs (as passed to readv and
+ * writev). The array is copied into IOV, which must have room for
+ * IOV_MAX entries and must stay around while the uio is in use.
+ * Fails with EINVAL if IOVCNT is out of range or the lengths add up
+ * to more than fits in a size_t.
+ */
+int mk_uuio(struct uio *, struct iovec *iov, userptr_t uiov, int iovcnt,
+	    off_t pos, enum uio_rw rw);
+
 #endif /* _UIO_H_ */
@@ -48,6 +48,66 @@ int vfs_lookup(char *path, struct vnode **result);
 int vfs_lookparent(char *path, struct vnode **result,
 		   char *buf, size_t buflen);
 
+/*
+ * VFS name cache (used by vfs_lookup).
+ *
+ *    vfs_namecache_lookup - Check for a cached lookup of NAME relative
+ *                     to DIR. Returns nonzero on a hit; the vnode is
+ *                     handed back referenced, or NULL for a cached
+ *                     ENOENT. On a miss, hands back a generation
+ *                     number to pass to vfs_namecache_enter.
+ *    vfs_namecache_enter - Cache the result (a vnode, or NULL for
+ *                     ENOENT) of looking up NAME relative to DIR.
+ *    vfs_namecache_purge - Drop all entries for a filesystem (or all
+ *                     entries, if passed NULL).
+ *    vfs_namecache_purgename - Drop the entries for a filesystem whose
+ *                     path includes NAME. Must be done whenever a
+ *                     directory entry NAME is created or removed.
+ *    vfs_namecache_printstats - Print hit rates.
+ *
+ * Paths of VFS_NAMECACHE_NAMELEN or more characters are not cached.
+ */
+
+#define VFS_NAMECACHE_NAMELEN  64
+
+int vfs_namecache_lookup(struct vnode *dir, const char *name,
+			 struct vnode **ret, u_int32_t *gen);
+void vfs_namecache_enter(struct vnode *dir, const char *name,
+			 struct vnode *vn, u_int32_t gen);
+void vfs_namecache_purge(struct fs *fs);
+void vfs_namecache_purgename(struct fs *fs, const char *name);
+void vfs_namecache_printstats(void);
+
+/*
+ * VFS page cache (used by filesystems for reading file data).
+ *
+ *    vfs_pcache_read - Read from VN into UIO, a page at a time, from
+ *                     the cache. Pages that aren't cached are read
+ *                     with FILL, which should read the page of the
+ *                     file at OFFSET into PAGE and set *LEN to how
+ *                     many bytes there were (less than a page at
+ *                     EOF).
+ *    vfs_pcache_insert - Offer page PAGENO of VN, LEN bytes at DATA,
+ *                     that a fill function got along with the page it
+ *                     was asked for. Ignored if the page is already
+ *                     cached or no cache page is free.
+ *    vfs_pcache_invalidate - Drop all cached pages of a file. Must be
+ *                     done after the file is written or truncated,
+ *                     and when its vnode is reclaimed.
+ *    vfs_pcache_purge - Drop all cached pages of files on FS.
+ *    vfs_pcache_printstats - Print hit rates.
+ */
+
+typedef int (*vfs_pcache_fill_t)(struct vnode *vn, void *page, off_t offset,
+				 u_int32_t *len);
+
+int vfs_pcache_read(struct vnode *vn, struct uio *uio, vfs_pcache_fill_t fill);
+void vfs_pcache_insert(struct vnode *vn, u_int32_t pageno, const void *data,
+		       u_int32_t len);
+void vfs_pcache_invalidate(struct vnode *vn);
+void vfs_pcache_purge(struct fs *fs);
+void vfs_pcache_printstats(void);
+
 /*
  * VFS layer high-level operations on pathnames
  * Because namei may destroy pathnames, these all may too.
@@ -81,6 +141,15 @@ int vfs_rename(char *oldpath, char *newpath);
 int vfs_chdir(char *path);
 int vfs_getcwd(struct uio *buf);
 
+/*
+ * Pipes
+ *
+ *    pipe_create - Make a pipe, handing back its read and write ends
+ *                  already open. Close each with vfs_close.
+ */
+
+int pipe_create(struct vnode **readend, struct vnode **writeend);
+
 /*
  * Misc
  *
@@ -91,6 +160,10 @@ int vfs_getcwd(struct uio *buf);
  *                    bootfs-related structures. (Called from 
  *                    vfs_bootstrap.)
  *
+ *    vfs_namecache_bootstrap - Likewise, for the name cache.
+ *
+ *    vfs_pcache_bootstrap - Likewise, for the page cache.
+ *
  *    vfs_setbootfs - Set the filesystem that paths beginning with a
  *                    slash are sent to. If not set, these paths fail
  *                    with ENOENT. The argument should be the device
@@ -128,11 +201,17 @@ int vfs_getcwd(struct uio *buf);
  *                    specified device.
  *
  *    vfs_unmountall - Unmount all mounted filesystems.
+ *
+ *    vfs_getdevice - Find the device structure for a mountable device
+ *                    (such as "lhd0"), for code like benchmarks that
+ *                    talks to the device directly.
  */
 
 void vfs_bootstrap(void);
 
 void vfs_initbootfs(void);
+void vfs_namecache_bootstrap(void);
+void vfs_pcache_bootstrap(void);
 int vfs_setbootfs(const char *fsname);
 void vfs_clearbootfs(void);
 
@@ -145,5 +224,6 @@ int vfs_mount(const char *devname, void *data,
 			       struct fs **result));
 int vfs_unmount(const char *devname);
 int vfs_unmountall(void);
+int vfs_getdevice(const char *devname, struct device **result);
 
 #endif /* _VFS_H_ */
@@ -21,8 +21,18 @@
 #define WORD_TYPE       unsigned char
 #define WORD_ALLBITS    (0xff)
 
+/*
+ * When searching, however, we can still skip over full regions of
+ * the map four bytes at a time: whether a 32-bit chunk is all ones
+ * doesn't depend on byte order.
+ */
+#define SCAN_TYPE       u_int32_t
+#define SCAN_ALLBITS    (0xffffffff)
+#define WORDS_PER_SCAN  (sizeof(SCAN_TYPE)/sizeof(WORD_TYPE))
+
 struct bitmap {
 	u_int32_t nbits;
+	u_int32_t firstfree;	/* rotor: all words below this are full */
 	WORD_TYPE *v;
 };
 
@@ -44,8 +54,12 @@ bitmap_create(u_int32_t nbits)
 		return NULL;
 	}
 
+	/* The fast scan depends on kmalloc handing back aligned memory */
+	assert(((vaddr_t)b->v) % sizeof(SCAN_TYPE) == 0);
+
 	bzero(b->v, words*sizeof(WORD_TYPE));
 	b->nbits = nbits;
+	b->firstfree = 0;
 
 	/* Mark any leftover bits at the end in use */
 	if (nbits / BITS_PER_WORD < words) {
@@ -66,9 +80,58 @@ bitmap_create(u_int32_t nbits)
 void *
 bitmap_getdata(struct bitmap *b)
 {
+	/* The caller may be about to load new data; forget the rotor. */
+	b->firstfree = 0;
 	return b->v;
 }
 
+/*
+ * Return the index of the first word in [ix, limit) that has a clear
+ * bit in it, or limit if there isn't one.
+ */
+static
+u_int32_t
+bitmap_scan(struct bitmap *b, u_int32_t ix, u_int32_t limit)
+{
+	/* Byte at a time up to an alignment boundary... */
+	while (ix < limit && ix % WORDS_PER_SCAN != 0) {
+		if (b->v[ix] != WORD_ALLBITS) {
+			return ix;
+		}
+		ix++;
+	}
+
+	/* ...then skip full regions a scan word at a time... */
+	while (ix + WORDS_PER_SCAN <= limit &&
+	       *(SCAN_TYPE *)&b->v[ix] == SCAN_ALLBITS) {
+		ix += WORDS_PER_SCAN;
+	}
+
+	/* ...and find the exact word within what's left. */
+	while (ix < limit && b->v[ix] == WORD_ALLBITS) {
+		ix++;
+	}
+	return ix;
+}
+
+/*
+ * Return the offset of the lowest clear bit in a word that has one.
+ * w+1 carries through the low run of ones, so ~w & (w+1) is just the
+ * first clear bit; then turn that into a bit number without looping.
+ */
+static
+inline
+u_int32_t
+bitmap_firstclear(WORD_TYPE w)
+{
+	WORD_TYPE bit = (WORD_TYPE)~w & (WORD_TYPE)(w+1);
+
+	assert(w != WORD_ALLBITS);
+	return ((bit & 0xf0) ? 4 : 0) +
+		((bit & 0xcc) ? 2 : 0) +
+		((bit & 0xaa) ? 1 : 0);
+}
+
 int
 bitmap_alloc(struct bitmap *b, u_int32_t *index)
 {
@@ -76,21 +139,55 @@ bitmap_alloc(struct bitmap *b, u_int32_t *index)
 	u_int32_t maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
 	u_int32_t offset;
 
-	for (ix=0; ix<maxix; ix++) {
-		if (b->v[ix]!=WORD_ALLBITS) {
-			for (offset = 0; offset < BITS_PER_WORD; offset++) {
-				WORD_TYPE mask = ((WORD_TYPE)1)<<offset;
-				if ((b->v[ix] & mask)==0) {
-					b->v[ix] |= mask;
-					*index = (ix*BITS_PER_WORD)+offset;
-					assert(*index < b->nbits);
-					return 0;
-				}
+	/* Nothing below the rotor is free, so start there. */
+	ix = bitmap_scan(b, b->firstfree, maxix);
+	b->firstfree = ix;
+	if (ix == maxix) {
+		return ENOSPC;
+	}
+
+	offset = bitmap_firstclear(b->v[ix]);
+	b->v[ix] |= ((WORD_TYPE)1)<<offset;
+	*index = (ix*BITS_PER_WORD)+offset;
+	assert(*index < b->nbits);
+	return 0;
+}
+
+int
+bitmap_alloc_near(struct bitmap *b, u_int32_t goal, u_int32_t *index)
+{
+	u_int32_t ix, goalix, offset;
+	u_int32_t maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
+	WORD_TYPE w;
+
+	if (goal >= b->nbits) {
+		goal = 0;
+	}
+	goalix = goal / BITS_PER_WORD;
+
+	/* First try the goal itself and the bits after it in its word. */
+	w = b->v[goalix] | (WORD_TYPE)((1 << (goal % BITS_PER_WORD)) - 1);
+	if (w != WORD_ALLBITS) {
+		ix = goalix;
+		offset = bitmap_firstclear(w);
+	}
+	else {
+		/* Then search forward to the end of the map... */
+		ix = bitmap_scan(b, goalix+1, maxix);
+		if (ix == maxix) {
+			/* ...and wrap around, from the rotor up to the goal. */
+			ix = bitmap_scan(b, b->firstfree, goalix+1);
+			if (ix >= goalix+1) {
+				return ENOSPC;
 			}
-			assert(0);
 		}
+		offset = bitmap_firstclear(b->v[ix]);
 	}
-	return ENOSPC;
+
+	b->v[ix] |= ((WORD_TYPE)1)<<offset;
+	*index = (ix*BITS_PER_WORD)+offset;
+	assert(*index < b->nbits);
+	return 0;
 }
 
 static
@@ -128,6 +225,11 @@ bitmap_unmark(struct bitmap *b, u_int32_t index)
 	assert((b->v[ix] & mask)!=0);
 
 	b->v[ix] &= ~mask;
+
+	/* Keep the rotor below every free bit */
+	if (ix < b->firstfree) {
+		b->firstfree = ix;
+	}
 }
 
 
@@ -174,6 +174,13 @@ copyout(const void *src, userptr_t userdest, size_t len)
 	return 0;
 }
 
+/*
+ * True if some byte of the 32-bit word W is zero: the top bit of a
+ * byte can be set after subtracting 1 from each byte, and clear
+ * before, only if that byte or one below it was zero.
+ */
+#define HASZERO(w)  (((w) - 0x01010101) & ~(w) & 0x80808080)
+
 /*
  * Common string copying function that behaves the way that's desired
  * for copyinstr and copyoutstr.
@@ -189,20 +196,54 @@ copyout(const void *src, userptr_t userdest, size_t len)
  * hit STOPLEN it's because the string has run into the end of
  * userspace. Thus in the latter case we return EFAULT, not 
  * ENAMETOOLONG.
+ *
+ * Once SRC is word-aligned, the string is read a word at a time, and
+ * the word is checked for a zero byte before anything is stored, so
+ * only the last few bytes are done one at a time. Reading a whole
+ * aligned word can't fault where reading its first byte didn't, and
+ * USERTOP is page-aligned, so a word never straddles STOPLEN. The
+ * words are stored whole when DEST is aligned the same way as SRC.
  */
 static
 int
 copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 	size_t *gotlen)
 {
-	size_t i;
-	for (i=0; i<maxlen && i<stoplen; i++) {
+	size_t i, limit;
+	u_int32_t w;
+
+	limit = maxlen < stoplen ? maxlen : stoplen;
+
+	i = 0;
+	while (i < limit && (vaddr_t)(src+i) % sizeof(u_int32_t) != 0) {
+		dest[i] = src[i];
+		if (src[i]==0) {
+			goto done;
+		}
+		i++;
+	}
+
+	while (limit - i >= sizeof(u_int32_t)) {
+		w = *(const u_int32_t *)(src+i);
+		if (HASZERO(w)) {
+			break;
+		}
+		if ((vaddr_t)(dest+i) % sizeof(u_int32_t) == 0) {
+			*(u_int32_t *)(dest+i) = w;
+		}
+		else {
+			dest[i] = src[i];
+			dest[i+1] = src[i+1];
+			dest[i+2] = src[i+2];
+			dest[i+3] = src[i+3];
+		}
+		i += sizeof(u_int32_t);
+	}
+
+	for (; i<limit; i++) {
 		dest[i] = src[i];
 		if (src[i]==0) {
-			if (gotlen != NULL) {
-				*gotlen = i+1;
-			}
-			return 0;
+			goto done;
 		}
 	}
 	if (stoplen < maxlen) {
@@ -210,6 +251,12 @@ copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 		return EFAULT;
 	}
 	return ENAMETOOLONG;
+
+ done:
+	if (gotlen != NULL) {
+		*gotlen = i+1;
+	}
+	return 0;
 }
 
 /*
@@ -277,3 +324,134 @@ copyoutstr(const char *src, userptr_t userdest, size_t len, size_t *actual)
 	curthread->t_pcb.pcb_badfaultfunc = NULL;
 	return result;
 }
+
+/*
+ * copyinv
+ *
+ * Copy each of the NVEC blocks described by VEC from user space to
+ * kernel space. All the blocks are checked before anything is copied,
+ * and the copying is done under a single pcb_badfaultfunc/setjmp, so
+ * this is cheaper than calling copyin for each.
+ */
+int
+copyinv(const struct copyvec *vec, unsigned nvec)
+{
+	int result;
+	size_t stoplen;
+	unsigned i;
+
+	for (i=0; i<nvec; i++) {
+		result = copycheck(vec[i].cv_uaddr, vec[i].cv_len, &stoplen);
+		if (result) {
+			return result;
+		}
+		if (stoplen != vec[i].cv_len) {
+			return EFAULT;
+		}
+	}
+
+	curthread->t_pcb.pcb_badfaultfunc = copyfail;
+
+	result = setjmp(curthread->t_pcb.pcb_copyjmp);
+	if (result) {
+		curthread->t_pcb.pcb_badfaultfunc = NULL;
+		return EFAULT;
+	}
+
+	for (i=0; i<nvec; i++) {
+		memcpy(vec[i].cv_kaddr, (const void *)vec[i].cv_uaddr,
+		       vec[i].cv_len);
+	}
+
+	curthread->t_pcb.pcb_badfaultfunc = NULL;
+	return 0;
+}
+
+/*
+ * copyoutv
+ *
+ * Copy each of the NVEC blocks described by VEC from kernel space to
+ * user space, as per copyinv.
+ */
+int
+copyoutv(const struct copyvec *vec, unsigned nvec)
+{
+	int result;
+	size_t stoplen;
+	unsigned i;
+
+	for (i=0; i<nvec; i++) {
+		result = copycheck(vec[i].cv_uaddr, vec[i].cv_len, &stoplen);
+		if (result) {
+			return result;
+		}
+		if (stoplen != vec[i].cv_len) {
+			return EFAULT;
+		}
+	}
+
+	curthread->t_pcb.pcb_badfaultfunc = copyfail;
+
+	result = setjmp(curthread->t_pcb.pcb_copyjmp);
+	if (result) {
+		curthread->t_pcb.pcb_badfaultfunc = NULL;
+		return EFAULT;
+	}
+
+	for (i=0; i<nvec; i++) {
+		memcpy((void *)vec[i].cv_uaddr, vec[i].cv_kaddr,
+		       vec[i].cv_len);
+	}
+
+	curthread->t_pcb.pcb_badfaultfunc = NULL;
+	return 0;
+}
+
+/*
+ * copyinstrv
+ *
+ * Copy the NSTRS strings at user addresses USRCS[] to kernel address
+ * DEST, one after another, each with its null terminator, using at
+ * most LEN bytes in all; as per copystr, but under a single
+ * pcb_badfaultfunc/setjmp. The total length used is stored in GOT.
+ */
+int
+copyinstrv(const const_userptr_t *usrcs, unsigned nstrs, char *dest,
+	   size_t len, size_t *got)
+{
+	int result;
+	size_t pos, stoplen, slen;
+	unsigned i;
+
+	curthread->t_pcb.pcb_badfaultfunc = copyfail;
+
+	result = setjmp(curthread->t_pcb.pcb_copyjmp);
+	if (result) {
+		curthread->t_pcb.pcb_badfaultfunc = NULL;
+		return EFAULT;
+	}
+
+	pos = 0;
+	for (i=0; i<nstrs; i++) {
+		if (pos == len) {
+			result = ENAMETOOLONG;
+			break;
+		}
+		result = copycheck(usrcs[i], len - pos, &stoplen);
+		if (result) {
+			break;
+		}
+		result = copystr(dest + pos, (const char *)usrcs[i],
+				 len - pos, stoplen, &slen);
+		if (result) {
+			break;
+		}
+		pos += slen;
+	}
+
+	curthread->t_pcb.pcb_badfaultfunc = NULL;
+	if (result == 0 && got != NULL) {
+		*got = pos;
+	}
+	return result;
+}
@@ -27,13 +27,9 @@ static
 void
 console_send(void *junk, const char *data, size_t len)
 {
-	size_t i;
-
 	(void)junk;
 
-	for (i=0; i<len; i++) {
-		putch(data[i]);
-	}
+	putchars(data, len);
 }
 
 /* Create the kprintf lock. Must be called before creating a second thread. */
@@ -0,0 +1,305 @@
+/*
+ * Statistical kernel profiler. See prof.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/unistd.h>
+#include <lib.h>
+#include <clock.h>
+#include <machine/spl.h>
+#include <thread.h>
+#include <curthread.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <prof.h>
+
+/* True while sampling */
+static int prof_on;
+
+/* PC hash table; an entry with pp_count 0 is empty */
+static struct prof_pc *prof_pcs;
+
+/* Thread table; the extra entry at the end is for everyone else */
+static struct prof_thread prof_threads[PROF_NTHREADS + 1];
+static unsigned prof_nthreads;
+
+static u_int32_t prof_nsamples;
+static u_int32_t prof_dropped;
+
+void
+prof_bootstrap(void)
+{
+	prof_pcs = kmalloc(PROF_NPCS * sizeof(struct prof_pc));
+	if (prof_pcs == NULL) {
+		panic("prof_bootstrap: Out of memory\n");
+	}
+	prof_on = 0;
+	prof_clear();
+}
+
+/*
+ * Find the thread table entry for the current thread, adding it if
+ * it's not there and there's room.
+ */
+static
+struct prof_thread *
+prof_thread(void)
+{
+	struct prof_thread *pt;
+	const char *name;
+	unsigned i;
+
+	for (i=0; i<prof_nthreads; i++) {
+		if (prof_threads[i].pt_thread == (u_int32_t)curthread) {
+			return &prof_threads[i];
+		}
+	}
+	if (prof_nthreads == PROF_NTHREADS) {
+		return &prof_threads[PROF_NTHREADS];
+	}
+
+	pt = &prof_threads[prof_nthreads++];
+	pt->pt_thread = (u_int32_t)curthread;
+	name = curthread->t_name;
+	for (i=0; i<PROF_NAMELEN-1 && name[i]; i++) {
+		pt->pt_name[i] = name[i];
+	}
+	pt->pt_name[i] = 0;
+	return pt;
+}
+
+/*
+ * Called from the timer interrupt, so interrupts are already off.
+ */
+void
+prof_sample(vaddr_t pc, int user)
+{
+	struct prof_pc *pp;
+	struct prof_thread *pt;
+	u_int32_t key, slot;
+	unsigned i;
+
+	if (!prof_on || curthread == NULL) {
+		return;
+	}
+
+	prof_nsamples++;
+
+	pt = prof_thread();
+	if (user) {
+		pt->pt_user++;
+	}
+	else {
+		pt->pt_kernel++;
+	}
+
+	/* Fibonacci hash of the word address, then probe linearly */
+	key = pc | (user ? PROF_USER : 0);
+	slot = ((pc >> 2) * 2654435761U) >> 20;
+	for (i=0; i<PROF_PROBE; i++) {
+		pp = &prof_pcs[(slot + i) & (PROF_NPCS - 1)];
+		if (pp->pp_count == 0) {
+			pp->pp_pc = key;
+			pp->pp_count = 1;
+			return;
+		}
+		if (pp->pp_pc == key) {
+			pp->pp_count++;
+			return;
+		}
+	}
+	prof_dropped++;
+}
+
+void
+prof_start(void)
+{
+	prof_on = 1;
+}
+
+void
+prof_stop(void)
+{
+	prof_on = 0;
+}
+
+void
+prof_clear(void)
+{
+	unsigned i;
+	int spl;
+
+	spl = splhigh();
+	for (i=0; i<PROF_NPCS; i++) {
+		prof_pcs[i].pp_pc = 0;
+		prof_pcs[i].pp_count = 0;
+	}
+	for (i=0; i<=PROF_NTHREADS; i++) {
+		prof_threads[i].pt_thread = 0;
+		prof_threads[i].pt_kernel = 0;
+		prof_threads[i].pt_user = 0;
+		strcpy(prof_threads[i].pt_name, "(others)");
+	}
+	prof_nthreads = 0;
+	prof_nsamples = 0;
+	prof_dropped = 0;
+	splx(spl);
+}
+
+static
+void
+prof_printthread(const struct prof_thread *pt)
+{
+	if (pt->pt_kernel + pt->pt_user == 0) {
+		return;
+	}
+	kprintf("  0x%08x %-16s %8u %8u\n", pt->pt_thread, pt->pt_name,
+		pt->pt_kernel, pt->pt_user);
+}
+
+void
+prof_print(unsigned n)
+{
+	struct prof_pc *pp, *best;
+	u_int32_t lastcount, lastpc;
+	unsigned i, j, npcs;
+	int on;
+
+	on = prof_on;
+	prof_on = 0;
+
+	npcs = 0;
+	for (i=0; i<PROF_NPCS; i++) {
+		if (prof_pcs[i].pp_count > 0) {
+			npcs++;
+		}
+	}
+	kprintf("prof: %s, %u samples at %u Hz, %u PCs, %u dropped\n",
+		on ? "on" : "off", prof_nsamples, HZ, npcs, prof_dropped);
+
+	kprintf("  %-10s %-16s %8s %8s\n", "thread", "name", "kernel", "user");
+	for (i=0; i<prof_nthreads; i++) {
+		prof_printthread(&prof_threads[i]);
+	}
+	prof_printthread(&prof_threads[PROF_NTHREADS]);
+
+	/*
+	 * The N PCs with the most samples, highest first: each time
+	 * round, the highest that comes after the last one printed in
+	 * (count descending, PC ascending) order.
+	 */
+	kprintf("  %-10s %-6s %8s\n", "pc", "mode", "samples");
+	lastcount = 0xffffffff;
+	lastpc = 0;
+	for (j=0; j<n; j++) {
+		best = NULL;
+		for (i=0; i<PROF_NPCS; i++) {
+			pp = &prof_pcs[i];
+			if (pp->pp_count == 0 || pp->pp_count > lastcount ||
+			    (pp->pp_count == lastcount && pp->pp_pc <= lastpc)) {
+				continue;
+			}
+			if (best == NULL || pp->pp_count > best->pp_count ||
+			    (pp->pp_count == best->pp_count &&
+			     pp->pp_pc < best->pp_pc)) {
+				best = pp;
+			}
+		}
+		if (best == NULL) {
+			break;
+		}
+		kprintf("  0x%08x %-6s %8u\n", best->pp_pc & ~PROF_USER,
+			(best->pp_pc & PROF_USER) ? "user" : "kernel",
+			best->pp_count);
+		lastcount = best->pp_count;
+		lastpc = best->pp_pc;
+	}
+
+	prof_on = on;
+}
+
+/*
+ * Write LEN bytes at BUF to V at *POS, advancing *POS.
+ */
+static
+int
+prof_write(struct vnode *v, void *buf, size_t len, off_t *pos)
+{
+	struct uio ku;
+	int result;
+
+	mk_kuio(&ku, buf, len, *pos, UIO_WRITE);
+	result = VOP_WRITE(v, &ku);
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid != 0) {
+		return ENOSPC;
+	}
+	*pos += len;
+	return 0;
+}
+
+/* PCs written at a time by prof_save */
+#define PROF_SAVEBATCH  64
+
+int
+prof_save(char *path)
+{
+	struct prof_header ph;
+	struct prof_pc batch[PROF_SAVEBATCH];
+	struct vnode *v;
+	off_t pos = 0;
+	unsigned i, n;
+	int on, result;
+
+	on = prof_on;
+	prof_on = 0;
+
+	result = vfs_open(path, O_WRONLY|O_CREAT|O_TRUNC, &v);
+	if (result) {
+		prof_on = on;
+		return result;
+	}
+
+	ph.ph_magic = PROF_MAGIC;
+	ph.ph_hz = HZ;
+	ph.ph_nsamples = prof_nsamples;
+	ph.ph_dropped = prof_dropped;
+	ph.ph_npcs = 0;
+	for (i=0; i<PROF_NPCS; i++) {
+		if (prof_pcs[i].pp_count > 0) {
+			ph.ph_npcs++;
+		}
+	}
+	ph.ph_nthreads = prof_nthreads + 1;
+	result = prof_write(v, &ph, sizeof(ph), &pos);
+
+	/* The used entries of the hash table, packed together */
+	n = 0;
+	for (i=0; i<PROF_NPCS && result == 0; i++) {
+		if (prof_pcs[i].pp_count > 0) {
+			batch[n++] = prof_pcs[i];
+		}
+		if (n == PROF_SAVEBATCH || (i == PROF_NPCS-1 && n > 0)) {
+			result = prof_write(v, batch, n * sizeof(batch[0]),
+					    &pos);
+			n = 0;
+		}
+	}
+
+	if (result == 0) {
+		result = prof_write(v, prof_threads,
+			prof_nthreads * sizeof(struct prof_thread), &pos);
+	}
+	if (result == 0) {
+		result = prof_write(v, &prof_threads[PROF_NTHREADS],
+			sizeof(struct prof_thread), &pos);
+	}
+
+	vfs_close(v);
+	prof_on = on;
+	return result;
+}
@@ -0,0 +1,250 @@
+/*
+ * In-memory event trace. See trace.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/unistd.h>
+#include <lib.h>
+#include <clock.h>
+#include <machine/spl.h>
+#include <thread.h>
+#include <curthread.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <trace.h>
+
+/* Classes being traced; see TRACE() */
+u_int32_t trace_mask;
+
+/* The ring, and the number of events ever recorded into it */
+static struct trace_event *trace_buf;
+static u_int32_t trace_next;
+
+static const char *const trace_classnames[TRC_NCLASSES] = {
+	"sched", "lock", "vm", "syscall", "disk",
+};
+
+/*
+ * How to print each type of event: its name, and a format for its
+ * two arguments.
+ */
+static const struct {
+	u_int32_t type;
+	const char *name;
+	const char *fmt;
+} trace_types[] = {
+	{ TR_SWITCH,    "switch",    "from 0x%x, which is now state %u" },
+	{ TR_SLEEP,     "sleep",     "on 0x%x" },
+	{ TR_WAKEUP,    "wakeup",    "on 0x%x, thread 0x%x" },
+	{ TR_LOCK,      "lock",      "0x%x, waited %u" },
+	{ TR_UNLOCK,    "unlock",    "0x%x" },
+	{ TR_VMFAULT,   "vmfault",   "at 0x%x, type %u" },
+	{ TR_SYSCALL,   "syscall",   "%u, a0 0x%x" },
+	{ TR_SYSRET,    "sysret",    "%u, error %u" },
+	{ TR_DISKQ,     "diskq",     "block %u, %u blocks" },
+	{ TR_DISKSTART, "diskstart", "block %u, %u blocks" },
+	{ TR_DISKDONE,  "diskdone",  "block %u, %u usec" },
+};
+#define TRACE_NTYPES (sizeof(trace_types) / sizeof(trace_types[0]))
+
+void
+trace_bootstrap(void)
+{
+	trace_buf = kmalloc(TRACE_NEVENTS * sizeof(struct trace_event));
+	if (trace_buf == NULL) {
+		panic("trace_bootstrap: Out of memory\n");
+	}
+	trace_next = 0;
+	trace_mask = 0;
+}
+
+void
+trace_record(u_int32_t type, u_int32_t arg1, u_int32_t arg2)
+{
+	struct trace_event *te;
+	time_t secs;
+	u_int32_t nsecs;
+	int spl;
+
+	gettime(&secs, &nsecs);
+
+	spl = splhigh();
+	te = &trace_buf[trace_next++ % TRACE_NEVENTS];
+	te->te_usecs = secs*1000000 + nsecs/1000;
+	te->te_type = type;
+	te->te_thread = (u_int32_t)curthread;
+	te->te_arg1 = arg1;
+	te->te_arg2 = arg2;
+	splx(spl);
+}
+
+void
+trace_setmask(u_int32_t mask)
+{
+	trace_mask = mask & ((1 << TRC_NCLASSES) - 1);
+}
+
+/*
+ * Return the class named NAME, or -1 if there isn't one.
+ */
+int
+trace_class(const char *name)
+{
+	int i;
+
+	for (i=0; i<TRC_NCLASSES; i++) {
+		if (!strcmp(name, trace_classnames[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+void
+trace_clear(void)
+{
+	int spl;
+
+	spl = splhigh();
+	trace_next = 0;
+	splx(spl);
+}
+
+/*
+ * Number of events held, and the index of the first.
+ */
+static
+u_int32_t
+trace_held(u_int32_t *first)
+{
+	u_int32_t n;
+
+	n = trace_next < TRACE_NEVENTS ? trace_next : TRACE_NEVENTS;
+	*first = trace_next - n;
+	return n;
+}
+
+void
+trace_printstats(void)
+{
+	u_int32_t first, n;
+	int i;
+
+	n = trace_held(&first);
+	kprintf("trace: %u events held, %u overwritten; tracing:",
+		n, first);
+	if (trace_mask == 0) {
+		kprintf(" nothing");
+	}
+	for (i=0; i<TRC_NCLASSES; i++) {
+		if (trace_mask & (1 << i)) {
+			kprintf(" %s", trace_classnames[i]);
+		}
+	}
+	kprintf("\n");
+}
+
+void
+trace_print(unsigned n)
+{
+	struct trace_event *te;
+	u_int32_t mask, first, held, i, start, arg2;
+	unsigned t;
+	int write;
+
+	mask = trace_mask;
+	trace_mask = 0;
+
+	held = trace_held(&first);
+	if (n > held) {
+		n = held;
+	}
+	first += held - n;
+	start = n > 0 ? trace_buf[first % TRACE_NEVENTS].te_usecs : 0;
+
+	kprintf("%10s %10s %-9s\n", "usec", "thread", "event");
+	for (i=first; i<first+n; i++) {
+		te = &trace_buf[i % TRACE_NEVENTS];
+		for (t=0; t<TRACE_NTYPES; t++) {
+			if (trace_types[t].type == te->te_type) {
+				break;
+			}
+		}
+		kprintf("%10u 0x%08x ", te->te_usecs - start, te->te_thread);
+		if (t == TRACE_NTYPES) {
+			kprintf("type 0x%x: 0x%x 0x%x\n", te->te_type,
+				te->te_arg1, te->te_arg2);
+			continue;
+		}
+
+		arg2 = te->te_arg2;
+		write = 0;
+		if ((te->te_type == TR_DISKQ || te->te_type == TR_DISKSTART)
+		    && (arg2 & TR_DISKWRITE)) {
+			arg2 &= ~TR_DISKWRITE;
+			write = 1;
+		}
+		kprintf("%-9s ", trace_types[t].name);
+		kprintf(trace_types[t].fmt, te->te_arg1, arg2);
+		if (write) {
+			kprintf(", write");
+		}
+		kprintf("\n");
+	}
+
+	trace_mask = mask;
+}
+
+int
+trace_save(char *path)
+{
+	struct trace_header th;
+	struct vnode *v;
+	struct uio ku;
+	u_int32_t mask, first, n, i, chunk;
+	off_t pos;
+	int result;
+
+	mask = trace_mask;
+	trace_mask = 0;
+
+	result = vfs_open(path, O_WRONLY|O_CREAT|O_TRUNC, &v);
+	if (result) {
+		trace_mask = mask;
+		return result;
+	}
+
+	n = trace_held(&first);
+	th.th_magic = TRACE_MAGIC;
+	th.th_nevents = n;
+	th.th_lost = first;
+	th.th_mask = mask;
+
+	mk_kuio(&ku, &th, sizeof(th), 0, UIO_WRITE);
+	result = VOP_WRITE(v, &ku);
+	pos = sizeof(th);
+
+	/* The events, oldest first: the ring may have wrapped */
+	while (result == 0 && ku.uio_resid == 0 && n > 0) {
+		i = first % TRACE_NEVENTS;
+		chunk = TRACE_NEVENTS - i;
+		if (chunk > n) {
+			chunk = n;
+		}
+		mk_kuio(&ku, &trace_buf[i], chunk * sizeof(struct trace_event),
+			pos, UIO_WRITE);
+		result = VOP_WRITE(v, &ku);
+		pos += chunk * sizeof(struct trace_event);
+		first += chunk;
+		n -= chunk;
+	}
+	if (result == 0 && ku.uio_resid != 0) {
+		result = ENOSPC;
+	}
+
+	vfs_close(v);
+	trace_mask = mask;
+	return result;
+}
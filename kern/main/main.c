@@ -16,6 +16,9 @@
 #include <vfs.h>
 #include <vm.h>
 #include <syscall.h>
+#include <proc.h>
+#include <trace.h>
+#include <prof.h>
 #include <version.h>
 
 void hello(); // function prototype for hello function
@@ -80,7 +83,15 @@ boot(void)
 	thread_bootstrap();
 	vfs_bootstrap();
 	dev_bootstrap();
+	thread_stats_bootstrap();
+#if OPT_LOCKSTAT
+	lockstat_bootstrap();
+#endif
 	vm_bootstrap();
+	proc_bootstrap();
+	exec_bootstrap();
+	trace_bootstrap();
+	prof_bootstrap();
 	kprintf_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
@@ -102,6 +113,7 @@ void
 shutdown(void)
 {
 	kprintf("Shutting down.\n");
+	syscall_shutdown();
 	
 	vfs_clearbootfs();
 	vfs_clearcurdir();
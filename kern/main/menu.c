@@ -9,14 +9,24 @@
 #include <lib.h>
 #include <clock.h>
 #include <thread.h>
+#include <curthread.h>
+#include <synch.h>
+#include <proc.h>
 #include <syscall.h>
 #include <uio.h>
 #include <vfs.h>
+#include <dev.h>
 #include <sfs.h>
+#include <emufs.h>
+#include <iosched.h>
+#include <trace.h>
+#include <prof.h>
 #include <test.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
+#include "opt-lockorder.h"
 
 #define _PATH_SHELL "/bin/sh"
 
@@ -39,39 +49,44 @@ getinterval(time_t s1, u_int32_t ns1, time_t s2, u_int32_t ns2,
 //
 // Command menu functions 
 
+/*
+ * What common_prog hands the thread that runs a program.
+ */
+struct progargs {
+	char **pa_args;
+	int pa_nargs;
+	struct proc *pa_proc;
+};
+
 /*
  * Function for a thread that runs an arbitrary userlevel program by
- * name.
- *
- * Note: this cannot pass arguments to the program. You may wish to 
- * change it so it can, because that will make testing much easier
- * in the future.
+ * name, passing it the arguments from the command line.
  *
  * It copies the program name because runprogram destroys the copy
  * it gets by passing it to vfs_open(). 
  */
 static
 void
-cmd_progthread(void *ptr, unsigned long nargs)
+cmd_progthread(void *ptr, unsigned long unused)
 {
-	char **args = ptr;
+	struct progargs *pa = ptr;
 	char progname[128];
 	int result;
 
-	assert(nargs >= 1);
+	(void)unused;
 
-	if (nargs > 2) {
-		kprintf("Warning: argument passing from menu not supported\n");
-	}
+	assert(pa->pa_nargs >= 1);
+
+	curthread->t_proc = pa->pa_proc;
 
 	/* Hope we fit. */
-	assert(strlen(args[0]) < sizeof(progname));
+	assert(strlen(pa->pa_args[0]) < sizeof(progname));
 
-	strcpy(progname, args[0]);
+	strcpy(progname, pa->pa_args[0]);
 
-	result = runprogram(progname);
+	result = runprogram(progname, pa->pa_args, pa->pa_nargs);
 	if (result) {
-		kprintf("Running program %s failed: %s\n", args[0],
+		kprintf("Running program %s failed: %s\n", pa->pa_args[0],
 			strerror(result));
 		return;
 	}
@@ -82,34 +97,50 @@ cmd_progthread(void *ptr, unsigned long nargs)
 /*
  * Common code for cmd_prog and cmd_shell.
  *
- * Note that this does not wait for the subprogram to finish, but
- * returns immediately to the menu. This is usually not what you want,
- * so you should have it call your system-calls-assignment waitpid
- * code after forking.
- *
- * Also note that because the subprogram's thread uses the "args"
- * array and strings, until you do this a race condition exists
- * between that code and the menu input code.
+ * The program runs as a new process, and the menu waits for it to
+ * exit before going on. (That also means the "args" array and strings,
+ * which the program's thread uses, stay put until it's done with them.)
  */
 static
 int
 common_prog(int nargs, char **args)
 {
-	int result;
+	struct progargs pa;
+	struct proc *p;
+	pid_t pid;
+	int code, result;
 
 #if OPT_SYNCHPROBS
 	kprintf("Warning: this probably won't work with a "
 		"synchronization-problems kernel.\n");
 #endif
 
+	result = proc_create(NULL, &p);
+	if (result) {
+		kprintf("proc_create failed: %s\n", strerror(result));
+		return result;
+	}
+	pid = p->p_pid;
+
+	pa.pa_args = args;
+	pa.pa_nargs = nargs;
+	pa.pa_proc = p;
+
 	result = thread_fork(args[0] /* thread name */,
-			args /* thread arg */, nargs /* thread arg */,
+			&pa /* thread arg */, 0 /* thread arg */,
 			cmd_progthread, NULL);
 	if (result) {
 		kprintf("thread_fork failed: %s\n", strerror(result));
+		proc_destroy(p);
 		return result;
 	}
 
+	result = proc_wait(pid, &code);
+	assert(result == 0);
+	if (code != 0) {
+		kprintf("%s: exit code %d\n", args[0], code);
+	}
+
 	return 0;
 }
 
@@ -347,6 +378,274 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_threadstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_namecachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	vfs_namecache_printstats();
+
+	return 0;
+}
+
+/*
+ * Command to choose the disk I/O scheduling policy. Put it on the
+ * kernel command line to pick one at boot.
+ */
+static
+int
+cmd_iosched(int nargs, char **args)
+{
+	if (nargs != 2) {
+		kprintf("Usage: iosched noop|cscan|deadline\n");
+		return EINVAL;
+	}
+
+	return iosched_select(args[1]);
+}
+
+/*
+ * Command to control the event trace:
+ *    tr                  - say what's being traced and how much is held
+ *    tr on [class...]    - trace the classes given, or all of them
+ *    tr off              - stop tracing
+ *    tr clear            - throw away the events held
+ *    tr show [n]         - decode the last N events (default 40)
+ *    tr save file        - write the events to FILE for tracedump
+ */
+static
+int
+cmd_trace(int nargs, char **args)
+{
+	u_int32_t mask;
+	int i, cls;
+
+	if (nargs == 1) {
+		trace_printstats();
+		return 0;
+	}
+	if (!strcmp(args[1], "on")) {
+		mask = (nargs == 2) ? 0xffffffff : 0;
+		for (i=2; i<nargs; i++) {
+			cls = trace_class(args[i]);
+			if (cls < 0) {
+				kprintf("tr: No class %s (classes are sched, "
+					"lock, vm, syscall, disk)\n", args[i]);
+				return EINVAL;
+			}
+			mask |= 1 << cls;
+		}
+		trace_setmask(mask);
+		return 0;
+	}
+	if (!strcmp(args[1], "off") && nargs == 2) {
+		trace_setmask(0);
+		return 0;
+	}
+	if (!strcmp(args[1], "clear") && nargs == 2) {
+		trace_clear();
+		return 0;
+	}
+	if (!strcmp(args[1], "show") && nargs <= 3) {
+		trace_print(nargs == 3 ? atoi(args[2]) : 40);
+		return 0;
+	}
+	if (!strcmp(args[1], "save") && nargs == 3) {
+		return trace_save(args[2]);
+	}
+
+	kprintf("Usage: tr [on [class...] | off | clear | show [n] | "
+		"save file]\n");
+	return EINVAL;
+}
+
+/*
+ * Command to control the profiler:
+ *    prof on             - start sampling
+ *    prof off            - stop sampling
+ *    prof clear          - throw away the samples taken
+ *    prof dump [n]       - print the threads and the N hottest PCs
+ *                          (default 20)
+ *    prof dump file      - write the samples to FILE for profdump
+ */
+static
+int
+cmd_prof(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		prof_start();
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "off")) {
+		prof_stop();
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "clear")) {
+		prof_clear();
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "dump")) {
+		prof_print(20);
+		return 0;
+	}
+	if (nargs == 3 && !strcmp(args[1], "dump")) {
+		if (args[2][0] >= '0' && args[2][0] <= '9') {
+			prof_print(atoi(args[2]));
+			return 0;
+		}
+		return prof_save(args[2]);
+	}
+
+	kprintf("Usage: prof on | off | clear | dump [n | file]\n");
+	return EINVAL;
+}
+
+static
+int
+cmd_iostats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	iosched_printstats();
+	dev_printcopystats();
+
+	return 0;
+}
+
+static
+int
+cmd_pagecachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	vfs_pcache_printstats();
+
+	return 0;
+}
+
+/*
+ * Command for fork and exec stats. "ps reset" zeroes them.
+ */
+static
+int
+cmd_procstats(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		proc_resetstats();
+		return 0;
+	}
+	if (nargs != 1) {
+		kprintf("Usage: ps [reset]\n");
+		return EINVAL;
+	}
+
+	proc_printstats();
+
+	return 0;
+}
+
+/*
+ * Command for system call stats. "sc reset" zeroes them.
+ */
+static
+int
+cmd_syscallstats(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		syscall_resetstats();
+		return 0;
+	}
+	if (nargs != 1) {
+		kprintf("Usage: sc [reset]\n");
+		return EINVAL;
+	}
+
+	syscall_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_emufsstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	emufs_printstats();
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for lock statistics:
+ *    lockstat            - print them, most contended first
+ *    lockstat reset      - zero them
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		lockstat_print();
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+		return 0;
+	}
+	kprintf("Usage: lockstat [reset]\n");
+	return EINVAL;
+}
+#endif
+
+#if OPT_LOCKORDER
+/*
+ * Command to print the lock orders seen.
+ */
+static
+int
+cmd_lockorder(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	lockorder_print();
+	return 0;
+}
+#endif
+
+#if OPT_SFS
+static
+int
+cmd_sfsstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	sfs_printstats();
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -386,6 +685,9 @@ static const char *opsmenu[] = {
 	"[cd]      Change directory          ",
 	"[pwd]     Print current directory   ",
 	"[sync]    Sync filesystems          ",
+	"[iosched] Set disk I/O scheduler    ",
+	"[tr]      Kernel event trace        ",
+	"[prof]    Kernel profiler           ",
 	"[panic]   Intentional panic         ",
 	"[q]       Quit and shut down        ",
 	NULL
@@ -406,6 +708,8 @@ static const char *testmenu[] = {
 	"[at]  Array test                    ",
 	"[bt]  Bitmap test                   ",
 	"[qt]  Queue test                    ",
+	"[mc1] memcpy/memmove/bzero test     ",
+	"[mc2] memcpy/memmove/bzero benchmark",
 	"[km1] Kernel malloc test            ",
 	"[km2] kmalloc stress test           ",
 	"[tt1] Thread test 1                 ",
@@ -417,11 +721,18 @@ static const char *testmenu[] = {
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
+#if OPT_LOCKORDER
+	"[sy4] Lock order check test         ",
+#endif
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress        (4)     ",
 	"[fs3] FS write stress       (4)     ",
 	"[fs4] FS write stress 2     (4)     ",
 	"[fs5] FS create stress      (4)     ",
+	"[fs6] FS fill test                  ",
+	"[fs7] FS directory stress           ",
+	"[fs8] FS gather write               ",
+	"[io]  Disk request benchmark        ",
 	NULL
 };
 
@@ -442,15 +753,62 @@ cmd_testmenu(int n, char **a)
 	return 0;
 }
 
+static const char *benchmenu[] = {
+	"[bn1] thread_fork and exit          ",
+	"[bn2] Thread yield                  ",
+	"[bn3] P/V round trip                ",
+	"[bn4] Lock acquire/release          ",
+	"[bn5] kmalloc/kfree                 ",
+	"[bn6] uiomove                       ",
+	"[bn7] File read/write              ",
+	"[bn8] Path lookup                   ",
+	"[bna] All of the above              ",
+	NULL
+};
+
+static
+int
+cmd_benchmenu(int n, char **a)
+{
+	(void)n;
+	(void)a;
+
+	showmenu("OS/161 benchmark menu", benchmenu);
+	kprintf("    Each takes an optional repetition count, after "
+		"the filesystem\n");
+	kprintf("    for bn7 and bn8 (and bna, which takes just the "
+		"filesystem).\n");
+	kprintf("\n");
+
+	return 0;
+}
+
 static const char *mainmenu[] = {
 	"[?o] Operations menu                ",
 	"[?t] Tests menu                     ",
+	"[?b] Benchmark menu                 ",
 #if OPT_SYNCHPROBS
 	"[1a] Cat/mouse with semaphores      ",
 	"[1b] Cat/mouse with locks and CVs   ",
 	"[1c] Stoplight                      ",
 #endif
 	"[kh] Kernel heap stats              ",
+	"[top] Thread CPU usage              ",
+	"[nc] VFS name cache stats           ",
+	"[pc] VFS page cache stats           ",
+	"[ios] Disk I/O stats                 ",
+	"[es] emufs stats                    ",
+	"[sc] System call stats              ",
+	"[ps] Fork and exec stats            ",
+#if OPT_SFS
+	"[ks] SFS stats                      ",
+#endif
+#if OPT_LOCKSTAT
+	"[lockstat] Lock contention stats    ",
+#endif
+#if OPT_LOCKORDER
+	"[lockorder] Lock orders seen        ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -480,6 +838,7 @@ static struct {
 	{ "help",	cmd_mainmenu },
 	{ "?o",		cmd_opsmenu },
 	{ "?t",		cmd_testmenu },
+	{ "?b",		cmd_benchmenu },
 
 	/* operations */
 	{ "s",		cmd_shell },
@@ -491,6 +850,9 @@ static struct {
 	{ "cd",		cmd_chdir },
 	{ "pwd",	cmd_pwd },
 	{ "sync",	cmd_sync },
+	{ "iosched",	cmd_iosched },
+	{ "tr",		cmd_trace },
+	{ "prof",	cmd_prof },
 	{ "panic",	cmd_panic },
 	{ "q",		cmd_quit },
 	{ "exit",	cmd_quit },
@@ -505,11 +867,29 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "top",        cmd_threadstats },
+	{ "nc",         cmd_namecachestats },
+	{ "pc",         cmd_pagecachestats },
+	{ "ios",        cmd_iostats },
+	{ "es",         cmd_emufsstats },
+	{ "sc",         cmd_syscallstats },
+	{ "ps",         cmd_procstats },
+#if OPT_SFS
+	{ "ks",         cmd_sfsstats },
+#endif
+#if OPT_LOCKSTAT
+	{ "lockstat",   cmd_lockstat },
+#endif
+#if OPT_LOCKORDER
+	{ "lockorder",  cmd_lockorder },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
 	{ "bt",		bitmaptest },
 	{ "qt",		queuetest },
+	{ "mc1",	memcpytest },
+	{ "mc2",	memcpybench },
 	{ "km1",	malloctest },
 	{ "km2",	mallocstress },
 #if OPT_NET
@@ -523,6 +903,9 @@ static struct {
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
+#if OPT_LOCKORDER
+	{ "sy4",	lockordertest },
+#endif
 
 	/* file system assignment tests */
 	{ "fs1",	fstest },
@@ -530,6 +913,23 @@ static struct {
 	{ "fs3",	writestress },
 	{ "fs4",	writestress2 },
 	{ "fs5",	createstress },
+	{ "fs6",	filltest },
+	{ "fs7",	dirstress },
+	{ "fs8",	gathertest },
+
+	/* device tests */
+	{ "io",		iotest },
+
+	/* benchmarks */
+	{ "bn1",	benchfork },
+	{ "bn2",	benchyield },
+	{ "bn3",	benchpv },
+	{ "bn4",	benchlock },
+	{ "bn5",	benchmalloc },
+	{ "bn6",	benchuio },
+	{ "bn7",	benchfs },
+	{ "bn8",	benchlookup },
+	{ "bna",	benchall },
 
 	{ NULL, NULL }
 };
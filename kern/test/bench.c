@@ -0,0 +1,742 @@
+/*
+ * bench - kernel microbenchmarks
+ *
+ * Each of these times ITERS repetitions of one operation and prints
+ * a line per result in a fixed format, so runs on different kernels
+ * can be compared with a script:
+ *
+ *    BENCH name iters usecs ns/op KB/sec
+ *
+ * where usecs is the total time, ns/op the time per repetition, and
+ * KB/sec is "-" for operations that don't move data. Each command
+ * first prints a line starting with "#" naming the kernel build.
+ *
+ *    bn1 [iters]      thread_fork of a thread that runs and exits
+ *    bn2 [iters]      thread_yield between two threads
+ *    bn3 [iters]      P/V round trip between two threads
+ *    bn4 [iters]      lock acquire/release, uncontended and contended
+ *    bn5 [iters]      kmalloc/kfree, for a range of sizes
+ *    bn6 [iters]      uiomove between kernel buffers, several sizes
+ *    bn7 fs [iters]   file reads and writes, sequential and random
+ *    bn8 fs [iters]   path lookup, found and not found
+ *    bna [fs]         all of the above with the default counts
+ *
+ * There's no cycle counter, so everything is timed with gettime().
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/unistd.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <clock.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <test.h>
+
+/* Default repetitions */
+#define BENCH_NFORK    200
+#define BENCH_NYIELD   2000
+#define BENCH_NPV      1000
+#define BENCH_NLOCK    2000
+#define BENCH_NMALLOC  2000
+#define BENCH_NUIO     2000
+#define BENCH_NFSIO    64       /* chunks in the file */
+#define BENCH_NLOOKUP  500
+
+#define BENCH_IOSIZE   4096     /* bytes per read or write for bn7 */
+#define BENCH_FILE     "bench.tmp"
+#define BENCH_DIR      "bench.dir"
+
+/* From vers.c, made when the kernel is linked */
+extern const int buildversion;
+extern const char buildconfig[];
+
+static struct semaphore *bench_sem = NULL;
+static struct semaphore *bench_ping, *bench_pong;
+static struct lock *bench_lock;
+
+static
+void
+init_benchsems(void)
+{
+	if (bench_sem == NULL) {
+		bench_sem = sem_create("bench", 0);
+		bench_ping = sem_create("bench ping", 0);
+		bench_pong = sem_create("bench pong", 0);
+		bench_lock = lock_create("bench");
+		if (bench_sem == NULL || bench_ping == NULL ||
+		    bench_pong == NULL || bench_lock == NULL) {
+			panic("bench: Out of memory\n");
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Timing and reporting
+
+struct bench_timer {
+	time_t bt_secs;
+	u_int32_t bt_nsecs;
+};
+
+static
+void
+bench_start(struct bench_timer *bt)
+{
+	gettime(&bt->bt_secs, &bt->bt_nsecs);
+}
+
+/*
+ * Return the microseconds since bench_start.
+ */
+static
+u_int32_t
+bench_stop(struct bench_timer *bt)
+{
+	time_t secs, isecs;
+	u_int32_t nsecs, insecs;
+
+	gettime(&secs, &nsecs);
+	getinterval(bt->bt_secs, bt->bt_nsecs, secs, nsecs, &isecs, &insecs);
+	return isecs*1000000 + insecs/1000;
+}
+
+static
+void
+bench_header(void)
+{
+	kprintf("# kernel %s #%d\n", buildconfig, buildversion);
+	kprintf("# %-14s %8s %10s %10s %10s\n",
+		"name", "iters", "usecs", "ns/op", "KB/sec");
+}
+
+/*
+ * Print a result. BYTES is the data moved per repetition, or 0.
+ */
+static
+void
+bench_report(const char *name, u_int32_t iters, u_int32_t usecs,
+	     u_int32_t bytes)
+{
+	u_int32_t nsop, kb;
+
+	/* usecs*1000/iters, without overflowing 32 bits */
+	if (usecs < 4000000) {
+		nsop = usecs * 1000 / iters;
+	}
+	else {
+		nsop = (usecs / iters) * 1000 + (usecs % iters) * 1000 / iters;
+	}
+
+	kprintf("BENCH %-14s %8u %10u %10u ", name, iters, usecs, nsop);
+	if (bytes == 0) {
+		kprintf("%10s\n", "-");
+	}
+	else if (usecs < 1000) {
+		kprintf("%10s\n", "inf");
+	}
+	else {
+		/* bytes*iters/1024, likewise */
+		kb = bytes * (iters / 1024) + bytes * (iters % 1024) / 1024;
+		kprintf("%10u\n", kb * 1000 / (usecs / 1000));
+	}
+}
+
+/*
+ * Get the repetition count from args[ARGN], if it's there.
+ */
+static
+int
+bench_iters(int nargs, char **args, int argn, u_int32_t def,
+	    u_int32_t *ret)
+{
+	int n;
+
+	if (nargs <= argn) {
+		*ret = def;
+		return 0;
+	}
+	n = atoi(args[argn]);
+	if (n <= 0) {
+		kprintf("bench: %s: Bad repetition count\n", args[argn]);
+		return EINVAL;
+	}
+	*ret = n;
+	return 0;
+}
+
+/*
+ * Fork a thread for the two-thread benchmarks, or panic.
+ */
+static
+void
+bench_fork(void (*func)(void *, unsigned long), u_int32_t iters)
+{
+	int result;
+
+	result = thread_fork("bench", NULL, iters, func, NULL);
+	if (result) {
+		panic("bench: thread_fork failed: %s\n", strerror(result));
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Threads and synchronization
+
+static
+void
+bench_exitthread(void *junk, unsigned long junk2)
+{
+	(void)junk;
+	(void)junk2;
+
+	V(bench_sem);
+}
+
+static
+void
+bench_dofork(u_int32_t iters)
+{
+	struct bench_timer bt;
+	u_int32_t i;
+
+	bench_start(&bt);
+	for (i=0; i<iters; i++) {
+		bench_fork(bench_exitthread, 0);
+		P(bench_sem);
+	}
+	bench_report("fork", iters, bench_stop(&bt), 0);
+}
+
+static
+void
+bench_yieldthread(void *junk, unsigned long iters)
+{
+	unsigned long i;
+
+	(void)junk;
+
+	for (i=0; i<iters; i++) {
+		thread_yield();
+	}
+	V(bench_sem);
+}
+
+/*
+ * Two threads yield back and forth; each yield is a context switch.
+ */
+static
+void
+bench_doyield(u_int32_t iters)
+{
+	struct bench_timer bt;
+
+	bench_start(&bt);
+	bench_fork(bench_yieldthread, iters);
+	bench_fork(bench_yieldthread, iters);
+	P(bench_sem);
+	P(bench_sem);
+	bench_report("yield", 2*iters, bench_stop(&bt), 0);
+}
+
+static
+void
+bench_pingthread(void *junk, unsigned long iters)
+{
+	unsigned long i;
+
+	(void)junk;
+
+	for (i=0; i<iters; i++) {
+		V(bench_ping);
+		P(bench_pong);
+	}
+	V(bench_sem);
+}
+
+static
+void
+bench_pongthread(void *junk, unsigned long iters)
+{
+	unsigned long i;
+
+	(void)junk;
+
+	for (i=0; i<iters; i++) {
+		P(bench_ping);
+		V(bench_pong);
+	}
+	V(bench_sem);
+}
+
+/*
+ * A semaphore handed to another thread and back again.
+ */
+static
+void
+bench_dopv(u_int32_t iters)
+{
+	struct bench_timer bt;
+
+	bench_start(&bt);
+	bench_fork(bench_pingthread, iters);
+	bench_fork(bench_pongthread, iters);
+	P(bench_sem);
+	P(bench_sem);
+	bench_report("pv-roundtrip", iters, bench_stop(&bt), 0);
+}
+
+/*
+ * Hold the lock across a yield, and yield after releasing it, so
+ * the two threads take turns and each always finds the lock held.
+ */
+static
+void
+bench_lockthread(void *junk, unsigned long iters)
+{
+	unsigned long i;
+
+	(void)junk;
+
+	for (i=0; i<iters; i++) {
+		lock_acquire(bench_lock);
+		thread_yield();
+		lock_release(bench_lock);
+		thread_yield();
+	}
+	V(bench_sem);
+}
+
+static
+void
+bench_dolock(u_int32_t iters)
+{
+	struct bench_timer bt;
+	u_int32_t i;
+
+	bench_start(&bt);
+	for (i=0; i<iters; i++) {
+		lock_acquire(bench_lock);
+		lock_release(bench_lock);
+	}
+	bench_report("lock", iters, bench_stop(&bt), 0);
+
+	bench_start(&bt);
+	bench_fork(bench_lockthread, iters);
+	bench_fork(bench_lockthread, iters);
+	P(bench_sem);
+	P(bench_sem);
+	bench_report("lock-contended", 2*iters, bench_stop(&bt), 0);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Memory
+
+static const size_t bench_mallocsizes[] = {
+	16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 16384,
+};
+#define BENCH_NMALLOCSIZES \
+	(sizeof(bench_mallocsizes) / sizeof(bench_mallocsizes[0]))
+
+static
+int
+bench_domalloc(u_int32_t iters)
+{
+	struct bench_timer bt;
+	char name[32];
+	void *ptr;
+	u_int32_t i, usecs;
+	unsigned s;
+
+	for (s=0; s<BENCH_NMALLOCSIZES; s++) {
+		bench_start(&bt);
+		for (i=0; i<iters; i++) {
+			ptr = kmalloc(bench_mallocsizes[s]);
+			if (ptr == NULL) {
+				kprintf("bench: kmalloc %u: Out of memory\n",
+					bench_mallocsizes[s]);
+				return ENOMEM;
+			}
+			kfree(ptr);
+		}
+		usecs = bench_stop(&bt);
+		snprintf(name, sizeof(name), "kmalloc-%u",
+			 bench_mallocsizes[s]);
+		bench_report(name, iters, usecs, 0);
+	}
+	return 0;
+}
+
+static
+int
+bench_douio(u_int32_t iters)
+{
+	static const size_t sizes[] = { 64, 512, 4096 };
+	struct bench_timer bt;
+	struct uio ku;
+	char name[32];
+	char *src, *dst;
+	u_int32_t i, usecs;
+	unsigned s;
+	int result = 0;
+
+	src = kmalloc(4096);
+	dst = kmalloc(4096);
+	if (src == NULL || dst == NULL) {
+		result = ENOMEM;
+		goto out;
+	}
+	bzero(src, 4096);
+
+	for (s=0; s<sizeof(sizes)/sizeof(sizes[0]) && result == 0; s++) {
+		bench_start(&bt);
+		for (i=0; i<iters && result == 0; i++) {
+			mk_kuio(&ku, dst, sizes[s], 0, UIO_READ);
+			result = uiomove(src, sizes[s], &ku);
+		}
+		usecs = bench_stop(&bt);
+		snprintf(name, sizeof(name), "uiomove-%u", sizes[s]);
+		bench_report(name, iters, usecs, sizes[s]);
+	}
+
+ out:
+	if (src) kfree(src);
+	if (dst) kfree(dst);
+	if (result) {
+		kprintf("bench: uiomove: %s\n", strerror(result));
+	}
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Filesystem
+
+/*
+ * Chunk number I of the random pattern over N chunks.
+ */
+static
+u_int32_t
+bench_randchunk(u_int32_t i, u_int32_t n)
+{
+	i = i*1103515245 + 12345;
+	i ^= i >> 16;
+	return i % n;
+}
+
+/*
+ * Read or write ITERS chunks of V, in order or scattered.
+ */
+static
+int
+bench_fsio(const char *name, struct vnode *v, char *buf, u_int32_t iters,
+	   int write, int scattered)
+{
+	struct bench_timer bt;
+	struct uio ku;
+	u_int32_t i, chunk;
+	int result = 0;
+
+	bench_start(&bt);
+	for (i=0; i<iters && result == 0; i++) {
+		chunk = scattered ? bench_randchunk(i, iters) : i;
+		mk_kuio(&ku, buf, BENCH_IOSIZE, chunk * BENCH_IOSIZE,
+			write ? UIO_WRITE : UIO_READ);
+		result = write ? VOP_WRITE(v, &ku) : VOP_READ(v, &ku);
+		if (result == 0 && ku.uio_resid != 0) {
+			result = write ? ENOSPC : EIO;
+		}
+	}
+	if (result) {
+		kprintf("bench: %s: %s\n", name, strerror(result));
+		return result;
+	}
+	bench_report(name, iters, bench_stop(&bt), BENCH_IOSIZE);
+	return 0;
+}
+
+static
+int
+bench_dofs(const char *fs, u_int32_t iters)
+{
+	char path[64], name[64];
+	struct vnode *v;
+	char *buf;
+	int result;
+
+	buf = kmalloc(BENCH_IOSIZE);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	bzero(buf, BENCH_IOSIZE);
+
+	snprintf(name, sizeof(name), "%s:%s", fs, BENCH_FILE);
+	strcpy(path, name);
+	result = vfs_open(path, O_RDWR|O_CREAT|O_TRUNC, &v);
+	if (result) {
+		kprintf("bench: %s: %s\n", name, strerror(result));
+		kfree(buf);
+		return result;
+	}
+
+	result = bench_fsio("fs-seqwrite", v, buf, iters, 1, 0);
+	if (result == 0) {
+		result = bench_fsio("fs-seqread", v, buf, iters, 0, 0);
+	}
+	if (result == 0) {
+		result = bench_fsio("fs-randwrite", v, buf, iters, 1, 1);
+	}
+	if (result == 0) {
+		result = bench_fsio("fs-randread", v, buf, iters, 0, 1);
+	}
+
+	vfs_close(v);
+	strcpy(path, name);
+	vfs_remove(path);
+	kfree(buf);
+	return result;
+}
+
+/*
+ * Look up NAME ITERS times. If it shouldn't be there, a lookup
+ * counts if it fails with ENOENT.
+ */
+static
+int
+bench_lookup(const char *what, const char *name, u_int32_t iters,
+	     int exists)
+{
+	struct bench_timer bt;
+	struct vnode *v;
+	char path[64];
+	u_int32_t i;
+	int result;
+
+	bench_start(&bt);
+	for (i=0; i<iters; i++) {
+		/* vfs_lookup destroys the string it's passed */
+		strcpy(path, name);
+		result = vfs_lookup(path, &v);
+		if (result == 0) {
+			VOP_DECREF(v);
+		}
+		if (exists ? result != 0 : result != ENOENT) {
+			kprintf("bench: %s: %s\n", name,
+				result ? strerror(result) : "Found");
+			return result ? result : EEXIST;
+		}
+	}
+	bench_report(what, iters, bench_stop(&bt), 0);
+	return 0;
+}
+
+static
+int
+bench_dolookup(const char *fs, u_int32_t iters)
+{
+	char file[64], dir[64], deep[64], miss[64], path[64];
+	struct vnode *v;
+	int result, havedir;
+
+	snprintf(file, sizeof(file), "%s:%s", fs, BENCH_FILE);
+	snprintf(dir, sizeof(dir), "%s:%s", fs, BENCH_DIR);
+	snprintf(deep, sizeof(deep), "%s:%s/%s", fs, BENCH_DIR, BENCH_FILE);
+	snprintf(miss, sizeof(miss), "%s:%s.none", fs, BENCH_FILE);
+
+	strcpy(path, file);
+	result = vfs_open(path, O_WRONLY|O_CREAT, &v);
+	if (result) {
+		kprintf("bench: %s: %s\n", file, strerror(result));
+		return result;
+	}
+	vfs_close(v);
+
+	/* A file one directory down too, if the fs has directories */
+	strcpy(path, dir);
+	havedir = (vfs_mkdir(path) == 0);
+	if (havedir) {
+		strcpy(path, deep);
+		result = vfs_open(path, O_WRONLY|O_CREAT, &v);
+		if (result) {
+			kprintf("bench: %s: %s\n", deep, strerror(result));
+			strcpy(path, dir);
+			vfs_rmdir(path);
+			havedir = 0;
+		}
+		else {
+			vfs_close(v);
+		}
+	}
+
+	result = bench_lookup("lookup", file, iters, 1);
+	if (result == 0 && havedir) {
+		result = bench_lookup("lookup-2", deep, iters, 1);
+	}
+	if (result == 0) {
+		result = bench_lookup("lookup-miss", miss, iters, 0);
+	}
+
+	if (havedir) {
+		strcpy(path, deep);
+		vfs_remove(path);
+		strcpy(path, dir);
+		vfs_rmdir(path);
+	}
+	strcpy(path, file);
+	vfs_remove(path);
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Menu commands
+
+int
+benchfork(int nargs, char **args)
+{
+	u_int32_t iters;
+
+	if (nargs > 2 || bench_iters(nargs, args, 1, BENCH_NFORK, &iters)) {
+		kprintf("Usage: bn1 [iters]\n");
+		return EINVAL;
+	}
+	init_benchsems();
+	bench_header();
+	bench_dofork(iters);
+	return 0;
+}
+
+int
+benchyield(int nargs, char **args)
+{
+	u_int32_t iters;
+
+	if (nargs > 2 || bench_iters(nargs, args, 1, BENCH_NYIELD, &iters)) {
+		kprintf("Usage: bn2 [iters]\n");
+		return EINVAL;
+	}
+	init_benchsems();
+	bench_header();
+	bench_doyield(iters);
+	return 0;
+}
+
+int
+benchpv(int nargs, char **args)
+{
+	u_int32_t iters;
+
+	if (nargs > 2 || bench_iters(nargs, args, 1, BENCH_NPV, &iters)) {
+		kprintf("Usage: bn3 [iters]\n");
+		return EINVAL;
+	}
+	init_benchsems();
+	bench_header();
+	bench_dopv(iters);
+	return 0;
+}
+
+int
+benchlock(int nargs, char **args)
+{
+	u_int32_t iters;
+
+	if (nargs > 2 || bench_iters(nargs, args, 1, BENCH_NLOCK, &iters)) {
+		kprintf("Usage: bn4 [iters]\n");
+		return EINVAL;
+	}
+	init_benchsems();
+	bench_header();
+	bench_dolock(iters);
+	return 0;
+}
+
+int
+benchmalloc(int nargs, char **args)
+{
+	u_int32_t iters;
+
+	if (nargs > 2 ||
+	    bench_iters(nargs, args, 1, BENCH_NMALLOC, &iters)) {
+		kprintf("Usage: bn5 [iters]\n");
+		return EINVAL;
+	}
+	bench_header();
+	return bench_domalloc(iters);
+}
+
+int
+benchuio(int nargs, char **args)
+{
+	u_int32_t iters;
+
+	if (nargs > 2 || bench_iters(nargs, args, 1, BENCH_NUIO, &iters)) {
+		kprintf("Usage: bn6 [iters]\n");
+		return EINVAL;
+	}
+	bench_header();
+	return bench_douio(iters);
+}
+
+int
+benchfs(int nargs, char **args)
+{
+	u_int32_t iters;
+
+	if (nargs < 2 || nargs > 3 ||
+	    bench_iters(nargs, args, 2, BENCH_NFSIO, &iters)) {
+		kprintf("Usage: bn7 filesystem [chunks]\n");
+		return EINVAL;
+	}
+	bench_header();
+	return bench_dofs(args[1], iters);
+}
+
+int
+benchlookup(int nargs, char **args)
+{
+	u_int32_t iters;
+
+	if (nargs < 2 || nargs > 3 ||
+	    bench_iters(nargs, args, 2, BENCH_NLOOKUP, &iters)) {
+		kprintf("Usage: bn8 filesystem [iters]\n");
+		return EINVAL;
+	}
+	bench_header();
+	return bench_dolookup(args[1], iters);
+}
+
+int
+benchall(int nargs, char **args)
+{
+	int result;
+
+	if (nargs > 2) {
+		kprintf("Usage: bna [filesystem]\n");
+		return EINVAL;
+	}
+
+	init_benchsems();
+	bench_header();
+	bench_dofork(BENCH_NFORK);
+	bench_doyield(BENCH_NYIELD);
+	bench_dopv(BENCH_NPV);
+	bench_dolock(BENCH_NLOCK);
+	result = bench_domalloc(BENCH_NMALLOC);
+	if (result == 0) {
+		result = bench_douio(BENCH_NUIO);
+	}
+	if (result == 0 && nargs == 2) {
+		result = bench_dofs(args[1], BENCH_NFSIO);
+	}
+	if (result == 0 && nargs == 2) {
+		result = bench_dolookup(args[1], BENCH_NLOOKUP);
+	}
+	return result;
+}
@@ -1,4 +1,5 @@
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <bitmap.h>
 #include <test.h>
@@ -10,7 +11,7 @@ bitmaptest(int nargs, char **args)
 {
 	struct bitmap *b;
 	char data[TESTSIZE];
-	u_int32_t x;
+	u_int32_t x, goal, expect;
 	int i;
 
 	(void)nargs;
@@ -72,6 +73,47 @@ bitmaptest(int nargs, char **args)
 		assert(data[i]==0);
 	}
 
+	/*
+	 * Now free a random set again and check that bitmap_alloc
+	 * always hands back the lowest free bit, and bitmap_alloc_near
+	 * the first free bit at or after the goal.
+	 */
+	for (i=0; i<TESTSIZE; i++) {
+		data[i] = random()%2;
+		if (data[i]) {
+			bitmap_unmark(b, i);
+		}
+	}
+
+	for (expect=0; expect<TESTSIZE && !data[expect]; expect++);
+	if (expect < TESTSIZE) {
+		assert(bitmap_alloc(b, &x)==0);
+		assert(x == expect);
+		data[x] = 0;
+	}
+
+	for (;;) {
+		goal = random() % TESTSIZE;
+		for (expect=goal; expect<TESTSIZE && !data[expect]; expect++);
+		if (expect == TESTSIZE) {
+			for (expect=0; expect<goal && !data[expect]; expect++);
+		}
+		if (!data[expect]) {
+			assert(bitmap_alloc_near(b, goal, &x)==ENOSPC);
+			break;
+		}
+		assert(bitmap_alloc_near(b, goal, &x)==0);
+		assert(x == expect);
+		assert(bitmap_isset(b, x));
+		data[x] = 0;
+	}
+
+	for (i=0; i<TESTSIZE; i++) {
+		assert(bitmap_isset(b, i));
+	}
+
+	bitmap_destroy(b);
+
 	kprintf("Bitmap test complete\n");
 	return 0;
 }
@@ -12,6 +12,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/unistd.h>
+#include <kern/limits.h>
 #include <lib.h>
 #include <synch.h>
 #include <fs.h>
@@ -20,6 +21,11 @@
 #include <uio.h>
 #include <test.h>
 #include <thread.h>
+#include <clock.h>
+#include <sfs.h>
+#include <dev.h>
+#include <iosched.h>
+#include "opt-sfs.h"
 
 #define SLOGAN   "HODIE MIHI - CRAS TIBI\n"
 #define FILENAME "fstest.tmp"
@@ -27,6 +33,14 @@
 #define NTHREADS 12
 #define NCREATES 32
 
+#define FILLSTREAMS 4       /* files written at once by filltest */
+#define FILLBLOCKS  128     /* blocks per file for filltest */
+#define FILLMAX     1024    /* max files for filltest */
+#define FILLBLKSIZE 512
+#define DIRFILES    1000    /* files in one directory for dirstress */
+#define GATHERRECSIZE 256   /* record size for gathertest */
+#define GATHERBYTES (1024*1024) /* bytes written per gathertest pass */
+
 static struct semaphore *threadsem = NULL;
 
 static
@@ -267,6 +281,19 @@ dofstest(const char *filesys)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Report what the disk scheduler saw during a stress test. Sync
+ * first, so writes still sitting in the buffer cache are counted.
+ */
+static
+void
+fstest_iostats(void)
+{
+	vfs_sync();
+	iosched_printstats();
+	dev_printcopystats();
+}
+
 static
 void
 readstress_thread(void *fs, unsigned long num)
@@ -293,6 +320,8 @@ doreadstress(const char *filesys)
 		return;
 	}
 
+	iosched_resetstats();
+
 	for (i=0; i<NTHREADS; i++) {
 		err = thread_fork("readstress", (void *)filesys, i, 
 				  readstress_thread, NULL);
@@ -306,6 +335,8 @@ doreadstress(const char *filesys)
 		P(threadsem);
 	}
 
+	fstest_iostats();
+
 	if (fstest_remove(filesys, "")) {
 		kprintf("*** Test failed\n");
 		return;
@@ -316,6 +347,36 @@ doreadstress(const char *filesys)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Report write throughput for the write stress tests, and how much
+ * of what was written could be lost in a crash before the syncer
+ * gets to it.
+ */
+static
+void
+fstest_throughput(const char *what, u_int32_t bytes,
+		  time_t s1, u_int32_t ns1, time_t s2, u_int32_t ns2)
+{
+	time_t secs;
+	u_int32_t nsecs, msecs;
+
+	getinterval(s1, ns1, s2, ns2, &secs, &nsecs);
+	msecs = secs*1000 + nsecs/1000000;
+	kprintf("%s: %lu bytes in %lu.%06lu seconds", what,
+		(unsigned long) bytes, (unsigned long) secs,
+		(unsigned long) nsecs/1000);
+	if (msecs > 0) {
+		kprintf(" (%lu bytes/sec)", 
+			(unsigned long) (bytes / msecs) * 1000);
+	}
+	kprintf("\n");
+#if OPT_SFS
+	kprintf("%s: sfs data-loss window at most %d seconds\n", what,
+		SFS_SYNCAGE + 2*SFS_SYNCPERIOD);
+	sfs_printbufstats();
+#endif
+}
+
 static
 void
 writestress_thread(void *fs, unsigned long num)
@@ -350,11 +411,15 @@ void
 dowritestress(const char *filesys)
 {
 	int i, err;
+	time_t s1, s2;
+	u_int32_t ns1, ns2;
 
 	init_threadsem();
 
 	kprintf("*** Starting fs write stress test on %s:\n", filesys);
 
+	iosched_resetstats();
+	gettime(&s1, &ns1);
 	for (i=0; i<NTHREADS; i++) {
 		err = thread_fork("writestress", (void *)filesys, i, 
 				     writestress_thread, NULL);
@@ -366,6 +431,11 @@ dowritestress(const char *filesys)
 	for (i=0; i<NTHREADS; i++) {
 		P(threadsem);
 	}
+	gettime(&s2, &ns2);
+
+	fstest_throughput("writestress", NTHREADS*NCHUNKS*strlen(SLOGAN),
+			  s1, ns1, s2, ns2);
+	fstest_iostats();
 
 	kprintf("*** fs write stress test done\n");
 }
@@ -394,6 +464,8 @@ dowritestress2(const char *filesys)
 	int i, err;
 	char name[32];
 	struct vnode *vn;
+	time_t s1, s2;
+	u_int32_t ns1, ns2;
 
 	init_threadsem();
 
@@ -409,6 +481,8 @@ dowritestress2(const char *filesys)
 	}
 	vfs_close(vn);
 
+	iosched_resetstats();
+	gettime(&s1, &ns1);
 	for (i=0; i<NTHREADS; i++) {
 		err = thread_fork("writestress2", (void *)filesys, i, 
 				      writestress2_thread, NULL);
@@ -421,6 +495,11 @@ dowritestress2(const char *filesys)
 	for (i=0; i<NTHREADS; i++) {
 		P(threadsem);
 	}
+	gettime(&s2, &ns2);
+
+	fstest_throughput("writestress2", NCHUNKS*strlen(SLOGAN),
+			  s1, ns1, s2, ns2);
+	fstest_iostats();
 
 	if (fstest_read(filesys, "")) {
 		kprintf("*** Test failed\n");
@@ -500,6 +579,355 @@ docreatestress(const char *filesys)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Fill test: fill the disk with files written FILLSTREAMS at a time
+ * in interleaved blocks, punch holes by removing every other file,
+ * then fill it again. This is the worst case for block placement;
+ * report the time taken per block written and, for sfs, how many
+ * blocks ended up where the allocator wanted them.
+ */
+
+static
+int
+filltest_pass(const char *filesys, int first, int step, int *nblocks)
+{
+	static char buf[FILLBLKSIZE];
+	struct vnode *vn[FILLSTREAMS];
+	char name[32];
+	struct uio ku;
+	int i, j, k, n, err;
+
+	*nblocks = 0;
+	for (i=first; i<FILLMAX; i += step*FILLSTREAMS) {
+		n = 0;
+		for (k=0; k<FILLSTREAMS; k++) {
+			snprintf(name, sizeof(name), "%s:fill%d", 
+				 filesys, i+k*step);
+			err = vfs_open(name, O_WRONLY|O_CREAT|O_TRUNC, &vn[k]);
+			if (err) {
+				break;
+			}
+			n++;
+		}
+
+		err = 0;
+		for (j=0; j<FILLBLOCKS && !err && n>0; j++) {
+			for (k=0; k<n; k++) {
+				mk_kuio(&ku, buf, sizeof(buf), j*sizeof(buf),
+					UIO_WRITE);
+				err = VOP_WRITE(vn[k], &ku);
+				if (err) {
+					break;
+				}
+				(*nblocks)++;
+			}
+		}
+
+		for (k=0; k<n; k++) {
+			vfs_close(vn[k]);
+		}
+		if (err || n < FILLSTREAMS) {
+			return (err==ENOSPC || err==0) ? 0 : err;
+		}
+	}
+	return 0;
+}
+
+static
+void
+filltest_remove(const char *filesys, int first, int step)
+{
+	char name[32];
+	int i;
+
+	for (i=first; i<FILLMAX; i += step) {
+		snprintf(name, sizeof(name), "%s:fill%d", filesys, i);
+		vfs_remove(name);
+	}
+}
+
+static
+void
+fstest_report(const char *what, int count, const char *unit,
+	      time_t s1, u_int32_t ns1, time_t s2, u_int32_t ns2)
+{
+	time_t secs;
+	u_int32_t nsecs, usecs;
+
+	getinterval(s1, ns1, s2, ns2, &secs, &nsecs);
+	usecs = secs*1000000 + nsecs/1000;
+	kprintf("%s: %d %ss in %lu.%06lu seconds", what, count, unit,
+		(unsigned long) secs, (unsigned long) nsecs/1000);
+	if (count > 0) {
+		kprintf(" (%lu usec/%s)", (unsigned long) usecs/count, unit);
+	}
+	kprintf("\n");
+}
+
+static
+void
+dofilltest(const char *filesys)
+{
+	time_t s1, s2;
+	u_int32_t ns1, ns2;
+	int nblocks, err;
+
+	kprintf("*** Starting fs fill test on %s:\n", filesys);
+
+	gettime(&s1, &ns1);
+	err = filltest_pass(filesys, 0, 1, &nblocks);
+	gettime(&s2, &ns2);
+	if (err) {
+		kprintf("filltest: %s\n", strerror(err));
+	}
+	fstest_report("first fill", nblocks, "block", s1, ns1, s2, ns2);
+
+	/* Remove every other file, leaving holes all over the disk */
+	filltest_remove(filesys, 1, 2);
+
+	gettime(&s1, &ns1);
+	err = filltest_pass(filesys, 1, 2, &nblocks);
+	gettime(&s2, &ns2);
+	if (err) {
+		kprintf("filltest: %s\n", strerror(err));
+	}
+	fstest_report("refill", nblocks, "block", s1, ns1, s2, ns2);
+
+#if OPT_SFS
+	sfs_printstats();
+#endif
+
+	filltest_remove(filesys, 0, 1);
+
+	kprintf("*** fs fill test done\n");
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Directory stress: create a lot of files in one directory, open each
+ * of them again, and remove them, timing each phase. This exercises
+ * name lookup in large directories.
+ */
+
+#define DIRSTRESS_CREATE  0
+#define DIRSTRESS_OPEN    1
+#define DIRSTRESS_REMOVE  2
+
+static
+int
+dirstress_phase(const char *filesys, const char *what, int op)
+{
+	time_t s1, s2;
+	u_int32_t ns1, ns2;
+	struct vnode *vn;
+	char name[32];
+	int i, err = 0;
+
+	gettime(&s1, &ns1);
+	for (i=0; i<DIRFILES; i++) {
+		snprintf(name, sizeof(name), "%s:dir%d", filesys, i);
+		if (op == DIRSTRESS_REMOVE) {
+			err = vfs_remove(name);
+		}
+		else {
+			err = vfs_open(name, op==DIRSTRESS_CREATE ? 
+				       O_WRONLY|O_CREAT|O_EXCL : O_RDONLY, 
+				       &vn);
+			if (err == 0) {
+				vfs_close(vn);
+			}
+		}
+		if (err) {
+			kprintf("%s: file %d: %s\n", what, i, strerror(err));
+			break;
+		}
+	}
+	gettime(&s2, &ns2);
+	fstest_report(what, i, "file", s1, ns1, s2, ns2);
+	return err;
+}
+
+static
+void
+dodirstress(const char *filesys)
+{
+	kprintf("*** Starting fs directory stress test on %s:\n", filesys);
+
+	if (dirstress_phase(filesys, "create", DIRSTRESS_CREATE) == 0) {
+		dirstress_phase(filesys, "open", DIRSTRESS_OPEN);
+	}
+	dirstress_phase(filesys, "remove", DIRSTRESS_REMOVE);
+
+#if OPT_SFS
+	sfs_printstats();
+#endif
+
+	kprintf("*** fs directory stress test done\n");
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Gather test: write a file of small records (like a log) several
+ * records per VOP_WRITE, using a uio with one block per record, and
+ * report how many calls each megabyte took. Then read it back the
+ * same way, scattering into the record buffers, and check it.
+ */
+
+static char gather_recs[IOV_MAX][GATHERRECSIZE];
+
+static
+void
+gather_fill(int recno, char *rec)
+{
+	int i;
+
+	for (i=0; i<GATHERRECSIZE; i++) {
+		rec[i] = recno + i;
+	}
+}
+
+static
+int
+gather_check(int recno, const char *rec)
+{
+	int i;
+
+	for (i=0; i<GATHERRECSIZE; i++) {
+		if (rec[i] != (char)(recno + i)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Set up a uio covering the first N record buffers.
+ */
+static
+void
+gather_mkuio(struct uio *ku, struct iovec *iov, int n, off_t pos,
+	     enum uio_rw rw)
+{
+	int i;
+
+	for (i=0; i<n; i++) {
+		iov[i].iov_kbase = gather_recs[i];
+		iov[i].iov_len = GATHERRECSIZE;
+	}
+	mk_kuio(ku, gather_recs[0], GATHERRECSIZE, pos, rw);
+	ku->uio_iov = &iov[1];
+	ku->uio_iovcnt = n-1;
+	ku->uio_resid = n*GATHERRECSIZE;
+}
+
+static
+int
+gather_pass(const char *filesys, int batch)
+{
+	struct iovec iov[IOV_MAX];
+	struct vnode *vn;
+	struct uio ku;
+	char name[32];
+	time_t s1, s2, secs;
+	u_int32_t ns1, ns2, nsecs, msecs;
+	int i, rec, ncalls, err;
+
+	snprintf(name, sizeof(name), "%s:%s", filesys, FILENAME);
+	err = vfs_open(name, O_WRONLY|O_CREAT|O_TRUNC, &vn);
+	if (err) {
+		kprintf("gathertest: %s: %s\n", name, strerror(err));
+		return err;
+	}
+
+	ncalls = 0;
+	gettime(&s1, &ns1);
+	for (rec=0; rec < GATHERBYTES/GATHERRECSIZE; rec += batch) {
+		for (i=0; i<batch; i++) {
+			gather_fill(rec+i, gather_recs[i]);
+		}
+		gather_mkuio(&ku, iov, batch, rec*GATHERRECSIZE, UIO_WRITE);
+		err = VOP_WRITE(vn, &ku);
+		ncalls++;
+		if (err) {
+			kprintf("gathertest: write: %s\n", strerror(err));
+			vfs_close(vn);
+			return err;
+		}
+		assert(ku.uio_resid == 0);
+	}
+	gettime(&s2, &ns2);
+	vfs_close(vn);
+
+	getinterval(s1, ns1, s2, ns2, &secs, &nsecs);
+	msecs = secs*1000 + nsecs/1000000;
+	kprintf("gathertest: %2d records/call: %d calls/MB", batch,
+		ncalls * (1024*1024) / GATHERBYTES);
+	if (msecs > 0) {
+		kprintf(", %lu bytes/sec",
+			(unsigned long) (GATHERBYTES / msecs) * 1000);
+	}
+	kprintf("\n");
+
+	/* Read it back, scattered into the record buffers */
+	err = vfs_open(name, O_RDONLY, &vn);
+	if (err) {
+		kprintf("gathertest: %s: %s\n", name, strerror(err));
+		return err;
+	}
+	for (rec=0; rec < GATHERBYTES/GATHERRECSIZE; rec += batch) {
+		gather_mkuio(&ku, iov, batch, rec*GATHERRECSIZE, UIO_READ);
+		err = VOP_READ(vn, &ku);
+		if (err) {
+			kprintf("gathertest: read: %s\n", strerror(err));
+			break;
+		}
+		if (ku.uio_resid != 0) {
+			kprintf("gathertest: short read at record %d\n", rec);
+			err = EIO;
+			break;
+		}
+		for (i=0; i<batch; i++) {
+			if (gather_check(rec+i, gather_recs[i])) {
+				kprintf("gathertest: record %d is wrong\n",
+					rec+i);
+				err = EIO;
+				break;
+			}
+		}
+		if (err) {
+			break;
+		}
+	}
+	vfs_close(vn);
+	return err;
+}
+
+static
+void
+dogathertest(const char *filesys)
+{
+	char name[32];
+	int batch;
+
+	kprintf("*** Starting fs gather test on %s:\n", filesys);
+
+	for (batch = 1; batch <= IOV_MAX; batch *= 4) {
+		if (gather_pass(filesys, batch)) {
+			kprintf("*** Test failed\n");
+			break;
+		}
+	}
+
+	snprintf(name, sizeof(name), "%s:%s", filesys, FILENAME);
+	vfs_remove(name);
+
+	kprintf("*** fs gather test done\n");
+}
+
+////////////////////////////////////////////////////////////
+
 static
 int
 checkfilesystem(int nargs, char **args)
@@ -507,7 +935,7 @@ checkfilesystem(int nargs, char **args)
 	char *device;
 
 	if (nargs != 2) {
-		kprintf("Usage: fs[12345] filesystem:\n");
+		kprintf("Usage: fs[12345678] filesystem:\n");
 		return EINVAL;
 	}
 
@@ -539,6 +967,9 @@ DEFTEST(readstress);
 DEFTEST(writestress);
 DEFTEST(writestress2);
 DEFTEST(createstress);
+DEFTEST(filltest);
+DEFTEST(dirstress);
+DEFTEST(gathertest);
 
 ////////////////////////////////////////////////////////////
 
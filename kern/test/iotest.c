@@ -0,0 +1,305 @@
+/*
+ * iotest - disk request benchmark
+ *
+ * Reads IOB_NREQS requests of IOB_NBLOCKS blocks each straight from a
+ * disk through its d_submit function: first with one thread
+ * submitting and waiting for one request at a time, then with
+ * IOB_NTHREADS threads doing that at once, then with one thread
+ * keeping IOB_DEPTH requests outstanding. Each is done with a
+ * sequential pattern (request i reads the chunk after request i-1,
+ * whichever thread does it) and a scattered one, and reported as
+ * requests per second and bytes per second.
+ *
+ * Only reads are done, so it's safe to use on a disk that has a
+ * filesystem on it.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <clock.h>
+#include <machine/spl.h>
+#include <vfs.h>
+#include <dev.h>
+#include <test.h>
+
+#define IOB_NREQS    256    /* requests per run */
+#define IOB_NBLOCKS  4      /* blocks per request */
+#define IOB_NTHREADS 8      /* submitters for the concurrent run */
+#define IOB_DEPTH    8      /* outstanding requests for the async run */
+
+struct iob_run {
+	struct device *ir_dev;
+	int ir_random;          /* scattered rather than sequential */
+	int ir_nthreads;        /* threads splitting up the requests */
+	u_int32_t ir_nmerged;   /* requests the driver merged */
+	int ir_err;             /* first error seen */
+};
+
+static struct semaphore *iob_sem = NULL;
+
+/* Completed requests for the async run, and how many are outstanding */
+static struct devreq *iob_finished;
+static int iob_outstanding;
+
+static
+void
+init_iobsem(void)
+{
+	if (iob_sem==NULL) {
+		iob_sem = sem_create("iotestsem", 0);
+		if (iob_sem == NULL) {
+			panic("iotest: sem_create failed\n");
+		}
+	}
+}
+
+/*
+ * Choose the first block for request number N.
+ */
+static
+u_int32_t
+iob_block(struct iob_run *run, u_int32_t n)
+{
+	u_int32_t nchunks = run->ir_dev->d_blocks / IOB_NBLOCKS;
+
+	if (run->ir_random) {
+		n = n*1103515245 + 12345;
+		n ^= n >> 16;
+	}
+	return (n % nchunks) * IOB_NBLOCKS;
+}
+
+static
+void
+iob_seterr(struct iob_run *run, int err)
+{
+	if (err && run->ir_err == 0) {
+		run->ir_err = err;
+	}
+}
+
+/*
+ * One synchronous submitter: does every ir_nthreads'th request,
+ * starting with request NUM.
+ */
+static
+void
+iob_thread(void *vrun, unsigned long num)
+{
+	struct iob_run *run = vrun;
+	struct devreq req;
+	u_int32_t i;
+	int spl;
+
+	req.dr_buf = kmalloc(IOB_NBLOCKS * run->ir_dev->d_blocksize);
+	if (req.dr_buf == NULL) {
+		iob_seterr(run, ENOMEM);
+		V(iob_sem);
+		return;
+	}
+
+	for (i=num; i<IOB_NREQS; i+=run->ir_nthreads) {
+		req.dr_block = iob_block(run, i);
+		req.dr_nblocks = IOB_NBLOCKS;
+		req.dr_write = 0;
+		iob_seterr(run, dev_doio(run->ir_dev, &req));
+
+		spl = splhigh();
+		run->ir_nmerged += req.dr_merged;
+		splx(spl);
+	}
+
+	kfree(req.dr_buf);
+	V(iob_sem);
+}
+
+/*
+ * Completion callback for the async run.
+ */
+static
+void
+iob_done(struct devreq *req)
+{
+	req->dr_next = iob_finished;
+	iob_finished = req;
+	thread_wakeup(&iob_finished);
+}
+
+/*
+ * Send off the next request of the async run, if there is one, using
+ * REQ. Called at splhigh.
+ */
+static
+void
+iob_submit(struct iob_run *run, struct devreq *req, u_int32_t *next)
+{
+	int result;
+
+	if (*next >= IOB_NREQS || run->ir_err) {
+		return;
+	}
+
+	req->dr_block = iob_block(run, (*next)++);
+	req->dr_nblocks = IOB_NBLOCKS;
+	req->dr_write = 0;
+	req->dr_done = iob_done;
+	req->dr_data = run;
+	result = run->ir_dev->d_submit(run->ir_dev, req);
+	if (result) {
+		iob_seterr(run, result);
+		return;
+	}
+	iob_outstanding++;
+}
+
+/*
+ * One asynchronous submitter, keeping IOB_DEPTH requests in flight.
+ */
+static
+void
+iob_async(struct iob_run *run)
+{
+	struct devreq reqs[IOB_DEPTH], *req;
+	u_int32_t next = 0;
+	int i, spl;
+
+	for (i=0; i<IOB_DEPTH; i++) {
+		reqs[i].dr_buf = kmalloc(IOB_NBLOCKS*run->ir_dev->d_blocksize);
+		if (reqs[i].dr_buf == NULL) {
+			iob_seterr(run, ENOMEM);
+			while (--i >= 0) {
+				kfree(reqs[i].dr_buf);
+			}
+			return;
+		}
+	}
+
+	spl = splhigh();
+	for (i=0; i<IOB_DEPTH; i++) {
+		iob_submit(run, &reqs[i], &next);
+	}
+	while (iob_outstanding > 0) {
+		while (iob_finished == NULL) {
+			thread_sleep(&iob_finished);
+		}
+		req = iob_finished;
+		iob_finished = req->dr_next;
+		iob_outstanding--;
+
+		iob_seterr(run, req->dr_result);
+		run->ir_nmerged += req->dr_merged;
+
+		iob_submit(run, req, &next);
+	}
+	splx(spl);
+
+	for (i=0; i<IOB_DEPTH; i++) {
+		kfree(reqs[i].dr_buf);
+	}
+}
+
+/*
+ * Do one run and report on it. NTHREADS of 0 means the async run.
+ */
+static
+void
+iob_dorun(struct device *dev, int nthreads, int scattered)
+{
+	struct iob_run run;
+	time_t s1, s2, secs;
+	u_int32_t ns1, ns2, nsecs, msecs, bytes;
+	int i, err;
+
+	run.ir_dev = dev;
+	run.ir_random = scattered;
+	run.ir_nthreads = nthreads;
+	run.ir_nmerged = 0;
+	run.ir_err = 0;
+
+	gettime(&s1, &ns1);
+	if (nthreads == 0) {
+		iob_async(&run);
+	}
+	else {
+		for (i=0; i<nthreads; i++) {
+			err = thread_fork("iotest", &run, i, iob_thread, NULL);
+			if (err) {
+				panic("iotest: thread_fork failed: %s\n",
+				      strerror(err));
+			}
+		}
+		for (i=0; i<nthreads; i++) {
+			P(iob_sem);
+		}
+	}
+	gettime(&s2, &ns2);
+
+	if (run.ir_err) {
+		kprintf("io: %s\n", strerror(run.ir_err));
+		return;
+	}
+
+	getinterval(s1, ns1, s2, ns2, &secs, &nsecs);
+	msecs = secs*1000 + nsecs/1000000;
+	bytes = IOB_NREQS * IOB_NBLOCKS * dev->d_blocksize;
+
+	if (nthreads == 0) {
+		kprintf("io: async, depth %d, ", IOB_DEPTH);
+	}
+	else {
+		kprintf("io: %d thread%s, ", nthreads, nthreads==1 ? "" : "s");
+	}
+	kprintf("%s: %d requests in %lu.%06lu seconds",
+		scattered ? "scattered" : "sequential", IOB_NREQS,
+		(unsigned long) secs, (unsigned long) nsecs/1000);
+	if (msecs > 0) {
+		kprintf(" (%lu requests/sec, %lu bytes/sec)",
+			(unsigned long) (IOB_NREQS*1000) / msecs,
+			(unsigned long) (bytes / msecs) * 1000);
+	}
+	kprintf(", %lu merged\n", (unsigned long) run.ir_nmerged);
+}
+
+int
+iotest(int nargs, char **args)
+{
+	struct device *dev;
+	char *name;
+	int scattered, result;
+
+	if (nargs != 2) {
+		kprintf("Usage: io device\n");
+		return EINVAL;
+	}
+
+	name = args[1];
+	if (name[strlen(name)-1]==':') {
+		name[strlen(name)-1] = 0;
+	}
+
+	result = vfs_getdevice(name, &dev);
+	if (result) {
+		kprintf("io: %s: %s\n", name, strerror(result));
+		return result;
+	}
+	if (dev->d_submit == NULL || dev->d_blocks < IOB_NBLOCKS) {
+		kprintf("io: %s: Device doesn't support queued requests\n",
+			name);
+		return ENODEV;
+	}
+
+	init_iobsem();
+
+	kprintf("*** Starting disk request benchmark on %s:\n", name);
+	for (scattered=0; scattered<2; scattered++) {
+		iob_dorun(dev, 1, scattered);
+		iob_dorun(dev, IOB_NTHREADS, scattered);
+		iob_dorun(dev, 0, scattered);
+	}
+	kprintf("*** disk request benchmark done\n");
+
+	return 0;
+}
@@ -0,0 +1,315 @@
+/*
+ * memcpytest - tests and benchmark for memcpy, memmove, and bzero
+ *
+ * mc1 checks the block routines over a range of lengths and every
+ * combination of source and destination alignment within a word,
+ * including memmove with the blocks overlapping both ways, and that
+ * nothing outside the block is touched.
+ *
+ * mc2 times them over a range of sizes, with source and destination
+ * aligned, aligned the same way but not on a word boundary, and
+ * aligned differently, next to a plain byte-at-a-time loop, and
+ * reports microseconds per call and kilobytes per second.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <test.h>
+
+#define MCT_MAXLEN   300     /* longest block checked by mc1 */
+#define MCT_ALIGN    8       /* offsets checked by mc1 */
+#define MCT_GUARD    0xa5    /* fill for bytes that shouldn't change */
+
+#define MCB_MAXSIZE  16384   /* largest size timed by mc2 */
+#define MCB_BYTES    (256*1024)  /* bytes copied per timing */
+
+static unsigned char *mct_src, *mct_dst, *mct_ref;
+
+static
+int
+mct_alloc(size_t size)
+{
+	mct_src = kmalloc(size);
+	mct_dst = kmalloc(size);
+	mct_ref = kmalloc(size);
+	if (mct_src == NULL || mct_dst == NULL || mct_ref == NULL) {
+		if (mct_src) kfree(mct_src);
+		if (mct_dst) kfree(mct_dst);
+		if (mct_ref) kfree(mct_ref);
+		return ENOMEM;
+	}
+	return 0;
+}
+
+static
+void
+mct_free(void)
+{
+	kfree(mct_src);
+	kfree(mct_dst);
+	kfree(mct_ref);
+}
+
+/*
+ * Fill BUF with bytes that depend on SEED, so a copy from the wrong
+ * place shows up.
+ */
+static
+void
+mct_fill(unsigned char *buf, size_t len, unsigned seed)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		buf[i] = (unsigned char)(i*7 + seed*13 + (i >> 8));
+	}
+}
+
+/*
+ * Bytewise copy, for setting up the reference buffer without using
+ * what's being tested.
+ */
+static
+void
+mct_copy(unsigned char *dst, const unsigned char *src, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		dst[i] = src[i];
+	}
+}
+
+/*
+ * Compare the test buffer with the reference; print and count a
+ * failure if they differ.
+ */
+static
+int
+mct_check(const char *what, size_t len, int so, int dof)
+{
+	size_t i;
+
+	for (i=0; i<MCT_MAXLEN + 2*MCT_ALIGN; i++) {
+		if (mct_dst[i] != mct_ref[i]) {
+			kprintf("mc1: %s: len %u, src +%d, dst +%d: "
+				"wrong byte at %u\n", what, len, so, dof, i);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int
+memcpytest(int nargs, char **args)
+{
+	size_t bufsize = MCT_MAXLEN + 2*MCT_ALIGN;
+	size_t len, i;
+	int so, dof, bad = 0;
+
+	(void)nargs;
+	(void)args;
+
+	if (mct_alloc(bufsize)) {
+		kprintf("mc1: Out of memory\n");
+		return ENOMEM;
+	}
+
+	kprintf("Starting memcpy test...\n");
+
+	for (len=0; len<=MCT_MAXLEN; len++) {
+		for (so=0; so<MCT_ALIGN; so++) {
+			for (dof=0; dof<MCT_ALIGN; dof++) {
+				/* memcpy, separate buffers */
+				mct_fill(mct_src, bufsize, len);
+				for (i=0; i<bufsize; i++) {
+					mct_dst[i] = MCT_GUARD;
+					mct_ref[i] = MCT_GUARD;
+				}
+				for (i=0; i<len; i++) {
+					mct_ref[dof+i] = mct_src[so+i];
+				}
+				if (memcpy(mct_dst+dof, mct_src+so, len)
+				    != mct_dst+dof) {
+					kprintf("mc1: memcpy: wrong return "
+						"value\n");
+					bad++;
+				}
+				bad += mct_check("memcpy", len, so, dof);
+
+				/*
+				 * memmove within one buffer; src +so and
+				 * dst +dof overlap one way or the other
+				 * unless the block is empty.
+				 */
+				mct_fill(mct_dst, bufsize, len+1);
+				mct_copy(mct_ref, mct_dst, bufsize);
+				mct_copy(mct_src, mct_ref+so, len);
+				mct_copy(mct_ref+dof, mct_src, len);
+				if (memmove(mct_dst+dof, mct_dst+so, len)
+				    != mct_dst+dof) {
+					kprintf("mc1: memmove: wrong return "
+						"value\n");
+					bad++;
+				}
+				bad += mct_check("memmove", len, so, dof);
+			}
+
+			/* bzero */
+			mct_fill(mct_dst, bufsize, len+2);
+			mct_copy(mct_ref, mct_dst, bufsize);
+			for (i=0; i<len; i++) {
+				mct_ref[so+i] = 0;
+			}
+			bzero(mct_dst+so, len);
+			bad += mct_check("bzero", len, so, so);
+		}
+		if (len % 30 == 0) {
+			kprintf(".");
+		}
+	}
+	kprintf("\n");
+
+	mct_free();
+
+	if (bad) {
+		kprintf("memcpy test: %d failures\n", bad);
+		return EINVAL;
+	}
+	kprintf("memcpy test done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * The simplest possible copy, to compare against.
+ */
+static
+void *
+mcb_bytecopy(void *dst, const void *src, size_t len)
+{
+	char *d = dst;
+	const char *s = src;
+
+	while (len > 0) {
+		*d++ = *s++;
+		len--;
+	}
+	return dst;
+}
+
+static
+void *
+mcb_bzero(void *dst, const void *src, size_t len)
+{
+	(void)src;
+	bzero(dst, len);
+	return dst;
+}
+
+static const struct {
+	const char *name;
+	void *(*func)(void *, const void *, size_t);
+} mcb_funcs[] = {
+	{ "bytes",   mcb_bytecopy },
+	{ "memcpy",  memcpy },
+	{ "memmove", memmove },
+	{ "bzero",   mcb_bzero },
+};
+#define MCB_NFUNCS (sizeof(mcb_funcs) / sizeof(mcb_funcs[0]))
+
+static const struct {
+	const char *name;
+	int srcoff, dstoff;
+} mcb_aligns[] = {
+	{ "aligned",   0, 0 },
+	{ "both +1",   1, 1 },
+	{ "src +1",    1, 0 },
+	{ "src +3",    3, 0 },
+	{ "dst +2",    0, 2 },
+};
+#define MCB_NALIGNS (sizeof(mcb_aligns) / sizeof(mcb_aligns[0]))
+
+/*
+ * Time MCB_BYTES worth of calls to FUNC with SIZE bytes each, and
+ * return the total in microseconds.
+ */
+static
+u_int32_t
+mcb_time(void *(*func)(void *, const void *, size_t),
+	 unsigned char *dst, const unsigned char *src, size_t size)
+{
+	time_t s1, s2, secs;
+	u_int32_t ns1, ns2, nsecs;
+	unsigned i, ncalls;
+
+	ncalls = MCB_BYTES / size;
+
+	gettime(&s1, &ns1);
+	for (i=0; i<ncalls; i++) {
+		func(dst, src, size);
+	}
+	gettime(&s2, &ns2);
+
+	getinterval(s1, ns1, s2, ns2, &secs, &nsecs);
+	return secs*1000000 + nsecs/1000;
+}
+
+int
+memcpybench(int nargs, char **args)
+{
+	unsigned f, a;
+	size_t size;
+	u_int32_t usecs, ncalls;
+
+	(void)nargs;
+	(void)args;
+
+	if (mct_alloc(MCB_MAXSIZE + MCT_ALIGN)) {
+		kprintf("mc2: Out of memory\n");
+		return ENOMEM;
+	}
+	mct_fill(mct_src, MCB_MAXSIZE + MCT_ALIGN, 0);
+
+	kprintf("*** Starting memcpy benchmark (%u bytes per test)\n",
+		MCB_BYTES);
+	kprintf("%-8s %-8s %6s %10s %12s\n",
+		"func", "align", "size", "usec/call", "KB/sec");
+
+	for (f=0; f<MCB_NFUNCS; f++) {
+		for (a=0; a<MCB_NALIGNS; a++) {
+			if (mcb_funcs[f].func == mcb_bzero &&
+			    mcb_aligns[a].srcoff != 0) {
+				/* bzero has no source */
+				continue;
+			}
+			for (size=16; size<=MCB_MAXSIZE; size*=4) {
+				usecs = mcb_time(mcb_funcs[f].func,
+					 mct_dst + mcb_aligns[a].dstoff,
+					 mct_src + mcb_aligns[a].srcoff,
+					 size);
+				ncalls = MCB_BYTES / size;
+				kprintf("%-8s %-8s %6u %6lu.%03lu",
+					mcb_funcs[f].name,
+					mcb_aligns[a].name, size,
+					(unsigned long) usecs / ncalls,
+					(unsigned long)
+					(usecs % ncalls) * 1000 / ncalls);
+				if (usecs > 0) {
+					kprintf(" %12lu",
+						(unsigned long)
+						(MCB_BYTES/1024) * 1000000
+						/ usecs);
+				}
+				kprintf("\n");
+			}
+		}
+	}
+
+	mct_free();
+	kprintf("*** memcpy benchmark done\n");
+	return 0;
+}
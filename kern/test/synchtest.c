@@ -273,3 +273,71 @@ cvtest(int nargs, char **args)
 
 	return 0;
 }
+
+#if OPT_LOCKORDER
+/*
+ * Take locks a, b, and c in an order that makes a cycle (a then b,
+ * b then c, c then a) in one thread, which can't actually deadlock,
+ * and check the lock order checker reports it once, and only once.
+ * Orders stay in the graph, so a second run should report nothing.
+ */
+
+static
+void
+lockorder_nest(struct lock *outer, struct lock *inner)
+{
+	lock_acquire(outer);
+	lock_acquire(inner);
+	lock_release(inner);
+	lock_release(outer);
+}
+
+int
+lockordertest(int nargs, char **args)
+{
+	static int ran;
+	struct lock *a, *b, *c;
+	unsigned before, expect;
+
+	(void)nargs;
+	(void)args;
+
+	a = lock_create("lockordertest a");
+	b = lock_create("lockordertest b");
+	c = lock_create("lockordertest c");
+	if (a == NULL || b == NULL || c == NULL) {
+		panic("lockordertest: lock_create failed\n");
+	}
+
+	kprintf("Starting lock order test...\n");
+	before = lockorder_reports();
+
+	lockorder_nest(a, b);
+	lockorder_nest(b, c);
+	lockorder_nest(a, b);
+	if (lockorder_reports() != before) {
+		panic("lockordertest: report without a cycle\n");
+	}
+
+	expect = ran ? 0 : 1;
+	kprintf("There should be %u report of a, b, and c:\n", expect);
+	lockorder_nest(c, a);
+	if (lockorder_reports() != before + expect) {
+		panic("lockordertest: expected %u reports, got %u\n",
+		      expect, lockorder_reports() - before);
+	}
+
+	lockorder_nest(c, a);
+	if (lockorder_reports() != before + expect) {
+		panic("lockordertest: cycle reported twice\n");
+	}
+
+	lock_destroy(a);
+	lock_destroy(b);
+	lock_destroy(c);
+	ran = 1;
+
+	kprintf("Lock order test done.\n");
+	return 0;
+}
+#endif
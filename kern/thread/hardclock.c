@@ -3,6 +3,7 @@
 #include <machine/spl.h>
 #include <thread.h>
 #include <clock.h>
+#include <prof.h>
 
 /* 
  * The address of lbolt has thread_wakeup called on it once a second.
@@ -21,7 +22,8 @@ hardclock(void)
 	/*
 	 * Collect statistics here as desired.
 	 */
-
+	prof_sample(intr_pc, intr_user);
+	thread_tick();
 
 	lbolt_counter++;
 	if (lbolt_counter >= HZ) {
@@ -9,8 +9,603 @@
 #include <thread.h>
 #include <curthread.h>
 #include <machine/spl.h>
+#include <clock.h>
+#include <trace.h>
 // #include <stdbool.h>
 
+#if OPT_LOCKSTAT
+////////////////////////////////////////////////////////////
+//
+// Lock statistics. See synch.h.
+
+#define LOCKSTAT_NNAMES    64     /* names tracked */
+#define LOCKSTAT_NAMELEN   24     /* longer names are cut short */
+#define LOCKSTAT_NWAITERS  3      /* top waiters kept per name */
+
+struct lockstat {
+	char name[LOCKSTAT_NAMELEN];
+	int issem;
+	unsigned nobjs;              /* created with this name */
+	u_int32_t nacquire;
+	u_int32_t ncontended;        /* acquisitions that had to wait */
+	u_int32_t waittime;          /* usec */
+	u_int32_t holdtime;          /* usec; locks only */
+	u_int32_t maxhold;
+	struct {
+		char name[LOCKSTAT_NAMELEN];
+		u_int32_t waittime;
+	} waiters[LOCKSTAT_NWAITERS];
+};
+
+static struct lockstat lockstats[LOCKSTAT_NNAMES];
+static unsigned lockstat_nnames;
+static unsigned lockstat_untracked;  /* objects with no room for a name */
+
+/* Nothing is timed until there's a clock */
+static int lockstat_on;
+
+/*
+ * The current time in microseconds. Wraps.
+ */
+static
+u_int32_t
+lockstat_stamp(void)
+{
+	time_t secs;
+	u_int32_t nsecs;
+
+	if (!lockstat_on) {
+		return 0;
+	}
+	gettime(&secs, &nsecs);
+	return secs*1000000 + nsecs/1000;
+}
+
+static
+void
+lockstat_copyname(char *dst, const char *src)
+{
+	int i;
+
+	for (i=0; i<LOCKSTAT_NAMELEN-1 && src[i]; i++) {
+		dst[i] = src[i];
+	}
+	dst[i] = 0;
+}
+
+/*
+ * Find the entry for NAME, making one if it's not there. Returns
+ * NULL if the table is full.
+ */
+static
+struct lockstat *
+lockstat_find(const char *name, int issem)
+{
+	char key[LOCKSTAT_NAMELEN];
+	struct lockstat *ls;
+	unsigned i;
+	int spl;
+
+	lockstat_copyname(key, name);
+
+	spl = splhigh();
+	for (i=0; i<lockstat_nnames; i++) {
+		ls = &lockstats[i];
+		if (ls->issem == issem && !strcmp(ls->name, key)) {
+			ls->nobjs++;
+			splx(spl);
+			return ls;
+		}
+	}
+	if (lockstat_nnames == LOCKSTAT_NNAMES) {
+		lockstat_untracked++;
+		splx(spl);
+		return NULL;
+	}
+	ls = &lockstats[lockstat_nnames++];
+	bzero(ls, sizeof(*ls));
+	strcpy(ls->name, key);
+	ls->issem = issem;
+	ls->nobjs = 1;
+	splx(spl);
+	return ls;
+}
+
+/*
+ * Count an acquisition. If it had to wait, WAITSTART is when it
+ * started to, and the current thread is considered for the top
+ * waiters. Interrupts must be off.
+ */
+static
+void
+lockstat_acquired(struct lockstat *ls, int waited, u_int32_t waitstart)
+{
+	u_int32_t wait;
+	unsigned i, min;
+
+	if (ls == NULL) {
+		return;
+	}
+	ls->nacquire++;
+	if (!waited) {
+		return;
+	}
+
+	ls->ncontended++;
+	wait = lockstat_stamp() - waitstart;
+	ls->waittime += wait;
+
+	/* Add to the thread's entry, or replace the smallest */
+	min = 0;
+	for (i=0; i<LOCKSTAT_NWAITERS; i++) {
+		if (!strcmp(ls->waiters[i].name, curthread->t_name)) {
+			ls->waiters[i].waittime += wait;
+			return;
+		}
+		if (ls->waiters[i].waittime < ls->waiters[min].waittime) {
+			min = i;
+		}
+	}
+	if (ls->waiters[min].waittime < wait) {
+		lockstat_copyname(ls->waiters[min].name, curthread->t_name);
+		ls->waiters[min].waittime = wait;
+	}
+}
+
+void
+lockstat_bootstrap(void)
+{
+	lockstat_on = 1;
+}
+
+void
+lockstat_reset(void)
+{
+	struct lockstat *ls;
+	unsigned i;
+	int spl;
+
+	spl = splhigh();
+	for (i=0; i<lockstat_nnames; i++) {
+		ls = &lockstats[i];
+		ls->nacquire = 0;
+		ls->ncontended = 0;
+		ls->waittime = 0;
+		ls->holdtime = 0;
+		ls->maxhold = 0;
+		bzero(ls->waiters, sizeof(ls->waiters));
+	}
+	splx(spl);
+}
+
+/*
+ * Print the names that have been acquired, in order of total wait,
+ * most first.
+ */
+void
+lockstat_print(void)
+{
+	struct lockstat *ls;
+	unsigned order[LOCKSTAT_NNAMES];
+	unsigned n, i, j, w, tmp;
+	int spl;
+
+	spl = splhigh();
+	n = lockstat_nnames;
+	for (i=0; i<n; i++) {
+		tmp = i;
+		for (j=i; j>0 && lockstats[order[j-1]].waittime <
+			     lockstats[tmp].waittime; j--) {
+			order[j] = order[j-1];
+		}
+		order[j] = tmp;
+	}
+	splx(spl);
+
+	kprintf("%-23s %4s %4s %8s %8s %9s %8s %9s %8s\n",
+		"name", "kind", "objs", "acquire", "contend", "wait ms",
+		"avg us", "hold ms", "max us");
+	for (i=0; i<n; i++) {
+		ls = &lockstats[order[i]];
+		if (ls->nacquire == 0) {
+			continue;
+		}
+		kprintf("%-23s %4s %4u %8u %8u %9u %8u ", ls->name,
+			ls->issem ? "sem" : "lock", ls->nobjs,
+			ls->nacquire, ls->ncontended, ls->waittime / 1000,
+			ls->ncontended ? ls->waittime / ls->ncontended : 0);
+		if (ls->issem) {
+			kprintf("%9s %8s\n", "-", "-");
+		}
+		else {
+			kprintf("%9u %8u\n", ls->holdtime / 1000, ls->maxhold);
+		}
+		for (w=0; w<LOCKSTAT_NWAITERS; w++) {
+			if (ls->waiters[w].waittime > 0) {
+				kprintf("    waiter %-23s %9u us\n",
+					ls->waiters[w].name,
+					ls->waiters[w].waittime);
+			}
+		}
+	}
+	if (lockstat_untracked > 0) {
+		kprintf("(%u locks and semaphores not tracked: more than "
+			"%u names)\n", lockstat_untracked, LOCKSTAT_NNAMES);
+	}
+}
+
+/*
+ * Count a release of a lock acquired at STAMP. Interrupts must be off.
+ */
+static
+void
+lockstat_released(struct lockstat *ls, u_int32_t stamp)
+{
+	u_int32_t hold;
+
+	if (ls == NULL || stamp == 0) {
+		/* not tracked, or acquired before there was a clock */
+		return;
+	}
+	hold = lockstat_stamp() - stamp;
+	ls->holdtime += hold;
+	if (hold > ls->maxhold) {
+		ls->maxhold = hold;
+	}
+}
+#endif /* OPT_LOCKSTAT */
+
+#if OPT_LOCKORDER
+////////////////////////////////////////////////////////////
+//
+// Lock order checking. See synch.h.
+
+#define LOCKORDER_NCLASSES  64     /* lock names tracked */
+#define LOCKORDER_NAMELEN   24     /* longer names are cut short */
+#define LOCKORDER_NEDGES    256    /* orders kept with their details */
+
+#define LOCKORDER_MAPWORDS  (LOCKORDER_NCLASSES / 32)
+#define LOCKORDER_ISSET(map, c)  ((map)[(c) / 32] & (1U << ((c) % 32)))
+#define LOCKORDER_SET(map, c)    ((map)[(c) / 32] |= (1U << ((c) % 32)))
+
+static char lockorder_names[LOCKORDER_NCLASSES][LOCKORDER_NAMELEN];
+static unsigned lockorder_nclasses;
+static unsigned lockorder_untracked;  /* locks with no room for a class */
+
+/*
+ * The graph: lockorder_after[a] has bit b set once a lock of class b
+ * has been acquired while holding one of class a. lockorder_reported
+ * is the same shape and marks the pairs that closed a cycle and have
+ * been reported.
+ */
+static u_int32_t lockorder_after[LOCKORDER_NCLASSES][LOCKORDER_MAPWORDS];
+static u_int32_t lockorder_reported[LOCKORDER_NCLASSES][LOCKORDER_MAPWORDS];
+static unsigned lockorder_nreports;
+
+/*
+ * How each order was first taken: by which thread, from where, and
+ * what it held at the time. Orders past LOCKORDER_NEDGES are still
+ * in the graph, just without this.
+ */
+struct lockorder_edge {
+	int from, to;
+	vaddr_t pc;                          /* where "to" was acquired */
+	char thread[LOCKORDER_NAMELEN];
+	int nheld;
+	int held[THREAD_NHELD];
+	vaddr_t heldpc[THREAD_NHELD];
+};
+static struct lockorder_edge lockorder_edges[LOCKORDER_NEDGES];
+static unsigned lockorder_nedges;
+static unsigned lockorder_lostedges;
+
+/* Locks held past THREAD_NHELD, which aren't checked */
+static unsigned lockorder_overflow;
+
+/* Search state for lockorder_path; only used at splhigh */
+static int lockorder_queue[LOCKORDER_NCLASSES];
+static int lockorder_parent[LOCKORDER_NCLASSES];
+
+static
+void
+lockorder_copyname(char *dst, const char *src)
+{
+	int i;
+
+	for (i=0; i<LOCKORDER_NAMELEN-1 && src[i]; i++) {
+		dst[i] = src[i];
+	}
+	dst[i] = 0;
+}
+
+/*
+ * Find the class for NAME, making one if it's not there. Returns -1
+ * if the table is full.
+ */
+static
+int
+lockorder_class(const char *name)
+{
+	char key[LOCKORDER_NAMELEN];
+	unsigned i;
+	int spl, class;
+
+	lockorder_copyname(key, name);
+
+	spl = splhigh();
+	for (i=0; i<lockorder_nclasses; i++) {
+		if (!strcmp(lockorder_names[i], key)) {
+			splx(spl);
+			return i;
+		}
+	}
+	if (lockorder_nclasses == LOCKORDER_NCLASSES) {
+		lockorder_untracked++;
+		splx(spl);
+		return -1;
+	}
+	strcpy(lockorder_names[lockorder_nclasses], key);
+	class = lockorder_nclasses++;
+	splx(spl);
+	return class;
+}
+
+static
+struct lockorder_edge *
+lockorder_findedge(int from, int to)
+{
+	unsigned i;
+
+	for (i=0; i<lockorder_nedges; i++) {
+		if (lockorder_edges[i].from == from &&
+		    lockorder_edges[i].to == to) {
+			return &lockorder_edges[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Record that the current thread took class TO at PC while holding
+ * class FROM, with whatever else it holds.
+ */
+static
+void
+lockorder_addedge(int from, int to, vaddr_t pc)
+{
+	struct lockorder_edge *e;
+	struct lock *held;
+	int i;
+
+	LOCKORDER_SET(lockorder_after[from], to);
+
+	if (lockorder_nedges == LOCKORDER_NEDGES) {
+		lockorder_lostedges++;
+		return;
+	}
+	e = &lockorder_edges[lockorder_nedges++];
+	e->from = from;
+	e->to = to;
+	e->pc = pc;
+	lockorder_copyname(e->thread, curthread->t_name);
+	e->nheld = curthread->t_nheld;
+	for (i=0; i<e->nheld; i++) {
+		held = curthread->t_held[i];
+		e->held[i] = held->lo_class;
+		e->heldpc[i] = curthread->t_heldpc[i];
+	}
+}
+
+/*
+ * Breadth-first search for a path of orders from class FROM to class
+ * TO. If there is one, returns 1 and leaves lockorder_parent giving
+ * the way back from TO.
+ */
+static
+int
+lockorder_path(int from, int to)
+{
+	int head, tail, c, n;
+
+	for (c=0; c<LOCKORDER_NCLASSES; c++) {
+		lockorder_parent[c] = -1;
+	}
+	lockorder_parent[from] = from;
+	head = tail = 0;
+	lockorder_queue[tail++] = from;
+
+	while (head < tail) {
+		c = lockorder_queue[head++];
+		if (c == to) {
+			return 1;
+		}
+		for (n=0; n<(int)lockorder_nclasses; n++) {
+			if (lockorder_parent[n] < 0 &&
+			    LOCKORDER_ISSET(lockorder_after[c], n)) {
+				lockorder_parent[n] = c;
+				lockorder_queue[tail++] = n;
+			}
+		}
+	}
+	return 0;
+}
+
+static
+const char *
+lockorder_name(int c)
+{
+	return c < 0 ? "(untracked)" : lockorder_names[c];
+}
+
+/*
+ * Report that the current thread, acquiring LOCK at PC, is about to
+ * go against the path of orders lockorder_path just found, which
+ * runs from LOCK's class back to class HELD.
+ */
+static
+void
+lockorder_report(struct lock *lock, vaddr_t pc, int held)
+{
+	struct lockorder_edge *e;
+	int path[LOCKORDER_NCLASSES];
+	int i, n, c;
+
+	lockorder_nreports++;
+
+	kprintf("lockorder: possible deadlock\n");
+	kprintf("  thread %s acquiring %s (0x%x) at 0x%x, holding:\n",
+		curthread->t_name, lock->name, (u_int32_t)lock, pc);
+	for (i=0; i<curthread->t_nheld; i++) {
+		kprintf("    %s (0x%x) from 0x%x\n",
+			curthread->t_held[i]->name,
+			(u_int32_t)curthread->t_held[i],
+			curthread->t_heldpc[i]);
+	}
+
+	/* The path comes out backwards; turn it round */
+	n = 0;
+	for (c=held; c != lock->lo_class; c = lockorder_parent[c]) {
+		path[n++] = c;
+	}
+	path[n++] = lock->lo_class;
+
+	kprintf("  but %s has been taken before %s:\n",
+		lockorder_names[lock->lo_class], lockorder_names[held]);
+	for (i=n-1; i>0; i--) {
+		kprintf("    %s then %s", lockorder_names[path[i]],
+			lockorder_names[path[i-1]]);
+		e = lockorder_findedge(path[i], path[i-1]);
+		if (e == NULL) {
+			kprintf(" (no details kept)\n");
+			continue;
+		}
+		kprintf(" by thread %s at 0x%x, holding:\n", e->thread, e->pc);
+		for (c=0; c<e->nheld; c++) {
+			kprintf("      %s from 0x%x\n",
+				lockorder_name(e->held[c]), e->heldpc[c]);
+		}
+	}
+}
+
+/*
+ * Check acquiring LOCK from PC against what the current thread
+ * holds, and add the orders that makes. Interrupts must be off.
+ */
+static
+void
+lockorder_acquiring(struct lock *lock, vaddr_t pc)
+{
+	int i, h, c;
+
+	c = lock->lo_class;
+	if (c < 0 || curthread == NULL) {
+		return;
+	}
+	for (i=0; i<curthread->t_nheld; i++) {
+		h = curthread->t_held[i]->lo_class;
+		if (h < 0 || h == c ||
+		    LOCKORDER_ISSET(lockorder_after[h], c)) {
+			continue;
+		}
+		if (lockorder_path(c, h) &&
+		    !LOCKORDER_ISSET(lockorder_reported[h], c)) {
+			LOCKORDER_SET(lockorder_reported[h], c);
+			lockorder_report(lock, pc, h);
+		}
+		lockorder_addedge(h, c, pc);
+	}
+}
+
+/*
+ * Note that the current thread now holds LOCK, acquired from PC.
+ * Interrupts must be off.
+ */
+static
+void
+lockorder_acquired(struct lock *lock, vaddr_t pc)
+{
+	int n;
+
+	if (curthread == NULL) {
+		return;
+	}
+	n = curthread->t_nheld;
+	if (n == THREAD_NHELD) {
+		lockorder_overflow++;
+		return;
+	}
+	curthread->t_held[n] = lock;
+	curthread->t_heldpc[n] = pc;
+	curthread->t_nheld = n+1;
+}
+
+/*
+ * Note that the current thread has let go of LOCK, which needn't be
+ * the last one it took. Interrupts must be off.
+ */
+static
+void
+lockorder_released(struct lock *lock)
+{
+	int i, n;
+
+	if (curthread == NULL) {
+		return;
+	}
+	n = curthread->t_nheld;
+	for (i=n-1; i>=0; i--) {
+		if (curthread->t_held[i] == lock) {
+			break;
+		}
+	}
+	if (i < 0) {
+		/* one of the overflow locks */
+		return;
+	}
+	for (; i<n-1; i++) {
+		curthread->t_held[i] = curthread->t_held[i+1];
+		curthread->t_heldpc[i] = curthread->t_heldpc[i+1];
+	}
+	curthread->t_nheld = n-1;
+}
+
+unsigned
+lockorder_reports(void)
+{
+	return lockorder_nreports;
+}
+
+void
+lockorder_print(void)
+{
+	struct lockorder_edge *e;
+	unsigned i, n;
+
+	n = lockorder_nedges;
+	kprintf("lockorder: %u classes, %u orders, %u cycles reported\n",
+		lockorder_nclasses, lockorder_nedges + lockorder_lostedges,
+		lockorder_nreports);
+	for (i=0; i<n; i++) {
+		e = &lockorder_edges[i];
+		kprintf("  %-24s then %-24s %s at 0x%x\n",
+			lockorder_names[e->from], lockorder_names[e->to],
+			e->thread, e->pc);
+	}
+	if (lockorder_lostedges > 0) {
+		kprintf("  (and %u more orders without details)\n",
+			lockorder_lostedges);
+	}
+	if (lockorder_untracked > 0) {
+		kprintf("  (%u locks untracked: no room for more than %u "
+			"names)\n", lockorder_untracked, LOCKORDER_NCLASSES);
+	}
+	if (lockorder_overflow > 0) {
+		kprintf("  (%u acquisitions unchecked: more than %u locks "
+			"held)\n", lockorder_overflow, THREAD_NHELD);
+	}
+}
+#endif /* OPT_LOCKORDER */
+
 ////////////////////////////////////////////////////////////
 //
 // Semaphore.
@@ -34,6 +629,9 @@ sem_create(const char *namearg, int initial_count)
 	}
 
 	sem->count = initial_count;
+#if OPT_LOCKSTAT
+	sem->ls = lockstat_find(sem->name, 1);
+#endif
 	DEBUG(DB_THREADS, "Semaphore Created\n");
 	return sem;
 }
@@ -66,6 +664,10 @@ void
 P(struct semaphore *sem)
 {
 	int spl;
+#if OPT_LOCKSTAT
+	int waited;
+	u_int32_t waitstart;
+#endif
 	assert(sem != NULL);
 
 	/*
@@ -77,11 +679,18 @@ P(struct semaphore *sem)
 	assert(in_interrupt==0);
 
 	spl = splhigh();
+#if OPT_LOCKSTAT
+	waited = (sem->count==0);
+	waitstart = (waited && sem->ls != NULL) ? lockstat_stamp() : 0;
+#endif
 	while (sem->count==0) {
 		thread_sleep(sem);
 	}
 	assert(sem->count>0);
 	sem->count--;
+#if OPT_LOCKSTAT
+	lockstat_acquired(sem->ls, waited, waitstart);
+#endif
 	splx(spl);
 }
 
@@ -127,6 +736,13 @@ lock_create(const char *name)
 	// add stuff here as needed
 	lock->available = 1; 						// true, lock is available // TODO: warning: assignment makes pointer from integer without a cast
 	lock->holder = NULL; 						// no thread currenty holds the lock
+#if OPT_LOCKSTAT
+	lock->ls = lockstat_find(lock->name, 0);
+	lock->ls_stamp = 0;
+#endif
+#if OPT_LOCKORDER
+	lock->lo_class = lockorder_class(lock->name);
+#endif
 
 	// DEBUG(DB_THREADS, "Lock Created\n");
 	return lock;
@@ -139,8 +755,9 @@ lock_destroy(struct lock *lock)
 
 	// add stuff here as needed
 
-	kfree(lock->available); 					// not needed when volatile instead of pointer
-	kfree(lock->holder); 						// TODO: is this freeing the thread itself or just the pointer to the thread??
+	// available is a flag stored in the pointer and holder is a thread
+	// we don't own, so neither is ours to free
+	assert(lock->holder == NULL);
 	kfree(lock->name);
 	kfree(lock);
 	// DEBUG(DB_THREADS, "Lock Destroyed\n");
@@ -152,7 +769,22 @@ lock_acquire(struct lock *lock)
 	assert(lock != NULL);
 	
 	int spl = splhigh();
+	int waited = 0;
+#if OPT_LOCKSTAT
+	u_int32_t waitstart = 0;
+#endif
+#if OPT_LOCKORDER
+	vaddr_t pc = (vaddr_t)__builtin_return_address(0);
+
+	lockorder_acquiring(lock, pc);
+#endif
 	while(lock->available == 0){
+#if OPT_LOCKSTAT
+		if (!waited && lock->ls != NULL) {
+			waitstart = lockstat_stamp();
+		}
+#endif
+		waited = 1;
 		thread_sleep(lock);
 	}
 	// warning: comparison between pointer and integer 
@@ -160,6 +792,14 @@ lock_acquire(struct lock *lock)
 
 	lock->available = 0;
 	lock->holder = curthread; 					// unique identifier for the thread
+	TRACE(TR_LOCK, lock, waited);
+#if OPT_LOCKSTAT
+	lockstat_acquired(lock->ls, waited, waitstart);
+	lock->ls_stamp = lock->ls ? lockstat_stamp() : 0;
+#endif
+#if OPT_LOCKORDER
+	lockorder_acquired(lock, pc);
+#endif
 
 	// DEBUG(DB_THREADS, "Lock Acquired\n");
 	splx(spl); 									// TODO: why does it only work when I call splx blocking interrupt at the end
@@ -186,6 +826,14 @@ lock_try_acquire_alert(struct lock *lock) {
 
 	lock->available = 0;
 	lock->holder = curthread; 					// unique identifier for the thread
+	TRACE(TR_LOCK, lock, 0);
+#if OPT_LOCKSTAT
+	lockstat_acquired(lock->ls, 0, 0);
+	lock->ls_stamp = lock->ls ? lockstat_stamp() : 0;
+#endif
+#if OPT_LOCKORDER
+	lockorder_acquired(lock, (vaddr_t)__builtin_return_address(0));
+#endif
 
 	// DEBUG(DB_THREADS, "Lock Acquired\n");
 	splx(spl); 	
@@ -202,6 +850,13 @@ lock_release(struct lock *lock)
 	if(lock_do_i_hold(lock) == 1){
 		lock->available = 1;
 		lock->holder = NULL;					// lock is no longer owned by thread
+		TRACE(TR_UNLOCK, lock, 0);
+#if OPT_LOCKSTAT
+		lockstat_released(lock->ls, lock->ls_stamp);
+#endif
+#if OPT_LOCKORDER
+		lockorder_released(lock);
+#endif
 		assert(lock->available == 1);
 		thread_wakeup(lock);					// wake up threads waiting on the lock
 	}
@@ -250,34 +905,61 @@ cv_create(const char *name)
 void
 cv_destroy(struct cv *cv)
 {
+	int spl;
+
 	assert(cv != NULL);
 
-	// add stuff here as needed
+	spl = splhigh();
+	assert(thread_hassleepers(cv)==0);
+	splx(spl);
 	
 	kfree(cv->name);
 	kfree(cv);
 }
 
+/*
+ * The CV itself is the sleep address. Interrupts stay off from
+ * releasing the lock until we're asleep, so a signal sent in between
+ * can't be missed.
+ */
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
-	// Write this
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
+	int spl;
+
+	assert(cv != NULL);
+	assert(lock_do_i_hold(lock));
+
+	spl = splhigh();
+	lock_release(lock);
+	thread_sleep(cv);
+	splx(spl);
+
+	lock_acquire(lock);
 }
 
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
-	// Write this
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
+	int spl;
+
+	assert(cv != NULL);
+	assert(lock_do_i_hold(lock));
+
+	spl = splhigh();
+	thread_wakeone(cv);
+	splx(spl);
 }
 
 void
 cv_broadcast(struct cv *cv, struct lock *lock)
 {
-	// Write this
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
+	int spl;
+
+	assert(cv != NULL);
+	assert(lock_do_i_hold(lock));
+
+	spl = splhigh();
+	thread_wakeup(cv);
+	splx(spl);
 }
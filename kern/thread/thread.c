@@ -7,11 +7,16 @@
 #include <array.h>
 #include <machine/spl.h>
 #include <machine/pcb.h>
+#include <clock.h>
 #include <thread.h>
 #include <curthread.h>
 #include <scheduler.h>
 #include <addrspace.h>
 #include <vnode.h>
+#include <file.h>
+#include <proc.h>
+#include <kstats.h>
+#include <trace.h>
 #include "opt-synchprobs.h"
 
 /* States a thread can be in. */
@@ -34,6 +39,39 @@ static struct array *zombies;
 /* Total number of outstanding threads. Does not count zombies[]. */
 static int numthreads;
 
+/* Every thread that hasn't been destroyed yet, for thread_printstats. */
+static struct array *allthreads;
+
+/*
+ * System-wide CPU accounting. Nothing is timed until there's a clock
+ * to do it with; see thread_stats_bootstrap.
+ */
+static int stats_on;
+static u_int32_t stats_nswitches;      /* context switches */
+static u_int32_t stats_idletime;       /* usec with no thread running */
+
+/* Their values, and the time, at the last thread_printstats */
+static u_int32_t stats_laststamp;
+static u_int32_t stats_lastswitches;
+static u_int32_t stats_lastidle;
+
+/*
+ * The current time in microseconds, for CPU accounting. Wraps.
+ */
+static
+u_int32_t
+thread_stamp(void)
+{
+	time_t secs;
+	u_int32_t nsecs;
+
+	if (!stats_on) {
+		return 0;
+	}
+	gettime(&secs, &nsecs);
+	return secs*1000000 + nsecs/1000;
+}
+
 /*
  * Create a thread. This is used both to create the first thread's 
  * thread structure and to create subsequent threads.
@@ -54,10 +92,26 @@ thread_create(const char *name)
 	}
 	thread->t_sleepaddr = NULL;
 	thread->t_stack = NULL;
+
+	thread->t_stamp = thread_stamp();
+	thread->t_ticks = 0;
+	thread->t_runtime = 0;
+	thread->t_readytime = 0;
+	thread->t_sleeptime = 0;
+	thread->t_lastruntime = 0;
+	thread->t_nvolswitch = 0;
+	thread->t_ninvolswitch = 0;
+#if OPT_LOCKORDER
+	thread->t_nheld = 0;
+#endif
 	
 	thread->t_vmspace = NULL;
 
 	thread->t_cwd = NULL;
+
+	thread->t_filetable = NULL;
+
+	thread->t_proc = NULL;
 	
 	// If you add things to the thread structure, be sure to initialize
 	// them here.
@@ -75,14 +129,25 @@ static
 void
 thread_destroy(struct thread *thread)
 {
+	int i;
+
 	assert(thread != curthread);
 
+	for (i=0; i<array_getnum(allthreads); i++) {
+		if (array_getguy(allthreads, i) == thread) {
+			array_remove(allthreads, i);
+			break;
+		}
+	}
+
 	// If you add things to the thread structure, be sure to dispose of
 	// them here or in thread_exit.
 
 	// These things are cleaned up in thread_exit.
 	assert(thread->t_vmspace==NULL);
 	assert(thread->t_cwd==NULL);
+	assert(thread->t_filetable==NULL);
+	assert(thread->t_proc==NULL);
 	
 	if (thread->t_stack) {
 		kfree(thread->t_stack);
@@ -184,6 +249,11 @@ thread_bootstrap(void)
 	if (zombies==NULL) {
 		panic("Cannot create zombies array\n");
 	}
+
+	allthreads = array_create();
+	if (allthreads==NULL) {
+		panic("Cannot create allthreads array\n");
+	}
 	
 	/*
 	 * Create the thread structure for the first thread
@@ -205,6 +275,10 @@ thread_bootstrap(void)
 	/* Set curthread */
 	curthread = me;
 
+	if (array_add(allthreads, me)) {
+		panic("thread_bootstrap: Out of memory\n");
+	}
+
 	/* Number of threads starts at 1 */
 	numthreads = 1;
 
@@ -223,6 +297,8 @@ thread_shutdown(void)
 	sleepers = NULL;
 	array_destroy(zombies);
 	zombies = NULL;
+	array_destroy(allthreads);
+	allthreads = NULL;
 	// Don't do this - it frees our stack and we blow up
 	//thread_destroy(curthread);
 }
@@ -285,6 +361,10 @@ thread_fork(const char *name,
 	if (result) {
 		goto fail;
 	}
+	result = array_preallocate(allthreads, array_getnum(allthreads)+1);
+	if (result) {
+		goto fail;
+	}
 
 	/* Do the same for the scheduler. */
 	result = scheduler_preallocate(numthreads+1);
@@ -298,6 +378,10 @@ thread_fork(const char *name,
 		goto fail;
 	}
 
+	/* Preallocated above, so this can't fail */
+	result = array_add(allthreads, newguy);
+	assert(result==0);
+
 	/*
 	 * Increment the thread counter. This must be done atomically
 	 * with the preallocate calls; otherwise the count can be
@@ -341,6 +425,7 @@ void
 mi_switch(threadstate_t nextstate)
 {
 	struct thread *cur, *next;
+	u_int32_t then, now;
 	int result;
 	
 	/* Interrupts should already be off. */
@@ -371,6 +456,20 @@ mi_switch(threadstate_t nextstate)
 	cur = curthread;
 	curthread = NULL;
 
+	/*
+	 * Charge it for the time it's been running. A yield from an
+	 * interrupt handler is the timer preempting it.
+	 */
+	now = thread_stamp();
+	cur->t_runtime += now - cur->t_stamp;
+	cur->t_stamp = now;
+	if (nextstate==S_READY && in_interrupt) {
+		cur->t_ninvolswitch++;
+	}
+	else if (nextstate!=S_ZOMB) {
+		cur->t_nvolswitch++;
+	}
+
 	/*
 	 * Stash the current thread on whatever list it's supposed to go on.
 	 * Because we preallocate during thread_fork, this should not fail.
@@ -398,8 +497,22 @@ mi_switch(threadstate_t nextstate)
 
 	next = scheduler();
 
+	/*
+	 * Nothing ran while the scheduler did (which is nearly always
+	 * because it was idling). Charge the new thread for the time
+	 * it was waiting to run.
+	 */
+	then = now;
+	now = thread_stamp();
+	stats_nswitches++;
+	kstats.ks_switches++;
+	stats_idletime += now - then;
+	next->t_readytime += now - next->t_stamp;
+	next->t_stamp = now;
+
 	/* update curthread */
 	curthread = next;
+	TRACE(TR_SWITCH, cur, nextstate);
 	
 	/* 
 	 * Call the machine-dependent code that actually does the
@@ -448,18 +561,18 @@ thread_exit(void)
 		DEBUG(DB_THREADS, "Thread Exited\n");
 	}
 
-	splhigh();
+	thread_release();
 
-	if (curthread->t_vmspace) {
-		/*
-		 * Do this carefully to avoid race condition with
-		 * context switch code.
-		 */
-		struct addrspace *as = curthread->t_vmspace;
-		curthread->t_vmspace = NULL;
-		as_destroy(as);
+	/*
+	 * A process whose thread dies without calling _exit (because
+	 * runprogram failed, say) exits as if with _exit(1).
+	 */
+	if (curthread->t_proc) {
+		proc_exit(1);
 	}
 
+	splhigh();
+
 	if (curthread->t_cwd) {
 		VOP_DECREF(curthread->t_cwd);
 		curthread->t_cwd = NULL;
@@ -472,6 +585,31 @@ thread_exit(void)
 	panic("Thread came back from the dead!\n");
 }
 
+void
+thread_release(void)
+{
+	struct addrspace *as;
+	int spl;
+
+	/* Closing files may sleep, so do it before turning interrupts off */
+	if (curthread->t_filetable) {
+		filetable_destroy(curthread->t_filetable);
+		curthread->t_filetable = NULL;
+	}
+
+	spl = splhigh();
+	if (curthread->t_vmspace) {
+		/*
+		 * Do this carefully to avoid race condition with
+		 * context switch code.
+		 */
+		as = curthread->t_vmspace;
+		curthread->t_vmspace = NULL;
+		as_destroy(as);
+	}
+	splx(spl);
+}
+
 /*
  * Yield the cpu to another process, but stay runnable.
  */
@@ -504,11 +642,26 @@ thread_sleep(const void *addr)
 	// may not sleep in an interrupt handler
 	assert(in_interrupt==0);
 	
+	TRACE(TR_SLEEP, addr, 0);
 	curthread->t_sleepaddr = addr;
 	mi_switch(S_SLEEP);
 	curthread->t_sleepaddr = NULL;
 }
 
+/*
+ * Charge a thread being woken up for the time it was asleep.
+ */
+static
+void
+thread_woke(struct thread *t)
+{
+	u_int32_t now;
+
+	now = thread_stamp();
+	t->t_sleeptime += now - t->t_stamp;
+	t->t_stamp = now;
+}
+
 /*
  * Wake up one or more threads who are sleeping on "sleep address"
  * ADDR.
@@ -529,6 +682,8 @@ thread_wakeup(const void *addr)
 			
 			// Remove from list
 			array_remove(sleepers, i);
+			TRACE(TR_WAKEUP, addr, t);
+			thread_woke(t);
 			
 			// must look at the same sleepers[i] again
 			i--;
@@ -543,6 +698,31 @@ thread_wakeup(const void *addr)
 	}
 }
 
+/*
+ * Wake up the thread that has been sleeping longest on "sleep
+ * address" ADDR, if there is one.
+ */
+void
+thread_wakeone(const void *addr)
+{
+	int i, result;
+	
+	// meant to be called with interrupts off
+	assert(curspl>0);
+	
+	for (i=0; i<array_getnum(sleepers); i++) {
+		struct thread *t = array_getguy(sleepers, i);
+		if (t->t_sleepaddr == addr) {
+			array_remove(sleepers, i);
+			TRACE(TR_WAKEUP, addr, t);
+			thread_woke(t);
+			result = make_runnable(t);
+			assert(result==0);
+			return;
+		}
+	}
+}
+
 /*
  * Return nonzero if there are any threads who are sleeping on "sleep address"
  * ADDR. This is meant to be used only for diagnostic purposes.
@@ -598,3 +778,109 @@ mi_threadstart(void *data1, unsigned long data2,
 	/* Done. */
 	thread_exit();
 }
+
+/*
+ * Start CPU accounting. Until now there was no clock, so the times
+ * recorded so far mean nothing; start everything from here.
+ */
+void
+thread_stats_bootstrap(void)
+{
+	struct thread *t;
+	u_int32_t now;
+	int i, spl;
+
+	spl = splhigh();
+	stats_on = 1;
+	now = thread_stamp();
+	for (i=0; i<array_getnum(allthreads); i++) {
+		t = array_getguy(allthreads, i);
+		t->t_stamp = now;
+	}
+	stats_laststamp = now;
+	splx(spl);
+}
+
+/*
+ * Called from hardclock on each timer tick.
+ */
+void
+thread_tick(void)
+{
+	if (curthread != NULL) {
+		curthread->t_ticks++;
+	}
+}
+
+/*
+ * Print the times for each thread, and the system-wide context
+ * switch rate and idle time since the last call (or since boot).
+ * The time a thread has spent in the state it's in now is included.
+ * %CPU is the share of the time since the last call spent running.
+ */
+void
+thread_printstats(void)
+{
+	struct thread *t;
+	u_int32_t now, ms, ready, sleep, run, switches, idle;
+	const char *state;
+	int i, j, spl;
+
+	/* Turn interrupts off so the whole table prints atomically. */
+	spl = splhigh();
+
+	now = thread_stamp();
+	ms = (now - stats_laststamp) / 1000;
+	switches = stats_nswitches - stats_lastswitches;
+	idle = stats_idletime - stats_lastidle;
+	if (ms == 0) {
+		ms = 1;
+	}
+
+	kprintf("%d threads; over %u.%03u sec: %u switches/sec, "
+		"%u.%u%% idle\n", array_getnum(allthreads), ms/1000, ms%1000,
+		switches * 1000 / ms, (idle / ms) / 10, (idle / ms) % 10);
+	kprintf("%-10s %-16s %-5s %6s %8s %8s %8s %6s %6s %5s\n",
+		"thread", "name", "state", "ticks", "run ms", "ready ms",
+		"sleep ms", "vol", "invol", "%cpu");
+
+	for (i=0; i<array_getnum(allthreads); i++) {
+		t = array_getguy(allthreads, i);
+		run = t->t_runtime;
+		ready = t->t_readytime;
+		sleep = t->t_sleeptime;
+
+		if (t == curthread) {
+			state = "run";
+			run += now - t->t_stamp;
+		}
+		else if (t->t_sleepaddr != NULL) {
+			state = "sleep";
+			sleep += now - t->t_stamp;
+		}
+		else {
+			state = "ready";
+			for (j=0; j<array_getnum(zombies); j++) {
+				if (array_getguy(zombies, j) == t) {
+					state = "zomb";
+				}
+			}
+			if (state[0] == 'r') {
+				ready += now - t->t_stamp;
+			}
+		}
+
+		kprintf("0x%08x %-16s %-5s %6u %8u %8u %8u %6u %6u %3u.%u\n",
+			(u_int32_t)t, t->t_name, state, t->t_ticks, run/1000,
+			ready/1000, sleep/1000, t->t_nvolswitch,
+			t->t_ninvolswitch, ((run - t->t_lastruntime) / ms) / 10,
+			((run - t->t_lastruntime) / ms) % 10);
+		t->t_lastruntime = run;
+	}
+
+	stats_laststamp = now;
+	stats_lastswitches = stats_nswitches;
+	stats_lastidle = stats_idletime;
+
+	splx(spl);
+}
@@ -0,0 +1,224 @@
+/*
+ * Open files and file descriptor tables. See file.h.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <bitmap.h>
+#include <machine/spl.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <file.h>
+
+////////////////////////////////////////////////////////////
+//
+// Open files
+
+int
+openfile_create(struct vnode *vn, int flags, struct openfile **ret)
+{
+	struct openfile *of;
+
+	of = kmalloc(sizeof(struct openfile));
+	if (of == NULL) {
+		return ENOMEM;
+	}
+	of->of_lock = lock_create("openfile");
+	if (of->of_lock == NULL) {
+		kfree(of);
+		return ENOMEM;
+	}
+	of->of_vnode = vn;
+	of->of_flags = flags;
+	of->of_offset = 0;
+	of->of_refcount = 1;
+
+	*ret = of;
+	return 0;
+}
+
+int
+openfile_open(char *path, int flags, struct openfile **ret)
+{
+	struct vnode *vn;
+	int result;
+
+	result = vfs_open(path, flags, &vn);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_create(vn, flags, ret);
+	if (result) {
+		vfs_close(vn);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * The refcount is only ever touched for a moment, so rather than take
+ * a lock for it, just turn interrupts off.
+ */
+void
+openfile_incref(struct openfile *of)
+{
+	int spl;
+
+	spl = splhigh();
+	assert(of->of_refcount > 0);
+	of->of_refcount++;
+	splx(spl);
+}
+
+void
+openfile_decref(struct openfile *of)
+{
+	int spl, last;
+
+	spl = splhigh();
+	assert(of->of_refcount > 0);
+	of->of_refcount--;
+	last = (of->of_refcount == 0);
+	splx(spl);
+
+	if (last) {
+		vfs_close(of->of_vnode);
+		lock_destroy(of->of_lock);
+		kfree(of);
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// File tables
+
+struct filetable *
+filetable_create(void)
+{
+	struct filetable *ft;
+	int i;
+
+	ft = kmalloc(sizeof(struct filetable));
+	if (ft == NULL) {
+		return NULL;
+	}
+	ft->ft_used = bitmap_create(OPEN_MAX);
+	if (ft->ft_used == NULL) {
+		kfree(ft);
+		return NULL;
+	}
+	for (i=0; i<OPEN_MAX; i++) {
+		ft->ft_files[i] = NULL;
+	}
+	return ft;
+}
+
+void
+filetable_destroy(struct filetable *ft)
+{
+	int i;
+
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] != NULL) {
+			openfile_decref(ft->ft_files[i]);
+		}
+	}
+	bitmap_destroy(ft->ft_used);
+	kfree(ft);
+}
+
+/*
+ * Make a copy of FT for a child process. The copies share the open
+ * files with the originals.
+ */
+int
+filetable_copy(struct filetable *ft, struct filetable **ret)
+{
+	struct filetable *nft;
+	int i;
+
+	nft = filetable_create();
+	if (nft == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] != NULL) {
+			openfile_incref(ft->ft_files[i]);
+			nft->ft_files[i] = ft->ft_files[i];
+			bitmap_mark(nft->ft_used, i);
+		}
+	}
+	*ret = nft;
+	return 0;
+}
+
+int
+filetable_place(struct filetable *ft, struct openfile *of, int *fd)
+{
+	u_int32_t index;
+
+	if (bitmap_alloc(ft->ft_used, &index)) {
+		return EMFILE;
+	}
+	assert(ft->ft_files[index] == NULL);
+	ft->ft_files[index] = of;
+	*fd = index;
+	return 0;
+}
+
+int
+filetable_get(struct filetable *ft, int fd, struct openfile **ret)
+{
+	if (fd < 0 || fd >= OPEN_MAX || ft->ft_files[fd] == NULL) {
+		return EBADF;
+	}
+	*ret = ft->ft_files[fd];
+	return 0;
+}
+
+int
+filetable_dup2(struct filetable *ft, int oldfd, int newfd)
+{
+	struct openfile *of, *old;
+	int result;
+
+	result = filetable_get(ft, oldfd, &of);
+	if (result) {
+		return result;
+	}
+	if (newfd < 0 || newfd >= OPEN_MAX) {
+		return EBADF;
+	}
+	if (newfd == oldfd) {
+		return 0;
+	}
+
+	openfile_incref(of);
+	old = ft->ft_files[newfd];
+	ft->ft_files[newfd] = of;
+	if (old != NULL) {
+		openfile_decref(old);
+	}
+	else {
+		bitmap_mark(ft->ft_used, newfd);
+	}
+	return 0;
+}
+
+int
+filetable_close(struct filetable *ft, int fd)
+{
+	struct openfile *of;
+	int result;
+
+	result = filetable_get(ft, fd, &of);
+	if (result) {
+		return result;
+	}
+	ft->ft_files[fd] = NULL;
+	bitmap_unmark(ft->ft_used, fd);
+	openfile_decref(of);
+	return 0;
+}
@@ -0,0 +1,312 @@
+/*
+ * File system calls: open, read, write, readv, writev, close, lseek,
+ * dup2, pipe, remove.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/unistd.h>
+#include <kern/limits.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <machine/spl.h>
+#include <synch.h>
+#include <uio.h>
+#include <thread.h>
+#include <curthread.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <file.h>
+#include <syscall.h>
+#include <kstats.h>
+
+int
+sys_open(userptr_t path, int flags, int *retval)
+{
+	struct openfile *of;
+	char *kpath;
+	int result;
+
+	kpath = kmalloc(PATH_MAX);
+	if (kpath == NULL) {
+		return ENOMEM;
+	}
+
+	result = copyinstr(path, kpath, PATH_MAX, NULL);
+	if (result) {
+		kfree(kpath);
+		return result;
+	}
+
+	result = openfile_open(kpath, flags, &of);
+	kfree(kpath);
+	if (result) {
+		return result;
+	}
+
+	result = filetable_place(curthread->t_filetable, of, retval);
+	if (result) {
+		openfile_decref(of);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Common code for read, write, readv, and writev. UIO is set up
+ * except for the offset; the open file supplies that.
+ */
+static
+int
+file_rw(int fd, struct uio *uio, int *retval)
+{
+	struct openfile *of;
+	struct stat st;
+	size_t len;
+	int how, result, spl;
+
+	result = filetable_get(curthread->t_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+
+	how = of->of_flags & O_ACCMODE;
+	if (uio->uio_rw == UIO_READ ? how == O_WRONLY : how == O_RDONLY) {
+		return EBADF;
+	}
+
+	len = uio->uio_resid;
+
+	lock_acquire(of->of_lock);
+	if (uio->uio_rw == UIO_WRITE && (of->of_flags & O_APPEND)) {
+		result = VOP_STAT(of->of_vnode, &st);
+		if (result) {
+			lock_release(of->of_lock);
+			return result;
+		}
+		of->of_offset = st.st_size;
+	}
+	uio->uio_offset = of->of_offset;
+
+	if (uio->uio_rw == UIO_READ) {
+		result = VOP_READ(of->of_vnode, uio);
+	}
+	else {
+		result = VOP_WRITE(of->of_vnode, uio);
+	}
+	of->of_offset = uio->uio_offset;
+	lock_release(of->of_lock);
+
+	if (result) {
+		return result;
+	}
+	*retval = len - uio->uio_resid;
+
+	spl = splhigh();
+	if (uio->uio_rw == UIO_READ) {
+		kstats.ks_readbytes += *retval;
+	}
+	else {
+		kstats.ks_writebytes += *retval;
+	}
+	splx(spl);
+	return 0;
+}
+
+/*
+ * Set up a uio for a single user buffer.
+ */
+static
+void
+file_mkuio(struct uio *uio, userptr_t buf, size_t len, enum uio_rw rw)
+{
+	uio->uio_iovec.iov_ubase = buf;
+	uio->uio_iovec.iov_len = len;
+	uio->uio_iov = NULL;
+	uio->uio_iovcnt = 0;
+	uio->uio_offset = 0;
+	uio->uio_resid = len;
+	uio->uio_segflg = UIO_USERSPACE;
+	uio->uio_rw = rw;
+	uio->uio_space = curthread->t_vmspace;
+}
+
+int
+sys_read(int fd, userptr_t buf, size_t len, int *retval)
+{
+	struct uio u;
+
+	file_mkuio(&u, buf, len, UIO_READ);
+	return file_rw(fd, &u, retval);
+}
+
+int
+sys_write(int fd, userptr_t buf, size_t len, int *retval)
+{
+	struct uio u;
+
+	file_mkuio(&u, buf, len, UIO_WRITE);
+	return file_rw(fd, &u, retval);
+}
+
+int
+sys_readv(int fd, userptr_t iov, int iovcnt, int *retval)
+{
+	struct iovec kiov[IOV_MAX];
+	struct uio u;
+	int result;
+
+	result = mk_uuio(&u, kiov, iov, iovcnt, 0, UIO_READ);
+	if (result) {
+		return result;
+	}
+	return file_rw(fd, &u, retval);
+}
+
+int
+sys_writev(int fd, userptr_t iov, int iovcnt, int *retval)
+{
+	struct iovec kiov[IOV_MAX];
+	struct uio u;
+	int result;
+
+	result = mk_uuio(&u, kiov, iov, iovcnt, 0, UIO_WRITE);
+	if (result) {
+		return result;
+	}
+	return file_rw(fd, &u, retval);
+}
+
+int
+sys_close(int fd)
+{
+	return filetable_close(curthread->t_filetable, fd);
+}
+
+int
+sys_lseek(int fd, off_t pos, int whence, off_t *retval)
+{
+	struct openfile *of;
+	struct stat st;
+	int result;
+
+	result = filetable_get(curthread->t_filetable, fd, &of);
+	if (result) {
+		return result;
+	}
+
+	lock_acquire(of->of_lock);
+	switch (whence) {
+	    case SEEK_SET:
+		break;
+	    case SEEK_CUR:
+		pos += of->of_offset;
+		break;
+	    case SEEK_END:
+		result = VOP_STAT(of->of_vnode, &st);
+		if (result) {
+			lock_release(of->of_lock);
+			return result;
+		}
+		pos += st.st_size;
+		break;
+	    default:
+		lock_release(of->of_lock);
+		return EINVAL;
+	}
+
+	/* The vnode says if it can seek at all (pipes and devices can't) */
+	result = VOP_TRYSEEK(of->of_vnode, pos);
+	if (result == 0 && pos < 0) {
+		result = EINVAL;
+	}
+	if (result == 0) {
+		of->of_offset = pos;
+	}
+	lock_release(of->of_lock);
+
+	if (result) {
+		return result;
+	}
+	*retval = pos;
+	return 0;
+}
+
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+	int result;
+
+	result = filetable_dup2(curthread->t_filetable, oldfd, newfd);
+	if (result) {
+		return result;
+	}
+	*retval = newfd;
+	return 0;
+}
+
+int
+sys_pipe(userptr_t fds)
+{
+	struct filetable *ft = curthread->t_filetable;
+	struct vnode *rvn, *wvn;
+	struct openfile *rof, *wof;
+	int kfds[2];
+	int result;
+
+	result = pipe_create(&rvn, &wvn);
+	if (result) {
+		return result;
+	}
+	result = openfile_create(rvn, O_RDONLY, &rof);
+	if (result) {
+		vfs_close(rvn);
+		vfs_close(wvn);
+		return result;
+	}
+	result = openfile_create(wvn, O_WRONLY, &wof);
+	if (result) {
+		openfile_decref(rof);
+		vfs_close(wvn);
+		return result;
+	}
+
+	result = filetable_place(ft, rof, &kfds[0]);
+	if (result) {
+		openfile_decref(rof);
+		openfile_decref(wof);
+		return result;
+	}
+	result = filetable_place(ft, wof, &kfds[1]);
+	if (result) {
+		filetable_close(ft, kfds[0]);
+		openfile_decref(wof);
+		return result;
+	}
+
+	result = copyout(kfds, fds, sizeof(kfds));
+	if (result) {
+		filetable_close(ft, kfds[0]);
+		filetable_close(ft, kfds[1]);
+		return result;
+	}
+	return 0;
+}
+
+int
+sys_remove(userptr_t path)
+{
+	char *kpath;
+	int result;
+
+	kpath = kmalloc(PATH_MAX);
+	if (kpath == NULL) {
+		return ENOMEM;
+	}
+
+	result = copyinstr(path, kpath, PATH_MAX, NULL);
+	if (result == 0) {
+		result = vfs_remove(kpath);
+	}
+	kfree(kpath);
+	return result;
+}
@@ -0,0 +1,28 @@
+/*
+ * The kernel event counters, and the system call that reads them.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <machine/spl.h>
+#include <kstats.h>
+#include <syscall.h>
+
+struct kstats kstats;
+
+/*
+ * Take the snapshot at splhigh, so the counters are all from the same
+ * moment.
+ */
+int
+sys___kstats(userptr_t ksp)
+{
+	struct kstats ks;
+	int spl;
+
+	spl = splhigh();
+	ks = kstats;
+	splx(spl);
+
+	return copyout(&ks, ksp, sizeof(ks));
+}
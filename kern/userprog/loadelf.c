@@ -52,6 +52,8 @@ load_segment(struct vnode *v, off_t offset, vaddr_t vaddr,
 
 	u.uio_iovec.iov_ubase = (userptr_t)vaddr;
 	u.uio_iovec.iov_len = memsize;   // length of the memory space
+	u.uio_iov = NULL;
+	u.uio_iovcnt = 0;
 	u.uio_resid = filesize;          // amount to actually read
 	u.uio_offset = offset;
 	u.uio_segflg = is_executable ? UIO_USERISPACE : UIO_USERSPACE;
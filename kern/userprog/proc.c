@@ -0,0 +1,302 @@
+/*
+ * Processes and the pid table. See proc.h.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <synch.h>
+#include <machine/spl.h>
+#include <thread.h>
+#include <curthread.h>
+#include <proc.h>
+
+/* Largest pid generation, so pids stay positive */
+#define PROC_MAXGEN  (0x7fffffff / PROC_MAX - 1)
+
+struct pidslot {
+	struct proc *ps_proc;           /* NULL if free */
+	u_int32_t ps_gen;               /* generation, for the next pid */
+	int ps_next;                    /* next free slot, or -1 */
+};
+
+static struct pidslot proc_table[PROC_MAX];
+static int proc_freehead;               /* oldest free slot */
+static int proc_freetail;               /* newest free slot */
+static struct lock *proc_lock;
+
+/* Statistics */
+static u_int32_t proc_forks;
+static u_int32_t proc_forkusecs;
+static u_int32_t proc_execs;
+static u_int32_t proc_execusecs;
+static u_int32_t proc_execmax;
+
+void
+proc_bootstrap(void)
+{
+	int i;
+
+	proc_lock = lock_create("proc");
+	if (proc_lock == NULL) {
+		panic("proc_bootstrap: Out of memory\n");
+	}
+
+	for (i=0; i<PROC_MAX; i++) {
+		proc_table[i].ps_proc = NULL;
+		proc_table[i].ps_gen = 1;
+		proc_table[i].ps_next = i+1;
+	}
+	proc_table[PROC_MAX-1].ps_next = -1;
+	proc_freehead = 0;
+	proc_freetail = PROC_MAX-1;
+}
+
+int
+proc_create(struct proc *parent, struct proc **ret)
+{
+	struct proc *p;
+	struct pidslot *ps;
+	int slot;
+
+	p = kmalloc(sizeof(struct proc));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	p->p_cv = cv_create("proc");
+	if (p->p_cv == NULL) {
+		kfree(p);
+		return ENOMEM;
+	}
+	p->p_parent = parent;
+	p->p_orphan = 0;
+	p->p_nchildren = 0;
+	p->p_exited = 0;
+	p->p_exitcode = 0;
+
+	lock_acquire(proc_lock);
+
+	slot = proc_freehead;
+	if (slot < 0) {
+		lock_release(proc_lock);
+		cv_destroy(p->p_cv);
+		kfree(p);
+		return EAGAIN;
+	}
+	ps = &proc_table[slot];
+	proc_freehead = ps->ps_next;
+	if (proc_freehead < 0) {
+		proc_freetail = -1;
+	}
+
+	ps->ps_proc = p;
+	p->p_pid = ps->ps_gen * PROC_MAX + slot;
+	if (parent != NULL) {
+		parent->p_nchildren++;
+	}
+
+	lock_release(proc_lock);
+
+	*ret = p;
+	return 0;
+}
+
+/*
+ * Free P and its pid. Called with proc_lock held.
+ */
+static
+void
+proc_free(struct proc *p)
+{
+	struct pidslot *ps;
+	int slot;
+
+	slot = p->p_pid % PROC_MAX;
+	ps = &proc_table[slot];
+	assert(ps->ps_proc == p);
+
+	ps->ps_proc = NULL;
+	ps->ps_gen = (ps->ps_gen < PROC_MAXGEN) ? ps->ps_gen + 1 : 1;
+	ps->ps_next = -1;
+	if (proc_freetail < 0) {
+		proc_freehead = slot;
+	}
+	else {
+		proc_table[proc_freetail].ps_next = slot;
+	}
+	proc_freetail = slot;
+
+	if (p->p_parent != NULL) {
+		assert(p->p_parent->p_nchildren > 0);
+		p->p_parent->p_nchildren--;
+	}
+
+	cv_destroy(p->p_cv);
+	kfree(p);
+}
+
+void
+proc_destroy(struct proc *p)
+{
+	lock_acquire(proc_lock);
+	proc_free(p);
+	lock_release(proc_lock);
+}
+
+void
+proc_exit(int code)
+{
+	struct proc *p = curthread->t_proc;
+	struct proc *child;
+	int i;
+
+	assert(p != NULL);
+
+	lock_acquire(proc_lock);
+
+	/* Let go of the children: free the dead ones, orphan the rest */
+	for (i=0; i<PROC_MAX && p->p_nchildren > 0; i++) {
+		child = proc_table[i].ps_proc;
+		if (child == NULL || child->p_parent != p) {
+			continue;
+		}
+		if (child->p_exited) {
+			proc_free(child);
+		}
+		else {
+			child->p_parent = NULL;
+			child->p_orphan = 1;
+			p->p_nchildren--;
+		}
+	}
+	assert(p->p_nchildren == 0);
+
+	p->p_exited = 1;
+	p->p_exitcode = code;
+	curthread->t_proc = NULL;
+
+	if (p->p_orphan) {
+		proc_free(p);
+	}
+	else {
+		cv_broadcast(p->p_cv, proc_lock);
+	}
+
+	lock_release(proc_lock);
+}
+
+int
+proc_wait(pid_t pid, int *code)
+{
+	struct proc *p;
+
+	if (pid <= 0) {
+		return ESRCH;
+	}
+
+	lock_acquire(proc_lock);
+
+	p = proc_table[pid % PROC_MAX].ps_proc;
+	if (p == NULL || p->p_pid != pid) {
+		lock_release(proc_lock);
+		return ESRCH;
+	}
+	if (p->p_orphan || p->p_parent != curthread->t_proc) {
+		lock_release(proc_lock);
+		return ECHILD;
+	}
+
+	while (!p->p_exited) {
+		cv_wait(p->p_cv, proc_lock);
+	}
+	*code = p->p_exitcode;
+	proc_free(p);
+
+	lock_release(proc_lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Stats
+
+/*
+ * Microseconds since S/NS.
+ */
+static
+u_int32_t
+proc_usecsince(time_t s, u_int32_t ns)
+{
+	time_t s2;
+	u_int32_t ns2;
+
+	gettime(&s2, &ns2);
+	getinterval(s, ns, s2, ns2, &s2, &ns2);
+	return s2*1000000 + ns2/1000;
+}
+
+void
+proc_timefork(time_t s, u_int32_t ns)
+{
+	u_int32_t usecs;
+	int spl;
+
+	usecs = proc_usecsince(s, ns);
+
+	spl = splhigh();
+	proc_forks++;
+	proc_forkusecs += usecs;
+	splx(spl);
+}
+
+void
+proc_timeexec(time_t s, u_int32_t ns)
+{
+	u_int32_t usecs;
+	int spl;
+
+	usecs = proc_usecsince(s, ns);
+
+	spl = splhigh();
+	proc_execs++;
+	proc_execusecs += usecs;
+	if (usecs > proc_execmax) {
+		proc_execmax = usecs;
+	}
+	splx(spl);
+}
+
+void
+proc_printstats(void)
+{
+	u_int32_t each;
+
+	kprintf("proc: %u forks", proc_forks);
+	if (proc_forks > 0 && proc_forkusecs > 0) {
+		each = proc_forkusecs / proc_forks;
+		kprintf(", %u usec each, %u forks/sec", each,
+			each > 0 ? 1000000 / each : 0);
+	}
+	kprintf("\n");
+
+	kprintf("proc: %u execs", proc_execs);
+	if (proc_execs > 0) {
+		kprintf(", %u usec each, max %u usec",
+			proc_execusecs / proc_execs, proc_execmax);
+	}
+	kprintf("\n");
+}
+
+void
+proc_resetstats(void)
+{
+	int spl;
+
+	spl = splhigh();
+	proc_forks = 0;
+	proc_forkusecs = 0;
+	proc_execs = 0;
+	proc_execusecs = 0;
+	proc_execmax = 0;
+	splx(spl);
+}
@@ -0,0 +1,154 @@
+/*
+ * Process system calls: fork, waitpid, getpid, _exit. (execv is with
+ * runprogram, in runprogram.c.)
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <machine/trapframe.h>
+#include <thread.h>
+#include <curthread.h>
+#include <addrspace.h>
+#include <file.h>
+#include <proc.h>
+#include <syscall.h>
+
+/*
+ * What the parent of a fork hands the child thread.
+ */
+struct forkinfo {
+	struct trapframe fi_tf;
+	struct addrspace *fi_as;
+	struct filetable *fi_ft;
+	struct proc *fi_proc;
+};
+
+/*
+ * Where the child of a fork starts: take over what the parent set up
+ * and go to user mode.
+ */
+static
+void
+fork_child(void *data1, unsigned long data2)
+{
+	struct forkinfo *fi = data1;
+	struct trapframe tf;
+
+	(void)data2;
+
+	curthread->t_vmspace = fi->fi_as;
+	curthread->t_filetable = fi->fi_ft;
+	curthread->t_proc = fi->fi_proc;
+
+	/* The trapframe has to be on our own stack */
+	memcpy(&tf, &fi->fi_tf, sizeof(tf));
+	kfree(fi);
+
+	as_activate(curthread->t_vmspace);
+	md_forkentry(&tf);
+
+	/* md_forkentry does not return */
+	panic("md_forkentry returned\n");
+}
+
+int
+sys_fork(struct trapframe *tf, pid_t *retval)
+{
+	struct forkinfo *fi;
+	time_t s;
+	u_int32_t ns;
+	pid_t pid;
+	int result;
+
+	assert(curthread->t_proc != NULL);
+
+	gettime(&s, &ns);
+
+	fi = kmalloc(sizeof(struct forkinfo));
+	if (fi == NULL) {
+		return ENOMEM;
+	}
+	memcpy(&fi->fi_tf, tf, sizeof(*tf));
+
+	result = as_copy(curthread->t_vmspace, &fi->fi_as);
+	if (result) {
+		goto fail;
+	}
+	result = filetable_copy(curthread->t_filetable, &fi->fi_ft);
+	if (result) {
+		goto fail_as;
+	}
+	result = proc_create(curthread->t_proc, &fi->fi_proc);
+	if (result) {
+		goto fail_ft;
+	}
+
+	/* Once the child runs it may exit and free its proc */
+	pid = fi->fi_proc->p_pid;
+
+	result = thread_fork(curthread->t_name, fi, 0, fork_child, NULL);
+	if (result) {
+		goto fail_proc;
+	}
+
+	proc_timefork(s, ns);
+	*retval = pid;
+	return 0;
+
+ fail_proc:
+	proc_destroy(fi->fi_proc);
+ fail_ft:
+	filetable_destroy(fi->fi_ft);
+ fail_as:
+	as_destroy(fi->fi_as);
+ fail:
+	kfree(fi);
+	return result;
+}
+
+int
+sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval)
+{
+	int code, result;
+
+	if (options != 0) {
+		return EINVAL;
+	}
+
+	result = proc_wait(pid, &code);
+	if (result) {
+		return result;
+	}
+
+	if (status != NULL) {
+		result = copyout(&code, status, sizeof(code));
+		if (result) {
+			return result;
+		}
+	}
+	*retval = pid;
+	return 0;
+}
+
+int
+sys_getpid(pid_t *retval)
+{
+	assert(curthread->t_proc != NULL);
+	*retval = curthread->t_proc->p_pid;
+	return 0;
+}
+
+/*
+ * The exit code goes to the parent, if it's waiting or will wait.
+ * Close the files and free the address space first, so that when
+ * the parent hears, everything is let go of (a pipe's other end sees
+ * EOF, and so on).
+ */
+void
+sys__exit(int code)
+{
+	thread_release();
+	proc_exit(code);
+	thread_exit();
+}
@@ -1,76 +1,396 @@
 /*
- * Sample/test code for running a user program.  You can use this for
- * reference when implementing the execv() system call. Remember though
- * that execv() needs to do more than this function does.
+ * Running user programs: runprogram, which starts a program from the
+ * kernel menu, and the execv system call.
+ *
+ * Both build the new program's argv in exec_argbuf, then copy all of
+ * it onto the new user stack with one copyout. In the buffer, argv[]
+ * comes first and the strings follow; until they're copied out, the
+ * argv[] entries hold offsets into the buffer. The buffer is ARG_MAX
+ * bytes, allocated once at boot rather than on each exec (a buffer
+ * that size would take whole pages from kmalloc), and exec_lock lets
+ * one exec at a time use it. Once the arguments are in, they're moved
+ * to a private buffer just big enough to hold them and the lock is
+ * dropped, so an exec doesn't hold up others while it loads its
+ * program from disk.
  */
 
 #include <types.h>
 #include <kern/unistd.h>
 #include <kern/errno.h>
+#include <kern/limits.h>
 #include <lib.h>
+#include <clock.h>
+#include <synch.h>
 #include <addrspace.h>
 #include <thread.h>
 #include <curthread.h>
 #include <vm.h>
 #include <vfs.h>
+#include <file.h>
+#include <proc.h>
+#include <syscall.h>
 #include <test.h>
 
+static char *exec_argbuf;
+static struct lock *exec_lock;
+
+void
+exec_bootstrap(void)
+{
+	exec_argbuf = kmalloc(ARG_MAX);
+	exec_lock = lock_create("exec");
+	if (exec_argbuf == NULL || exec_lock == NULL) {
+		panic("exec_bootstrap: Out of memory\n");
+	}
+}
+
 /*
- * Load program "progname" and start running it in usermode.
- * Does not return except on error.
+ * Put the kernel strings ARGS[0..NARGS-1] in exec_argbuf. Hands back
+ * how much of the buffer is used.
+ */
+static
+int
+exec_kargs(char **args, int nargs, size_t *len)
+{
+	u_int32_t *argv = (u_int32_t *)exec_argbuf;
+	size_t pos, slen;
+	int i;
+
+	assert(lock_do_i_hold(exec_lock));
+
+	pos = (nargs+1) * sizeof(u_int32_t);
+	if (pos > ARG_MAX) {
+		return E2BIG;
+	}
+	for (i=0; i<nargs; i++) {
+		slen = strlen(args[i]) + 1;
+		if (slen > ARG_MAX - pos) {
+			return E2BIG;
+		}
+		memcpy(exec_argbuf + pos, args[i], slen);
+		argv[i] = pos;
+		pos += slen;
+	}
+	*len = pos;
+	return 0;
+}
+
+/*
+ * Copy in the user argv[] at UARGV, and the strings it points to, to
+ * exec_argbuf. Hands back the number of arguments and how much of the
+ * buffer is used.
  *
- * Calls vfs_open on progname and thus may destroy it.
+ * argv[] is copied in as much of a page at a time as possible, rather
+ * than a pointer at a time. Reading to the end of the page that holds
+ * the next pointer can't fault if reading the pointer itself doesn't.
+ * The strings are then all copied in with one copyinstrv, and argv[]
+ * is pointed at them by finding the nulls between them.
  */
+static
 int
-runprogram(char *progname)
+exec_copyinargs(userptr_t uargv, int *argc, size_t *len)
 {
-	struct vnode *v;
-	vaddr_t entrypoint, stackptr;
-	int result;
+	u_int32_t *argv = (u_int32_t *)exec_argbuf;
+	const int maxargs = ARG_MAX / sizeof(u_int32_t);
+	vaddr_t uaddr;
+	size_t pos, got;
+	int n, i, result;
 
-	/* Open the file. */
-	result = vfs_open(progname, O_RDONLY, &v);
+	assert(lock_do_i_hold(exec_lock));
+
+	if ((vaddr_t)uargv % sizeof(u_int32_t) != 0) {
+		return EFAULT;
+	}
+
+	n = 0;
+	for (;;) {
+		uaddr = (vaddr_t)uargv + n*sizeof(u_int32_t);
+		i = (PAGE_SIZE - uaddr % PAGE_SIZE) / sizeof(u_int32_t);
+		if (i > maxargs - n) {
+			i = maxargs - n;
+		}
+		if (i == 0) {
+			return E2BIG;
+		}
+		result = copyin((const_userptr_t)uaddr, &argv[n],
+				i*sizeof(u_int32_t));
+		if (result) {
+			return result;
+		}
+		for (; i > 0; i--, n++) {
+			if (argv[n] == 0) {
+				break;
+			}
+		}
+		if (i > 0) {
+			break;
+		}
+	}
+
+	/* Now the strings, packed in after argv[] */
+	pos = (n+1) * sizeof(u_int32_t);
+	result = copyinstrv((const const_userptr_t *)argv, n,
+			    exec_argbuf + pos, ARG_MAX - pos, &got);
+	if (result == ENAMETOOLONG) {
+		return E2BIG;
+	}
 	if (result) {
 		return result;
 	}
+	for (i=0; i<n; i++) {
+		argv[i] = pos;
+		pos += strlen(exec_argbuf + pos) + 1;
+	}
+	assert(pos == (n+1) * sizeof(u_int32_t) + got);
 
-	/* We should be a new thread. */
-	assert(curthread->t_vmspace == NULL);
+	*argc = n;
+	*len = pos;
+	return 0;
+}
 
-	/* Create a new address space. */
-	curthread->t_vmspace = as_create();
-	if (curthread->t_vmspace==NULL) {
-		vfs_close(v);
+/*
+ * Move the first LEN bytes of exec_argbuf to a buffer of their own,
+ * freeing exec_argbuf for the next exec.
+ */
+static
+int
+exec_saveargs(size_t len, char **buf)
+{
+	assert(lock_do_i_hold(exec_lock));
+
+	*buf = kmalloc(len);
+	if (*buf == NULL) {
 		return ENOMEM;
 	}
+	memcpy(*buf, exec_argbuf, len);
+	return 0;
+}
 
-	/* Activate it. */
-	as_activate(curthread->t_vmspace);
+/*
+ * Replace the current address space with a new one holding the
+ * program PATH, and copy the ARGC arguments in ARGBUF (LEN bytes, laid
+ * out as in exec_argbuf) onto its stack. Hands back what md_usermode
+ * needs. On error the old address space is left in place.
+ *
+ * Calls vfs_open on PATH and thus may destroy it.
+ */
+static
+int
+exec_load(char *path, int argc, char *argbuf, size_t len,
+	  vaddr_t *entrypoint, vaddr_t *stackptr, userptr_t *uargv)
+{
+	u_int32_t *argv = (u_int32_t *)argbuf;
+	struct addrspace *oldas, *newas;
+	struct vnode *v;
+	vaddr_t base;
+	int i, result;
 
-	/* Load the executable. */
-	result = load_elf(v, &entrypoint);
+	/* Open the file. */
+	result = vfs_open(path, O_RDONLY, &v);
 	if (result) {
-		/* thread_exit destroys curthread->t_vmspace */
-		vfs_close(v);
 		return result;
 	}
 
+	/* Create a new address space, and switch to it. */
+	newas = as_create();
+	if (newas == NULL) {
+		vfs_close(v);
+		return ENOMEM;
+	}
+	oldas = curthread->t_vmspace;
+	curthread->t_vmspace = newas;
+	as_activate(newas);
+
+	/* Load the executable. */
+	result = load_elf(v, entrypoint);
+
 	/* Done with the file now. */
 	vfs_close(v);
 
+	if (result) {
+		goto fail;
+	}
+
 	/* Define the user stack in the address space */
-	result = as_define_stack(curthread->t_vmspace, &stackptr);
+	result = as_define_stack(newas, stackptr);
 	if (result) {
-		/* thread_exit destroys curthread->t_vmspace */
+		goto fail;
+	}
+
+	/* Put the arguments at the top of the stack, aligned */
+	base = (*stackptr - len) & ~(vaddr_t)7;
+	for (i=0; i<argc; i++) {
+		argv[i] += base;
+	}
+	argv[argc] = 0;
+	result = copyout(argbuf, (userptr_t)base, len);
+	if (result) {
+		goto fail;
+	}
+	*stackptr = base;
+	*uargv = (userptr_t)base;
+
+	if (oldas != NULL) {
+		as_destroy(oldas);
+	}
+	return 0;
+
+ fail:
+	curthread->t_vmspace = oldas;
+	if (oldas != NULL) {
+		as_activate(oldas);
+	}
+	as_destroy(newas);
+	return result;
+}
+
+/*
+ * Give the current thread a file table with the console open as
+ * standard input, output, and error.
+ */
+static
+int
+runprogram_openstd(void)
+{
+	struct filetable *ft;
+	struct openfile *of;
+	char path[5];
+	int fd, result;
+
+	ft = filetable_create();
+	if (ft == NULL) {
+		return ENOMEM;
+	}
+
+	/* vfs_open destroys the string it's passed */
+	strcpy(path, "con:");
+	result = openfile_open(path, O_RDONLY, &of);
+	if (result) {
+		filetable_destroy(ft);
+		return result;
+	}
+	result = filetable_place(ft, of, &fd);
+	assert(result == 0 && fd == STDIN_FILENO);
+
+	strcpy(path, "con:");
+	result = openfile_open(path, O_WRONLY, &of);
+	if (result) {
+		filetable_destroy(ft);
 		return result;
 	}
+	result = filetable_place(ft, of, &fd);
+	assert(result == 0 && fd == STDOUT_FILENO);
+
+	result = filetable_dup2(ft, STDOUT_FILENO, STDERR_FILENO);
+	assert(result == 0);
+
+	curthread->t_filetable = ft;
+	return 0;
+}
+
+/*
+ * Load program "progname" and start running it in usermode, with
+ * the NARGS strings in ARGS as its argv.
+ * Does not return except on error.
+ *
+ * Calls vfs_open on progname and thus may destroy it.
+ */
+int
+runprogram(char *progname, char **args, int nargs)
+{
+	vaddr_t entrypoint, stackptr;
+	userptr_t uargv;
+	time_t s;
+	u_int32_t ns;
+	char *argbuf;
+	size_t len;
+	int result;
+
+	gettime(&s, &ns);
+
+	/* We should be a new thread. */
+	assert(curthread->t_vmspace == NULL);
+	assert(curthread->t_filetable == NULL);
+
+	result = runprogram_openstd();
+	if (result) {
+		return result;
+	}
+
+	lock_acquire(exec_lock);
+	result = exec_kargs(args, nargs, &len);
+	if (result == 0) {
+		result = exec_saveargs(len, &argbuf);
+	}
+	lock_release(exec_lock);
+	if (result) {
+		return result;
+	}
+
+	result = exec_load(progname, nargs, argbuf, len,
+			   &entrypoint, &stackptr, &uargv);
+	kfree(argbuf);
+	if (result) {
+		return result;
+	}
+
+	proc_timeexec(s, ns);
 
 	/* Warp to user mode. */
-	md_usermode(0 /*argc*/, NULL /*userspace addr of argv*/,
-		    stackptr, entrypoint);
-	
+	md_usermode(nargs, uargv, stackptr, entrypoint);
+
 	/* md_usermode does not return */
 	panic("md_usermode returned\n");
 	return EINVAL;
 }
 
+int
+sys_execv(userptr_t path, userptr_t args)
+{
+	vaddr_t entrypoint, stackptr;
+	userptr_t uargv;
+	char *kpath, *argbuf;
+	time_t s;
+	u_int32_t ns;
+	size_t len;
+	int argc, result;
+
+	gettime(&s, &ns);
+
+	kpath = kmalloc(PATH_MAX);
+	if (kpath == NULL) {
+		return ENOMEM;
+	}
+	result = copyinstr(path, kpath, PATH_MAX, NULL);
+	if (result) {
+		kfree(kpath);
+		return result;
+	}
+
+	lock_acquire(exec_lock);
+	result = exec_copyinargs(args, &argc, &len);
+	if (result == 0) {
+		result = exec_saveargs(len, &argbuf);
+	}
+	lock_release(exec_lock);
+	if (result) {
+		kfree(kpath);
+		return result;
+	}
+
+	result = exec_load(kpath, argc, argbuf, len,
+			   &entrypoint, &stackptr, &uargv);
+	kfree(argbuf);
+	kfree(kpath);
+	if (result) {
+		return result;
+	}
+
+	proc_timeexec(s, ns);
+
+	md_usermode(argc, uargv, stackptr, entrypoint);
+
+	/* md_usermode does not return */
+	panic("md_usermode returned\n");
+	return EINVAL;
+}
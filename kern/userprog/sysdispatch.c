@@ -0,0 +1,336 @@
+/*
+ * System call dispatch.
+ *
+ * The machine-dependent trap code (mips_syscall) fetches the call
+ * number and the arguments, as plain 32-bit words, and hands them to
+ * syscall_dispatch. That looks the call up in a table indexed by call
+ * number. Each entry says how many argument words the call takes and
+ * has a small stub that turns the words into the typed arguments of
+ * the sys_* function.
+ *
+ * Each entry also counts how many times its call was made, how many
+ * of those failed, and the total time spent in it. Time is taken
+ * from the real-time clock (the processor has no cycle counter), so
+ * very short calls are measured only roughly.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/callno.h>
+#include <lib.h>
+#include <clock.h>
+#include <machine/spl.h>
+#include <syscall.h>
+#include <kstats.h>
+#include <trace.h>
+
+struct syscall_desc {
+	const char *sd_name;
+	int sd_nargs;                   /* argument words */
+	int (*sd_func)(struct trapframe *tf, const u_int32_t *args,
+		       int32_t *retval);
+
+	/* Statistics */
+	u_int32_t sd_count;             /* calls */
+	u_int32_t sd_errors;            /* calls that failed */
+	u_int32_t sd_usecs;             /* total time in call */
+};
+
+////////////////////////////////////////////////////////////
+//
+// Argument decoding
+
+static
+int
+sc_reboot(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	(void)rv;
+	return sys_reboot(a[0]);
+}
+
+static
+int
+sc_exit(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	(void)rv;
+	sys__exit(a[0]);
+	panic("sys__exit returned\n");
+	return 0;
+}
+
+static
+int
+sc_fork(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)a;
+	return sys_fork(tf, rv);
+}
+
+static
+int
+sc_execv(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	(void)rv;
+	return sys_execv((userptr_t)a[0], (userptr_t)a[1]);
+}
+
+static
+int
+sc_waitpid(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	return sys_waitpid(a[0], (userptr_t)a[1], a[2], rv);
+}
+
+static
+int
+sc_getpid(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	(void)a;
+	return sys_getpid(rv);
+}
+
+static
+int
+sc_open(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	return sys_open((userptr_t)a[0], a[1], rv);
+}
+
+static
+int
+sc_read(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	return sys_read(a[0], (userptr_t)a[1], a[2], rv);
+}
+
+static
+int
+sc_write(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	return sys_write(a[0], (userptr_t)a[1], a[2], rv);
+}
+
+static
+int
+sc_readv(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	return sys_readv(a[0], (userptr_t)a[1], a[2], rv);
+}
+
+static
+int
+sc_writev(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	return sys_writev(a[0], (userptr_t)a[1], a[2], rv);
+}
+
+static
+int
+sc_close(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	(void)rv;
+	return sys_close(a[0]);
+}
+
+/*
+ * off_t is 32 bits, so the offset takes one word like everything
+ * else. (A 64-bit off_t would take an aligned pair of words, pushing
+ * whence to the fifth word, on the user stack.)
+ */
+static
+int
+sc_lseek(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	return sys_lseek(a[0], (off_t)a[1], a[2], rv);
+}
+
+static
+int
+sc_dup2(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	return sys_dup2(a[0], a[1], rv);
+}
+
+static
+int
+sc_pipe(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	(void)rv;
+	return sys_pipe((userptr_t)a[0]);
+}
+
+static
+int
+sc_remove(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	(void)rv;
+	return sys_remove((userptr_t)a[0]);
+}
+
+static
+int
+sc_time(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	return sys___time((userptr_t)a[0], (userptr_t)a[1], rv);
+}
+
+static
+int
+sc_kstats(struct trapframe *tf, const u_int32_t *a, int32_t *rv)
+{
+	(void)tf;
+	(void)rv;
+	return sys___kstats((userptr_t)a[0]);
+}
+
+#define SC(callno, name, nargs, func) \
+	[callno] = { name, nargs, func, 0, 0, 0 }
+
+static struct syscall_desc syscall_table[] = {
+	SC(SYS__exit,   "_exit",   1, sc_exit),
+	SC(SYS_execv,   "execv",   2, sc_execv),
+	SC(SYS_fork,    "fork",    0, sc_fork),
+	SC(SYS_waitpid, "waitpid", 3, sc_waitpid),
+	SC(SYS_open,    "open",    2, sc_open),
+	SC(SYS_read,    "read",    3, sc_read),
+	SC(SYS_write,   "write",   3, sc_write),
+	SC(SYS_close,   "close",   1, sc_close),
+	SC(SYS_reboot,  "reboot",  1, sc_reboot),
+	SC(SYS_getpid,  "getpid",  0, sc_getpid),
+	SC(SYS_lseek,   "lseek",   3, sc_lseek),
+	SC(SYS_remove,  "remove",  1, sc_remove),
+	SC(SYS_dup2,    "dup2",    2, sc_dup2),
+	SC(SYS_pipe,    "pipe",    1, sc_pipe),
+	SC(SYS___time,  "__time",  2, sc_time),
+	SC(SYS_readv,   "readv",   3, sc_readv),
+	SC(SYS_writev,  "writev",  3, sc_writev),
+	SC(SYS___kstats, "__kstats", 1, sc_kstats),
+};
+
+#define NSYSCALLS (sizeof(syscall_table) / sizeof(syscall_table[0]))
+
+////////////////////////////////////////////////////////////
+//
+// Dispatch
+
+/*
+ * Return how many argument words CALLNO takes, or -1 if there's no
+ * such call.
+ */
+int
+syscall_nargs(int callno)
+{
+	if (callno < 0 || (unsigned)callno >= NSYSCALLS ||
+	    syscall_table[callno].sd_func == NULL) {
+		return -1;
+	}
+	return syscall_table[callno].sd_nargs;
+}
+
+/*
+ * Run a system call. ARGS holds syscall_nargs(CALLNO) words; TF is
+ * the trapframe, which only fork needs.
+ */
+int
+syscall_dispatch(int callno, struct trapframe *tf, const u_int32_t *args,
+		 int32_t *retval)
+{
+	struct syscall_desc *sd;
+	time_t s1, s2;
+	u_int32_t ns1, ns2;
+	int err, spl;
+
+	assert(syscall_nargs(callno) >= 0);
+	sd = &syscall_table[callno];
+
+	/* Count it first: _exit doesn't come back */
+	spl = splhigh();
+	sd->sd_count++;
+	kstats.ks_syscalls++;
+	splx(spl);
+
+	TRACE(TR_SYSCALL, callno, args[0]);
+	gettime(&s1, &ns1);
+	err = sd->sd_func(tf, args, retval);
+	gettime(&s2, &ns2);
+	TRACE(TR_SYSRET, callno, err);
+
+	getinterval(s1, ns1, s2, ns2, &s2, &ns2);
+	spl = splhigh();
+	sd->sd_usecs += s2*1000000 + ns2/1000;
+	if (err) {
+		sd->sd_errors++;
+	}
+	splx(spl);
+
+	return err;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Stats
+
+void
+syscall_printstats(void)
+{
+	struct syscall_desc *sd;
+	unsigned i;
+
+	kprintf("%-10s %10s %8s %10s %10s\n", "syscall", "calls", "errors",
+		"usec", "usec/call");
+	for (i=0; i<NSYSCALLS; i++) {
+		sd = &syscall_table[i];
+		if (sd->sd_count == 0) {
+			continue;
+		}
+		kprintf("%-10s %10u %8u %10u %10u\n", sd->sd_name,
+			sd->sd_count, sd->sd_errors, sd->sd_usecs,
+			sd->sd_usecs / sd->sd_count);
+	}
+}
+
+/*
+ * Print the stats at shutdown, if any user program ran.
+ */
+void
+syscall_shutdown(void)
+{
+	unsigned i;
+
+	for (i=0; i<NSYSCALLS; i++) {
+		if (syscall_table[i].sd_count > 0) {
+			syscall_printstats();
+			return;
+		}
+	}
+}
+
+void
+syscall_resetstats(void)
+{
+	unsigned i;
+	int spl;
+
+	spl = splhigh();
+	for (i=0; i<NSYSCALLS; i++) {
+		syscall_table[i].sd_count = 0;
+		syscall_table[i].sd_errors = 0;
+		syscall_table[i].sd_usecs = 0;
+	}
+	splx(spl);
+}
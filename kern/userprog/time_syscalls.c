@@ -0,0 +1,44 @@
+/*
+ * Time system calls.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <syscall.h>
+
+/*
+ * Either pointer may be NULL if the caller doesn't want that part.
+ * Both parts go out with one copyoutv.
+ */
+int
+sys___time(userptr_t secsp, userptr_t nsecsp, int *retval)
+{
+	struct copyvec vec[2];
+	unsigned nvec = 0;
+	time_t secs;
+	u_int32_t nsecs;
+	int result;
+
+	gettime(&secs, &nsecs);
+
+	if (secsp != NULL) {
+		vec[nvec].cv_kaddr = &secs;
+		vec[nvec].cv_uaddr = secsp;
+		vec[nvec].cv_len = sizeof(secs);
+		nvec++;
+	}
+	if (nsecsp != NULL) {
+		vec[nvec].cv_kaddr = &nsecs;
+		vec[nvec].cv_uaddr = nsecsp;
+		vec[nvec].cv_len = sizeof(nsecs);
+		nvec++;
+	}
+	result = copyoutv(vec, nvec);
+	if (result) {
+		return result;
+	}
+
+	*retval = secs;
+	return 0;
+}
@@ -1,17 +1,46 @@
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/limits.h>
 #include <lib.h>
 #include <uio.h>
 #include <thread.h>
 #include <curthread.h>
 
+/*
+ * Number of user blocks uiomove saves up to hand to one copyinv or
+ * copyoutv.
+ */
+#define UIO_COPYBATCH  8
+
+/*
+ * Copy the user blocks uiomove has saved up.
+ */
+static
+int
+uio_usercopy(struct uio *uio, const struct copyvec *vec, unsigned nvec)
+{
+	if (uio->uio_rw == UIO_READ) {
+		return copyoutv(vec, nvec);
+	}
+	return copyinv(vec, nvec);
+}
+
 /*
  * See uio.h for a description.
+ *
+ * Pieces of user memory are saved up in VEC and copied UIO_COPYBATCH
+ * at a time, so a readv or writev with many small blocks doesn't set
+ * up fault handling for each one. The uio is updated as the pieces
+ * are saved; if the copy then fails, it's been moved past them, but
+ * it's not to be used after an error anyway.
  */
 
 int
 uiomove(void *ptr, size_t n, struct uio *uio)
 {
 	struct iovec *iov;
+	struct copyvec vec[UIO_COPYBATCH];
+	unsigned nvec = 0;
 	size_t size;
 	int result;
 
@@ -27,6 +56,13 @@ uiomove(void *ptr, size_t n, struct uio *uio)
 
 	while (n > 0 && uio->uio_resid > 0) {
 		iov = &uio->uio_iovec;
+
+		/* Move on to the next block when this one is used up */
+		while (iov->iov_len == 0 && uio->uio_iovcnt > 0) {
+			*iov = *uio->uio_iov++;
+			uio->uio_iovcnt--;
+		}
+
 		size = iov->iov_len;
 
 		if (size > n) {
@@ -55,14 +91,15 @@ uiomove(void *ptr, size_t n, struct uio *uio)
 			    break;
 		    case UIO_USERSPACE:
 		    case UIO_USERISPACE:
-			    if (uio->uio_rw == UIO_READ) {
-				    result = copyout(ptr, iov->iov_ubase,size);
-			    }
-			    else {
-				    result = copyin(iov->iov_ubase, ptr, size);
-			    }
-			    if (result) {
-				    return result;
+			    vec[nvec].cv_kaddr = ptr;
+			    vec[nvec].cv_uaddr = iov->iov_ubase;
+			    vec[nvec].cv_len = size;
+			    if (++nvec == UIO_COPYBATCH) {
+				    result = uio_usercopy(uio, vec, nvec);
+				    if (result) {
+					    return result;
+				    }
+				    nvec = 0;
 			    }
 			    iov->iov_ubase += size;
 			    break;
@@ -78,6 +115,9 @@ uiomove(void *ptr, size_t n, struct uio *uio)
 		n -= size;
 	}
 
+	if (nvec > 0) {
+		return uio_usercopy(uio, vec, nvec);
+	}
 	return 0;
 }
 
@@ -115,9 +155,50 @@ mk_kuio(struct uio *uio, void *kbuf, size_t len, off_t pos, enum uio_rw rw)
 {
 	uio->uio_iovec.iov_kbase = kbuf;
 	uio->uio_iovec.iov_len = len;
+	uio->uio_iov = NULL;
+	uio->uio_iovcnt = 0;
 	uio->uio_offset = pos;
 	uio->uio_resid = len;
 	uio->uio_segflg = UIO_SYSSPACE;
 	uio->uio_rw = rw;
 	uio->uio_space = NULL;
 }
+
+/*
+ * Convenience function to cons up a uio for readv and writev.
+ */
+int
+mk_uuio(struct uio *uio, struct iovec *iov, userptr_t uiov, int iovcnt,
+	off_t pos, enum uio_rw rw)
+{
+	size_t total = 0;
+	int i, result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	/* One copyin for the whole array */
+	result = copyin(uiov, iov, iovcnt * sizeof(struct iovec));
+	if (result) {
+		return result;
+	}
+
+	for (i=0; i<iovcnt; i++) {
+		if (total + iov[i].iov_len < total) {
+			return EINVAL;
+		}
+		total += iov[i].iov_len;
+	}
+
+	uio->uio_iovec = iov[0];
+	uio->uio_iov = &iov[1];
+	uio->uio_iovcnt = iovcnt - 1;
+	uio->uio_offset = pos;
+	uio->uio_resid = total;
+	uio->uio_segflg = UIO_USERSPACE;
+	uio->uio_rw = rw;
+	uio->uio_space = curthread->t_vmspace;
+
+	return 0;
+}
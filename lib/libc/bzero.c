@@ -19,28 +19,44 @@ void
 bzero(void *vblock, size_t len)
 {
 	char *block = vblock;
-	size_t i;
+	unsigned long *lb;
+	size_t nwords;
 
 	/*
-	 * For performance, optimize the common case where the pointer
-	 * and the length are word-aligned, and write word-at-a-time
-	 * instead of byte-at-a-time. Otherwise, write bytes.
+	 * For performance, write bytes until the pointer is
+	 * word-aligned, then words, four at a time, then the bytes
+	 * left over at the end. Short blocks are just done by bytes.
 	 *
 	 * The alignment logic here should be portable. We rely on the
 	 * compiler to be reasonably intelligent about optimizing the
 	 * divides and moduli out. Fortunately, it is.
 	 */
 
-	if ((uintptr_t)block % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
-		long *lb = (long *)block;
-		for (i=0; i<len/sizeof(long); i++) {
-			lb[i] = 0;
+	if (len >= 4 * sizeof(long)) {
+		while ((uintptr_t)block % sizeof(long) != 0) {
+			*block++ = 0;
+			len--;
 		}
-	}
-	else {
-		for (i=0; i<len; i++) {
-			block[i] = 0;
+
+		lb = (unsigned long *)block;
+		nwords = len / sizeof(long);
+		len %= sizeof(long);
+
+		for (; nwords >= 4; nwords -= 4) {
+			lb[0] = 0;
+			lb[1] = 0;
+			lb[2] = 0;
+			lb[3] = 0;
+			lb += 4;
 		}
+		for (; nwords > 0; nwords--) {
+			*lb++ = 0;
+		}
+		block = (char *)lb;
+	}
+
+	while (len > 0) {
+		*block++ = 0;
+		len--;
 	}
 }
@@ -10,6 +10,23 @@
 #include <string.h>
 #endif
 
+/*
+ * Shift amounts for putting together one destination word from two
+ * adjacent source words, when source and destination are misaligned
+ * relative to each other. MERGE(a, b, sh) takes the last bytes of a
+ * and the first bytes of b, where sh is 8 times the number of bytes
+ * of a to skip.
+ */
+#define WORDBITS     (sizeof(long) * 8)
+#ifdef _BIG_ENDIAN
+#define MERGE(a, b, sh)  (((a) << (sh)) | ((b) >> (WORDBITS - (sh))))
+#else
+#define MERGE(a, b, sh)  (((a) >> (sh)) | ((b) << (WORDBITS - (sh))))
+#endif
+
+/* Copies shorter than this are done by bytes */
+#define MEMCPY_SHORT  (4 * sizeof(long))
+
 /*
  * C standard function - copy a block of memory.
  */
@@ -17,39 +34,77 @@
 void *
 memcpy(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	char *d = dst;
+	const char *s = src;
 
 	/*
 	 * memcpy does not support overlapping buffers, so always do it
 	 * forwards. (Don't change this without adjusting memmove.)
 	 *
-	 * For speedy copying, optimize the common case where both pointers
-	 * and the length are word-aligned, and copy word-at-a-time instead
-	 * of byte-at-a-time. Otherwise, copy by bytes.
+	 * Copy bytes until the destination is word-aligned, then by
+	 * words, then the bytes left over at the end. If the source
+	 * is aligned the same way as the destination, the words are
+	 * copied straight across, four at a time. Otherwise each
+	 * destination word is put together from two aligned source
+	 * words. (This reads source words that are only partly within
+	 * the block, but never past the word holding its last byte,
+	 * so it can't fault where a byte copy wouldn't.)
 	 *
 	 * The alignment logic below should be portable. We rely on
 	 * the compiler to be reasonably intelligent about optimizing
 	 * the divides and modulos out. Fortunately, it is.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
+	if (len >= MEMCPY_SHORT) {
+		unsigned long *dw;
+		size_t nwords, shift;
 
-		long *d = dst;
-		const long *s = src;
+		while ((uintptr_t)d % sizeof(long) != 0) {
+			*d++ = *s++;
+			len--;
+		}
 
-		for (i=0; i<len/sizeof(long); i++) {
-			d[i] = s[i];
+		dw = (unsigned long *)d;
+		nwords = len / sizeof(long);
+		len %= sizeof(long);
+
+		if ((uintptr_t)s % sizeof(long) == 0) {
+			const unsigned long *sw = (const unsigned long *)s;
+
+			for (; nwords >= 4; nwords -= 4) {
+				dw[0] = sw[0];
+				dw[1] = sw[1];
+				dw[2] = sw[2];
+				dw[3] = sw[3];
+				dw += 4;
+				sw += 4;
+			}
+			for (; nwords > 0; nwords--) {
+				*dw++ = *sw++;
+			}
+			s = (const char *)sw;
 		}
-	}
-	else {
-		char *d = dst;
-		const char *s = src;
+		else {
+			const unsigned long *sw;
+			unsigned long prev, next;
 
-		for (i=0; i<len; i++) {
-			d[i] = s[i];
+			shift = ((uintptr_t)s % sizeof(long)) * 8;
+			sw = (const unsigned long *)(s - shift/8);
+			s += nwords * sizeof(long);
+
+			prev = *sw++;
+			for (; nwords > 0; nwords--) {
+				next = *sw++;
+				*dw++ = MERGE(prev, next, shift);
+				prev = next;
+			}
 		}
+		d = (char *)dw;
+	}
+
+	while (len > 0) {
+		*d++ = *s++;
+		len--;
 	}
 
 	return dst;
@@ -18,7 +18,8 @@
 void *
 memmove(void *dst, const void *src, size_t len)
 {
-	size_t i;
+	char *d;
+	const char *s;
 
 	/*
 	 * If the buffers don't overlap, it doesn't matter what direction
@@ -45,42 +46,62 @@ memmove(void *dst, const void *src, size_t len)
          *                     |___|
 	 */
 
-	if ((uintptr_t)dst < (uintptr_t)src) {
+	if ((uintptr_t)dst < (uintptr_t)src ||
+	    (uintptr_t)dst >= (uintptr_t)src + len) {
 		/*
 		 * As author/maintainer of libc, take advantage of the
-		 * fact that we know memcpy copies forwards.
+		 * fact that we know memcpy copies forwards. (And if
+		 * they don't overlap, the direction doesn't matter.)
 		 */
 		return memcpy(dst, src, len);
 	}
 
 	/*
-	 * Copy by words in the common case. Look in memcpy.c for more
-	 * information.
+	 * Copy backwards. When source and destination are aligned the
+	 * same way, do it by words in the middle, as memcpy does (look
+	 * in memcpy.c for more information); otherwise by bytes.
+	 * Overlapping copies that need to go backwards are rare enough
+	 * that it's not worth putting words together from pieces.
 	 */
 
-	if ((uintptr_t)dst % sizeof(long) == 0 &&
-	    (uintptr_t)src % sizeof(long) == 0 &&
-	    len % sizeof(long) == 0) {
+	d = (char *)dst + len;
+	s = (const char *)src + len;
 
-		long *d = dst;
-		const long *s = src;
+	if (len >= 4 * sizeof(long) &&
+	    (uintptr_t)d % sizeof(long) == (uintptr_t)s % sizeof(long)) {
+		unsigned long *dw;
+		const unsigned long *sw;
+		size_t nwords;
 
-		/*
-		 * The reason we copy index i-1 and test i>0 is that
-		 * i is unsigned - so testing i>=0 doesn't work.
-		 */
+		while ((uintptr_t)d % sizeof(long) != 0) {
+			*--d = *--s;
+			len--;
+		}
+
+		dw = (unsigned long *)d;
+		sw = (const unsigned long *)s;
+		nwords = len / sizeof(long);
+		len %= sizeof(long);
 
-		for (i=len/sizeof(long); i>0; i--) {
-			d[i-1] = s[i-1];
+		for (; nwords >= 4; nwords -= 4) {
+			dw -= 4;
+			sw -= 4;
+			dw[3] = sw[3];
+			dw[2] = sw[2];
+			dw[1] = sw[1];
+			dw[0] = sw[0];
 		}
+		for (; nwords > 0; nwords--) {
+			*--dw = *--sw;
+		}
+
+		d = (char *)dw;
+		s = (const char *)sw;
 	}
-	else {
-		char *d = dst;
-		const char *s = src;
 
-		for (i=len; i>0; i--) {
-			d[i-1] = s[i-1];
-		}
+	while (len > 0) {
+		*--d = *--s;
+		len--;
 	}
 
 	return dst;
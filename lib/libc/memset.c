@@ -2,16 +2,52 @@
 
 /*
  * C standard function - initialize a block of memory
+ *
+ * Like bzero, this writes by words once the pointer is aligned; the
+ * word is CH repeated in every byte.
  */
 
 void *
 memset(void *ptr, int ch, size_t len)
 {
 	char *p = ptr;
-	size_t i;
-	
-	for (i=0; i<len; i++) {
-		p[i] = ch;
+	unsigned long *lp, word;
+	size_t nwords;
+
+	if (len >= 4 * sizeof(long)) {
+		while ((uintptr_t)p % sizeof(long) != 0) {
+			*p++ = ch;
+			len--;
+		}
+
+		word = (unsigned char)ch;
+		word |= word << 8;
+		word |= word << 16;
+		if (sizeof(long) > 4) {
+			/* Done in two steps so it's not too big a shift */
+			word |= (word << 16) << 16;
+		}
+
+		lp = (unsigned long *)p;
+		nwords = len / sizeof(long);
+		len %= sizeof(long);
+
+		for (; nwords >= 4; nwords -= 4) {
+			lp[0] = word;
+			lp[1] = word;
+			lp[2] = word;
+			lp[3] = word;
+			lp += 4;
+		}
+		for (; nwords > 0; nwords--) {
+			*lp++ = word;
+		}
+		p = (char *)lp;
+	}
+
+	while (len > 0) {
+		*p++ = ch;
+		len--;
 	}
 
 	return ptr;
@@ -38,6 +38,13 @@ dumpsb(void)
 	sp.sp_volname[sizeof(sp.sp_volname)-1] = 0;
 	printf("Volume name: %-40s  %u blocks\n", sp.sp_volname, 
 	       SWAPL(sp.sp_nblocks));
+	if (SWAPL(sp.sp_jblocks) > 0) {
+		printf("Journal: %u blocks at block %u\n",
+		       SWAPL(sp.sp_jblocks), SWAPL(sp.sp_jstart));
+	}
+	else {
+		printf("No journal\n");
+	}
 
 	return SWAPL(sp.sp_nblocks);
 }
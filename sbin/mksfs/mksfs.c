@@ -38,7 +38,8 @@ check(void)
 
 static
 void
-writesuper(const char *volname, u_int32_t nblocks)
+writesuper(const char *volname, u_int32_t nblocks,
+	   u_int32_t jstart, u_int32_t jblocks)
 {
 	struct sfs_super sp;
 
@@ -51,6 +52,8 @@ writesuper(const char *volname, u_int32_t nblocks)
 	sp.sp_magic = SWAPL(SFS_MAGIC);
 	sp.sp_nblocks = SWAPL(nblocks);
 	strcpy(sp.sp_volname, volname);
+	sp.sp_jstart = SWAPL(jstart);
+	sp.sp_jblocks = SWAPL(jblocks);
 
 	diskwrite(&sp, SFS_SB_LOCATION);
 }
@@ -70,6 +73,29 @@ writerootdir(void)
 	diskwrite(&sfi, SFS_ROOT_LOCATION);
 }
 
+/*
+ * Set up an empty journal: a header expecting transaction 1, and a
+ * blank descriptor so nothing stale looks like a transaction.
+ */
+static
+void
+writejournal(u_int32_t jstart)
+{
+	struct sfs_jheader jh;
+	struct sfs_jdesc jd;
+
+	assert(sizeof(jh)==SFS_BLOCKSIZE);
+	assert(sizeof(jd)==SFS_BLOCKSIZE);
+
+	bzero((void *)&jh, sizeof(jh));
+	jh.jh_magic = SWAPL(SFS_JMAGIC);
+	jh.jh_seq = SWAPL(1);
+	diskwrite(&jh, jstart);
+
+	bzero((void *)&jd, sizeof(jd));
+	diskwrite(&jd, jstart+1);
+}
+
 static char bitbuf[MAXBITBLOCKS*SFS_BLOCKSIZE];
 
 static
@@ -85,7 +111,7 @@ doallocbit(u_int32_t bit)
 
 static
 void
-writebitmap(u_int32_t fsblocks)
+writebitmap(u_int32_t fsblocks, u_int32_t jstart, u_int32_t jblocks)
 {
 
 	u_int32_t nbits = SFS_BITMAPSIZE(fsblocks);
@@ -103,6 +129,9 @@ writebitmap(u_int32_t fsblocks)
 	for (i=0; i<nblocks; i++) {
 		doallocbit(SFS_MAP_LOCATION+i);
 	}
+	for (i=0; i<jblocks; i++) {
+		doallocbit(jstart+i);
+	}
 	for (i=fsblocks; i<nbits; i++) {
 		doallocbit(i);
 	}
@@ -116,7 +145,7 @@ writebitmap(u_int32_t fsblocks)
 int
 main(int argc, char **argv)
 {
-	u_int32_t size, blocksize;
+	u_int32_t size, blocksize, jstart, jblocks;
 	char *volname, *s;
 
 #ifdef HOST
@@ -155,9 +184,20 @@ main(int argc, char **argv)
 	}
 	size = diskblocks();
 
-	writesuper(volname, size);
+	/* The journal goes right after the freemap, if there's room */
+	jstart = SFS_MAP_LOCATION + SFS_BITBLOCKS(size);
+	jblocks = SFS_JNBLOCKS;
+	if (size < 8*SFS_JNBLOCKS) {
+		warnx("Disk too small for a journal; making none");
+		jstart = jblocks = 0;
+	}
+
+	writesuper(volname, size, jstart, jblocks);
 	writerootdir();
-	writebitmap(size);
+	writebitmap(size, jstart, jblocks);
+	if (jblocks > 0) {
+		writejournal(jstart);
+	}
 
 	closedisk();
 
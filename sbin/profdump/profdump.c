@@ -0,0 +1,413 @@
+/*
+ * profdump - print a flat profile from a kernel profile.
+ *
+ * Usage: profdump kernel profilefile
+ *
+ * The profile is one written by the kernel menu's "prof dump file";
+ * see <kern/prof.h> for the format. KERNEL is the kernel image that
+ * was running, which is used to turn the PCs sampled into function
+ * names. Prints the samples taken in each thread, then the functions
+ * with the most samples, highest first. Samples taken in user mode
+ * are lumped together as [user].
+ *
+ * Built for the host too (host-profdump), so a profile saved onto
+ * emu0: can be read there against the kernel in the build tree.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "kern/prof.h"
+
+#ifdef HOST
+
+#include <netinet/in.h> // for arpa/inet.h
+#include <arpa/inet.h>  // for ntohl
+#include "hostcompat.h"
+#define SWAPL(x) ntohl(x)
+#define SWAPS(x) ntohs(x)
+
+#else
+
+#define SWAPL(x) (x)
+#define SWAPS(x) (x)
+
+#endif
+
+/*
+ * The parts of ELF we need that the kernel's <elf.h> leaves out.
+ */
+struct elfhdr {
+	unsigned char e_ident[16];
+	u_int16_t e_type;
+	u_int16_t e_machine;
+	u_int32_t e_version;
+	u_int32_t e_entry;
+	u_int32_t e_phoff;
+	u_int32_t e_shoff;             /* location of section headers */
+	u_int32_t e_flags;
+	u_int16_t e_ehsize;
+	u_int16_t e_phentsize;
+	u_int16_t e_phnum;
+	u_int16_t e_shentsize;         /* size of a section header */
+	u_int16_t e_shnum;             /* number of section headers */
+	u_int16_t e_shstrndx;
+};
+
+struct elfshdr {
+	u_int32_t sh_name;
+	u_int32_t sh_type;             /* SHT_* */
+	u_int32_t sh_flags;            /* SHF_* */
+	u_int32_t sh_addr;
+	u_int32_t sh_offset;           /* location in file */
+	u_int32_t sh_size;
+	u_int32_t sh_link;             /* for a symbol table, its strings */
+	u_int32_t sh_info;
+	u_int32_t sh_addralign;
+	u_int32_t sh_entsize;
+};
+#define SHT_SYMTAB     2
+#define SHF_EXECINSTR  0x4
+
+struct elfsym {
+	u_int32_t st_name;             /* offset in the string table */
+	u_int32_t st_value;
+	u_int32_t st_size;
+	unsigned char st_info;         /* type in the low 4 bits */
+	unsigned char st_other;
+	u_int16_t st_shndx;            /* section it's in */
+};
+#define STT_NOTYPE  0
+#define STT_FUNC    2
+
+/* Limits on what we'll load */
+#define MAXSECTS    64
+#define MAXSYMS     8192
+#define NAMESPACE   (256*1024)
+
+/*
+ * Functions, sorted by address, with the samples in each.
+ */
+struct func {
+	u_int32_t addr;
+	const char *name;
+	u_int32_t count;
+};
+static struct func funcs[MAXSYMS];
+static unsigned nfuncs;
+
+static char names[NAMESPACE];
+static unsigned namesused;
+
+/* Samples not in any kernel function */
+static u_int32_t usercount, unknowncount;
+
+static
+void
+readat(int fd, void *buf, size_t len, off_t pos, const char *file)
+{
+	int r;
+
+	if (lseek(fd, pos, SEEK_SET) < 0) {
+		err(1, "%s: lseek", file);
+	}
+	r = read(fd, buf, len);
+	if (r < 0) {
+		err(1, "%s", file);
+	}
+	if ((size_t)r != len) {
+		errx(1, "%s: Unexpected end of file", file);
+	}
+}
+
+/*
+ * Copy the null-terminated name at POS in FD into the name space.
+ */
+static
+const char *
+readname(int fd, off_t pos, const char *file)
+{
+	char *name = &names[namesused];
+	size_t left = NAMESPACE - namesused;
+	int r, i;
+
+	if (lseek(fd, pos, SEEK_SET) < 0) {
+		err(1, "%s: lseek", file);
+	}
+	r = read(fd, name, left > 128 ? 128 : left);
+	if (r < 0) {
+		err(1, "%s", file);
+	}
+	for (i=0; i<r; i++) {
+		if (name[i] == 0) {
+			namesused += i+1;
+			return name;
+		}
+	}
+	errx(1, "%s: Symbol name too long, or out of space for names", file);
+	return NULL;
+}
+
+/*
+ * Load the text symbols from the kernel image.
+ */
+static
+void
+loadsyms(const char *file)
+{
+	struct elfhdr eh;
+	struct elfshdr sh[MAXSECTS];
+	struct elfsym sym;
+	const struct elfshdr *symtab, *strtab;
+	u_int32_t shnum, i, nsyms, shndx;
+	unsigned type;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", file);
+	}
+
+	readat(fd, &eh, sizeof(eh), 0, file);
+	if (eh.e_ident[0] != 0x7f || eh.e_ident[1] != 'E' ||
+	    eh.e_ident[2] != 'L' || eh.e_ident[3] != 'F') {
+		errx(1, "%s: Not an ELF file", file);
+	}
+	shnum = SWAPS(eh.e_shnum);
+	if (shnum > MAXSECTS) {
+		errx(1, "%s: Too many sections", file);
+	}
+	if (SWAPS(eh.e_shentsize) != sizeof(struct elfshdr)) {
+		errx(1, "%s: Wrong section header size", file);
+	}
+	readat(fd, sh, shnum * sizeof(sh[0]), SWAPL(eh.e_shoff), file);
+
+	symtab = NULL;
+	for (i=0; i<shnum; i++) {
+		if (SWAPL(sh[i].sh_type) == SHT_SYMTAB) {
+			symtab = &sh[i];
+			break;
+		}
+	}
+	if (symtab == NULL) {
+		errx(1, "%s: No symbol table", file);
+	}
+	if (SWAPL(symtab->sh_link) >= shnum) {
+		errx(1, "%s: Bad symbol table", file);
+	}
+	strtab = &sh[SWAPL(symtab->sh_link)];
+
+	nsyms = SWAPL(symtab->sh_size) / sizeof(sym);
+	for (i=0; i<nsyms; i++) {
+		readat(fd, &sym, sizeof(sym),
+		       SWAPL(symtab->sh_offset) + i*sizeof(sym), file);
+
+		/* Functions, and labels in code (from assembler) */
+		type = sym.st_info & 0xf;
+		if (type != STT_FUNC && type != STT_NOTYPE) {
+			continue;
+		}
+		shndx = SWAPS(sym.st_shndx);
+		if (shndx == 0 || shndx >= shnum ||
+		    (SWAPL(sh[shndx].sh_flags) & SHF_EXECINSTR) == 0) {
+			continue;
+		}
+		if (sym.st_name == 0) {
+			continue;
+		}
+		if (nfuncs == MAXSYMS) {
+			errx(1, "%s: Too many symbols", file);
+		}
+		funcs[nfuncs].addr = SWAPL(sym.st_value);
+		funcs[nfuncs].name = readname(fd,
+			SWAPL(strtab->sh_offset) + SWAPL(sym.st_name), file);
+		funcs[nfuncs].count = 0;
+		if (funcs[nfuncs].name[0] == '$' ||
+		    (funcs[nfuncs].name[0] == '.' &&
+		     funcs[nfuncs].name[1] == 'L')) {
+			/* compiler-generated local label */
+			continue;
+		}
+		nfuncs++;
+	}
+	close(fd);
+
+	if (nfuncs == 0) {
+		errx(1, "%s: No functions in symbol table", file);
+	}
+}
+
+/*
+ * Shell sort of the functions, by address if BYCOUNT is 0 and by
+ * samples (highest first) otherwise. There's no qsort in our libc.
+ */
+static
+int
+before(const struct func *a, const struct func *b, int bycount)
+{
+	if (bycount && a->count != b->count) {
+		return a->count > b->count;
+	}
+	return a->addr < b->addr;
+}
+
+static
+void
+sortfuncs(int bycount)
+{
+	struct func tmp;
+	unsigned gap, i, j;
+
+	for (gap = nfuncs/2; gap > 0; gap /= 2) {
+		for (i=gap; i<nfuncs; i++) {
+			tmp = funcs[i];
+			for (j=i; j>=gap && before(&tmp, &funcs[j-gap], bycount);
+			     j-=gap) {
+				funcs[j] = funcs[j-gap];
+			}
+			funcs[j] = tmp;
+		}
+	}
+}
+
+/*
+ * Charge COUNT samples at PC to the function containing it: the one
+ * with the highest address not above it.
+ */
+static
+void
+charge(u_int32_t pc, u_int32_t count)
+{
+	unsigned lo, hi, mid;
+
+	if (pc & PROF_USER) {
+		usercount += count;
+		return;
+	}
+	if (pc < funcs[0].addr) {
+		unknowncount += count;
+		return;
+	}
+
+	lo = 0;
+	hi = nfuncs;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (funcs[mid].addr <= pc) {
+			lo = mid;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	funcs[lo].count += count;
+}
+
+/*
+ * Print one line of the profile.
+ */
+static
+void
+printline(u_int32_t count, u_int32_t *cumul, u_int32_t total,
+	  const char *name)
+{
+	unsigned long pct, cpct;
+
+	*cumul += count;
+	pct = (unsigned long)count * 1000 / total;
+	cpct = (unsigned long)*cumul * 1000 / total;
+	printf("%3lu.%lu%% %4lu.%lu%% %8lu  %s\n", pct/10, pct%10,
+	       cpct/10, cpct%10, (unsigned long)count, name);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct prof_header ph;
+	struct prof_pc pcs[64];
+	struct prof_thread pt;
+	u_int32_t npcs, nthreads, n, i, j, hz, total, cumul;
+	int fd;
+
+#ifdef HOST
+	hostcompat_init(argc, argv);
+#endif
+
+	if (argc != 3) {
+		errx(1, "Usage: profdump kernel profilefile");
+	}
+
+	loadsyms(argv[1]);
+	sortfuncs(0);
+
+	fd = open(argv[2], O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", argv[2]);
+	}
+	readat(fd, &ph, sizeof(ph), 0, argv[2]);
+	if (SWAPL(ph.ph_magic) != PROF_MAGIC) {
+		errx(1, "%s: Not a kernel profile", argv[2]);
+	}
+	hz = SWAPL(ph.ph_hz);
+	npcs = SWAPL(ph.ph_npcs);
+	nthreads = SWAPL(ph.ph_nthreads);
+
+	/* The PCs, charged to functions */
+	total = 0;
+	for (i=0; i<npcs; i+=n) {
+		n = npcs - i < 64 ? npcs - i : 64;
+		readat(fd, pcs, n * sizeof(pcs[0]),
+		       sizeof(ph) + i * sizeof(pcs[0]), argv[2]);
+		for (j=0; j<n; j++) {
+			charge(SWAPL(pcs[j].pp_pc), SWAPL(pcs[j].pp_count));
+			total += SWAPL(pcs[j].pp_count);
+		}
+	}
+
+	printf("%lu samples at %lu Hz (%lu.%02lu seconds), %lu dropped\n",
+	       (unsigned long)SWAPL(ph.ph_nsamples), (unsigned long)hz,
+	       (unsigned long)SWAPL(ph.ph_nsamples) / hz,
+	       (unsigned long)SWAPL(ph.ph_nsamples) % hz * 100 / hz,
+	       (unsigned long)SWAPL(ph.ph_dropped));
+
+	/* The threads */
+	printf("\n%-10s %-16s %8s %8s\n", "thread", "name", "kernel", "user");
+	for (i=0; i<nthreads; i++) {
+		readat(fd, &pt, sizeof(pt), sizeof(ph) + npcs*sizeof(pcs[0])
+		       + i*sizeof(pt), argv[2]);
+		if (pt.pt_kernel == 0 && pt.pt_user == 0) {
+			continue;
+		}
+		pt.pt_name[PROF_NAMELEN-1] = 0;
+		printf("0x%08lx %-16s %8lu %8lu\n",
+		       (unsigned long)SWAPL(pt.pt_thread), pt.pt_name,
+		       (unsigned long)SWAPL(pt.pt_kernel),
+		       (unsigned long)SWAPL(pt.pt_user));
+	}
+	close(fd);
+
+	if (total == 0) {
+		printf("\nNo samples.\n");
+		return 0;
+	}
+
+	/* The flat profile */
+	sortfuncs(1);
+	printf("\n%6s %6s %8s  %s\n", "%", "cumul", "samples", "function");
+	cumul = 0;
+	if (usercount > 0) {
+		printline(usercount, &cumul, total, "[user]");
+	}
+	for (i=0; i<nfuncs && funcs[i].count > 0; i++) {
+		printline(funcs[i].count, &cumul, total, funcs[i].name);
+	}
+	if (unknowncount > 0) {
+		printline(unknowncount, &cumul, total, "[unknown]");
+	}
+
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * tracedump - decode a kernel event trace.
+ *
+ * Usage: tracedump tracefile
+ *
+ * The file is one written by the kernel menu's "tr save" command; see
+ * <kern/trace.h> for the format. Each event is printed with its time
+ * in microseconds since the first one, the thread it happened in, and
+ * what it was; then a count of each type of event.
+ *
+ * Built for the host too (host-tracedump), so a trace saved onto
+ * emu0: can be read there.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "kern/trace.h"
+
+#ifdef HOST
+
+#include <netinet/in.h> // for arpa/inet.h
+#include <arpa/inet.h>  // for ntohl
+#include "hostcompat.h"
+#define SWAPL(x) ntohl(x)
+
+#else
+
+#define SWAPL(x) (x)
+
+#endif
+
+/* Events read at a time */
+#define NBUF 64
+
+/*
+ * How to print each type of event; the same as the kernel's table in
+ * trace.c.
+ */
+static const struct {
+	u_int32_t type;
+	const char *name;
+	const char *fmt;
+} types[] = {
+	{ TR_SWITCH,    "switch",    "from 0x%x, which is now state %u" },
+	{ TR_SLEEP,     "sleep",     "on 0x%x" },
+	{ TR_WAKEUP,    "wakeup",    "on 0x%x, thread 0x%x" },
+	{ TR_LOCK,      "lock",      "0x%x, waited %u" },
+	{ TR_UNLOCK,    "unlock",    "0x%x" },
+	{ TR_VMFAULT,   "vmfault",   "at 0x%x, type %u" },
+	{ TR_SYSCALL,   "syscall",   "%u, a0 0x%x" },
+	{ TR_SYSRET,    "sysret",    "%u, error %u" },
+	{ TR_DISKQ,     "diskq",     "block %u, %u blocks" },
+	{ TR_DISKSTART, "diskstart", "block %u, %u blocks" },
+	{ TR_DISKDONE,  "diskdone",  "block %u, %u usec" },
+};
+#define NTYPES (sizeof(types) / sizeof(types[0]))
+
+static unsigned long counts[NTYPES];
+static unsigned long nunknown;
+
+static
+void
+readall(int fd, void *buf, size_t len, const char *file)
+{
+	int r;
+
+	r = read(fd, buf, len);
+	if (r < 0) {
+		err(1, "%s", file);
+	}
+	if ((size_t)r != len) {
+		errx(1, "%s: Truncated trace", file);
+	}
+}
+
+static
+void
+printevent(const struct trace_event *te, u_int32_t start)
+{
+	u_int32_t type, arg1, arg2;
+	unsigned i;
+	int write = 0;
+
+	type = SWAPL(te->te_type);
+	arg1 = SWAPL(te->te_arg1);
+	arg2 = SWAPL(te->te_arg2);
+
+	printf("%10lu 0x%08lx ",
+	       (unsigned long)(SWAPL(te->te_usecs) - start),
+	       (unsigned long)SWAPL(te->te_thread));
+
+	for (i=0; i<NTYPES; i++) {
+		if (types[i].type == type) {
+			break;
+		}
+	}
+	if (i == NTYPES) {
+		nunknown++;
+		printf("type 0x%lx: 0x%lx 0x%lx\n", (unsigned long)type,
+		       (unsigned long)arg1, (unsigned long)arg2);
+		return;
+	}
+	counts[i]++;
+
+	if ((type == TR_DISKQ || type == TR_DISKSTART) &&
+	    (arg2 & TR_DISKWRITE)) {
+		arg2 &= ~TR_DISKWRITE;
+		write = 1;
+	}
+	printf("%-9s ", types[i].name);
+	printf(types[i].fmt, arg1, arg2);
+	if (write) {
+		printf(", write");
+	}
+	printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	struct trace_header th;
+	struct trace_event buf[NBUF];
+	u_int32_t nevents, start = 0, n, i;
+	int fd, first = 1;
+
+#ifdef HOST
+	hostcompat_init(argc, argv);
+#endif
+
+	if (argc != 2) {
+		errx(1, "Usage: tracedump tracefile");
+	}
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", argv[1]);
+	}
+
+	readall(fd, &th, sizeof(th), argv[1]);
+	if (SWAPL(th.th_magic) != TRACE_MAGIC) {
+		errx(1, "%s: Not a kernel trace", argv[1]);
+	}
+	nevents = SWAPL(th.th_nevents);
+	printf("%lu events (%lu earlier ones overwritten), mask 0x%lx\n",
+	       (unsigned long)nevents, (unsigned long)SWAPL(th.th_lost),
+	       (unsigned long)SWAPL(th.th_mask));
+
+	printf("%10s %10s %-9s\n", "usec", "thread", "event");
+	while (nevents > 0) {
+		n = nevents < NBUF ? nevents : NBUF;
+		readall(fd, buf, n * sizeof(buf[0]), argv[1]);
+		if (first) {
+			start = SWAPL(buf[0].te_usecs);
+			first = 0;
+		}
+		for (i=0; i<n; i++) {
+			printevent(&buf[i], start);
+		}
+		nevents -= n;
+	}
+	close(fd);
+
+	printf("\n");
+	for (i=0; i<NTYPES; i++) {
+		if (counts[i] > 0) {
+			printf("%-9s %8lu\n", types[i].name, counts[i]);
+		}
+	}
+	if (nunknown > 0) {
+		printf("%-9s %8lu\n", "unknown", nunknown);
+	}
+
+	return 0;
+}
@@ -0,0 +1,327 @@
+/*
+ * bench.c
+ *
+ * 	Benchmark harness. Runs each workload NRUNS times (3 unless
+ *	-n says otherwise) and for each run prints the wall time, from
+ *	__time, the rate, and how much the kernel's counters (see
+ *	<kern/kstats.h>) went up: system calls, vm faults, TLB misses,
+ *	context switches, and kilobytes read plus written. Then the
+ *	mean of the runs.
+ *
+ *	Usage: bench [-n nruns] [workload ...]
+ *
+ *	With no workloads named, runs them all:
+ *
+ *	    syscall    - getpid, NSYSCALLS times
+ *	    pipe       - PIPEKB kilobytes through a pipe to a child
+ *	    forkexec   - fork, exec /bin/true, and wait, NPROCS times
+ *	    createdel  - create NFILES empty files, then remove them
+ *
+ *	The counters are kernel-wide, so run nothing else at the same
+ *	time. The harness's own calls (__time and __kstats) are in the
+ *	system call count, two per run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <kern/kstats.h>
+
+#define NSYSCALLS 2000
+#define PIPEKB 256
+#define NPROCS 50
+#define NFILES 100
+
+#define PIPEBUF 4096
+
+static char buf[PIPEBUF];
+
+static
+unsigned long
+wl_syscall(void)
+{
+	int i;
+
+	for (i=0; i<NSYSCALLS; i++) {
+		getpid();
+	}
+	return NSYSCALLS;
+}
+
+static
+unsigned long
+wl_pipe(void)
+{
+	int fds[2], pid, status, r;
+	unsigned long got;
+
+	if (pipe(fds)) {
+		err(1, "pipe");
+	}
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		for (got=0; got < PIPEKB*1024; got += PIPEBUF) {
+			if (write(fds[1], buf, PIPEBUF) != PIPEBUF) {
+				err(1, "pipe write");
+			}
+		}
+		_exit(0);
+	}
+
+	close(fds[1]);
+	got = 0;
+	while ((r = read(fds[0], buf, PIPEBUF)) > 0) {
+		got += r;
+	}
+	if (r < 0) {
+		err(1, "pipe read");
+	}
+	close(fds[0]);
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (status != 0 || got != PIPEKB*1024) {
+		errx(1, "pipe: got %lu bytes, child exit %d", got, status);
+	}
+	return PIPEKB;
+}
+
+static
+unsigned long
+wl_forkexec(void)
+{
+	char *targv[2] = { (char *)"true", NULL };
+	int i, pid, status;
+
+	for (i=0; i<NPROCS; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			execv("/bin/true", targv);
+			err(1, "/bin/true");
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (status != 0) {
+			errx(1, "pid %d: exit %d", pid, status);
+		}
+	}
+	return NPROCS;
+}
+
+static
+unsigned long
+wl_createdel(void)
+{
+	char name[32];
+	int i, fd;
+
+	for (i=0; i<NFILES; i++) {
+		snprintf(name, sizeof(name), "bench.tmp.%d", i);
+		fd = open(name, O_WRONLY|O_CREAT|O_TRUNC);
+		if (fd < 0) {
+			err(1, "%s", name);
+		}
+		close(fd);
+	}
+	for (i=0; i<NFILES; i++) {
+		snprintf(name, sizeof(name), "bench.tmp.%d", i);
+		if (remove(name)) {
+			err(1, "remove %s", name);
+		}
+	}
+	return NFILES;
+}
+
+/*
+ * Each workload returns how many of UNIT it did, which the harness
+ * divides by the time for the rate.
+ */
+static const struct {
+	const char *name;
+	const char *unit;
+	unsigned long (*func)(void);
+} workloads[] = {
+	{ "syscall",   "calls", wl_syscall },
+	{ "pipe",      "KB",    wl_pipe },
+	{ "forkexec",  "procs", wl_forkexec },
+	{ "createdel", "files", wl_createdel },
+};
+#define NWORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+/*
+ * One run's results, or the sum of several.
+ */
+struct result {
+	unsigned long usecs;
+	unsigned long ops;
+	struct kstats ks;
+};
+
+static
+void
+kstats_get(struct kstats *ks)
+{
+	if (__kstats(ks)) {
+		err(1, "__kstats");
+	}
+}
+
+static
+void
+printhead(void)
+{
+	printf("%-10s %4s %9s %10s %8s %7s %7s %7s %7s\n",
+	       "workload", "run", "usec", "rate/sec", "syscalls", "faults",
+	       "tlbmiss", "switch", "io KB");
+}
+
+static
+void
+printresult(const char *name, const char *run, const char *unit,
+	    const struct result *r)
+{
+	unsigned long rate;
+
+	/* ops is small enough for this not to overflow */
+	rate = r->usecs > 0 ? r->ops * 1000000 / r->usecs : 0;
+	printf("%-10s %4s %9lu %10lu %8lu %7lu %7lu %7lu %7lu  %s\n",
+	       name, run, r->usecs, rate,
+	       (unsigned long) r->ks.ks_syscalls,
+	       (unsigned long) r->ks.ks_vmfaults,
+	       (unsigned long) r->ks.ks_tlbmisses,
+	       (unsigned long) r->ks.ks_switches,
+	       (unsigned long) (r->ks.ks_readbytes + r->ks.ks_writebytes)/1024,
+	       unit);
+}
+
+static
+void
+runone(unsigned w, int nruns)
+{
+	struct kstats ks1, ks2;
+	struct result r, sum;
+	time_t secs1, secs2;
+	unsigned long nsecs1, nsecs2;
+	char run[8];
+	int i;
+
+	memset(&sum, 0, sizeof(sum));
+	for (i=0; i<nruns; i++) {
+		kstats_get(&ks1);
+		__time(&secs1, &nsecs1);
+		r.ops = workloads[w].func();
+		__time(&secs2, &nsecs2);
+		kstats_get(&ks2);
+
+		if (nsecs2 < nsecs1) {
+			nsecs2 += 1000000000;
+			secs2--;
+		}
+		r.usecs = (secs2 - secs1) * 1000000 + (nsecs2 - nsecs1) / 1000;
+		r.ks.ks_syscalls = ks2.ks_syscalls - ks1.ks_syscalls;
+		r.ks.ks_vmfaults = ks2.ks_vmfaults - ks1.ks_vmfaults;
+		r.ks.ks_tlbmisses = ks2.ks_tlbmisses - ks1.ks_tlbmisses;
+		r.ks.ks_switches = ks2.ks_switches - ks1.ks_switches;
+		r.ks.ks_readbytes = ks2.ks_readbytes - ks1.ks_readbytes;
+		r.ks.ks_writebytes = ks2.ks_writebytes - ks1.ks_writebytes;
+
+		snprintf(run, sizeof(run), "%d", i+1);
+		printresult(workloads[w].name, run, workloads[w].unit, &r);
+
+		sum.usecs += r.usecs;
+		sum.ops += r.ops;
+		sum.ks.ks_syscalls += r.ks.ks_syscalls;
+		sum.ks.ks_vmfaults += r.ks.ks_vmfaults;
+		sum.ks.ks_tlbmisses += r.ks.ks_tlbmisses;
+		sum.ks.ks_switches += r.ks.ks_switches;
+		sum.ks.ks_readbytes += r.ks.ks_readbytes;
+		sum.ks.ks_writebytes += r.ks.ks_writebytes;
+	}
+
+	/* The rate comes out the same from the sums as from the means */
+	r.usecs = sum.usecs / nruns;
+	r.ops = sum.ops / nruns;
+	r.ks.ks_syscalls = sum.ks.ks_syscalls / nruns;
+	r.ks.ks_vmfaults = sum.ks.ks_vmfaults / nruns;
+	r.ks.ks_tlbmisses = sum.ks.ks_tlbmisses / nruns;
+	r.ks.ks_switches = sum.ks.ks_switches / nruns;
+	r.ks.ks_readbytes = sum.ks.ks_readbytes / nruns;
+	r.ks.ks_writebytes = sum.ks.ks_writebytes / nruns;
+	printresult(workloads[w].name, "mean", workloads[w].unit, &r);
+}
+
+static
+void
+usage(void)
+{
+	unsigned w;
+
+	printf("Usage: bench [-n nruns] [workload ...]\n");
+	printf("Workloads:");
+	for (w=0; w<NWORKLOADS; w++) {
+		printf(" %s", workloads[w].name);
+	}
+	printf("\n");
+	exit(1);
+}
+
+/*
+ * Index of the workload named NAME, or NWORKLOADS if there isn't one.
+ */
+static
+unsigned
+findworkload(const char *name)
+{
+	unsigned w;
+
+	for (w=0; w<NWORKLOADS; w++) {
+		if (!strcmp(name, workloads[w].name)) {
+			break;
+		}
+	}
+	return w;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i, first, nruns = 3;
+	unsigned w;
+
+	first = 1;
+	if (argc > 1 && !strcmp(argv[1], "-n")) {
+		if (argc < 3 || (nruns = atoi(argv[2])) < 1) {
+			usage();
+		}
+		first = 3;
+	}
+
+	/* Check the names before running anything */
+	for (i=first; i<argc; i++) {
+		if (findworkload(argv[i]) == NWORKLOADS) {
+			usage();
+		}
+	}
+
+	printhead();
+	if (first == argc) {
+		for (w=0; w<NWORKLOADS; w++) {
+			runone(w, nruns);
+		}
+	}
+	for (i=first; i<argc; i++) {
+		runone(findworkload(argv[i]), nruns);
+	}
+	return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * conbench.c
+ *
+ * 	Measures console output: writes NLINES lines of text to
+ *	stdout, first a whole line per write, then a character per
+ *	write, and prints how many characters per second each got
+ *	through.
+ *
+ *	The console may still be sending the last thousand or so
+ *	characters when the writes return, so the first figure is a
+ *	little optimistic.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <err.h>
+
+#define NLINES 200
+#define LINELEN 72
+
+static char line[LINELEN+1];
+
+static time_t start_secs;
+static unsigned long start_nsecs;
+
+static
+void
+start(void)
+{
+	__time(&start_secs, &start_nsecs);
+}
+
+/*
+ * Milliseconds since start().
+ */
+static
+unsigned long
+stop(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	if (nsecs < start_nsecs) {
+		nsecs += 1000000000;
+		secs--;
+	}
+	return (secs - start_secs) * 1000 + (nsecs - start_nsecs) / 1000000;
+}
+
+static
+void
+dowrite(const char *buf, size_t len)
+{
+	if (write(STDOUT_FILENO, buf, len) != (int)len) {
+		err(1, "stdout");
+	}
+}
+
+int
+main(void)
+{
+	unsigned long linemsecs, charmsecs;
+	unsigned long nchars = NLINES * (LINELEN+1);
+	int i, j;
+
+	for (i=0; i<LINELEN; i++) {
+		line[i] = 'a' + i % 26;
+	}
+	line[LINELEN] = '\n';
+
+	start();
+	for (i=0; i<NLINES; i++) {
+		dowrite(line, LINELEN+1);
+	}
+	linemsecs = stop();
+
+	start();
+	for (i=0; i<NLINES; i++) {
+		for (j=0; j<=LINELEN; j++) {
+			dowrite(&line[j], 1);
+		}
+	}
+	charmsecs = stop();
+
+	printf("line writes: %lu chars in %lu ms, %lu chars/sec\n",
+	       nchars, linemsecs,
+	       linemsecs > 0 ? nchars * 1000 / linemsecs : 0);
+	printf("char writes: %lu chars in %lu ms, %lu chars/sec\n",
+	       nchars, charmsecs,
+	       charmsecs > 0 ? nchars * 1000 / charmsecs : 0);
+
+	return 0;
+}
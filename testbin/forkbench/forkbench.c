@@ -0,0 +1,121 @@
+/*
+ * forkbench.c
+ *
+ * 	Measures process creation: fork a child that exits right away
+ *	and wait for it, NPROCS times, then the same with the child
+ *	running /bin/true, then again passing /bin/true NBIGARGS
+ *	arguments. Prints the time per round, forks per second, how
+ *	much longer the exec made each round, which is about what an
+ *	exec costs, and how much more the arguments added to that.
+ *
+ *	The kernel keeps its own counts; see "ps" in the kernel menu.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <err.h>
+
+#define NPROCS 100
+#define NBIGARGS 500
+
+static char *targv[2] = { (char *)"true", NULL };
+static char *bigargv[NBIGARGS+1];
+static char bigargs[NBIGARGS][8];
+
+static time_t start_secs;
+static unsigned long start_nsecs;
+
+static
+void
+start(void)
+{
+	__time(&start_secs, &start_nsecs);
+}
+
+/*
+ * Microseconds per round since start().
+ */
+static
+unsigned long
+stop(int nrounds)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	if (nsecs < start_nsecs) {
+		nsecs += 1000000000;
+		secs--;
+	}
+	return ((secs - start_secs) * 1000000 +
+		(nsecs - start_nsecs) / 1000) / nrounds;
+}
+
+/*
+ * Fork a child that runs /bin/true with ARGV, or if ARGV is NULL just
+ * exits, and wait for it.
+ */
+static
+void
+spawn(char **argv)
+{
+	int pid, status;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		if (argv != NULL) {
+			execv("/bin/true", argv);
+			err(1, "/bin/true");
+		}
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (status != 0) {
+		errx(1, "pid %d: exit %d", pid, status);
+	}
+}
+
+int
+main(void)
+{
+	unsigned long forkusecs, execusecs, bigusecs;
+	int i;
+
+	for (i=0; i<NBIGARGS; i++) {
+		snprintf(bigargs[i], sizeof(bigargs[i]), "arg%d", i);
+		bigargv[i] = bigargs[i];
+	}
+	bigargv[NBIGARGS] = NULL;
+
+	start();
+	for (i=0; i<NPROCS; i++) {
+		spawn(NULL);
+	}
+	forkusecs = stop(NPROCS);
+	printf("fork + exit + wait        %6lu usec, %lu forks/sec\n",
+	       forkusecs, forkusecs > 0 ? 1000000 / forkusecs : 0);
+
+	start();
+	for (i=0; i<NPROCS; i++) {
+		spawn(targv);
+	}
+	execusecs = stop(NPROCS);
+	printf("fork + exec + exit + wait %6lu usec, exec %lu usec\n",
+	       execusecs, execusecs > forkusecs ? execusecs - forkusecs : 0);
+
+	start();
+	for (i=0; i<NPROCS; i++) {
+		spawn(bigargv);
+	}
+	bigusecs = stop(NPROCS);
+	printf("fork + exec, %d args     %6lu usec, args %lu usec\n",
+	       NBIGARGS, bigusecs,
+	       bigusecs > execusecs ? bigusecs - execusecs : 0);
+
+	return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * syslat.c
+ *
+ * 	Measures how long simple file system calls take: each is done
+ *	NCALLS times in a row and the average printed. The file calls
+ *	use null: so that they measure the system call layer and not a
+ *	filesystem.
+ *
+ * 	The first line, __time, is about as cheap as a system call
+ *	gets, so it's the baseline for the others.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <err.h>
+
+#define NCALLS 1000
+
+static time_t start_secs;
+static unsigned long start_nsecs;
+
+static
+void
+start(void)
+{
+	__time(&start_secs, &start_nsecs);
+}
+
+static
+void
+stop(const char *what, int ncalls)
+{
+	time_t secs;
+	unsigned long nsecs, usecs;
+
+	__time(&secs, &nsecs);
+	if (nsecs < start_nsecs) {
+		nsecs += 1000000000;
+		secs--;
+	}
+	usecs = (secs - start_secs) * 1000000 + (nsecs - start_nsecs) / 1000;
+
+	/* hundredths of a microsecond per call */
+	usecs = usecs * 100 / ncalls;
+	printf("%-24s %5lu.%02lu usec/call\n", what, usecs / 100, usecs % 100);
+}
+
+static
+int
+opennull(int flags)
+{
+	int fd;
+
+	fd = open("null:", flags);
+	if (fd < 0) {
+		err(1, "null:");
+	}
+	return fd;
+}
+
+int
+main(void)
+{
+	char buf[4];
+	struct iovec iov[4];
+	int fd, fds[2], i;
+
+	start();
+	for (i=0; i<NCALLS; i++) {
+		__time(NULL, NULL);
+	}
+	stop("__time", NCALLS);
+
+	fd = opennull(O_RDWR);
+
+	start();
+	for (i=0; i<NCALLS; i++) {
+		if (write(fd, buf, 1) != 1) {
+			err(1, "write");
+		}
+	}
+	stop("write 1 byte", NCALLS);
+
+	start();
+	for (i=0; i<NCALLS; i++) {
+		if (read(fd, buf, 1) < 0) {
+			err(1, "read");
+		}
+	}
+	stop("read 1 byte", NCALLS);
+
+	for (i=0; i<4; i++) {
+		iov[i].iov_base = &buf[i];
+		iov[i].iov_len = 1;
+	}
+	start();
+	for (i=0; i<NCALLS; i++) {
+		if (writev(fd, iov, 4) != 4) {
+			err(1, "writev");
+		}
+	}
+	stop("writev 4 x 1 byte", NCALLS);
+
+	start();
+	for (i=0; i<NCALLS; i++) {
+		if (dup2(fd, 10) != 10) {
+			err(1, "dup2");
+		}
+		if (close(10)) {
+			err(1, "close");
+		}
+	}
+	stop("dup2 + close", NCALLS);
+
+	close(fd);
+
+	start();
+	for (i=0; i<NCALLS; i++) {
+		fd = opennull(O_RDONLY);
+		if (close(fd)) {
+			err(1, "close");
+		}
+	}
+	stop("open + close", NCALLS);
+
+	if (pipe(fds)) {
+		err(1, "pipe");
+	}
+	start();
+	for (i=0; i<NCALLS; i++) {
+		if (write(fds[1], buf, 1) != 1) {
+			err(1, "pipe write");
+		}
+		if (read(fds[0], buf, 1) != 1) {
+			err(1, "pipe read");
+		}
+	}
+	stop("pipe write + read", NCALLS);
+	close(fds[0]);
+	close(fds[1]);
+
+	return 0;
+}